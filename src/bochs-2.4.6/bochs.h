@@ -172,6 +172,8 @@ void print_tree(bx_param_c *node, int level = 0);
 // #define BX_OUTP(addr, val, len)  bx_pc_system.outp(addr, val, len)
 #define BX_INP(addr, len)           bx_devices.inp(addr, len)
 #define BX_OUTP(addr, val, len)     bx_devices.outp(addr, val, len)
+#define BX_INP_BULK(addr, len, host, count)  bx_devices.inp_bulk(addr, len, host, count)
+#define BX_OUTP_BULK(addr, len, host, count) bx_devices.outp_bulk(addr, len, host, count)
 #define BX_TICK1()                  bx_pc_system.tick1()
 #define BX_TICKN(n)                 bx_pc_system.tickn(n)
 #define BX_INTR                     bx_pc_system.INTR
@@ -215,6 +217,38 @@ void print_tree(bx_param_c *node, int level = 0);
 #  endif
 #endif
 
+#if BX_SUPPORT_SMP_THREADS
+// When every CPU runs on its own host thread the devices, the local APICs
+// and the memory slow paths are serialized by a single recursive lock.
+// Taking it is a no-op outside of the CPU threads; the simulation thread
+// only runs while all CPU threads are waiting for the next round.
+extern void bx_smp_lock(void);
+extern void bx_smp_unlock(void);
+// keep the lock until the current instruction completes, for a R-M-W
+// access to a memory mapped device (released by handleAsyncEvent)
+extern void bx_smp_lock_rmw(void);
+extern void bx_smp_unlock_rmw(void);
+// release the lock entirely, for a CPU thread returning from a longjmp
+extern void bx_smp_unlock_all(void);
+// system reset asked for by a CPU thread, done by the simulation thread
+extern void bx_smp_request_reset(unsigned type);
+extern volatile bx_bool bx_smp_reset_pending;
+
+class bx_smp_lock_guard_c {
+public:
+  bx_smp_lock_guard_c(bx_bool lock = 1): locked(lock) { if (locked) bx_smp_lock(); }
+ ~bx_smp_lock_guard_c() { if (locked) bx_smp_unlock(); }
+private:
+  bx_bool locked;
+};
+
+#  define BX_SMP_LOCK_SCOPE() bx_smp_lock_guard_c bx_smp_lock_guard
+#  define BX_SMP_LOCK_SCOPE_IF(cond) bx_smp_lock_guard_c bx_smp_lock_guard(cond)
+#else
+#  define BX_SMP_LOCK_SCOPE()
+#  define BX_SMP_LOCK_SCOPE_IF(cond)
+#endif
+
 //
 // Ways for the the external environment to report back information
 // to the debugger.
@@ -21,6 +21,7 @@
 #include "bochs.h"
 #include "iodev/iodev.h"
 #include "param_names.h"
+#include "profiler.h"
 #include <assert.h>
 
 #ifdef HAVE_LOCALE_H
@@ -200,7 +201,7 @@ void bx_init_options()
   bx_param_c *root_param = SIM->get_param(".");
 
   // general options subtree
-  menu = new bx_list_c(root_param, "general", "", 11);
+  menu = new bx_list_c(root_param, "general", "", 13);
 
  // config interface option, set in bochsrc or command line
   static const char *config_interface_list[] = {
@@ -246,6 +247,19 @@ void bx_init_options()
     "",
     BX_PATHNAME_LEN);
 
+  // periodic saved states, set by command line arg
+  new bx_param_num_c(menu,
+      "checkpoint",
+      "checkpoint interval",
+      "save the Bochs state every n millions of emulated ticks",
+      0, BX_MAX_BIT32U, 0);
+  new bx_param_string_c(menu,
+    "checkpoint_path",
+    "Path to periodic saved states",
+    "Path to periodic saved states",
+    "",
+    BX_PATHNAME_LEN);
+
   // benchmarking mode, set by command line arg
   new bx_param_num_c(menu,
       "benchmark",
@@ -267,7 +281,7 @@ void bx_init_options()
 #endif
 
   // cpu subtree
-  bx_list_c *cpu_param = new bx_list_c(root_param, "cpu", "CPU Options", 8 + BX_SUPPORT_SMP);
+  bx_list_c *cpu_param = new bx_list_c(root_param, "cpu", "CPU Options", 10 + BX_SUPPORT_SMP + BX_CPU_STATISTICS);
 
   // cpu options
   bx_param_num_c *nprocessors = new bx_param_num_c(cpu_param,
@@ -317,6 +331,23 @@ void bx_init_options()
       "Set path to the configurable MSR definition file",
       "", BX_PATHNAME_LEN);
 #endif
+  new bx_param_num_c(cpu_param,
+      "tlb_size", "Number of TLB entries",
+      "Number of TLB entries in every address space, must be a power of 2",
+      64, 65536,
+      BX_TLB_SIZE);
+  new bx_param_num_c(cpu_param,
+      "tlb_asids", "Number of address spaces kept in the TLB",
+      "Number of recently used CR3 values the TLB keeps entries for (1 = flush the TLB on every CR3 reload)",
+      1, BX_TLB_MAX_ASIDS,
+      1);
+#if BX_CPU_STATISTICS
+  new bx_param_filename_c(cpu_param,
+      "stats_file",
+      "Statistics output file",
+      "Emulator statistics are written to this file as JSON at exit",
+      "cpustats.json", BX_PATHNAME_LEN);
+#endif
 
   cpu_param->set_options(menu->SHOW_PARENT);
 
@@ -447,6 +478,24 @@ void bx_init_options()
       BX_DEFAULT_MEM_MEGS);
   host_ramsize->set_ask_format("Enter host memory size (MB): [%d] ");
   host_ramsize->set_options(ramsize->USE_SPIN_CONTROL);
+
+  path = new bx_param_filename_c(ram,
+      "file",
+      "RAM backing file",
+      "Pathname of a file or shared memory object to map as guest RAM",
+      "", BX_PATHNAME_LEN);
+  path->set_format("Name of RAM backing file: %s");
+  path->set_ask_format("Enter RAM backing file (or 'none'): [%s] ");
+
+  static const char *mem_file_mode_names[] = { "private", "shared", NULL };
+  bx_param_enum_c *file_mode = new bx_param_enum_c(ram,
+      "file_mode",
+      "RAM backing file mode",
+      "Map the RAM backing file shared (guest writes go to the file) or private (copy-on-write)",
+      mem_file_mode_names,
+      BX_MEM_FILE_PRIVATE,
+      BX_MEM_FILE_PRIVATE);
+  file_mode->set_ask_format("Enter RAM backing file mode: [%s] ");
   ram->set_options(ram->SERIES_ASK);
 
   path = new bx_param_filename_c(rom,
@@ -1009,7 +1058,7 @@ void bx_init_options()
     14, 15, 11, 9
   };
 
-  #define BXP_PARAMS_PER_ATA_DEVICE 12
+  #define BXP_PARAMS_PER_ATA_DEVICE 16
 
   bx_list_c *ata_menu[BX_MAX_ATA_CHANNEL];
   bx_list_c *ata_res[BX_MAX_ATA_CHANNEL];
@@ -1176,6 +1225,33 @@ void bx_init_options()
         BX_ATA_TRANSLATION_NONE);
       translation->set_ask_format("Enter translation type: [%s]");
 
+      bx_param_num_c *cache = new bx_param_num_c(menu,
+        "cache",
+        "Sector cache size (KB)",
+        "Size of the host-side sector cache in KB (0 disables the cache)",
+        0, BX_MAX_BIT32U,
+        0);
+      cache->set_ask_format("Enter sector cache size in KB: [%d] ");
+      bx_param_num_c *cache_flush = new bx_param_num_c(menu,
+        "cache_flush",
+        "Cache flush interval (msecs)",
+        "Time between write-backs of the sector cache (0 selects write-through)",
+        0, BX_MAX_BIT32U,
+        1000);
+      cache_flush->set_ask_format("Enter cache flush interval in msecs: [%d] ");
+      bx_param_bool_c *async = new bx_param_bool_c(menu,
+        "async",
+        "Asynchronous I/O",
+        "Run the image I/O on a host worker thread",
+        0);
+      async->set_ask_format("Use asynchronous image I/O? [%s] ");
+      bx_param_bool_c *mapped = new bx_param_bool_c(menu,
+        "mmap",
+        "Memory mapped image",
+        "Map a flat image into host memory",
+        0);
+      mapped->set_ask_format("Map the image into host memory? [%s] ");
+
       // the menu and all items on it depend on the present flag
       deplist = new bx_list_c(NULL, 4);
       deplist->add(type);
@@ -1196,11 +1272,15 @@ void bx_init_options()
         heads,
         spt,
         translation,
+        cache,
+        cache_flush,
+        async,
+        mapped,
         NULL
       };
       deplist = new bx_list_c(NULL, "deplist", "", type_deplist);
       type->set_dependent_list(deplist, 0);
-      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0x3d);
+      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0x3fd);
       type->set_dependent_bitmap(BX_ATA_DEVICE_CDROM, 0x02);
 
       type->set_handler(bx_param_handler);
@@ -1595,7 +1675,7 @@ void bx_init_options()
   loglevel->set_dependent_list(deplist);
 
   // misc options subtree
-  bx_list_c *misc = new bx_list_c(root_param, "misc", "Configure Everything Else");
+  bx_list_c *misc = new bx_list_c(root_param, "misc", "Configure Everything Else", 8);
   misc->set_options(misc->SHOW_PARENT);
   bx_param_num_c *gdbstub_opt;
 
@@ -1649,6 +1729,40 @@ void bx_init_options()
     0);
   enabled->set_dependent_list(menu->clone());
 
+  // guest sampling profiler
+  static const char *profiler_format_names[] = { "flat", "folded", "perf", NULL };
+  menu = new bx_list_c(misc, "profiler", "Guest Profiler Options");
+  menu->set_options(menu->SHOW_PARENT | menu->USE_BOX_TITLE);
+  new bx_param_num_c(menu,
+    "interval",
+    "Sampling interval",
+    "Sample the guest instruction pointer every n emulated ticks (0 = disabled)",
+    0, BX_MAX_BIT32U,
+    0);
+  new bx_param_filename_c(menu,
+    "file",
+    "Output file",
+    "The sample histogram is written to this file at exit",
+    "profile.txt", BX_PATHNAME_LEN);
+  new bx_param_enum_c(menu,
+    "format",
+    "Output format",
+    "Flat symbol histogram, flamegraph folded stacks or perf script text",
+    profiler_format_names,
+    BX_PROFILER_FORMAT_FLAT,
+    BX_PROFILER_FORMAT_FLAT);
+  new bx_param_filename_c(menu,
+    "symbols",
+    "Symbol file",
+    "ELF file used to resolve the sampled addresses (e.g. the guest kernel)",
+    "", BX_PATHNAME_LEN);
+  new bx_param_num_c(menu,
+    "stack",
+    "Call stack depth",
+    "Number of callers recorded by walking the guest frame pointer chain",
+    0, BX_PROFILER_MAX_DEPTH,
+    0);
+
   // optional plugin control
   menu = new bx_list_c(misc, "plugin_ctrl", "Optional Plugin Control", 9);
   menu->set_options(menu->SHOW_PARENT | menu->USE_BOX_TITLE);
@@ -2406,6 +2520,14 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         SIM->get_param_bool("status", base)->set(1);
       } else if (!strncmp(params[i], "journal=", 8)) {
         SIM->get_param_string("journal", base)->set(&params[i][8]);
+      } else if (!strncmp(params[i], "cache=", 6)) {
+        SIM->get_param_num("cache", base)->set(strtoul(&params[i][6], NULL, 10));
+      } else if (!strncmp(params[i], "cache_flush=", 12)) {
+        SIM->get_param_num("cache_flush", base)->set(strtoul(&params[i][12], NULL, 10));
+      } else if (!strncmp(params[i], "async=", 6)) {
+        SIM->get_param_bool("async", base)->set(atol(&params[i][6]));
+      } else if (!strncmp(params[i], "mmap=", 5)) {
+        SIM->get_param_bool("mmap", base)->set(atol(&params[i][5]));
       } else {
         PARSE_ERR(("%s: ataX-master/slave directive malformed.", context));
       }
@@ -2566,6 +2688,22 @@ static int parse_line_formatted(const char *context, int num_params, char *param
 #endif
       } else if (!strncmp(params[i], "msrs=", 5)) {
         SIM->get_param_string(BXPN_CONFIGURABLE_MSRS_PATH)->set(&params[i][5]);
+      } else if (!strncmp(params[i], "tlb_size=", 9)) {
+        unsigned tlb_size = atol(&params[i][9]);
+        if (tlb_size < 64 || tlb_size > 65536 || (tlb_size & (tlb_size-1)) != 0) {
+          PARSE_ERR(("%s: cpu directive malformed, tlb_size must be a power of 2 between 64 and 65536.", context));
+        }
+        SIM->get_param_num(BXPN_CPU_TLB_SIZE)->set(tlb_size);
+      } else if (!strncmp(params[i], "tlb_asids=", 10)) {
+        unsigned tlb_asids = atol(&params[i][10]);
+        if (tlb_asids < 1 || tlb_asids > BX_TLB_MAX_ASIDS) {
+          PARSE_ERR(("%s: cpu directive malformed, tlb_asids must be between 1 and %d.", context, BX_TLB_MAX_ASIDS));
+        }
+        SIM->get_param_num(BXPN_CPU_TLB_ASIDS)->set(tlb_asids);
+#if BX_CPU_STATISTICS
+      } else if (!strncmp(params[i], "stats_file=", 11)) {
+        SIM->get_param_string(BXPN_CPU_STATS_FILE)->set(&params[i][11]);
+#endif
       } else {
         PARSE_ERR(("%s: cpu directive malformed.", context));
       }
@@ -2665,6 +2803,12 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         SIM->get_param_num(BXPN_HOST_MEM_SIZE)->set(atol(&params[i][5]));
       } else if (!strncmp(params[i], "guest=", 6)) {
         SIM->get_param_num(BXPN_MEM_SIZE)->set(atol(&params[i][6]));
+      } else if (!strncmp(params[i], "file=", 5)) {
+        SIM->get_param_string(BXPN_MEM_FILE)->set(&params[i][5]);
+      } else if (!strncmp(params[i], "mode=", 5)) {
+        if (!SIM->get_param_enum(BXPN_MEM_FILE_MODE)->set_by_name(&params[i][5])) {
+          PARSE_ERR(("%s: memory directive: unknown mode '%s'.", context, &params[i][5]));
+        }
       } else {
         PARSE_ERR(("%s: memory directive malformed.", context));
       }
@@ -3102,6 +3246,34 @@ static int parse_line_formatted(const char *context, int num_params, char *param
       PARSE_ERR(("%s: print_timestamps directive malformed.", context));
     }
   }
+  else if (!strcmp(params[0], "profiler")) {
+    if (num_params < 2) {
+      PARSE_ERR(("%s: profiler directive: wrong # args.", context));
+    }
+    base = (bx_list_c*) SIM->get_param(BXPN_PROFILER);
+    for (i=1; i<num_params; i++) {
+      if (!strncmp(params[i], "interval=", 9)) {
+        SIM->get_param_num("interval", base)->set(strtoul(&params[i][9], NULL, 10));
+      }
+      else if (!strncmp(params[i], "file=", 5)) {
+        SIM->get_param_string("file", base)->set(&params[i][5]);
+      }
+      else if (!strncmp(params[i], "format=", 7)) {
+        if (!SIM->get_param_enum("format", base)->set_by_name(&params[i][7])) {
+          PARSE_ERR(("%s: profiler directive: unknown format '%s'.", context, &params[i][7]));
+        }
+      }
+      else if (!strncmp(params[i], "symbols=", 8)) {
+        SIM->get_param_string("symbols", base)->set(&params[i][8]);
+      }
+      else if (!strncmp(params[i], "stack=", 6)) {
+        SIM->get_param_num("stack", base)->set(atol(&params[i][6]));
+      }
+      else {
+        PARSE_ERR(("%s: profiler directive malformed.", context));
+      }
+    }
+  }
   else if (!strcmp(params[0], "port_e9_hack")) {
     if (num_params != 2) {
       PARSE_ERR(("%s: port_e9_hack directive: wrong # args.", context));
@@ -3435,6 +3607,16 @@ int bx_write_atadevice_options(FILE *fp, Bit8u channel, Bit8u drive, bx_list_c *
         if (strcmp(SIM->get_param_string("journal", base)->getptr(), "") != 0)
           fprintf(fp, ", journal=\"%s\"", SIM->get_param_string("journal", base)->getptr());
 
+      if (SIM->get_param_num("cache", base)->get() > 0)
+        fprintf(fp, ", cache=%u, cache_flush=%u",
+          (Bit32u)SIM->get_param_num("cache", base)->get(),
+          (Bit32u)SIM->get_param_num("cache_flush", base)->get());
+
+      if (SIM->get_param_bool("async", base)->get())
+        fprintf(fp, ", async=1");
+      if (SIM->get_param_bool("mmap", base)->get())
+        fprintf(fp, ", mmap=1");
+
     } else if (SIM->get_param_enum("type", base)->get() == BX_ATA_DEVICE_CDROM) {
       fprintf(fp, "type=cdrom, path=\"%s\", status=%s",
         SIM->get_param_string("path", base)->getptr(),
@@ -3699,8 +3881,14 @@ int bx_write_configuration(const char *rc, int overwrite)
     fprintf(fp, ", options=\"%s\"\n", strptr);
   else
     fprintf(fp, "\n");
-  fprintf(fp, "memory: host=%d, guest=%d\n", SIM->get_param_num(BXPN_HOST_MEM_SIZE)->get(),
+  fprintf(fp, "memory: host=%d, guest=%d", SIM->get_param_num(BXPN_HOST_MEM_SIZE)->get(),
     SIM->get_param_num(BXPN_MEM_SIZE)->get());
+  strptr = SIM->get_param_string(BXPN_MEM_FILE)->getptr();
+  if (strlen(strptr) > 0 && strcmp(strptr, "none")) {
+    fprintf(fp, ", file=\"%s\", mode=%s", strptr,
+      SIM->get_param_enum(BXPN_MEM_FILE_MODE)->get_selected());
+  }
+  fprintf(fp, "\n");
   strptr = SIM->get_param_string(BXPN_ROM_PATH)->getptr();
   if (strlen(strptr) > 0) {
     fprintf(fp, "romimage: file=\"%s\"", strptr);
@@ -3807,6 +3995,11 @@ int bx_write_configuration(const char *rc, int overwrite)
   strptr = SIM->get_param_string(BXPN_CONFIGURABLE_MSRS_PATH)->getptr();
   if (strlen(strptr) > 0)
     fprintf(fp, ", msrs=\"%s\"", strptr);
+#endif
+  fprintf(fp, ", tlb_size=%u, tlb_asids=%u",
+    SIM->get_param_num(BXPN_CPU_TLB_SIZE)->get(), SIM->get_param_num(BXPN_CPU_TLB_ASIDS)->get());
+#if BX_CPU_STATISTICS
+  fprintf(fp, ", stats_file=\"%s\"", SIM->get_param_string(BXPN_CPU_STATS_FILE)->getptr());
 #endif
   fprintf(fp, "\n");
   fprintf(fp, "cpuid: cpuid_limit_winnt=%d", SIM->get_param_bool(BXPN_CPUID_LIMIT_WINNT)->get());
@@ -3847,6 +4040,18 @@ int bx_write_configuration(const char *rc, int overwrite)
   fprintf(fp, "print_timestamps: enabled=%d\n", bx_dbg.print_timestamps);
   bx_write_debugger_options(fp);
   fprintf(fp, "port_e9_hack: enabled=%d\n", SIM->get_param_bool(BXPN_PORT_E9_HACK)->get());
+  base = (bx_list_c*) SIM->get_param(BXPN_PROFILER);
+  if (SIM->get_param_num("interval", base)->get() > 0) {
+    fprintf(fp, "profiler: interval=%u, file=%s, format=%s, stack=%u",
+      SIM->get_param_num("interval", base)->get(),
+      SIM->get_param_string("file", base)->getptr(),
+      SIM->get_param_enum("format", base)->get_selected(),
+      SIM->get_param_num("stack", base)->get());
+    if (strlen(SIM->get_param_string("symbols", base)->getptr()) > 0) {
+      fprintf(fp, ", symbols=%s", SIM->get_param_string("symbols", base)->getptr());
+    }
+    fprintf(fp, "\n");
+  }
   fprintf(fp, "text_snapshot_check: enabled=%d\n", SIM->get_param_bool(BXPN_TEXT_SNAPSHOT_CHECK)->get());
   fprintf(fp, "private_colormap: enabled=%d\n", SIM->get_param_bool(BXPN_PRIVATE_COLORMAP)->get());
 #if BX_WITH_AMIGAOS
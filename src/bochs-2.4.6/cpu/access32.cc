@@ -706,6 +706,9 @@ accessOK:
           pageWriteStampTable.decWriteStamp(pAddr, 1);
           data = *hostAddr;
           BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+          BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
           BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 1, BX_RW);
           BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 1, CPL, BX_READ, (Bit8u*) &data);
           return data;
@@ -757,6 +760,9 @@ accessOK:
           pageWriteStampTable.decWriteStamp(pAddr, 2);
           ReadHostWordFromLittleEndian(hostAddr, data);
           BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+          BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
           BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 2, BX_RW);
           BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 2, CPL, BX_READ, (Bit8u*) &data);
           return data;
@@ -818,6 +824,9 @@ accessOK:
           pageWriteStampTable.decWriteStamp(pAddr, 4);
           ReadHostDWordFromLittleEndian(hostAddr, data);
           BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+          BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
           BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 4, BX_RW);
           BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 4, CPL, BX_READ, (Bit8u*) &data);
           return data;
@@ -879,6 +888,9 @@ accessOK:
           pageWriteStampTable.decWriteStamp(pAddr, 8);
           ReadHostQWordFromLittleEndian(hostAddr, data);
           BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+          BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
           BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 8, BX_RW);
           BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 8, CPL, BX_READ, (Bit8u*) &data);
           return data;
@@ -917,7 +929,13 @@ BX_CPU_C::write_RMW_virtual_byte(Bit8u val8)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit8u *hostAddr = (Bit8u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_ATOMIC_RMW
+    if (! __sync_bool_compare_and_swap(hostAddr,
+            (Bit8u) BX_CPU_THIS_PTR address_xlation.rmw_value, val8))
+      rmw_retry();
+#else
     *hostAddr = val8;
+#endif
   }
   else {
     // address_xlation.pages must be 1
@@ -931,7 +949,13 @@ BX_CPU_C::write_RMW_virtual_word(Bit16u val16)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit16u *hostAddr = (Bit16u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_ATOMIC_RMW
+    if (! __sync_bool_compare_and_swap(hostAddr,
+            (Bit16u) BX_CPU_THIS_PTR address_xlation.rmw_value, val16))
+      rmw_retry();
+#else
     WriteHostWordToLittleEndian(hostAddr, val16);
+#endif
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 2, BX_WRITE, (Bit8u*) &val16);
   }
@@ -965,7 +989,13 @@ BX_CPU_C::write_RMW_virtual_dword(Bit32u val32)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit32u *hostAddr = (Bit32u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_ATOMIC_RMW
+    if (! __sync_bool_compare_and_swap(hostAddr,
+            (Bit32u) BX_CPU_THIS_PTR address_xlation.rmw_value, val32))
+      rmw_retry();
+#else
     WriteHostDWordToLittleEndian(hostAddr, val32);
+#endif
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 4, BX_WRITE, (Bit8u*) &val32);
   }
@@ -1011,7 +1041,13 @@ BX_CPU_C::write_RMW_virtual_qword(Bit64u val64)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit64u *hostAddr = (Bit64u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_ATOMIC_RMW
+    if (! __sync_bool_compare_and_swap(hostAddr,
+            BX_CPU_THIS_PTR address_xlation.rmw_value, val64))
+      rmw_retry();
+#else
     WriteHostQWordToLittleEndian(hostAddr, val64);
+#endif
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 8, BX_WRITE, (Bit8u*) &val64);
   }
@@ -1051,6 +1087,29 @@ BX_CPU_C::write_RMW_virtual_qword(Bit64u val64)
   }
 }
 
+#if BX_SUPPORT_ATOMIC_RMW
+// Another CPU thread modified the R-M-W operand since it was read. Nothing
+// was written yet, so the instruction is restarted with the new contents.
+void BX_CPU_C::rmw_retry(void)
+{
+  RIP = BX_CPU_THIS_PTR prev_rip;
+  if (BX_CPU_THIS_PTR speculative_rsp)
+    RSP = BX_CPU_THIS_PTR prev_rsp;
+  longjmp(BX_CPU_THIS_PTR jmp_buf_env, 1); // go back to main decode loop
+}
+
+// R-M-W access split across two pages. The other CPU threads write either
+// page through their host pointers without taking any lock, so nothing
+// keeps them out in the middle. Restart the instruction and leave it to
+// the simulation thread, which runs it once all CPU threads are stopped.
+void BX_CPU_C::rmw_exclusive(void)
+{
+  BX_CPU_THIS_PTR rmw_exclusive_pending = 1;
+  BX_CPU_THIS_PTR set_async_event(1);
+  rmw_retry();
+}
+#endif
+
 //
 // Write data to new stack, these methods are required for emulation
 // correctness but not performance critical.
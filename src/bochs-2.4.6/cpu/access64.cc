@@ -593,6 +593,9 @@ BX_CPU_C::read_RMW_virtual_byte_64(unsigned s, Bit64u offset)
       pageWriteStampTable.decWriteStamp(pAddr, 1);
       data = *hostAddr;
       BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+      BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
       BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 1, BX_RW);
       BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 1, CPL, BX_READ, (Bit8u*) &data);
       return data;
@@ -634,6 +637,9 @@ BX_CPU_C::read_RMW_virtual_word_64(unsigned s, Bit64u offset)
       pageWriteStampTable.decWriteStamp(pAddr, 2);
       ReadHostWordFromLittleEndian(hostAddr, data);
       BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+      BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
       BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 2, BX_RW);
       BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 2, CPL, BX_READ, (Bit8u*) &data);
       return data;
@@ -689,6 +695,9 @@ BX_CPU_C::read_RMW_virtual_dword_64(unsigned s, Bit64u offset)
       pageWriteStampTable.decWriteStamp(pAddr, 4);
       ReadHostDWordFromLittleEndian(hostAddr, data);
       BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+      BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
       BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 4, BX_RW);
       BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 4, CPL, BX_READ, (Bit8u*) &data);
       return data;
@@ -744,6 +753,9 @@ BX_CPU_C::read_RMW_virtual_qword_64(unsigned s, Bit64u offset)
       pageWriteStampTable.decWriteStamp(pAddr, 8);
       ReadHostQWordFromLittleEndian(hostAddr, data);
       BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+#if BX_SUPPORT_ATOMIC_RMW
+      BX_CPU_THIS_PTR address_xlation.rmw_value = data;
+#endif
       BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr, pAddr, 8, BX_RW);
       BX_DBG_LIN_MEMORY_ACCESS(BX_CPU_ID, laddr, pAddr, 8, CPL, BX_READ, (Bit8u*) &data);
       return data;
@@ -38,8 +38,14 @@ extern bx_bool simulate_xapic;
 
 ///////////// APIC BUS /////////////
 
+// With BX_SUPPORT_SMP_THREADS the APIC bus and the local APIC registers
+// are accessed under the simulator lock, as the other CPU threads deliver
+// interrupts into this local APIC concurrently.
+
 int apic_bus_deliver_interrupt(Bit8u vector, apic_dest_t dest, Bit8u delivery_mode, bx_bool logical_dest, bx_bool level, bx_bool trig_mode)
 {
+  BX_SMP_LOCK_SCOPE();
+
   if(delivery_mode == APIC_DM_LOWPRI)
   {
      if(! logical_dest) {
@@ -90,6 +96,8 @@ int apic_bus_deliver_interrupt(Bit8u vector, apic_dest_t dest, Bit8u delivery_mo
 
 int apic_bus_deliver_lowest_priority(Bit8u vector, apic_dest_t dest, bx_bool trig_mode, bx_bool broadcast)
 {
+  BX_SMP_LOCK_SCOPE();
+
   int i;
 
   if (! BX_CPU_APIC(0)->is_xapic()) {
@@ -129,6 +137,8 @@ int apic_bus_deliver_lowest_priority(Bit8u vector, apic_dest_t dest, bx_bool tri
 
 int apic_bus_broadcast_interrupt(Bit8u vector, Bit8u delivery_mode, bx_bool trig_mode, int exclude_cpu)
 {
+  BX_SMP_LOCK_SCOPE();
+
   if(delivery_mode == APIC_DM_LOWPRI)
   {
     return apic_bus_deliver_lowest_priority(vector, 0 /* doesn't matter */, trig_mode, 1);
@@ -153,11 +163,15 @@ static void apic_bus_broadcast_eoi(Bit8u vector)
 // available even if APIC is not compiled in
 void apic_bus_deliver_smi(void)
 {
+  BX_SMP_LOCK_SCOPE();
+
   BX_CPU(0)->deliver_SMI();
 }
 
 void apic_bus_broadcast_smi(void)
 {
+  BX_SMP_LOCK_SCOPE();
+
   for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
     BX_CPU(i)->deliver_SMI();
 }
@@ -265,6 +279,8 @@ bx_bool bx_local_apic_c::is_selected(bx_phy_address addr)
 
 void bx_local_apic_c::read(bx_phy_address addr, void *data, unsigned len)
 {
+  BX_SMP_LOCK_SCOPE();
+
   if((addr & ~0x3) != ((addr+len-1) & ~0x3)) {
     BX_PANIC(("APIC read at address 0x" FMT_PHY_ADDRX " spans 32-bit boundary !", addr));
     return;
@@ -286,6 +302,8 @@ void bx_local_apic_c::read(bx_phy_address addr, void *data, unsigned len)
 
 void bx_local_apic_c::write(bx_phy_address addr, void *data, unsigned len)
 {
+  BX_SMP_LOCK_SCOPE();
+
   if (len != 4) {
     BX_PANIC(("APIC write with len=%d (should be 4)", len));
     return;
@@ -692,7 +710,7 @@ void bx_local_apic_c::service_local_apic(void)
   // return it.
   BX_DEBUG(("service_local_apic(): setting INTR=1 for vector 0x%02x", first_irr));
   INTR = 1;
-  cpu->async_event = 1;
+  cpu->set_async_event(1);
 }
 
 bx_bool bx_local_apic_c::deliver(Bit8u vector, Bit8u delivery_mode, Bit8u trig_mode)
@@ -769,6 +787,8 @@ void bx_local_apic_c::untrigger_irq(Bit8u vector, unsigned trigger_mode)
 
 Bit8u bx_local_apic_c::acknowledge_int(void)
 {
+  BX_SMP_LOCK_SCOPE();
+
   // CPU calls this when it is ready to service one interrupt
   if(!INTR)
     BX_PANIC(("APIC %d acknowledged an interrupt, but INTR=0", apic_id));
@@ -786,13 +806,13 @@ Bit8u bx_local_apic_c::acknowledge_int(void)
     print_status();
   }
   INTR = 0;
-  cpu->async_event = 1;
+  cpu->set_async_event(1);
   service_local_apic();  // will set INTR again if another is ready
   return vector;
 
 spurious:
   INTR = 0;
-  cpu->async_event = 1;
+  cpu->set_async_event(1);
   return spurious_vector;
 }
 
@@ -857,6 +877,8 @@ Bit8u bx_local_apic_c::get_ppr(void)
 
 void bx_local_apic_c::set_tpr(Bit8u priority)
 {
+  BX_SMP_LOCK_SCOPE();
+
   if(priority < task_priority) {
     task_priority = priority;
     service_local_apic();
@@ -980,6 +1002,8 @@ void bx_local_apic_c::set_initial_timer_count(Bit32u value)
 // return false when x2apic is not supported/not readable
 bx_bool bx_local_apic_c::read_x2apic(unsigned index, Bit64u *val_64)
 {
+  BX_SMP_LOCK_SCOPE();
+
   index = (index - 0x800) << 4;
 
   switch(index) {
@@ -1053,6 +1077,8 @@ bx_bool bx_local_apic_c::read_x2apic(unsigned index, Bit64u *val_64)
 // return false when x2apic is not supported/not writeable
 bx_bool bx_local_apic_c::write_x2apic(unsigned index, Bit64u val_64)
 {
+  BX_SMP_LOCK_SCOPE();
+
   Bit32u val32_lo = GET32L(val_64);
 
   index = (index - 0x800) << 4;
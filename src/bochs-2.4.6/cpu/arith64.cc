@@ -559,6 +559,39 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMPXCHG16B(bxInstruction_c *i)
   op1_64_lo = read_RMW_virtual_qword_64(i->seg(), eaddr);
   op1_64_hi = read_RMW_virtual_qword_64(i->seg(), (eaddr + 8) & i->asize_mask());
 
+#if BX_SUPPORT_ATOMIC_RMW
+  if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
+    // The aligned operand is in one host page, but compare and swap of
+    // either half alone would let another CPU thread modify the other one
+    // in between. Swap all 16 bytes at once.
+    Bit64u *hostAddr = (Bit64u *) (BX_CPU_THIS_PTR address_xlation.pages - 8);
+#if defined(__x86_64__)
+    Bit8u equal;
+    op1_64_lo = RAX;
+    op1_64_hi = RDX;
+    __asm__ __volatile__ ("lock; cmpxchg16b %1; setz %0"
+        : "=q" (equal), "+m" (*hostAddr), "+a" (op1_64_lo), "+d" (op1_64_hi)
+        : "b" (RBX), "c" (RCX)
+        : "memory", "cc");
+    if (equal) {
+      BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
+          BX_CPU_THIS_PTR address_xlation.paddress1, 8, BX_WRITE, (Bit8u*) &RCX);
+      assert_ZF();
+    }
+    else {
+      clear_ZF();
+      RAX = op1_64_lo;
+      RDX = op1_64_hi;
+    }
+    return;
+#else
+    // no 16 byte compare and swap on this host
+    if (bx_smp_self != NULL)
+      rmw_exclusive();
+#endif
+  }
+#endif
+
   diff  = RAX - op1_64_lo;
   diff |= RDX - op1_64_hi;
 
@@ -34,25 +34,38 @@
 
 #define InstrumentICACHE 0
 
-#if InstrumentICACHE
-static unsigned iCacheLookups=0;
-static unsigned iCacheMisses=0;
-
+#if InstrumentICACHE || BX_INSTRUMENTATION
 #define InstrICache_StatsMask 0xffffff
 
 #define InstrICache_Stats() {\
-  if ((iCacheLookups & InstrICache_StatsMask) == 0) { \
-    BX_INFO(("ICACHE lookups: %u, misses: %u, hit rate = %6.2f%% ", \
-          iCacheLookups, \
-          iCacheMisses,  \
-          (iCacheLookups-iCacheMisses) * 100.0 / iCacheLookups)); \
-    iCacheLookups = iCacheMisses = 0; \
-  } \
+  if ((BX_CPU_THIS_PTR iCache.lookups() & InstrICache_StatsMask) == 0) \
+    reportICacheStats(); \
 }
-#define InstrICache_Increment(v) (v)++
 #else
 #define InstrICache_Stats()
-#define InstrICache_Increment(v)
+#endif
+
+#if BX_CPU_STATISTICS
+// the opcode being executed is kept in the CPU, a fused instruction pair
+// switches it to its second instruction (see fusion.cc); the timers fired
+// inside the instruction are not counted (see BX_INSN_TICKN)
+#if BX_HOST_CYCLES
+#define InstrOpcode_Start(i) { \
+  BX_CPU_THIS_PTR stats.opcode = (i)->getIaOpcode(); \
+  BX_CPU_THIS_PTR stats.opcodeStart = bx_host_cycles(); \
+}
+#define InstrOpcode_Done() { \
+  unsigned ia_opcode = BX_CPU_THIS_PTR stats.opcode; \
+  BX_CPU_THIS_PTR stats.opcodeCycles[ia_opcode] += bx_host_cycles() - BX_CPU_THIS_PTR stats.opcodeStart; \
+  BX_CPU_THIS_PTR stats.opcodeCount[ia_opcode]++; \
+}
+#else
+#define InstrOpcode_Start(i) (BX_CPU_THIS_PTR stats.opcode = (i)->getIaOpcode())
+#define InstrOpcode_Done() (BX_CPU_THIS_PTR stats.opcodeCount[BX_CPU_THIS_PTR stats.opcode]++)
+#endif
+#else
+#define InstrOpcode_Start(i)
+#define InstrOpcode_Done()
 #endif
 
 // The CHECK_MAX_INSTRUCTIONS macro allows cpu_loop to execute a few
@@ -62,7 +75,14 @@ static unsigned iCacheMisses=0;
 //
 // If maximum instructions have been executed, return. The zero-count
 // means run forever.
-#if BX_SUPPORT_SMP || BX_DEBUGGER
+#if BX_SUPPORT_TRACE_FUSION && BX_SUPPORT_SMP
+  // the count is shared with the fused instruction pairs (see fusion.cc)
+  #define CHECK_MAX_INSTRUCTIONS(count)           \
+    if (BX_CPU_THIS_PTR instr_count_left > 0) {   \
+      BX_CPU_THIS_PTR instr_count_left--;         \
+      if (BX_CPU_THIS_PTR instr_count_left == 0) return; \
+    }
+#elif BX_SUPPORT_SMP || BX_DEBUGGER
   #define CHECK_MAX_INSTRUCTIONS(count) \
     if ((count) > 0) {                  \
       (count)--;                        \
@@ -80,8 +100,16 @@ void BX_CPU_C::cpu_loop(Bit32u max_instr_count)
   BX_CPU_THIS_PTR stop_reason = STOP_NO_REASON;
 #endif
 
+#if BX_SUPPORT_TRACE_FUSION && BX_SUPPORT_SMP
+  BX_CPU_THIS_PTR instr_count_left = max_instr_count;
+#endif
+
   if (setjmp(BX_CPU_THIS_PTR jmp_buf_env)) {
     // only from exception function we can get here ...
+#if BX_SUPPORT_SMP_THREADS
+    // the exception might have been raised with the simulator lock held
+    bx_smp_unlock_all();
+#endif
     BX_INSTR_NEW_INSTRUCTION(BX_CPU_ID);
     BX_TICK1_IF_SINGLE_PROCESSOR();
 #if BX_DEBUGGER || BX_GDBSTUB
@@ -108,18 +136,31 @@ void BX_CPU_C::cpu_loop(Bit32u max_instr_count)
   BX_CPU_THIS_PTR speculative_rsp = 0;
   BX_CPU_THIS_PTR EXT = 0;
 
+#if BX_SUPPORT_TRACE_CACHE
+  // trace which was stopped by a taken branch, the next trace is
+  // looked up through its successor links
+  bxICacheEntry_c *prevEntry = NULL;
+#endif
+
   while (1) {
 
     // check on events which occurred for previous instructions (traps)
     // and ones which are asynchronous to the CPU (hardware interrupts)
     if (BX_CPU_THIS_PTR async_event) {
+#if BX_SUPPORT_TRACE_CACHE
+      prevEntry = NULL;
+#endif
       if (handleAsyncEvent()) {
         // If request to return to caller ASAP.
         return;
       }
     }
 
+#if BX_SUPPORT_TRACE_CACHE
+    bxICacheEntry_c *entry = prevEntry ? getLinkedICacheEntry(prevEntry) : getICacheEntry();
+#else
     bxICacheEntry_c *entry = getICacheEntry();
+#endif
 
     bxInstruction_c *i = entry->i;
 
@@ -140,7 +181,9 @@ void BX_CPU_C::cpu_loop(Bit32u max_instr_count)
       // want to allow changing of the instruction inside instrumentation callback
       BX_INSTR_BEFORE_EXECUTION(BX_CPU_ID, i);
       RIP += i->ilen();
+      InstrOpcode_Start(i);
       BX_CPU_CALL_METHOD(i->execute, (i)); // might iterate repeat instruction
+      InstrOpcode_Done();
       BX_CPU_THIS_PTR prev_rip = RIP; // commit new RIP
       BX_INSTR_AFTER_EXECUTION(BX_CPU_ID, i);
       BX_TICK1_IF_SINGLE_PROCESSOR();
@@ -158,12 +201,13 @@ void BX_CPU_C::cpu_loop(Bit32u max_instr_count)
 #if BX_SUPPORT_TRACE_CACHE
       if (BX_CPU_THIS_PTR async_event) {
         // clear stop trace magic indication that probably was set by repeat or branch32/64
-        BX_CPU_THIS_PTR async_event &= ~BX_ASYNC_EVENT_STOP_TRACE;
+        BX_CPU_THIS_PTR clear_async_event(BX_ASYNC_EVENT_STOP_TRACE);
+        prevEntry = entry;
         break;
       }
 
       if (++i == last) {
-        entry = getICacheEntry();
+        entry = getLinkedICacheEntry(entry);
         i = entry->i;
         last = i + (entry->tlen);
       }
@@ -182,22 +226,67 @@ bxICacheEntry_c* BX_CPU_C::getICacheEntry(void)
   }
 
   bx_phy_address pAddr = BX_CPU_THIS_PTR pAddrPage + eipBiased;
-  bxICacheEntry_c *entry = BX_CPU_THIS_PTR iCache.get_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
+  bxICacheEntry_c *entry = BX_CPU_THIS_PTR iCache.lookup(pAddr, BX_CPU_THIS_PTR fetchModeMask);
 
-  InstrICache_Increment(iCacheLookups);
-  InstrICache_Stats();
-
-  if (entry->pAddr != pAddr)
+  if (entry == NULL)
   {
     // iCache miss. No validated instruction with matching fetch parameters
     // is in the iCache.
-    InstrICache_Increment(iCacheMisses);
+    entry = BX_CPU_THIS_PTR iCache.get_victim_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
     serveICacheMiss(entry, (Bit32u) eipBiased, pAddr);
   }
 
+  InstrICache_Stats();
+
   return entry;
 }
 
+#if BX_SUPPORT_TRACE_CACHE
+
+// Same as getICacheEntry() for the trace which directly follows prev:
+// the successor links of prev are tried before the iCache set lookup.
+bxICacheEntry_c* BX_CPU_C::getLinkedICacheEntry(bxICacheEntry_c *prev)
+{
+  bx_address eipBiased = RIP + BX_CPU_THIS_PTR eipPageBias;
+
+  if (eipBiased >= BX_CPU_THIS_PTR eipPageWindowSize) {
+    prefetch();
+    eipBiased = RIP + BX_CPU_THIS_PTR eipPageBias;
+  }
+
+  bx_phy_address pAddr = BX_CPU_THIS_PTR pAddrPage + eipBiased;
+  bxICacheEntry_c *entry = BX_CPU_THIS_PTR iCache.lookup_linked(prev, pAddr, BX_CPU_THIS_PTR fetchModeMask);
+
+  if (entry == NULL)
+  {
+    entry = BX_CPU_THIS_PTR iCache.get_victim_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
+    serveICacheMiss(entry, (Bit32u) eipBiased, pAddr);
+    BX_CPU_THIS_PTR iCache.link_trace(prev, entry);
+  }
+
+  InstrICache_Stats();
+
+  return entry;
+}
+
+#endif
+
+void BX_CPU_C::reportICacheStats(void)
+{
+  const bxICacheStats_t *stats = &BX_CPU_THIS_PTR iCache.stats;
+
+  BX_INSTR_ICACHE_STATS(BX_CPU_ID, stats->hits, stats->conflictMisses, stats->coldFills);
+
+#if InstrumentICACHE
+  Bit64u lookups = BX_CPU_THIS_PTR iCache.lookups();
+  if (lookups == 0) return;
+
+  BX_INFO(("ICACHE lookups: " FMT_LL "u, conflict misses: " FMT_LL "u, cold fills: " FMT_LL "u, hit rate = %6.2f%% ",
+          lookups, stats->conflictMisses, stats->coldFills,
+          stats->hits * 100.0 / lookups));
+#endif
+}
+
 void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat(bxInstruction_c *i, BxExecutePtr_tR execute)
 {
   // non repeated instruction
@@ -225,7 +314,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat(bxInstruction_c *i, BxExecutePtr_tR
 #endif
         break; // exit always if debugger enabled
 
-      BX_TICK1_IF_SINGLE_PROCESSOR();
+      BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
     }
   }
   else
@@ -244,7 +333,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat(bxInstruction_c *i, BxExecutePtr_tR
 #endif
         break; // exit always if debugger enabled
 
-      BX_TICK1_IF_SINGLE_PROCESSOR();
+      BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
     }
   }
   else  // 16bit addrsize
@@ -262,7 +351,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat(bxInstruction_c *i, BxExecutePtr_tR
 #endif
         break; // exit always if debugger enabled
 
-      BX_TICK1_IF_SINGLE_PROCESSOR();
+      BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
     }
   }
 
@@ -274,7 +363,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat(bxInstruction_c *i, BxExecutePtr_tR
 
 #if BX_SUPPORT_TRACE_CACHE
   // assert magic async_event to stop trace execution
-  BX_CPU_THIS_PTR async_event |= BX_ASYNC_EVENT_STOP_TRACE;
+  BX_CPU_THIS_PTR set_async_event(BX_ASYNC_EVENT_STOP_TRACE);
 #endif
 }
 
@@ -308,7 +397,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat_ZF(bxInstruction_c *i, BxExecutePtr
 #endif
           break; // exit always if debugger enabled
 
-        BX_TICK1_IF_SINGLE_PROCESSOR();
+        BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
       }
     }
     else
@@ -327,7 +416,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat_ZF(bxInstruction_c *i, BxExecutePtr
 #endif
           break; // exit always if debugger enabled
 
-        BX_TICK1_IF_SINGLE_PROCESSOR();
+        BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
       }
     }
     else  // 16bit addrsize
@@ -345,7 +434,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat_ZF(bxInstruction_c *i, BxExecutePtr
 #endif
           break; // exit always if debugger enabled
 
-        BX_TICK1_IF_SINGLE_PROCESSOR();
+        BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
       }
     }
   }
@@ -365,7 +454,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat_ZF(bxInstruction_c *i, BxExecutePtr
 #endif
           break; // exit always if debugger enabled
 
-        BX_TICK1_IF_SINGLE_PROCESSOR();
+        BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
       }
     }
     else
@@ -384,7 +473,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat_ZF(bxInstruction_c *i, BxExecutePtr
 #endif
           break; // exit always if debugger enabled
 
-        BX_TICK1_IF_SINGLE_PROCESSOR();
+        BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
       }
     }
     else  // 16bit addrsize
@@ -402,7 +491,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat_ZF(bxInstruction_c *i, BxExecutePtr
 #endif
           break; // exit always if debugger enabled
 
-        BX_TICK1_IF_SINGLE_PROCESSOR();
+        BX_INSN_TICK1_IF_SINGLE_PROCESSOR();
       }
     }
   }
@@ -415,7 +504,7 @@ void BX_CPP_AttrRegparmN(2) BX_CPU_C::repeat_ZF(bxInstruction_c *i, BxExecutePtr
 
 #if BX_SUPPORT_TRACE_CACHE
   // assert magic async_event to stop trace execution
-  BX_CPU_THIS_PTR async_event |= BX_ASYNC_EVENT_STOP_TRACE;
+  BX_CPU_THIS_PTR set_async_event(BX_ASYNC_EVENT_STOP_TRACE);
 #endif
 }
 
@@ -424,6 +513,39 @@ unsigned BX_CPU_C::handleAsyncEvent(void)
   //
   // This area is where we process special conditions and events.
   //
+  BX_CPU_STATS_INCREMENT(asyncEvents);
+
+#if BX_SUPPORT_SMP_THREADS
+  // the previous instruction is done, release the lock held for its R-M-W
+  // access to a device
+  bx_smp_unlock_rmw();
+
+  // the events are asserted by the other CPU threads under the simulator
+  // lock, hold it until async_event is cleared below
+  BX_SMP_LOCK_SCOPE();
+
+  if (BX_CPU_THIS_PTR remote_requests)
+    handle_remote_requests();
+#endif
+
+#if BX_SUPPORT_ATOMIC_RMW
+  if (BX_CPU_THIS_PTR rmw_exclusive_pending) {
+    // end the round, the simulation thread executes the instruction
+    return 1;
+  }
+#endif
+
+  if (bx_pc_system.state_ops_pending) {
+#if BX_SUPPORT_SMP_THREADS
+    // with CPU threads the simulation thread serves them once all CPUs
+    // have stopped
+    if (BX_SMP_PROCESSORS == 1)
+#endif
+      bx_pc_system.handle_state_ops();
+    // the CPU state might have been replaced, restart the CPU loop
+    return 1; // Return to caller of cpu_loop.
+  }
+
   if (BX_CPU_THIS_PTR activity_state) {
     // For one processor, pass the time as quickly as possible until
     // an interrupt wakes up the CPU.
@@ -472,6 +594,9 @@ unsigned BX_CPU_C::handleAsyncEvent(void)
         return 1; // Return to caller of cpu_loop.
 #endif
 
+      if (bx_pc_system.state_ops_pending)
+        return 1; // served on the next call, see above
+
       BX_TICKN(10); // when in HLT run time faster for single CPU
     }
   } else if (bx_pc_system.kill_bochs_request) {
@@ -479,6 +604,13 @@ unsigned BX_CPU_C::handleAsyncEvent(void)
     return 1; // Return to caller of cpu_loop.
   }
 
+#if BX_SUPPORT_SMP_THREADS
+  if (bx_smp_reset_pending) {
+    // the simulation thread resets the machine once all CPUs have stopped
+    return 1; // Return to caller of cpu_loop.
+  }
+#endif
+
   // VMLAUNCH/VMRESUME cannot be executed with interrupts inhibited.
   // Save inhibit interrupts state into shadow bits after clearing
   BX_CPU_THIS_PTR inhibit_mask = (BX_CPU_THIS_PTR inhibit_mask << 2) & 0xF;
@@ -554,6 +686,7 @@ unsigned BX_CPU_C::handleAsyncEvent(void)
 #if BX_SUPPORT_VMX
     VMexit_Event(0, BX_NMI, 2, 0, 0);
 #endif
+    BX_CPU_STATS_INCREMENT(nmis);
     BX_INSTR_HWINTERRUPT(BX_CPU_ID, 2, BX_CPU_THIS_PTR sregs[BX_SEG_REG_CS].selector.value, RIP);
     interrupt(2, BX_NMI, 0, 0);
   }
@@ -587,6 +720,7 @@ unsigned BX_CPU_C::handleAsyncEvent(void)
 #if BX_SUPPORT_VMX
     VMexit_Event(0, BX_EXTERNAL_INTERRUPT, vector, 0, 0);
 #endif
+    BX_CPU_STATS_INCREMENT(interrupts);
     BX_INSTR_HWINTERRUPT(BX_CPU_ID, vector,
         BX_CPU_THIS_PTR sregs[BX_SEG_REG_CS].selector.value, RIP);
     interrupt(vector, BX_EXTERNAL_INTERRUPT, 0, 0);
@@ -767,6 +901,15 @@ void BX_CPU_C::prefetch(void)
 
 void BX_CPU_C::deliver_SIPI(unsigned vector)
 {
+#if BX_SUPPORT_SMP_THREADS
+  if (BX_SMP_REMOTE_CPU(BX_CPU_THIS)) {
+    // the CPU state is loaded by the target CPU thread itself
+    BX_CPU_THIS_PTR remote_sipi_vector = vector;
+    post_remote_request(BX_REMOTE_SIPI);
+    return;
+  }
+#endif
+
   if (BX_CPU_THIS_PTR activity_state == BX_ACTIVITY_STATE_WAIT_FOR_SIPI) {
     BX_CPU_THIS_PTR activity_state = BX_ACTIVITY_STATE_ACTIVE;
     RIP = 0;
@@ -783,28 +926,85 @@ void BX_CPU_C::deliver_INIT(void)
 {
   if (! BX_CPU_THIS_PTR disable_INIT) {
     BX_CPU_THIS_PTR pending_INIT = 1;
-    BX_CPU_THIS_PTR async_event = 1;
+    BX_CPU_THIS_PTR set_async_event(1);
   }
 }
 
 void BX_CPU_C::deliver_NMI(void)
 {
   BX_CPU_THIS_PTR pending_NMI = 1;
-  BX_CPU_THIS_PTR async_event = 1;
+  BX_CPU_THIS_PTR set_async_event(1);
 }
 
 void BX_CPU_C::deliver_SMI(void)
 {
   BX_CPU_THIS_PTR pending_SMI = 1;
-  BX_CPU_THIS_PTR async_event = 1;
+  BX_CPU_THIS_PTR set_async_event(1);
 }
 
 void BX_CPU_C::set_INTR(bx_bool value)
 {
   BX_CPU_THIS_PTR INTR = value;
-  BX_CPU_THIS_PTR async_event = 1;
+  BX_CPU_THIS_PTR set_async_event(1);
+}
+
+#if BX_SUPPORT_SMP_THREADS
+
+void BX_CPU_C::post_remote_request(Bit32u request)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  BX_CPU_THIS_PTR remote_requests |= request;
+  BX_CPU_THIS_PTR set_async_event(1);
+}
+
+void BX_CPU_C::post_remote_smc(bx_phy_address pAddr, Bit32u mask)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  if (BX_CPU_THIS_PTR remote_smc_count < BX_REMOTE_SMC_QUEUE_SIZE) {
+    BX_CPU_THIS_PTR remote_smc_addr[BX_CPU_THIS_PTR remote_smc_count] = pAddr;
+    BX_CPU_THIS_PTR remote_smc_mask[BX_CPU_THIS_PTR remote_smc_count] = mask;
+    BX_CPU_THIS_PTR remote_smc_count++;
+    BX_CPU_THIS_PTR remote_requests |= BX_REMOTE_ICACHE_SMC;
+  }
+  else {
+    // too many modified lines, drop the whole iCache
+    BX_CPU_THIS_PTR remote_requests |= BX_REMOTE_ICACHE_FLUSH;
+  }
+
+  BX_CPU_THIS_PTR set_async_event(1);
 }
 
+// called with the simulator lock held
+void BX_CPU_C::handle_remote_requests(void)
+{
+  Bit32u requests = BX_CPU_THIS_PTR remote_requests;
+  BX_CPU_THIS_PTR remote_requests = 0;
+
+  if (requests & BX_REMOTE_ICACHE_FLUSH) {
+    BX_CPU_THIS_PTR iCache.flushICacheEntries();
+  }
+  else if (requests & BX_REMOTE_ICACHE_SMC) {
+    for (unsigned n=0; n < BX_CPU_THIS_PTR remote_smc_count; n++)
+      BX_CPU_THIS_PTR iCache.handleSMC(BX_CPU_THIS_PTR remote_smc_addr[n],
+                                       BX_CPU_THIS_PTR remote_smc_mask[n]);
+  }
+  BX_CPU_THIS_PTR remote_smc_count = 0;
+
+  if (requests & BX_REMOTE_TLB_FLUSH)
+    TLB_flush();
+  if (requests & BX_REMOTE_PAGE_TABLE_WRITE)
+    TLB_pageTableWrite();
+
+  if (requests & BX_REMOTE_SIPI) {
+    deliver_SIPI(BX_CPU_THIS_PTR remote_sipi_vector);
+    BX_CPU_THIS_PTR prev_rip = RIP; // commit new RIP
+  }
+}
+
+#endif
+
 #if BX_DEBUGGER || BX_GDBSTUB
 bx_bool BX_CPU_C::dbg_instruction_epilog(void)
 {
@@ -436,6 +436,23 @@ BOCHSAPI extern BX_CPU_C **bx_cpu_array;
 BOCHSAPI extern BX_CPU_C   bx_cpu;
 #endif
 
+#if BX_SUPPORT_SMP_THREADS
+// the CPU served by the current host thread, NULL for the simulation thread
+extern __thread BX_CPU_C *bx_smp_self;
+
+// Changes to the TLB, the iCache or the registers of a CPU running on
+// another host thread are posted to it and done by that CPU itself.
+#define BX_SMP_REMOTE_CPU(cpu) (bx_smp_self != NULL && bx_smp_self != (cpu))
+#endif
+
+// R-M-W accesses through native host pointers are done with compare and
+// swap, so they stay atomic against the other CPU threads.
+#if BX_SUPPORT_SMP_THREADS && defined(BX_LITTLE_ENDIAN)
+  #define BX_SUPPORT_ATOMIC_RMW 1
+#else
+  #define BX_SUPPORT_ATOMIC_RMW 0
+#endif
+
 // accessors for all eflags in bx_flags_reg_t
 // The macro is used once for each flag bit
 // Do not use for arithmetic flags !
@@ -647,17 +664,19 @@ struct cpuid_function_t {
 #include "instr.h"
 #include "lazy_flags.h"
 
-// BX_TLB_SIZE: Number of entries in TLB
+// BX_TLB_SIZE: Default number of entries in TLB (see config.h), the
+//   actual size is configured by the 'cpu: tlb_size' option.
+// BX_TLB_WAYS: The TLB is BX_TLB_WAYS set associative. Memory access
+//   fast paths only look into the first way, a hit in the second way
+//   is found by translate_linear() which swaps the two entries. When
+//   the first way is refilled its old entry is moved to the second way.
 // BX_TLB_INDEX_OF(lpf): This macro is passed the linear page frame
 //   (top 20 bits of the linear address.  It must map these bits to
-//   one of the TLB cache slots, given the size of BX_TLB_SIZE.
-//   There will be a many-to-one mapping to each TLB cache slot.
-//   When there are collisions, the old entry is overwritten with
-//   one for the newest access.
+//   one of the TLB sets, given the configured size of the TLB.
+//   There will be a many-to-one mapping to each TLB set.
 
-#define BX_TLB_SIZE 1024
-#define BX_TLB_MASK ((BX_TLB_SIZE-1) << 12)
-#define BX_TLB_INDEX_OF(lpf, len) ((((unsigned)(lpf) + (len)) & BX_TLB_MASK) >> 12)
+#define BX_TLB_WAYS 2
+#define BX_TLB_INDEX_OF(lpf, len) ((((unsigned)(lpf) + (len)) & BX_CPU_THIS_PTR TLB.mask) >> 12)
 
 typedef bx_ptr_equiv_t bx_hostpageaddr_t;
 
@@ -669,6 +688,24 @@ typedef struct {
   Bit32u lpf_mask;      // linear address mask of the page size
 } bx_TLB_entry;
 
+#if BX_CPU_LEVEL >= 6
+
+// BX_PSC_SIZE: Number of entries in every level of the paging-structure
+//   cache. The cache keeps non-leaf PAE and long mode paging entries
+//   (PDE, PDPTE and PML4E) indexed by the linear address bits they map,
+//   so that a page walk after TLB miss can skip the upper levels.
+
+#define BX_PSC_SIZE 32
+
+typedef struct {
+  bx_address tag;         // linear address bits mapped by the entry
+  bx_phy_address ppf;     // next level paging structure
+  Bit32u combined_access; // U/S and R/W combined over the walked levels
+  bx_bool nx;             // execute disable set at one of walked levels
+} bx_PSC_entry;
+
+#endif
+
 #if BX_SUPPORT_X86_64
   #define LPF_MASK BX_CONST64(0xfffffffffffff000)
 #else
@@ -691,6 +728,49 @@ typedef struct {
 
 #include "icache.h"
 
+#if BX_CPU_STATISTICS
+// the host time stamp counter measures the instruction handlers
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define BX_HOST_CYCLES 1
+BX_CPP_INLINE Bit64u bx_host_cycles(void)
+{
+  Bit32u lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((Bit64u) hi << 32) | lo;
+}
+#else
+#define BX_HOST_CYCLES 0
+#endif
+
+extern void bx_write_statistics(const char *path);
+#endif
+
+// Ticks taken inside an instruction, by the iterations of a repeated
+// string instruction or between a fused pair. The device callbacks of the
+// timers they fire run in the middle of the instruction, so with the
+// statistics their host cycles are taken out of the opcode cycles.
+#if BX_CPU_STATISTICS && BX_HOST_CYCLES
+#define BX_INSN_TICKN(n) {                                                 \
+  if ((Bit32u)(n) >= bx_pc_system_c::getNumCpuTicksLeftNextEvent()) {      \
+    Bit64u ticks_start = bx_host_cycles();                                 \
+    BX_TICKN(n);                                                           \
+    BX_CPU_THIS_PTR stats.opcodeStart += bx_host_cycles() - ticks_start;   \
+  }                                                                        \
+  else BX_TICKN(n);                                                        \
+}
+#define BX_INSN_TICK1() BX_INSN_TICKN(1)
+#else
+#define BX_INSN_TICKN(n) BX_TICKN(n)
+#define BX_INSN_TICK1()  BX_TICK1()
+#endif
+
+#if BX_SUPPORT_SMP
+#define BX_INSN_TICK1_IF_SINGLE_PROCESSOR() \
+              if (BX_SMP_PROCESSORS == 1) BX_INSN_TICK1()
+#else
+#define BX_INSN_TICK1_IF_SINGLE_PROCESSOR() BX_INSN_TICK1()
+#endif
+
 // general purpose register
 #if BX_SUPPORT_X86_64
 
@@ -865,6 +945,12 @@ public: // for now...
   bx_address prev_rsp;
   bx_bool    speculative_rsp;
 
+#if BX_SUPPORT_TRACE_FUSION && BX_SUPPORT_SMP
+  // instructions left to execute by cpu_loop (0 is unlimited), kept here
+  // because fused instruction pairs retire their first instruction too
+  Bit32u instr_count_left;
+#endif
+
 #define BX_INHIBIT_INTERRUPTS        0x01
 #define BX_INHIBIT_DEBUG             0x02
 #define BX_INHIBIT_INTERRUPTS_SHADOW 0x04
@@ -980,6 +1066,29 @@ public: // for now...
   #define BX_ASYNC_EVENT_STOP_TRACE (0x80000000)
 #endif
 
+#if BX_SUPPORT_SMP_THREADS
+  // Requests posted by the other CPU threads, served by this CPU in
+  // handleAsyncEvent() under the simulator lock.
+  #define BX_REMOTE_TLB_FLUSH         (1 << 0)
+  #define BX_REMOTE_PAGE_TABLE_WRITE  (1 << 1)
+  #define BX_REMOTE_ICACHE_FLUSH      (1 << 2)
+  #define BX_REMOTE_ICACHE_SMC        (1 << 3)
+  #define BX_REMOTE_SIPI              (1 << 4)
+
+  #define BX_REMOTE_SMC_QUEUE_SIZE 16
+
+  volatile Bit32u remote_requests;
+  unsigned remote_sipi_vector;
+  unsigned remote_smc_count;
+  bx_phy_address remote_smc_addr[BX_REMOTE_SMC_QUEUE_SIZE];
+  Bit32u remote_smc_mask[BX_REMOTE_SMC_QUEUE_SIZE];
+#endif
+#if BX_SUPPORT_ATOMIC_RMW
+  // R-M-W access across two pages, done by the simulation thread while
+  // all CPU threads are stopped (see rmw_exclusive)
+  bx_bool rmw_exclusive_pending;
+#endif
+
 #if BX_X86_DEBUGGER
   bx_bool  in_repeat;
 #endif
@@ -1029,10 +1138,29 @@ public: // for now...
 
   // for paging
   struct {
-    bx_TLB_entry entry[BX_TLB_SIZE] BX_CPP_AlignN(16);
+    bx_TLB_entry *entry;  // first way of the active address space
+    bx_TLB_entry *way1;   // second way of the active address space
+    Bit32u mask;
+    unsigned sets;
 #if BX_CPU_LEVEL >= 5
     bx_bool split_large;
 #endif
+    // CR3 tagged address spaces, entries[] holds BX_TLB_WAYS*sets entries
+    // for each of them
+    bx_TLB_entry *entries;
+    unsigned n_asids;
+    unsigned asid;        // the active address space
+    Bit32u lru_clock;
+    bx_bool walker_write; // A/D bits update by the page walker
+    struct {
+      bx_phy_address cr3;
+      Bit32u lru_stamp;
+      bx_bool valid;
+      bx_bool dirty;      // page tables were modified while active
+#if BX_CPU_LEVEL >= 5
+      bx_bool split_large;
+#endif
+    } space[BX_TLB_MAX_ASIDS];
   } TLB;
 
 #if BX_CPU_LEVEL >= 6
@@ -1040,6 +1168,42 @@ public: // for now...
     bx_bool valid;
     Bit64u entry[4];
   } PDPTR_CACHE;
+
+  // paging-structure cache, entry[level-1] caches the entries of level
+  struct {
+    bx_PSC_entry entry[3][BX_PSC_SIZE];
+    Bit64u lookups;
+    Bit64u hits[3];
+  } PSC;
+#endif
+
+#if BX_CPU_STATISTICS
+  // emulator statistics (configure --enable-cpu-statistics), exported
+  // as the "statistics.cpuN" parameter subtree by register_stats()
+  struct {
+    Bit64u opcodeCount[BX_IA_LAST];   // completed instructions per ia_opcode
+#if BX_HOST_CYCLES
+    Bit64u opcodeCycles[BX_IA_LAST];  // host TSC cycles spent in the handler
+    Bit64u opcodeStart;               // host TSC when the current one started
+#endif
+    unsigned opcode;                  // the instruction being executed
+    Bit64u tlbSlowPathLookups;        // translate_linear() calls, the inline
+                                      // TLB check of the access fast path missed
+    Bit64u tlbMisses;                 // not served by the TLB (no entry or no permission)
+    Bit64u tlbGlobalFlushes;
+    Bit64u tlbNonGlobalFlushes;
+    Bit64u tlbAddressSpaceSwitches;
+    Bit64u tlbAddressSpaceMisses;
+    Bit64u pageWalks[3];              // legacy, PAE and long mode page walks
+    Bit64u asyncEvents;               // handleAsyncEvent() calls
+    Bit64u nmis;
+    Bit64u interrupts;                // external (PIC/APIC) interrupts
+    Bit64u exceptions[BX_CPU_HANDLED_EXCEPTIONS];
+  } stats;
+
+#define BX_CPU_STATS_INCREMENT(field) (BX_CPU_THIS_PTR stats.field++)
+#else
+#define BX_CPU_STATS_INCREMENT(field)
 #endif
 
   // An instruction cache.  Each entry should be exactly 32 bytes, and
@@ -1062,6 +1226,10 @@ public: // for now...
                               // is greated than 2 (the maximum possible for
                               // normal cases) it is a native pointer and is used
                               // for a direct write access.
+#if BX_SUPPORT_ATOMIC_RMW
+    Bit64u rmw_value;         // Value read through the native host pointer,
+                              // the write back is a compare and swap with it.
+#endif
   } address_xlation;
 
   BX_SMF void setEFlags(Bit32u val) BX_CPP_AttrRegparmN(1);
@@ -1117,6 +1285,9 @@ public: // for now...
   void register_state(void);
 #if BX_WITH_WX
   void register_wx_state(void);
+#endif
+#if BX_CPU_STATISTICS
+  void register_stats(void);
 #endif
   static Bit64s param_save_handler(void *devptr, bx_param_c *param);
   static void param_restore_handler(void *devptr, bx_param_c *param, Bit64s val);
@@ -2814,6 +2985,21 @@ public: // for now...
   BX_SMF bx_address BxResolve64Base(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF bx_address BxResolve64BaseIndex(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
 #endif
+
+#if BX_SUPPORT_TRACE_FUSION
+  // fused instruction pairs
+  BX_SMF void CMP_GdEdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_EdIdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_EAXId_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void TEST_EdGdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void TEST_EdIdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void TEST_EAXId_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void DEC_ERX_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void INC_ERX_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void PUSH_ERX_ERX(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void POP_ERX_ERX(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void MOV32_GdEdM_ALU(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+#endif
 // <TAG-CLASS-CPU-END>
 
 #if BX_DEBUGGER
@@ -2843,6 +3029,17 @@ public: // for now...
   // now for some ancillary functions...
   BX_SMF void cpu_loop(Bit32u max_instr_count);
   BX_SMF unsigned handleAsyncEvent(void);
+#if BX_SUPPORT_SMP_THREADS
+  BX_SMF void post_remote_request(Bit32u request);
+  BX_SMF void post_remote_smc(bx_phy_address pAddr, Bit32u mask);
+  BX_SMF void handle_remote_requests(void);
+#endif
+#if BX_SUPPORT_ATOMIC_RMW
+  BX_SMF void rmw_retry(void) BX_CPP_AttrNoReturn();
+  BX_SMF void rmw_exclusive(void) BX_CPP_AttrNoReturn();
+#endif
+  BX_SMF BX_CPP_INLINE void set_async_event(Bit32u bits);
+  BX_SMF BX_CPP_INLINE void clear_async_event(Bit32u bits);
 
   BX_SMF int fetchDecode32(const Bit8u *fetchPtr, bxInstruction_c *i, unsigned remainingInPage) BX_CPP_AttrRegparmN(3);
 #if BX_SUPPORT_X86_64
@@ -2851,8 +3048,20 @@ public: // for now...
   BX_SMF void boundaryFetch(const Bit8u *fetchPtr, unsigned remainingInPage, bxInstruction_c *);
   BX_SMF void serveICacheMiss(bxICacheEntry_c *entry, Bit32u eipBiased, bx_phy_address pAddr);
   BX_SMF bxICacheEntry_c* getICacheEntry(void);
+#if BX_SUPPORT_TRACE_CACHE
+  BX_SMF bxICacheEntry_c* getLinkedICacheEntry(bxICacheEntry_c *prev);
+#endif
+  BX_SMF void reportICacheStats(void);
 #if BX_SUPPORT_TRACE_CACHE
   BX_SMF bx_bool mergeTraces(bxICacheEntry_c *entry, bxInstruction_c *i, bx_phy_address pAddr);
+#if BX_SUPPORT_TRACE_FUSION
+  BX_SMF void fuseTrace(bxICacheEntry_c *entry);
+  BX_SMF bx_bool jcc_taken(unsigned cond) BX_CPP_AttrRegparmN(1);
+  BX_SMF void branch_fused32(Bit32u new_EIP) BX_CPP_AttrRegparmN(1);
+#if BX_CPU_STATISTICS
+  BX_SMF void fusedStatistics(bxInstruction_c *i);
+#endif
+#endif
 #else
   BX_SMF bx_bool fetchInstruction(bxInstruction_c *iStorage, Bit32u eipBiased);
 #endif
@@ -3108,6 +3317,7 @@ public: // for now...
 
   BX_SMF void access_read_physical(bx_phy_address paddr, unsigned len, void *data);
   BX_SMF void access_write_physical(bx_phy_address paddr, unsigned len, void *data);
+  BX_SMF void update_paging_entry(bx_phy_address paddr, unsigned len, void *entry, Bit32u bits);
 
   BX_SMF bx_hostpageaddr_t getHostMemAddr(bx_phy_address addr, unsigned rw);
 
@@ -3133,6 +3343,17 @@ public: // for now...
 #endif
   BX_SMF void TLB_flush(void);
   BX_SMF void TLB_invlpg(bx_address laddr);
+  BX_SMF void TLB_init(void);
+  BX_SMF void TLB_flushAddressSpace(unsigned asid);
+  BX_SMF void TLB_activateAddressSpace(unsigned asid);
+  BX_SMF bx_bool TLB_switchAddressSpace(void);
+  BX_SMF void TLB_pageTableWrite(void);
+#if BX_CPU_LEVEL >= 6
+  BX_SMF void PSC_flush(void);
+  BX_SMF int  PSC_lookup(bx_address laddr, int max_level, bx_phy_address &ppf, Bit32u &combined_access, bx_bool &nx);
+  BX_SMF void PSC_update(bx_address laddr, int level, bx_phy_address ppf, Bit32u combined_access, bx_bool nx);
+  BX_SMF void reportPSCStats(void);
+#endif
   BX_SMF void set_INTR(bx_bool value);
   BX_SMF const char *strseg(bx_segment_reg_t *seg);
   BX_SMF void interrupt(Bit8u vector, unsigned type, bx_bool push_error,
@@ -3484,6 +3705,26 @@ public: // for now...
 #endif
 };
 
+// With one host thread per CPU the other threads assert async_event too,
+// a plain read-modify-write of this CPU could drop their events.
+BX_CPP_INLINE void BX_CPU_C::set_async_event(Bit32u bits)
+{
+#if BX_SUPPORT_SMP_THREADS
+  __sync_fetch_and_or(&BX_CPU_THIS_PTR async_event, bits);
+#else
+  BX_CPU_THIS_PTR async_event |= bits;
+#endif
+}
+
+BX_CPP_INLINE void BX_CPU_C::clear_async_event(Bit32u bits)
+{
+#if BX_SUPPORT_SMP_THREADS
+  __sync_fetch_and_and(&BX_CPU_THIS_PTR async_event, ~bits);
+#else
+  BX_CPU_THIS_PTR async_event &= ~bits;
+#endif
+}
+
 #if BX_CPU_LEVEL >= 5
 BX_CPP_INLINE void BX_CPU_C::prepareMMX(void)
 {
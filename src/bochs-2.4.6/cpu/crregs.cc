@@ -1150,6 +1150,10 @@ bx_bool BX_CPP_AttrRegparmN(1) BX_CPU_C::SetCR3(bx_address val)
 
   BX_CPU_THIS_PTR cr3 = val;
 
+  // keep the TLB entries of recently used address spaces if configured
+  if (TLB_switchAddressSpace())
+    return 1;
+
   // flush TLB even if value does not change
 #if BX_CPU_LEVEL >= 6
   if (BX_CPU_THIS_PTR cr4.get_PGE())
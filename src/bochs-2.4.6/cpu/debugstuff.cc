@@ -389,4 +389,8 @@ void BX_CPU_C::dbg_get_idtr(bx_dbg_global_sreg_t *sreg)
 void BX_CPU_C::atexit(void)
 {
   debug(BX_CPU_THIS_PTR prev_rip);
+  reportICacheStats();
+#if BX_CPU_LEVEL >= 6
+  reportPSCStats();
+#endif
 }
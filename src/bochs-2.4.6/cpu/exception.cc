@@ -832,6 +832,10 @@ struct BxExceptionInfo exceptions_info[BX_CPU_HANDLED_EXCEPTIONS+1] = {
 void BX_CPU_C::exception(unsigned vector, Bit16u error_code)
 {
   BX_INSTR_EXCEPTION(BX_CPU_ID, vector, error_code);
+#if BX_CPU_STATISTICS
+  if (vector < BX_CPU_HANDLED_EXCEPTIONS)
+    BX_CPU_THIS_PTR stats.exceptions[vector]++;
+#endif
 
 #if BX_DEBUGGER
   bx_dbg_exception(BX_CPU_ID, vector, error_code);
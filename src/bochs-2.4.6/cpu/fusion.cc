@@ -0,0 +1,409 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// fusion.cc
+//
+// Fused instruction pairs (superinstructions) of the trace cache.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#define NEED_CPU_REG_SHORTCUTS 1
+#include "bochs.h"
+#include "cpu.h"
+#define LOG_THIS BX_CPU_THIS_PTR
+
+// Make code more tidy with a few macros.
+#if BX_SUPPORT_X86_64==0
+#define RIP EIP
+#endif
+
+#if BX_SUPPORT_TRACE_FUSION
+
+//
+// Superinstructions: pairs of frequent instructions which are executed
+// by a single handler out of one trace entry.
+//
+// The fused entry keeps the fields of the first instruction, its ilen()
+// covers both instructions and ilen2() is the length of the second one.
+// Between the two instructions the handler checks for pending events
+// (traps, interrupts, breakpoints, self modifying code). When there is
+// one, RIP is rewound to the second instruction and control goes back
+// to cpu_loop exactly as if the pair was not fused. Otherwise the first
+// instruction is committed, so a fault in the second instruction
+// restarts that instruction only.
+//
+// The first instruction retires at the boundary: it ticks the system
+// timer before the check for pending events, like cpu_loop does after
+// every instruction, so an interrupt raised by that tick is taken before
+// the second instruction. Unless the pair is split it then counts against
+// the instruction count of cpu_loop (the pair is split when the count runs
+// out in between) and is accounted in the opcode statistics, so both
+// instructions are counted like unfused ones.
+//
+
+#if BX_SUPPORT_SMP
+  #define BX_FUSED_COUNT_EXHAUSTED() (BX_CPU_THIS_PTR instr_count_left == 1)
+  #define BX_FUSED_COUNT_RETIRE() {                      \
+    if (BX_CPU_THIS_PTR instr_count_left > 0)            \
+      BX_CPU_THIS_PTR instr_count_left--;                \
+  }
+#else
+  #define BX_FUSED_COUNT_EXHAUSTED() 0
+  #define BX_FUSED_COUNT_RETIRE()
+#endif
+
+#if BX_CPU_STATISTICS
+// the entry of a fused load carries the opcode of the ALU instruction
+static BX_CPP_INLINE unsigned fusedFirstOpcode(const bxInstruction_c *i)
+{
+  if (i->execute == &BX_CPU_C::MOV32_GdEdM_ALU) return BX_IA_MOV32_GdEd;
+  return i->getIaOpcode();
+}
+
+  #define BX_FUSED_STATISTICS(i) fusedStatistics(i)
+  // the second instruction executes unfused, cpu_loop counts the first
+  #define BX_FUSED_STATISTICS_SPLIT(i) \
+    (BX_CPU_THIS_PTR stats.opcode = fusedFirstOpcode(i))
+#else
+  #define BX_FUSED_STATISTICS(i)
+  #define BX_FUSED_STATISTICS_SPLIT(i)
+#endif
+
+#define BX_FUSED_BOUNDARY(i) {                           \
+  BX_INSN_TICK1_IF_SINGLE_PROCESSOR();                   \
+  if (BX_CPU_THIS_PTR async_event || BX_FUSED_COUNT_EXHAUSTED()) { \
+    RIP -= (i)->ilen2();                                 \
+    BX_FUSED_STATISTICS_SPLIT(i);                        \
+    return;                                              \
+  }                                                      \
+  BX_FUSED_COUNT_RETIRE();                               \
+  BX_FUSED_STATISTICS(i);                                \
+  BX_CPU_THIS_PTR prev_rip = RIP - (i)->ilen2();         \
+}
+
+  BX_CPP_INLINE bx_bool BX_CPP_AttrRegparmN(1)
+BX_CPU_C::jcc_taken(unsigned cond)
+{
+  switch(cond) {
+    case 0x0: return get_OF();
+    case 0x1: return ! get_OF();
+    case 0x2: return get_CF();
+    case 0x3: return ! get_CF();
+    case 0x4: return get_ZF();
+    case 0x5: return ! get_ZF();
+    case 0x6: return get_CF() || get_ZF();
+    case 0x7: return ! get_CF() && ! get_ZF();
+    case 0x8: return get_SF();
+    case 0x9: return ! get_SF();
+    case 0xA: return get_PF();
+    case 0xB: return ! get_PF();
+    case 0xC: return getB_SF() != getB_OF();
+    case 0xD: return getB_SF() == getB_OF();
+    case 0xE: return get_ZF() || (getB_SF() != getB_OF());
+    default:
+    case 0xF: return ! get_ZF() && (getB_SF() == getB_OF());
+  }
+}
+
+// same as branch_near32() which is local to ctrl_xfer32.cc
+  BX_CPP_INLINE void BX_CPP_AttrRegparmN(1)
+BX_CPU_C::branch_fused32(Bit32u new_EIP)
+{
+  if (new_EIP > BX_CPU_THIS_PTR sregs[BX_SEG_REG_CS].cache.u.segment.limit_scaled)
+  {
+    BX_ERROR(("branch_near32: offset outside of CS limits"));
+    exception(BX_GP_EXCEPTION, 0);
+  }
+
+  EIP = new_EIP;
+
+  // assert magic async_event to stop trace execution
+  BX_CPU_THIS_PTR set_async_event(BX_ASYNC_EVENT_STOP_TRACE);
+}
+
+#define BX_FUSED_JCC(i) {                                \
+  if (jcc_taken((i)->jccCond()))                         \
+    branch_fused32(EIP + (i)->displ32s());               \
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_GdEdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->nnn());
+  Bit32u op2_32 = BX_READ_32BIT_REG(i->rm());
+  Bit32u diff_32 = op1_32 - op2_32;
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_EdIdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->rm());
+  Bit32u op2_32 = i->Id();
+  Bit32u diff_32 = op1_32 - op2_32;
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_EAXId_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = EAX;
+  Bit32u op2_32 = i->Id();
+  Bit32u diff_32 = op1_32 - op2_32;
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::TEST_EdGdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->rm()) & BX_READ_32BIT_REG(i->nnn());
+  SET_FLAGS_OSZAPC_LOGIC_32(op1_32);
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::TEST_EdIdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->rm()) & i->Id();
+  SET_FLAGS_OSZAPC_LOGIC_32(op1_32);
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::TEST_EAXId_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = EAX & i->Id();
+  SET_FLAGS_OSZAPC_LOGIC_32(op1_32);
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::DEC_ERX_Jcc(bxInstruction_c *i)
+{
+  Bit32u erx = --BX_READ_32BIT_REG(i->rm());
+  SET_FLAGS_OSZAPC_DEC_32(erx);
+  BX_CLEAR_64BIT_HIGH(i->rm());
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::INC_ERX_Jcc(bxInstruction_c *i)
+{
+  Bit32u erx = ++BX_READ_32BIT_REG(i->rm());
+  SET_FLAGS_OSZAPC_INC_32(erx);
+  BX_CLEAR_64BIT_HIGH(i->rm());
+
+  BX_FUSED_BOUNDARY(i);
+  BX_FUSED_JCC(i);
+}
+
+// the second register is kept in nnn()
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUSH_ERX_ERX(bxInstruction_c *i)
+{
+  push_32(BX_READ_32BIT_REG(i->rm()));
+  BX_FUSED_BOUNDARY(i);
+  push_32(BX_READ_32BIT_REG(i->nnn()));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::POP_ERX_ERX(bxInstruction_c *i)
+{
+  BX_WRITE_32BIT_REGZ(i->rm(), pop_32());
+  BX_FUSED_BOUNDARY(i);
+  BX_WRITE_32BIT_REGZ(i->nnn(), pop_32());
+}
+
+// The load keeps its effective address fields, its destination register
+// moves to loadDst(). nnn(), rm() and Id() belong to the register form
+// ALU instruction which is called through execute2.
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::MOV32_GdEdM_ALU(bxInstruction_c *i)
+{
+  Bit32u eaddr = (Bit32u) BX_CPU_CALL_METHODR(i->ResolveModrm, (i));
+
+  Bit32u val32 = read_virtual_dword_32(i->seg(), eaddr);
+  BX_WRITE_32BIT_REGZ(i->loadDst(), val32);
+
+  BX_FUSED_BOUNDARY(i);
+  BX_CPU_CALL_METHOD(i->execute2, (i));
+}
+
+#if BX_CPU_STATISTICS
+
+static const Bit16u fusedJccOpcode[16] = {
+  BX_IA_JO_Jd,  BX_IA_JNO_Jd,  BX_IA_JB_Jd,  BX_IA_JNB_Jd,
+  BX_IA_JZ_Jd,  BX_IA_JNZ_Jd,  BX_IA_JBE_Jd, BX_IA_JNBE_Jd,
+  BX_IA_JS_Jd,  BX_IA_JNS_Jd,  BX_IA_JP_Jd,  BX_IA_JNP_Jd,
+  BX_IA_JL_Jd,  BX_IA_JNL_Jd,  BX_IA_JLE_Jd, BX_IA_JNLE_Jd
+};
+
+// The first instruction of the pair retired, account it and switch the
+// statistics of cpu_loop to the second one. A fault in the second
+// instruction leaves it uncounted, as for any other faulting instruction.
+void BX_CPU_C::fusedStatistics(bxInstruction_c *i)
+{
+  unsigned first = fusedFirstOpcode(i), second;
+
+  if (i->execute == &BX_CPU_C::PUSH_ERX_ERX || i->execute == &BX_CPU_C::POP_ERX_ERX) {
+    second = i->Id();
+  }
+  else if (i->execute == &BX_CPU_C::MOV32_GdEdM_ALU) {
+    second = i->getIaOpcode();
+  }
+  else {
+    second = fusedJccOpcode[i->jccCond()];
+  }
+
+  BX_CPU_THIS_PTR stats.opcodeCount[first]++;
+#if BX_HOST_CYCLES
+  Bit64u now = bx_host_cycles();
+  BX_CPU_THIS_PTR stats.opcodeCycles[first] += now - BX_CPU_THIS_PTR stats.opcodeStart;
+  BX_CPU_THIS_PTR stats.opcodeStart = now;
+#endif
+  BX_CPU_THIS_PTR stats.opcode = second;
+}
+
+#endif
+
+//
+// Trace build time peephole pass
+//
+
+// Returns condition code (0..15) of near conditional jump with 32-bit
+// displacement or -1 for any other instruction.
+static int fusedJccCond(const bxInstruction_c *i)
+{
+  switch(i->getIaOpcode()) {
+    case BX_IA_JO_Jd:   return 0x0;
+    case BX_IA_JNO_Jd:  return 0x1;
+    case BX_IA_JB_Jd:   return 0x2;
+    case BX_IA_JNB_Jd:  return 0x3;
+    case BX_IA_JZ_Jd:   return 0x4;
+    case BX_IA_JNZ_Jd:  return 0x5;
+    case BX_IA_JBE_Jd:  return 0x6;
+    case BX_IA_JNBE_Jd: return 0x7;
+    case BX_IA_JS_Jd:   return 0x8;
+    case BX_IA_JNS_Jd:  return 0x9;
+    case BX_IA_JP_Jd:   return 0xA;
+    case BX_IA_JNP_Jd:  return 0xB;
+    case BX_IA_JL_Jd:   return 0xC;
+    case BX_IA_JNL_Jd:  return 0xD;
+    case BX_IA_JLE_Jd:  return 0xE;
+    case BX_IA_JNLE_Jd: return 0xF;
+    default:
+      return -1;
+  }
+}
+
+// Fused handler for register form flag producer followed by Jcc
+static BxExecutePtr_tR fusedJccHandler(const bxInstruction_c *i)
+{
+  if (i->execute == &BX_CPU_C::CMP_GdEdR)  return &BX_CPU_C::CMP_GdEdR_Jcc;
+  if (i->execute == &BX_CPU_C::CMP_EdIdR)  return &BX_CPU_C::CMP_EdIdR_Jcc;
+  if (i->execute == &BX_CPU_C::CMP_EAXId)  return &BX_CPU_C::CMP_EAXId_Jcc;
+  if (i->execute == &BX_CPU_C::TEST_EdGdR) return &BX_CPU_C::TEST_EdGdR_Jcc;
+  if (i->execute == &BX_CPU_C::TEST_EdIdR) return &BX_CPU_C::TEST_EdIdR_Jcc;
+  if (i->execute == &BX_CPU_C::TEST_EAXId) return &BX_CPU_C::TEST_EAXId_Jcc;
+  if (i->execute == &BX_CPU_C::DEC_ERX)    return &BX_CPU_C::DEC_ERX_Jcc;
+  if (i->execute == &BX_CPU_C::INC_ERX)    return &BX_CPU_C::INC_ERX_Jcc;
+  return NULL;
+}
+
+// Register form ALU instructions which could follow a fused load. None
+// of them uses b1(), which holds the destination of the load.
+static bx_bool fusedLoadALU(const bxInstruction_c *i)
+{
+  return i->execute == &BX_CPU_C::ADD_GdEdR  || i->execute == &BX_CPU_C::ADD_EdIdR  ||
+         i->execute == &BX_CPU_C::OR_GdEdR   || i->execute == &BX_CPU_C::OR_EdIdR   ||
+         i->execute == &BX_CPU_C::ADC_GdEdR  || i->execute == &BX_CPU_C::ADC_EdIdR  ||
+         i->execute == &BX_CPU_C::SBB_GdEdR  || i->execute == &BX_CPU_C::SBB_EdIdR  ||
+         i->execute == &BX_CPU_C::AND_GdEdR  || i->execute == &BX_CPU_C::AND_EdIdR  ||
+         i->execute == &BX_CPU_C::SUB_GdEdR  || i->execute == &BX_CPU_C::SUB_EdIdR  ||
+         i->execute == &BX_CPU_C::XOR_GdEdR  || i->execute == &BX_CPU_C::XOR_EdIdR  ||
+         i->execute == &BX_CPU_C::CMP_GdEdR  || i->execute == &BX_CPU_C::CMP_EdIdR  ||
+         i->execute == &BX_CPU_C::TEST_EdGdR || i->execute == &BX_CPU_C::TEST_EdIdR;
+}
+
+// Try to fuse instruction i with the instruction following it, the fused
+// instruction replaces i.
+static bx_bool fuseInstructions(bxInstruction_c *i, const bxInstruction_c *next)
+{
+  BxExecutePtr_tR handler = fusedJccHandler(i);
+  if (handler) {
+    int cond = fusedJccCond(next);
+    if (cond < 0) return 0;
+
+    i->execute = handler;
+    i->setJccCond(cond);
+    i->modRMForm.displ32u = next->Id();
+  }
+  else if (i->execute == &BX_CPU_C::PUSH_ERX && next->execute == &BX_CPU_C::PUSH_ERX) {
+    i->execute = &BX_CPU_C::PUSH_ERX_ERX;
+    i->setNnn(next->rm());
+    // the opcode of the second instruction for the statistics
+    i->modRMForm.Id = next->getIaOpcode();
+  }
+  else if (i->execute == &BX_CPU_C::POP_ERX && next->execute == &BX_CPU_C::POP_ERX) {
+    i->execute = &BX_CPU_C::POP_ERX_ERX;
+    i->setNnn(next->rm());
+    i->modRMForm.Id = next->getIaOpcode();
+  }
+  else if (i->execute == &BX_CPU_C::MOV32_GdEdM && fusedLoadALU(next)) {
+    i->execute  = &BX_CPU_C::MOV32_GdEdM_ALU;
+    i->execute2 = next->execute;
+    i->setLoadDst(i->nnn());
+    i->setNnn(next->nnn());
+    i->setRm(next->rm());
+    i->modRMForm.Id = next->Id();
+    // the load is always MOV32_GdEd, the entry carries the opcode of
+    // the ALU instruction for the statistics
+    i->setIaOpcode(next->getIaOpcode());
+  }
+  else {
+    return 0;
+  }
+
+  i->setILen2(next->ilen());
+  i->setILen(i->ilen() + next->ilen());
+  return 1;
+}
+
+void BX_CPU_C::fuseTrace(bxICacheEntry_c *entry)
+{
+#if BX_GDBSTUB
+  // remote debugger should be able to stop at any instruction
+  if (bx_dbg.gdbstub_enabled) return;
+#endif
+
+#if BX_SUPPORT_X86_64
+  if (BX_CPU_THIS_PTR cpu_mode == BX_MODE_LONG_64) return;
+#endif
+
+  bxInstruction_c *last = entry->i + entry->tlen, *dst = entry->i;
+
+  // Instructions merged from another trace might be fused already, their
+  // handlers never match any of the patterns above so they are just
+  // moved into place.
+  for (bxInstruction_c *i = entry->i; i < last; i++, dst++) {
+    bxInstruction_c *first = i;
+    if (i+1 < last) {
+      // prefer to fuse a compare with the following Jcc
+      bx_bool skip = (i->execute == &BX_CPU_C::MOV32_GdEdM) && (i+2 < last) &&
+         fusedJccHandler(i+1) && fusedJccCond(i+2) >= 0;
+      if (! skip && fuseInstructions(i, i+1)) i++;
+    }
+    if (dst != first) *dst = *first;
+  }
+
+  entry->tlen = (Bit32u)(dst - entry->i);
+}
+
+#endif // BX_SUPPORT_TRACE_FUSION
@@ -0,0 +1,114 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// host_simd.h
+//
+// Packed MMX/SSE instructions executed with the host SSE2 unit.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_HOST_SIMD_H
+#define BX_HOST_SIMD_H
+
+//
+// Packed MMX/SSE instructions executed with the host SSE2 unit
+// (configure --enable-host-simd, x86 hosts only).
+//
+// The guest registers are laid out in memory exactly like the host ones,
+// so each instruction becomes a load of both operands, the matching SSE2
+// intrinsic and a store. MMX operands live in the low half of a host XMM
+// register, the host MMX/x87 state is never touched.
+//
+
+#if BX_SupportHostSIMD
+
+#include <emmintrin.h>
+
+// result = func(op1, op2) on the 128 bits of XMM registers
+#define BX_HOST_SIMD_XMM(result, op1, op2, func)                 \
+  _mm_storeu_si128((__m128i*) &(result),                          \
+    func(_mm_loadu_si128((const __m128i*) &(op1)),                \
+         _mm_loadu_si128((const __m128i*) &(op2))))
+
+// result = func(op1, op2) on the 64 bits of MMX registers
+#define BX_HOST_SIMD_MMX(result, op1, op2, func)                 \
+  _mm_storel_epi64((__m128i*) &(result),                          \
+    func(_mm_loadl_epi64((const __m128i*) &(op1)),                \
+         _mm_loadl_epi64((const __m128i*) &(op2))))
+
+//
+// Floating point instructions can only use the host SSE unit when it
+// produces the same results and exception flags as the softfloat code:
+// all exceptions masked (nothing to deliver), no DAZ and no FTZ (softfloat
+// flushes tiny results in a different way than the hardware). The guest
+// rounding mode is loaded into the host MXCSR just for the operation, the
+// exception flags raised by the host are merged into the guest MXCSR.
+//
+
+#define BX_HOST_SIMD_FP_MODE(mxcsr)                                     \
+  (((mxcsr) & (MXCSR_MASKED_EXCEPTIONS | MXCSR_DAZ |                    \
+     MXCSR_FLUSH_MASKED_UNDERFLOW)) == MXCSR_MASKED_EXCEPTIONS)
+
+// keeps the compiler from moving the operation across the MXCSR switch
+#if defined(__GNUC__)
+#define BX_HOST_SIMD_BARRIER(x) __asm__ __volatile__ ("" : "+x" (x))
+#else
+#define BX_HOST_SIMD_BARRIER(x)
+#endif
+
+BX_CPP_INLINE __m128  bx_host_load_ps(const BxPackedXmmRegister *op)
+  { return _mm_castsi128_ps(_mm_loadu_si128((const __m128i*) op)); }
+BX_CPP_INLINE __m128d bx_host_load_pd(const BxPackedXmmRegister *op)
+  { return _mm_castsi128_pd(_mm_loadu_si128((const __m128i*) op)); }
+BX_CPP_INLINE void bx_host_store_ps(BxPackedXmmRegister *op, __m128 val)
+  { _mm_storeu_si128((__m128i*) op, _mm_castps_si128(val)); }
+BX_CPP_INLINE void bx_host_store_pd(BxPackedXmmRegister *op, __m128d val)
+  { _mm_storeu_si128((__m128i*) op, _mm_castpd_si128(val)); }
+
+BX_CPP_INLINE __m128  bx_host_load_ss(const float32 *op)
+  { return _mm_castsi128_ps(_mm_cvtsi32_si128(*op)); }
+BX_CPP_INLINE __m128d bx_host_load_sd(const float64 *op)
+  { return _mm_castsi128_pd(_mm_loadl_epi64((const __m128i*) op)); }
+BX_CPP_INLINE void bx_host_store_ss(float32 *op, __m128 val)
+  { *op = _mm_cvtsi128_si32(_mm_castps_si128(val)); }
+BX_CPP_INLINE void bx_host_store_sd(float64 *op, __m128d val)
+  { _mm_storel_epi64((__m128i*) op, _mm_castpd_si128(val)); }
+
+// the square root instructions only have a source operand
+BX_CPP_INLINE __m128  bx_host_sqrt_ps(__m128 dst, __m128 src)   { return _mm_sqrt_ps(src); }
+BX_CPP_INLINE __m128d bx_host_sqrt_pd(__m128d dst, __m128d src) { return _mm_sqrt_pd(src); }
+
+// op1 = func(op1, op2) with the guest MXCSR register, type is ps/pd/ss/sd
+//
+// The host MXCSR is only written when its mode differs from the guest one
+// or it holds exception flags the guest MXCSR does not have yet (merging
+// flags the guest already has changes nothing), and it is only restored
+// when the mode was changed: the host code never looks at the sticky
+// flags. An LDMXCSR can cost far more than the operation itself, guest
+// code usually runs with #P already set and so needs none.
+#define BX_HOST_SIMD_FP(type, mxcsr, op1, op2, func) {                  \
+  unsigned host_mxcsr = _mm_getcsr();                                   \
+  unsigned guest_mode = (mxcsr) & (MXCSR_MASKED_EXCEPTIONS | MXCSR_ROUNDING_CONTROL); \
+  BX_HOST_SIMD_FP_TYPE_##type a = bx_host_load_##type(&(op1));          \
+  BX_HOST_SIMD_FP_TYPE_##type b = bx_host_load_##type(&(op2));          \
+  if ((host_mxcsr & ~((mxcsr) & MXCSR_EXCEPTIONS)) != guest_mode)        \
+    _mm_setcsr(guest_mode);                                             \
+  BX_HOST_SIMD_BARRIER(a);                                              \
+  BX_HOST_SIMD_BARRIER(b);                                              \
+  a = func(a, b);                                                       \
+  BX_HOST_SIMD_BARRIER(a);                                              \
+  (mxcsr) |= _mm_getcsr() & MXCSR_EXCEPTIONS;                           \
+  if ((host_mxcsr & ~MXCSR_EXCEPTIONS) != guest_mode)                   \
+    _mm_setcsr(host_mxcsr);                                             \
+  bx_host_store_##type(&(op1), a);                                      \
+}
+
+#define BX_HOST_SIMD_FP_TYPE_ps __m128
+#define BX_HOST_SIMD_FP_TYPE_pd __m128d
+#define BX_HOST_SIMD_FP_TYPE_ss __m128
+#define BX_HOST_SIMD_FP_TYPE_sd __m128d
+
+#endif // BX_SupportHostSIMD
+
+#endif
@@ -35,10 +35,18 @@ bxPageWriteStampTable pageWriteStampTable;
 
 void flushICaches(void)
 {
+  BX_SMP_LOCK_SCOPE();
+
   for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP_THREADS
+    if (BX_SMP_REMOTE_CPU(BX_CPU(i))) {
+      BX_CPU(i)->post_remote_request(BX_REMOTE_ICACHE_FLUSH);
+      continue;
+    }
+#endif
     BX_CPU(i)->iCache.flushICacheEntries();
 #if BX_SUPPORT_TRACE_CACHE
-    BX_CPU(i)->async_event |= BX_ASYNC_EVENT_STOP_TRACE;
+    BX_CPU(i)->set_async_event(BX_ASYNC_EVENT_STOP_TRACE);
 #endif
   }
 
@@ -47,14 +55,54 @@ void flushICaches(void)
 
 void handleSMC(bx_phy_address pAddr, Bit32u mask)
 {
+  BX_SMP_LOCK_SCOPE();
+
   for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP_THREADS
+    if (BX_SMP_REMOTE_CPU(BX_CPU(i))) {
+      BX_CPU(i)->post_remote_smc(pAddr, mask);
+      continue;
+    }
+#endif
 #if BX_SUPPORT_TRACE_CACHE
-    BX_CPU(i)->async_event |= BX_ASYNC_EVENT_STOP_TRACE;
+    BX_CPU(i)->set_async_event(BX_ASYNC_EVENT_STOP_TRACE);
 #endif
     BX_CPU(i)->iCache.handleSMC(pAddr, mask);
   }
 }
 
+// A line holding paging structures cached by the TLB was written, the
+// iCache is not affected
+void handlePageTableWrite(void)
+{
+  bx_bool walker_write = 0;
+
+  BX_SMP_LOCK_SCOPE();
+
+#if BX_SUPPORT_SMP_THREADS
+  // the other CPU threads walk their page tables concurrently
+  if (bx_smp_self)
+    walker_write = bx_smp_self->TLB.walker_write;
+  else
+#endif
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+    walker_write |= BX_CPU(i)->TLB.walker_write;
+
+  // Accessed/Dirty bits updates by the page walker don't change any
+  // cached translation
+  if (walker_write) return;
+
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP_THREADS
+    if (BX_SMP_REMOTE_CPU(BX_CPU(i))) {
+      BX_CPU(i)->post_remote_request(BX_REMOTE_PAGE_TABLE_WRITE);
+      continue;
+    }
+#endif
+    BX_CPU(i)->TLB_pageTableWrite();
+  }
+}
+
 #if BX_SUPPORT_TRACE_CACHE
 
 void BX_CPU_C::serveICacheMiss(bxICacheEntry_c *entry, Bit32u eipBiased, bx_phy_address pAddr)
@@ -63,8 +111,10 @@ void BX_CPU_C::serveICacheMiss(bxICacheEntry_c *entry, Bit32u eipBiased, bx_phy_
 
   // Cache miss. We weren't so lucky, but let's be optimistic - try to build 
   // trace from incoming instruction bytes stream !
+  entry->fetchModeMask = BX_CPU_THIS_PTR fetchModeMask;
   entry->pAddr = pAddr;
   entry->traceMask = 0;
+  entry->link[0] = entry->link[1] = entry;
 
   unsigned remainingInPage = BX_CPU_THIS_PTR eipPageWindowSize - eipBiased;
   const Bit8u *fetchPtr = BX_CPU_THIS_PTR eipFetchPtr + eipBiased;
@@ -130,6 +180,10 @@ void BX_CPU_C::serveICacheMiss(bxICacheEntry_c *entry, Bit32u eipBiased, bx_phy_
       if (mergeTraces(entry, i, pAddr)) break;
   }
 
+#if BX_SUPPORT_TRACE_FUSION
+  fuseTrace(entry);
+#endif
+
 //BX_INFO(("commit trace %08x len=%d mask %08x", (Bit32u) entry->pAddr, entry->tlen, pageWriteStampTable.getFineGranularityMapping(entry->pAddr)));
 
   entry->traceMask |= traceMask;
@@ -141,9 +195,9 @@ void BX_CPU_C::serveICacheMiss(bxICacheEntry_c *entry, Bit32u eipBiased, bx_phy_
 
 bx_bool BX_CPU_C::mergeTraces(bxICacheEntry_c *entry, bxInstruction_c *i, bx_phy_address pAddr)
 {
-  bxICacheEntry_c *e = BX_CPU_THIS_PTR iCache.get_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
+  bxICacheEntry_c *e = BX_CPU_THIS_PTR iCache.find_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
 
-  if (e->pAddr == pAddr)
+  if (e != NULL)
   {
     // determine max amount of instruction to take from another entry
     unsigned max_length = e->tlen;
@@ -196,8 +250,11 @@ void BX_CPU_C::serveICacheMiss(bxICacheEntry_c *entry, Bit32u eipBiased, bx_phy_
 {
   // The entry will be marked valid if fetchdecode will succeed
   if (fetchInstruction(entry->i, eipBiased)) {
+    Bit32u pageOffset = PAGE_OFFSET((Bit32u) pAddr);
     entry->pAddr = pAddr;
-    pageWriteStampTable.markICache(pAddr, entry->i->ilen());
+    entry->traceMask  = 1 <<  (pageOffset >> 7);
+    entry->traceMask |= 1 << ((pageOffset + entry->i->ilen() - 1) >> 7);
+    pageWriteStampTable.markICacheMask(pAddr, entry->traceMask);
   }
   else {
     entry->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
@@ -25,18 +25,43 @@
 #define BX_ICACHE_H
 
 extern void handleSMC(bx_phy_address pAddr, Bit32u mask);
+extern void handlePageTableWrite(void);
+
+#if BX_SUPPORT_SMP_THREADS
+  // the write stamps are updated by all CPU threads
+  #define BX_WRITE_STAMP_SET(stamp, mask)   __sync_fetch_and_or(&(stamp), (mask))
+  #define BX_WRITE_STAMP_CLEAR(stamp, mask) __sync_fetch_and_and(&(stamp), ~(mask))
+#else
+  #define BX_WRITE_STAMP_SET(stamp, mask)   ((stamp) |= (mask))
+  #define BX_WRITE_STAMP_CLEAR(stamp, mask) ((stamp) &= ~(mask))
+#endif
 
 class bxPageWriteStampTable
 {
 #define PHY_MEM_PAGES (1024*1024)
   Bit32u *fineGranularityMapping;
+  // 128 byte lines holding paging structures cached by the TLB, only
+  // allocated when the TLB retains more than one address space
+  Bit32u *pageTableMapping;
 
 public:
   bxPageWriteStampTable() {
     fineGranularityMapping = new Bit32u[PHY_MEM_PAGES];
+    pageTableMapping = NULL;
     resetWriteStamps();
   }
- ~bxPageWriteStampTable() { delete [] fineGranularityMapping; }
+ ~bxPageWriteStampTable() {
+    delete [] fineGranularityMapping;
+    delete [] pageTableMapping;
+  }
+
+  void enablePageTableTracking(void) {
+    if (pageTableMapping) return;
+    pageTableMapping = new Bit32u[PHY_MEM_PAGES];
+    for (Bit32u i=0; i<PHY_MEM_PAGES; i++) {
+      pageTableMapping[i] = 0;
+    }
+  }
 
   BX_CPP_INLINE Bit32u hash(bx_phy_address pAddr) const {
     // can share writeStamps between multiple pages if >32 bit phy address
@@ -53,12 +78,19 @@ public:
     Bit32u mask  = 1 << (PAGE_OFFSET((Bit32u) pAddr) >> 7);
            mask |= 1 << (PAGE_OFFSET((Bit32u) pAddr + len - 1) >> 7);
 
-    fineGranularityMapping[hash(pAddr)] |= mask;
+    BX_WRITE_STAMP_SET(fineGranularityMapping[hash(pAddr)], mask);
   }
 
   BX_CPP_INLINE void markICacheMask(bx_phy_address pAddr, Bit32u mask)
   {
-    fineGranularityMapping[hash(pAddr)] |= mask;
+    BX_WRITE_STAMP_SET(fineGranularityMapping[hash(pAddr)], mask);
+  }
+
+  BX_CPP_INLINE void markPageTable(bx_phy_address pAddr)
+  {
+    Bit32u mask = 1 << (PAGE_OFFSET((Bit32u) pAddr) >> 7);
+    if (! (pageTableMapping[hash(pAddr)] & mask))
+      BX_WRITE_STAMP_SET(pageTableMapping[hash(pAddr)], mask);
   }
 
   // whole page is being altered
@@ -67,8 +99,12 @@ public:
     Bit32u index = hash(pAddr);
 
     if (fineGranularityMapping[index]) {
+      BX_WRITE_STAMP_CLEAR(fineGranularityMapping[index], 0xffffffff);
       handleSMC(pAddr, 0xffffffff); // one of the CPUs might be running trace from this page
-      fineGranularityMapping[index] = 0;
+    }
+    if (pageTableMapping && pageTableMapping[index]) {
+      BX_WRITE_STAMP_CLEAR(pageTableMapping[index], 0xffffffff);
+      handlePageTableWrite();
     }
   }
 
@@ -82,10 +118,22 @@ public:
               mask |= 1 << (PAGE_OFFSET((Bit32u) pAddr + len - 1) >> 7);
 
        if (fineGranularityMapping[index] & mask) {
-          // one of the CPUs might be running trace from this page
+          // one of the CPUs might be running trace from this page, clear
+          // the stamp first so traces built concurrently mark it again
+          BX_WRITE_STAMP_CLEAR(fineGranularityMapping[index], mask);
           handleSMC(pAddr, mask);
-          fineGranularityMapping[index] &= ~mask;
-       }       
+       }
+    }
+
+    if (pageTableMapping && pageTableMapping[index]) {
+       Bit32u mask  = 1 << (PAGE_OFFSET((Bit32u) pAddr) >> 7);
+              mask |= 1 << (PAGE_OFFSET((Bit32u) pAddr + len - 1) >> 7);
+
+       if (pageTableMapping[index] & mask) {
+          // the page walker marks the line again on its next use
+          BX_WRITE_STAMP_CLEAR(pageTableMapping[index], mask);
+          handlePageTableWrite();
+       }
     }
   }
 
@@ -102,20 +150,50 @@ BX_CPP_INLINE void bxPageWriteStampTable::resetWriteStamps(void)
 extern bxPageWriteStampTable pageWriteStampTable;
 
 #define BxICacheEntries (64 * 1024)  // Must be a power of 2.
+#define BxICacheWays    4            // Must be a power of 2.
+#define BxICacheSets    (BxICacheEntries / BxICacheWays)
 #define BxICacheMemPool (384 * 1024)
 
+// The trace memory pool is split into generations which are filled in
+// round robin order. When the pool runs out only the oldest generation is
+// recycled and the traces living in it are invalidated.
+#define BxICacheGenerations 8        // Must divide BxICacheMemPool.
+#define BxICacheGenerationSize (BxICacheMemPool / BxICacheGenerations)
+
+// Trace which was hit that many times since it was decoded is considered
+// hot. Hot traces are evicted only when all the ways in the set are hot.
+#define BX_ICACHE_HOT_TRACE 64
+
 #if BX_SUPPORT_TRACE_CACHE
   #define BX_MAX_TRACE_LENGTH 32
+
+  // Fuse common pairs of instructions into a single trace entry when the
+  // trace is built (see fusion.cc). Instrumentation and internal debugger
+  // want to see every instruction separately.
+  #if BX_CPU_LEVEL >= 3 && BX_INSTRUMENTATION == 0 && BX_DEBUGGER == 0
+    #define BX_SUPPORT_TRACE_FUSION 1
+  #else
+    #define BX_SUPPORT_TRACE_FUSION 0
+  #endif
+#else
+  #define BX_SUPPORT_TRACE_FUSION 0
 #endif
 
 struct bxICacheEntry_c
 {
   bx_phy_address pAddr; // Physical address of the instruction
   Bit32u traceMask;
+  Bit32u lruStamp;      // Time of the last lookup hit, for LRU replacement
+  Bit32u heat;          // Number of lookup hits since the trace was decoded
 
 #if BX_SUPPORT_TRACE_CACHE
   Bit32u tlen;          // Trace length in instructions
+  Bit32u fetchModeMask; // Fetch mode the trace was decoded in
   bxInstruction_c *i;
+  // Most recently seen successor traces (typically the fall-through and
+  // the branch target). A link is only a hint, it is followed only if the
+  // linked entry still holds a trace for the expected pAddr/fetchModeMask.
+  bxICacheEntry_c *link[2];
 #else
   // ... define as array of 1 to simplify merge with trace cache code
   bxInstruction_c i[1];
@@ -124,12 +202,26 @@ struct bxICacheEntry_c
 
 #define BX_ICACHE_INVALID_PHY_ADDRESS (bx_phy_address(-1))
 
+struct bxICacheStats_t
+{
+  Bit64u hits;
+  Bit64u conflictMisses; // all the ways of the set were valid, one evicted
+  Bit64u coldFills;      // filled a free way (never seen, flushed or SMC)
+#if BX_SUPPORT_TRACE_CACHE
+  Bit64u linkHits;       // hits found through the successor links of a trace
+#endif
+};
+
 class BOCHSAPI bxICache_c {
 public:
+  // BxICacheSets sets of BxICacheWays consecutive entries each
   bxICacheEntry_c entry[BxICacheEntries];
+  Bit32u lruClock;
+  bxICacheStats_t stats;
 #if BX_SUPPORT_TRACE_CACHE
   bxInstruction_c mpool[BxICacheMemPool];
   unsigned mpindex;
+  unsigned mpgeneration; // generation mpindex points into
 
 #define BX_ICACHE_PAGE_SPLIT_ENTRIES 8 /* must be power of two */
   struct pageSplitEntryIndex {
@@ -140,24 +232,31 @@ public:
 #endif
 
 public:
-  bxICache_c() { flushICacheEntries(); }
+  bxICache_c() {
+    flushICacheEntries();
+    memset(&stats, 0, sizeof(stats));
+  }
 
+  // must be at least one set for every byte in the 4K page (see handleSMC)
   BX_CPP_INLINE unsigned hash(bx_phy_address pAddr, unsigned fetchModeMask) const
   {
-//  return ((pAddr + (pAddr << 2) + (pAddr>>6)) & (BxICacheEntries-1)) ^ fetchModeMask;
-    return ((pAddr) & (BxICacheEntries-1)) ^ fetchModeMask;
+//  return ((pAddr + (pAddr << 2) + (pAddr>>6)) & (BxICacheSets-1)) ^ fetchModeMask;
+    return ((pAddr) & (BxICacheSets-1)) ^ fetchModeMask;
   }
 
 #if BX_SUPPORT_TRACE_CACHE
   BX_CPP_INLINE void alloc_trace(bxICacheEntry_c *e)
   {
-    if (mpindex + BX_MAX_TRACE_LENGTH > BxICacheMemPool) {
-      flushICacheEntries();
+    // the trace must not cross the end of the current generation
+    if (mpindex + BX_MAX_TRACE_LENGTH > (mpgeneration+1) * BxICacheGenerationSize) {
+      recycleGeneration();
     }
     e->i = &mpool[mpindex];
     e->tlen = 0;
   }
 
+  BX_CPP_INLINE void recycleGeneration(void);
+
   BX_CPP_INLINE void commit_trace(unsigned len) { mpindex += len; }
 
   BX_CPP_INLINE void commit_page_split_trace(bx_phy_address paddr, bxICacheEntry_c *entry)
@@ -180,11 +279,82 @@ public:
   BX_CPP_INLINE void purgeICacheEntries(void);
   BX_CPP_INLINE void flushICacheEntries(void);
 
-  BX_CPP_INLINE bxICacheEntry_c* get_entry(bx_phy_address pAddr, unsigned fetchModeMask)
+  BX_CPP_INLINE bxICacheEntry_c* get_set(bx_phy_address pAddr, unsigned fetchModeMask)
+  {
+    return &(entry[hash(pAddr, fetchModeMask) * BxICacheWays]);
+  }
+
+  // find the trace without updating replacement state
+  BX_CPP_INLINE bxICacheEntry_c* find_entry(bx_phy_address pAddr, unsigned fetchModeMask)
+  {
+    bxICacheEntry_c *e = get_set(pAddr, fetchModeMask);
+
+    for (unsigned way=0; way < BxICacheWays; way++, e++) {
+      if (e->pAddr == pAddr) return e;
+    }
+
+    return NULL;
+  }
+
+  BX_CPP_INLINE void touch(bxICacheEntry_c *e)
+  {
+    stats.hits++;
+    e->lruStamp = ++lruClock;
+    if (e->heat < BX_ICACHE_HOT_TRACE) e->heat++;
+  }
+
+  BX_CPP_INLINE bxICacheEntry_c* lookup(bx_phy_address pAddr, unsigned fetchModeMask)
   {
-    return &(entry[hash(pAddr, fetchModeMask)]);
+    bxICacheEntry_c *e = find_entry(pAddr, fetchModeMask);
+    if (e) touch(e);
+    return e;
   }
 
+#if BX_SUPPORT_TRACE_CACHE
+  BX_CPP_INLINE bx_bool valid_link(const bxICacheEntry_c *e, bx_phy_address pAddr, unsigned fetchModeMask) const
+  {
+    return e->pAddr == pAddr && e->fetchModeMask == fetchModeMask;
+  }
+
+  // make e the most recently used successor of prev
+  BX_CPP_INLINE void link_trace(bxICacheEntry_c *prev, bxICacheEntry_c *e)
+  {
+    if (prev->link[0] != e) {
+      prev->link[1] = prev->link[0];
+      prev->link[0] = e;
+    }
+  }
+
+  // lookup the trace following prev, try the successor links first
+  BX_CPP_INLINE bxICacheEntry_c* lookup_linked(bxICacheEntry_c *prev, bx_phy_address pAddr, unsigned fetchModeMask)
+  {
+    bxICacheEntry_c *e = prev->link[0];
+
+    if (valid_link(e, pAddr, fetchModeMask)) {
+      stats.linkHits++;
+    }
+    else {
+      e = prev->link[1];
+      if (valid_link(e, pAddr, fetchModeMask)) {
+        stats.linkHits++;
+      }
+      else {
+        e = find_entry(pAddr, fetchModeMask);
+        if (! e) return NULL;
+      }
+      link_trace(prev, e);
+    }
+
+    touch(e);
+    return e;
+  }
+#endif
+
+  BX_CPP_INLINE bxICacheEntry_c* get_victim_entry(bx_phy_address pAddr, unsigned fetchModeMask);
+
+  BX_CPP_INLINE Bit64u lookups(void) const {
+    return stats.hits + stats.conflictMisses + stats.coldFills;
+  }
 };
 
 BX_CPP_INLINE void bxICache_c::flushICacheEntries(void)
@@ -195,17 +365,91 @@ BX_CPP_INLINE void bxICache_c::flushICacheEntries(void)
   for (i=0; i<BxICacheEntries; i++, e++) {
     e->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
     e->traceMask = 0;
+    e->lruStamp = 0;
+    e->heat = 0;
   }
 
+  lruClock = 0;
+
 #if BX_SUPPORT_TRACE_CACHE
   for (i=0;i<BX_ICACHE_PAGE_SPLIT_ENTRIES;i++)
     pageSplitIndex[i].ppf = BX_ICACHE_INVALID_PHY_ADDRESS;
 
   nextPageSplitIndex = 0;
   mpindex = 0;
+  mpgeneration = 0;
 #endif
 }
 
+#if BX_SUPPORT_TRACE_CACHE
+
+// Move to the next (oldest) generation of the trace memory pool and drop
+// all the traces which are stored in it.
+BX_CPP_INLINE void bxICache_c::recycleGeneration(void)
+{
+  mpgeneration = (mpgeneration+1) % BxICacheGenerations;
+  mpindex = mpgeneration * BxICacheGenerationSize;
+
+  const bxInstruction_c *start = &mpool[mpindex];
+  const bxInstruction_c *end = start + BxICacheGenerationSize;
+
+  bxICacheEntry_c* e = entry;
+  for (unsigned n=0; n<BxICacheEntries; n++, e++) {
+    if (e->i >= start && e->i < end)
+      e->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
+  }
+
+  for (unsigned n=0; n<BX_ICACHE_PAGE_SPLIT_ENTRIES; n++) {
+    if (pageSplitIndex[n].ppf != BX_ICACHE_INVALID_PHY_ADDRESS &&
+        pageSplitIndex[n].e->pAddr == BX_ICACHE_INVALID_PHY_ADDRESS)
+    {
+      pageSplitIndex[n].ppf = BX_ICACHE_INVALID_PHY_ADDRESS;
+    }
+  }
+}
+
+#endif
+
+// Select an entry for a new trace: a free way if there is one, otherwise
+// the least recently used cold trace. If all the ways are hot, the least
+// recently used hot trace is evicted. Hot traces passed over in favour of
+// a cold one cool down so a trace that is no longer running loses its
+// protection after a few replacements.
+BX_CPP_INLINE bxICacheEntry_c* bxICache_c::get_victim_entry(bx_phy_address pAddr, unsigned fetchModeMask)
+{
+  bxICacheEntry_c *e = get_set(pAddr, fetchModeMask);
+  bxICacheEntry_c *cold = NULL, *hot = NULL;
+
+  for (unsigned way=0; way < BxICacheWays; way++, e++) {
+    if (e->pAddr == BX_ICACHE_INVALID_PHY_ADDRESS) {
+      stats.coldFills++;
+      cold = e;
+      goto found;
+    }
+
+    if (e->heat < BX_ICACHE_HOT_TRACE) {
+      if (! cold || (Bit32s)(e->lruStamp - cold->lruStamp) < 0) cold = e;
+    }
+    else {
+      if (! hot || (Bit32s)(e->lruStamp - hot->lruStamp) < 0) hot = e;
+    }
+  }
+
+  stats.conflictMisses++;
+
+  if (! cold) {
+    cold = hot;
+  }
+  else if (hot) {
+    hot->heat >>= 1;
+  }
+
+found:
+  cold->lruStamp = ++lruClock;
+  cold->heat = 0;
+  return cold;
+}
+
 BX_CPP_INLINE void bxICache_c::handleSMC(bx_phy_address pAddr, Bit32u mask)
 {
   // TODO: invalidate only entries in same page as pAddr
@@ -219,17 +463,19 @@ BX_CPP_INLINE void bxICache_c::handleSMC(bx_phy_address pAddr, Bit32u mask)
     for (unsigned i=0;i<BX_ICACHE_PAGE_SPLIT_ENTRIES;i++) {
       if (pAddr == pageSplitIndex[i].ppf) {
         pageSplitIndex[i].ppf = BX_ICACHE_INVALID_PHY_ADDRESS;
+        pageSplitIndex[i].e->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
       }
     }
   }
 #endif
 
-  bxICacheEntry_c *e = get_entry(pAddr, 0);
+  bxICacheEntry_c *e = get_set(pAddr, 0);
 
+  // the page occupies 4096 consecutive sets, 128 sets for every cache line
   for (unsigned n=0; n < 32; n++) {
     Bit32u line_mask = (1 << n);
     if (line_mask > mask) break;
-    for (unsigned index=0; index < 128; index++, e++) {
+    for (unsigned index=0; index < 128*BxICacheWays; index++, e++) {
       if (pAddr == LPFOf(e->pAddr) && (e->traceMask & mask) != 0) {
         e->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
       }
@@ -43,6 +43,8 @@ BX_CPU_C::BX_CPU_C(unsigned id): bx_cpuid(id)
   char buffer[16];
   sprintf(buffer, "CPU%x", bx_cpuid);
   put(buffer);
+
+  TLB.entries = NULL;
 }
 
 #if BX_WITH_WX
@@ -155,6 +157,16 @@ void BX_CPU_C::initialize(void)
   init_isa_features_bitmask();
   init_FetchDecodeTables(); // must be called after init_isa_features_bitmask()
 
+  TLB_init();
+
+#if BX_SUPPORT_SMP_THREADS
+  BX_CPU_THIS_PTR remote_requests = 0;
+  BX_CPU_THIS_PTR remote_smc_count = 0;
+#endif
+#if BX_SUPPORT_ATOMIC_RMW
+  BX_CPU_THIS_PTR rmw_exclusive_pending = 0;
+#endif
+
 #if BX_CONFIGURE_MSRS
   for (unsigned n=0; n < BX_MSR_MAX_INDEX; n++) {
     BX_CPU_THIS_PTR msrs[n] = 0;
@@ -172,6 +184,10 @@ void BX_CPU_C::initialize(void)
 #if BX_WITH_WX
   register_wx_state();
 #endif
+
+#if BX_CPU_STATISTICS
+  register_stats();
+#endif
 }
 
 #if BX_WITH_WX
@@ -716,6 +732,7 @@ void BX_CPU_C::after_restore_state(void)
 BX_CPU_C::~BX_CPU_C()
 {
   BX_INSTR_EXIT(BX_CPU_ID);
+  delete [] TLB.entries;
   BX_DEBUG(("Exit."));
 }
 
@@ -152,6 +152,27 @@ public:
   BX_CPP_INLINE unsigned sibBase() const {
     return metaData[BX_INSTR_METADATA_BASE];
   }
+  // Fused instruction pairs (see fusion.cc) reuse the metadata slots
+  // which are not needed to execute the first instruction of the pair.
+  BX_CPP_INLINE unsigned ilen2(void) const {
+    return metaData[BX_INSTR_METADATA_MODRM];
+  }
+  BX_CPP_INLINE void setILen2(unsigned ilen) {
+    metaData[BX_INSTR_METADATA_MODRM] = ilen;
+  }
+  BX_CPP_INLINE unsigned jccCond(void) const {
+    return metaData[BX_INSTR_METADATA_SCALE];
+  }
+  BX_CPP_INLINE void setJccCond(unsigned cond) {
+    metaData[BX_INSTR_METADATA_SCALE] = cond;
+  }
+  BX_CPP_INLINE unsigned loadDst(void) const {
+    return metaData[BX_INSTR_METADATA_B1];
+  }
+  BX_CPP_INLINE void setLoadDst(unsigned reg) {
+    metaData[BX_INSTR_METADATA_B1] = reg;
+  }
+
   BX_CPP_INLINE Bit32s displ32s() const { return (Bit32s) modRMForm.displ32u; }
   BX_CPP_INLINE Bit16s displ16s() const { return (Bit16s) modRMForm.displ16u; }
   BX_CPP_INLINE Bit32u Id() const  { return modRMForm.Id; }
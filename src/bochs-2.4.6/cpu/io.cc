@@ -83,20 +83,13 @@ Bit32u BX_CPU_C::FastRepINSW(bxInstruction_c *i, bx_address dstOff, Bit16u port,
   // If after all the restrictions, there is anything left to do...
   if (wordCount) {
     for (count=0; count<wordCount; ) {
-      bx_devices.bulkIOQuantumsTransferred = 0;
       if (BX_CPU_THIS_PTR get_DF()==0) { // Only do accel for DF=0
-        bx_devices.bulkIOHostAddr = hostAddrDst;
-        bx_devices.bulkIOQuantumsRequested = (wordCount - count);
-      }
-      else
-        bx_devices.bulkIOQuantumsRequested = 0;
-      Bit16u temp16 = BX_INP(port, 2);
-      if (bx_devices.bulkIOQuantumsTransferred) {
-        hostAddrDst = bx_devices.bulkIOHostAddr;
-        count += bx_devices.bulkIOQuantumsTransferred;
+        unsigned n = BX_INP_BULK(port, 2, hostAddrDst, wordCount - count);
+        hostAddrDst += n << 1;
+        count += n;
       }
       else {
-        WriteHostWordToLittleEndian(hostAddrDst, temp16);
+        BX_INP_BULK(port, 2, hostAddrDst, 1);
         hostAddrDst += pointerDelta;
         count++;
       }
@@ -104,9 +97,6 @@ Bit32u BX_CPU_C::FastRepINSW(bxInstruction_c *i, bx_address dstOff, Bit16u port,
       if (BX_CPU_THIS_PTR async_event) break;
     }
 
-    // Reset for next non-bulk IO
-    bx_devices.bulkIOQuantumsRequested = 0;
-
     return count;
   }
 
@@ -157,21 +147,13 @@ Bit32u BX_CPU_C::FastRepOUTSW(bxInstruction_c *i, unsigned srcSeg, bx_address sr
   // If after all the restrictions, there is anything left to do...
   if (wordCount) {
     for (count=0; count<wordCount; ) {
-      bx_devices.bulkIOQuantumsTransferred = 0;
       if (BX_CPU_THIS_PTR get_DF()==0) { // Only do accel for DF=0
-        bx_devices.bulkIOHostAddr = hostAddrSrc;
-        bx_devices.bulkIOQuantumsRequested = (wordCount - count);
-      }
-      else
-        bx_devices.bulkIOQuantumsRequested = 0;
-      Bit16u temp16;
-      ReadHostWordFromLittleEndian(hostAddrSrc, temp16);
-      BX_OUTP(port, temp16, 2);
-      if (bx_devices.bulkIOQuantumsTransferred) {
-        hostAddrSrc = bx_devices.bulkIOHostAddr;
-        count += bx_devices.bulkIOQuantumsTransferred;
+        unsigned n = BX_OUTP_BULK(port, 2, hostAddrSrc, wordCount - count);
+        hostAddrSrc += n << 1;
+        count += n;
       }
       else {
+        BX_OUTP_BULK(port, 2, hostAddrSrc, 1);
         hostAddrSrc += pointerDelta;
         count++;
       }
@@ -179,9 +161,6 @@ Bit32u BX_CPU_C::FastRepOUTSW(bxInstruction_c *i, unsigned srcSeg, bx_address sr
       if (BX_CPU_THIS_PTR async_event) break;
     }
 
-    // Reset for next non-bulk IO
-    bx_devices.bulkIOQuantumsRequested = 0;
-
     return count;
   }
 
@@ -330,7 +309,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::INSW32_YwDX(bxInstruction_c *i)
       // one, since the main cpu loop will decrement one.  Also,
       // the count is predecremented before examined, so defintely
       // don't roll it under zero.
-      BX_TICKN(wordCount-1);
+      BX_INSN_TICKN(wordCount-1);
       RCX = ECX - (wordCount-1);
       incr = wordCount << 1; // count * 2.
     }
@@ -571,7 +550,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::OUTSW32_DXXw(bxInstruction_c *i)
     if (wordCount) {
       // Decrement eCX.  Note, the main loop will decrement 1 also, so
       // decrement by one less than expected, like the case above.
-      BX_TICKN(wordCount-1); // Main cpu loop also decrements one more.
+      BX_INSN_TICKN(wordCount-1); // Main cpu loop also decrements one more.
       RCX = ECX - (wordCount-1);
       incr = wordCount << 1; // count * 2.
     }
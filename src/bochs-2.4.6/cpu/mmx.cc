@@ -24,6 +24,7 @@
 #define NEED_CPU_REG_SHORTCUTS 1
 #include "bochs.h"
 #include "cpu.h"
+#include "host_simd.h"
 #define LOG_THIS BX_CPU_THIS_PTR
 
 // Make code more tidy with a few macros.
@@ -671,6 +672,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_cmpgt_epi8);
+#else
   MMXUB0(op1) = (MMXSB0(op1) > MMXSB0(op2)) ? 0xff : 0;
   MMXUB1(op1) = (MMXSB1(op1) > MMXSB1(op2)) ? 0xff : 0;
   MMXUB2(op1) = (MMXSB2(op1) > MMXSB2(op2)) ? 0xff : 0;
@@ -679,6 +683,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTB_PqQq(bxInstruction_c *i)
   MMXUB5(op1) = (MMXSB5(op1) > MMXSB5(op2)) ? 0xff : 0;
   MMXUB6(op1) = (MMXSB6(op1) > MMXSB6(op2)) ? 0xff : 0;
   MMXUB7(op1) = (MMXSB7(op1) > MMXSB7(op2)) ? 0xff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -705,10 +710,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_cmpgt_epi16);
+#else
   MMXUW0(op1) = (MMXSW0(op1) > MMXSW0(op2)) ? 0xffff : 0;
   MMXUW1(op1) = (MMXSW1(op1) > MMXSW1(op2)) ? 0xffff : 0;
   MMXUW2(op1) = (MMXSW2(op1) > MMXSW2(op2)) ? 0xffff : 0;
   MMXUW3(op1) = (MMXSW3(op1) > MMXSW3(op2)) ? 0xffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -735,8 +744,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_cmpgt_epi32);
+#else
   MMXUD0(op1) = (MMXSD0(op1) > MMXSD0(op2)) ? 0xffffffff : 0;
   MMXUD1(op1) = (MMXSD1(op1) > MMXSD1(op2)) ? 0xffffffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1023,6 +1036,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_cmpeq_epi8);
+#else
   MMXUB0(op1) = (MMXUB0(op1) == MMXUB0(op2)) ? 0xff : 0;
   MMXUB1(op1) = (MMXUB1(op1) == MMXUB1(op2)) ? 0xff : 0;
   MMXUB2(op1) = (MMXUB2(op1) == MMXUB2(op2)) ? 0xff : 0;
@@ -1031,6 +1047,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQB_PqQq(bxInstruction_c *i)
   MMXUB5(op1) = (MMXUB5(op1) == MMXUB5(op2)) ? 0xff : 0;
   MMXUB6(op1) = (MMXUB6(op1) == MMXUB6(op2)) ? 0xff : 0;
   MMXUB7(op1) = (MMXUB7(op1) == MMXUB7(op2)) ? 0xff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1057,10 +1074,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_cmpeq_epi16);
+#else
   MMXUW0(op1) = (MMXUW0(op1) == MMXUW0(op2)) ? 0xffff : 0;
   MMXUW1(op1) = (MMXUW1(op1) == MMXUW1(op2)) ? 0xffff : 0;
   MMXUW2(op1) = (MMXUW2(op1) == MMXUW2(op2)) ? 0xffff : 0;
   MMXUW3(op1) = (MMXUW3(op1) == MMXUW3(op2)) ? 0xffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1087,8 +1108,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_cmpeq_epi32);
+#else
   MMXUD0(op1) = (MMXUD0(op1) == MMXUD0(op2)) ? 0xffffffff : 0;
   MMXUD1(op1) = (MMXUD1(op1) == MMXUD1(op2)) ? 0xffffffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1236,6 +1261,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_srl_epi16);
+#else
   if(MMXUQ(op2) > 15) MMXUQ(op1) = 0;
   else
   {
@@ -1246,6 +1274,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLW_PqQq(bxInstruction_c *i)
     MMXUW2(op1) >>= shift;
     MMXUW3(op1) >>= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1272,6 +1301,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_srl_epi32);
+#else
   if(MMXUQ(op2) > 31) MMXUQ(op1) = 0;
   else
   {
@@ -1280,6 +1312,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLD_PqQq(bxInstruction_c *i)
     MMXUD0(op1) >>= shift;
     MMXUD1(op1) >>= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1306,12 +1339,16 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLQ_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_srl_epi64);
+#else
   if(MMXUQ(op2) > 63) {
     MMXUQ(op1) = 0;
   }
   else {
     MMXUQ(op1) >>= MMXUB0(op2);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1338,7 +1375,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDQ_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_add_epi64);
+#else
   MMXUQ(op1) += MMXUQ(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1365,6 +1406,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULLW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_mullo_epi16);
+#else
   Bit32u product1 = Bit32u(MMXUW0(op1)) * Bit32u(MMXUW0(op2));
   Bit32u product2 = Bit32u(MMXUW1(op1)) * Bit32u(MMXUW1(op2));
   Bit32u product3 = Bit32u(MMXUW2(op1)) * Bit32u(MMXUW2(op2));
@@ -1374,6 +1418,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULLW_PqQq(bxInstruction_c *i)
   MMXUW1(op1) = product2 & 0xffff;
   MMXUW2(op1) = product3 & 0xffff;
   MMXUW3(op1) = product4 & 0xffff;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1424,6 +1469,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBUSB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(result, op1, op2, _mm_subs_epu8);
+#else
   MMXUQ(result) = 0;
 
   if(MMXUB0(op1) > MMXUB0(op2)) MMXUB0(result) = MMXUB0(op1) - MMXUB0(op2);
@@ -1434,6 +1482,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBUSB_PqQq(bxInstruction_c *i)
   if(MMXUB5(op1) > MMXUB5(op2)) MMXUB5(result) = MMXUB5(op1) - MMXUB5(op2);
   if(MMXUB6(op1) > MMXUB6(op2)) MMXUB6(result) = MMXUB6(op1) - MMXUB6(op2);
   if(MMXUB7(op1) > MMXUB7(op2)) MMXUB7(result) = MMXUB7(op1) - MMXUB7(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), result);
@@ -1460,12 +1509,16 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBUSW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(result, op1, op2, _mm_subs_epu16);
+#else
   MMXUQ(result) = 0;
 
   if(MMXUW0(op1) > MMXUW0(op2)) MMXUW0(result) = MMXUW0(op1) - MMXUW0(op2);
   if(MMXUW1(op1) > MMXUW1(op2)) MMXUW1(result) = MMXUW1(op1) - MMXUW1(op2);
   if(MMXUW2(op1) > MMXUW2(op2)) MMXUW2(result) = MMXUW2(op1) - MMXUW2(op2);
   if(MMXUW3(op1) > MMXUW3(op2)) MMXUW3(result) = MMXUW3(op1) - MMXUW3(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), result);
@@ -1492,6 +1545,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMINUB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_min_epu8);
+#else
   if(MMXUB0(op2) < MMXUB0(op1)) MMXUB0(op1) = MMXUB0(op2);
   if(MMXUB1(op2) < MMXUB1(op1)) MMXUB1(op1) = MMXUB1(op2);
   if(MMXUB2(op2) < MMXUB2(op1)) MMXUB2(op1) = MMXUB2(op2);
@@ -1500,6 +1556,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMINUB_PqQq(bxInstruction_c *i)
   if(MMXUB5(op2) < MMXUB5(op1)) MMXUB5(op1) = MMXUB5(op2);
   if(MMXUB6(op2) < MMXUB6(op1)) MMXUB6(op1) = MMXUB6(op2);
   if(MMXUB7(op2) < MMXUB7(op1)) MMXUB7(op1) = MMXUB7(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1526,7 +1583,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PAND_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_and_si128);
+#else
   MMXUQ(op1) &= MMXUQ(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1553,6 +1614,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDUSB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_adds_epu8);
+#else
   MMXUB0(op1) = SaturateWordSToByteU(Bit16s(MMXUB0(op1)) + Bit16s(MMXUB0(op2)));
   MMXUB1(op1) = SaturateWordSToByteU(Bit16s(MMXUB1(op1)) + Bit16s(MMXUB1(op2)));
   MMXUB2(op1) = SaturateWordSToByteU(Bit16s(MMXUB2(op1)) + Bit16s(MMXUB2(op2)));
@@ -1562,6 +1626,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDUSB_PqQq(bxInstruction_c *i)
   MMXUB5(op1) = SaturateWordSToByteU(Bit16s(MMXUB5(op1)) + Bit16s(MMXUB5(op2)));
   MMXUB6(op1) = SaturateWordSToByteU(Bit16s(MMXUB6(op1)) + Bit16s(MMXUB6(op2)));
   MMXUB7(op1) = SaturateWordSToByteU(Bit16s(MMXUB7(op1)) + Bit16s(MMXUB7(op2)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1588,10 +1653,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDUSW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_adds_epu16);
+#else
   MMXUW0(op1) = SaturateDwordSToWordU(Bit32s(MMXUW0(op1)) + Bit32s(MMXUW0(op2)));
   MMXUW1(op1) = SaturateDwordSToWordU(Bit32s(MMXUW1(op1)) + Bit32s(MMXUW1(op2)));
   MMXUW2(op1) = SaturateDwordSToWordU(Bit32s(MMXUW2(op1)) + Bit32s(MMXUW2(op2)));
   MMXUW3(op1) = SaturateDwordSToWordU(Bit32s(MMXUW3(op1)) + Bit32s(MMXUW3(op2)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1618,6 +1687,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMAXUB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_max_epu8);
+#else
   if(MMXUB0(op2) > MMXUB0(op1)) MMXUB0(op1) = MMXUB0(op2);
   if(MMXUB1(op2) > MMXUB1(op1)) MMXUB1(op1) = MMXUB1(op2);
   if(MMXUB2(op2) > MMXUB2(op1)) MMXUB2(op1) = MMXUB2(op2);
@@ -1626,6 +1698,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMAXUB_PqQq(bxInstruction_c *i)
   if(MMXUB5(op2) > MMXUB5(op1)) MMXUB5(op1) = MMXUB5(op2);
   if(MMXUB6(op2) > MMXUB6(op1)) MMXUB6(op1) = MMXUB6(op2);
   if(MMXUB7(op2) > MMXUB7(op1)) MMXUB7(op1) = MMXUB7(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1652,7 +1725,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PANDN_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_andnot_si128);
+#else
   MMXUQ(op1) = ~(MMXUQ(op1)) & MMXUQ(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1679,6 +1756,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PAVGB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_avg_epu8);
+#else
   MMXUB0(op1) = (MMXUB0(op1) + MMXUB0(op2) + 1) >> 1;
   MMXUB1(op1) = (MMXUB1(op1) + MMXUB1(op2) + 1) >> 1;
   MMXUB2(op1) = (MMXUB2(op1) + MMXUB2(op2) + 1) >> 1;
@@ -1687,6 +1767,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PAVGB_PqQq(bxInstruction_c *i)
   MMXUB5(op1) = (MMXUB5(op1) + MMXUB5(op2) + 1) >> 1;
   MMXUB6(op1) = (MMXUB6(op1) + MMXUB6(op2) + 1) >> 1;
   MMXUB7(op1) = (MMXUB7(op1) + MMXUB7(op2) + 1) >> 1;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1713,6 +1794,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sra_epi16);
+#else
   if(!MMXUQ(op2)) return;
 
   if(MMXUQ(op2) > 15) {
@@ -1729,6 +1813,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAW_PqQq(bxInstruction_c *i)
     MMXUW2(op1) = (Bit16u)(MMXSW2(op1) >> shift);
     MMXUW3(op1) = (Bit16u)(MMXSW3(op1) >> shift);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1755,6 +1840,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sra_epi32);
+#else
   if(!MMXUQ(op2)) return;
 
   if(MMXUQ(op2) > 31) {
@@ -1767,6 +1855,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAD_PqQq(bxInstruction_c *i)
     MMXUD0(op1) = (Bit32u)(MMXSD0(op1) >> shift);
     MMXUD1(op1) = (Bit32u)(MMXSD1(op1) >> shift);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1793,10 +1882,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PAVGW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_avg_epu16);
+#else
   MMXUW0(op1) = (MMXUW0(op1) + MMXUW0(op2) + 1) >> 1;
   MMXUW1(op1) = (MMXUW1(op1) + MMXUW1(op2) + 1) >> 1;
   MMXUW2(op1) = (MMXUW2(op1) + MMXUW2(op2) + 1) >> 1;
   MMXUW3(op1) = (MMXUW3(op1) + MMXUW3(op2) + 1) >> 1;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1823,6 +1916,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHUW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_mulhi_epu16);
+#else
   Bit32u product1 = Bit32u(MMXUW0(op1)) * Bit32u(MMXUW0(op2));
   Bit32u product2 = Bit32u(MMXUW1(op1)) * Bit32u(MMXUW1(op2));
   Bit32u product3 = Bit32u(MMXUW2(op1)) * Bit32u(MMXUW2(op2));
@@ -1832,6 +1928,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHUW_PqQq(bxInstruction_c *i)
   MMXUW1(op1) = (Bit16u)(product2 >> 16);
   MMXUW2(op1) = (Bit16u)(product3 >> 16);
   MMXUW3(op1) = (Bit16u)(product4 >> 16);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1858,6 +1955,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_mulhi_epi16);
+#else
   Bit32s product1 = Bit32s(MMXSW0(op1)) * Bit32s(MMXSW0(op2));
   Bit32s product2 = Bit32s(MMXSW1(op1)) * Bit32s(MMXSW1(op2));
   Bit32s product3 = Bit32s(MMXSW2(op1)) * Bit32s(MMXSW2(op2));
@@ -1867,6 +1967,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHW_PqQq(bxInstruction_c *i)
   MMXUW1(op1) = Bit16u(product2 >> 16);
   MMXUW2(op1) = Bit16u(product3 >> 16);
   MMXUW3(op1) = Bit16u(product4 >> 16);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1908,6 +2009,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBSB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_subs_epi8);
+#else
   MMXSB0(op1) = SaturateWordSToByteS(Bit16s(MMXSB0(op1)) - Bit16s(MMXSB0(op2)));
   MMXSB1(op1) = SaturateWordSToByteS(Bit16s(MMXSB1(op1)) - Bit16s(MMXSB1(op2)));
   MMXSB2(op1) = SaturateWordSToByteS(Bit16s(MMXSB2(op1)) - Bit16s(MMXSB2(op2)));
@@ -1916,6 +2020,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBSB_PqQq(bxInstruction_c *i)
   MMXSB5(op1) = SaturateWordSToByteS(Bit16s(MMXSB5(op1)) - Bit16s(MMXSB5(op2)));
   MMXSB6(op1) = SaturateWordSToByteS(Bit16s(MMXSB6(op1)) - Bit16s(MMXSB6(op2)));
   MMXSB7(op1) = SaturateWordSToByteS(Bit16s(MMXSB7(op1)) - Bit16s(MMXSB7(op2)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1942,10 +2047,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBSW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_subs_epi16);
+#else
   MMXSW0(op1) = SaturateDwordSToWordS(Bit32s(MMXSW0(op1)) - Bit32s(MMXSW0(op2)));
   MMXSW1(op1) = SaturateDwordSToWordS(Bit32s(MMXSW1(op1)) - Bit32s(MMXSW1(op2)));
   MMXSW2(op1) = SaturateDwordSToWordS(Bit32s(MMXSW2(op1)) - Bit32s(MMXSW2(op2)));
   MMXSW3(op1) = SaturateDwordSToWordS(Bit32s(MMXSW3(op1)) - Bit32s(MMXSW3(op2)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -1972,10 +2081,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMINSW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_min_epi16);
+#else
   if(MMXSW0(op2) < MMXSW0(op1)) MMXSW0(op1) = MMXSW0(op2);
   if(MMXSW1(op2) < MMXSW1(op1)) MMXSW1(op1) = MMXSW1(op2);
   if(MMXSW2(op2) < MMXSW2(op1)) MMXSW2(op1) = MMXSW2(op2);
   if(MMXSW3(op2) < MMXSW3(op1)) MMXSW3(op1) = MMXSW3(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2002,7 +2115,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::POR_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_or_si128);
+#else
   MMXUQ(op1) |= MMXUQ(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2029,6 +2146,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDSB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_adds_epi8);
+#else
   MMXSB0(op1) = SaturateWordSToByteS(Bit16s(MMXSB0(op1)) + Bit16s(MMXSB0(op2)));
   MMXSB1(op1) = SaturateWordSToByteS(Bit16s(MMXSB1(op1)) + Bit16s(MMXSB1(op2)));
   MMXSB2(op1) = SaturateWordSToByteS(Bit16s(MMXSB2(op1)) + Bit16s(MMXSB2(op2)));
@@ -2037,6 +2157,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDSB_PqQq(bxInstruction_c *i)
   MMXSB5(op1) = SaturateWordSToByteS(Bit16s(MMXSB5(op1)) + Bit16s(MMXSB5(op2)));
   MMXSB6(op1) = SaturateWordSToByteS(Bit16s(MMXSB6(op1)) + Bit16s(MMXSB6(op2)));
   MMXSB7(op1) = SaturateWordSToByteS(Bit16s(MMXSB7(op1)) + Bit16s(MMXSB7(op2)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2063,10 +2184,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDSW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_adds_epi16);
+#else
   MMXSW0(op1) = SaturateDwordSToWordS(Bit32s(MMXSW0(op1)) + Bit32s(MMXSW0(op2)));
   MMXSW1(op1) = SaturateDwordSToWordS(Bit32s(MMXSW1(op1)) + Bit32s(MMXSW1(op2)));
   MMXSW2(op1) = SaturateDwordSToWordS(Bit32s(MMXSW2(op1)) + Bit32s(MMXSW2(op2)));
   MMXSW3(op1) = SaturateDwordSToWordS(Bit32s(MMXSW3(op1)) + Bit32s(MMXSW3(op2)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2093,10 +2218,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMAXSW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_max_epi16);
+#else
   if(MMXSW0(op2) > MMXSW0(op1)) MMXSW0(op1) = MMXSW0(op2);
   if(MMXSW1(op2) > MMXSW1(op1)) MMXSW1(op1) = MMXSW1(op2);
   if(MMXSW2(op2) > MMXSW2(op1)) MMXSW2(op1) = MMXSW2(op2);
   if(MMXSW3(op2) > MMXSW3(op1)) MMXSW3(op1) = MMXSW3(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2123,7 +2252,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PXOR_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_xor_si128);
+#else
   MMXUQ(op1) ^= MMXUQ(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2150,6 +2283,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sll_epi16);
+#else
   if(MMXUQ(op2) > 15) MMXUQ(op1) = 0;
   else
   {
@@ -2160,6 +2296,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLW_PqQq(bxInstruction_c *i)
     MMXUW2(op1) <<= shift;
     MMXUW3(op1) <<= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2186,6 +2323,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sll_epi32);
+#else
   if(MMXUQ(op2) > 31) MMXUQ(op1) = 0;
   else
   {
@@ -2194,6 +2334,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLD_PqQq(bxInstruction_c *i)
     MMXUD0(op1) <<= shift;
     MMXUD1(op1) <<= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2220,12 +2361,16 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLQ_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sll_epi64);
+#else
   if(MMXUQ(op2) > 63) {
     MMXUQ(op1) = 0;
   }
   else {
     MMXUQ(op1) <<= MMXUB0(op2);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2252,7 +2397,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULUDQ_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_mul_epu32);
+#else
   MMXUQ(op1) = Bit64u(MMXUD0(op1)) * Bit64u(MMXUD0(op2));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2279,6 +2428,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMADDWD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_madd_epi16);
+#else
   if(MMXUD0(op1) == 0x80008000 && MMXUD0(op2) == 0x80008000) {
     MMXUD0(op1) = 0x80000000;
   }
@@ -2292,6 +2444,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMADDWD_PqQq(bxInstruction_c *i)
   else {
     MMXUD1(op1) = Bit32s(MMXSW2(op1))*Bit32s(MMXSW2(op2)) + Bit32s(MMXSW3(op1))*Bit32s(MMXSW3(op2));
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2319,6 +2472,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSADBW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sad_epu8);
+#else
   temp += abs(MMXUB0(op1) - MMXUB0(op2));
   temp += abs(MMXUB1(op1) - MMXUB1(op2));
   temp += abs(MMXUB2(op1) - MMXUB2(op2));
@@ -2329,6 +2485,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSADBW_PqQq(bxInstruction_c *i)
   temp += abs(MMXUB7(op1) - MMXUB7(op2));
 
   MMXUQ(op1) = (Bit64u) temp;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2384,6 +2541,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sub_epi8);
+#else
   MMXUB0(op1) -= MMXUB0(op2);
   MMXUB1(op1) -= MMXUB1(op2);
   MMXUB2(op1) -= MMXUB2(op2);
@@ -2392,6 +2552,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBB_PqQq(bxInstruction_c *i)
   MMXUB5(op1) -= MMXUB5(op2);
   MMXUB6(op1) -= MMXUB6(op2);
   MMXUB7(op1) -= MMXUB7(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2418,10 +2579,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sub_epi16);
+#else
   MMXUW0(op1) -= MMXUW0(op2);
   MMXUW1(op1) -= MMXUW1(op2);
   MMXUW2(op1) -= MMXUW2(op2);
   MMXUW3(op1) -= MMXUW3(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2448,8 +2613,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sub_epi32);
+#else
   MMXUD0(op1) -= MMXUD0(op2);
   MMXUD1(op1) -= MMXUD1(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2476,7 +2645,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBQ_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_sub_epi64);
+#else
   MMXUQ(op1) -= MMXUQ(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2503,6 +2676,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDB_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_add_epi8);
+#else
   MMXUB0(op1) += MMXUB0(op2);
   MMXUB1(op1) += MMXUB1(op2);
   MMXUB2(op1) += MMXUB2(op2);
@@ -2511,6 +2687,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDB_PqQq(bxInstruction_c *i)
   MMXUB5(op1) += MMXUB5(op2);
   MMXUB6(op1) += MMXUB6(op2);
   MMXUB7(op1) += MMXUB7(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2537,10 +2714,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDW_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_add_epi16);
+#else
   MMXUW0(op1) += MMXUW0(op2);
   MMXUW1(op1) += MMXUW1(op2);
   MMXUW2(op1) += MMXUW2(op2);
   MMXUW3(op1) += MMXUW3(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -2567,8 +2748,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDD_PqQq(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR prepareFPU2MMX(); /* FPU2MMX transition */
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_MMX(op1, op1, op2, _mm_add_epi32);
+#else
   MMXUD0(op1) += MMXUD0(op2);
   MMXUD1(op1) += MMXUD1(op2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_MMX_REG(i->nnn(), op1);
@@ -24,6 +24,8 @@
 #include "cpu.h"
 #define LOG_THIS BX_CPU_THIS_PTR
 
+#include "param_names.h"
+
 // X86 Registers Which Affect Paging:
 // ==================================
 //
@@ -336,37 +338,175 @@ static const Bit8u priv_check[BX_PRIV_CHECK_SIZE] =
 
 // Note: this is an approximation of what Peter Tattam had.
 
-#define InstrumentTLB 0
-
-#if InstrumentTLB
-static unsigned tlbLookups=0;
-static unsigned tlbMisses=0;
-static unsigned tlbGlobalFlushes=0;
-static unsigned tlbNonGlobalFlushes=0;
-
-#define InstrTLB_StatsMask 0xfffff
-
-#define InstrTLB_Stats() {\
-  if ((tlbLookups & InstrTLB_StatsMask) == 0) { \
-    BX_INFO(("TLB lookup:%8d miss:%8d %6.2f%% flush:%8d %6.2f%%", \
-          tlbLookups, \
-          tlbMisses, \
-          tlbMisses * 100.0 / tlbLookups, \
-          (tlbGlobalFlushes+tlbNonGlobalFlushes), \
-          (tlbGlobalFlushes+tlbNonGlobalFlushes) * 100.0 / tlbLookups \
-          )); \
-    tlbLookups = tlbMisses = tlbGlobalFlushes = tlbNonGlobalFlushes = 0; \
-    } \
-  }
-#define InstrTLB_Increment(v) (v)++
-
+// TLB statistics, see BX_CPU_STATISTICS
+#if BX_CPU_STATISTICS
+#define InstrTLB_Increment(v) (BX_CPU_THIS_PTR stats.v)++
 #else
-#define InstrTLB_Stats()
 #define InstrTLB_Increment(v)
 #endif
 
 // ==============================================================
 
+void BX_CPU_C::TLB_init(void)
+{
+  unsigned sets = SIM->get_param_num(BXPN_CPU_TLB_SIZE)->get() / BX_TLB_WAYS;
+  while (sets & (sets-1)) sets &= sets-1; // must be a power of 2
+
+  BX_CPU_THIS_PTR TLB.sets = sets;
+  BX_CPU_THIS_PTR TLB.mask = (sets-1) << 12;
+  BX_CPU_THIS_PTR TLB.n_asids = SIM->get_param_num(BXPN_CPU_TLB_ASIDS)->get();
+  if (BX_CPU_THIS_PTR TLB.n_asids > 1)
+    pageWriteStampTable.enablePageTableTracking();
+  delete [] BX_CPU_THIS_PTR TLB.entries;
+  BX_CPU_THIS_PTR TLB.entries =
+      new bx_TLB_entry[BX_CPU_THIS_PTR TLB.n_asids * BX_TLB_WAYS * sets];
+  BX_CPU_THIS_PTR TLB.lru_clock = 0;
+  BX_CPU_THIS_PTR TLB.walker_write = 0;
+  BX_CPU_THIS_PTR TLB.asid = 0;
+#if BX_CPU_LEVEL >= 5
+  BX_CPU_THIS_PTR TLB.split_large = 0;
+#endif
+
+  for (unsigned n=0; n < BX_CPU_THIS_PTR TLB.n_asids; n++) {
+    BX_CPU_THIS_PTR TLB.space[n].cr3 = 0;
+    BX_CPU_THIS_PTR TLB.space[n].lru_stamp = 0;
+    BX_CPU_THIS_PTR TLB.space[n].valid = 0;
+    TLB_flushAddressSpace(n);
+  }
+
+  BX_CPU_THIS_PTR TLB.space[0].valid = 1;
+  TLB_activateAddressSpace(0);
+
+#if BX_CPU_LEVEL >= 6
+  PSC_flush();
+  BX_CPU_THIS_PTR PSC.lookups = 0;
+  for (unsigned level=0; level<3; level++)
+    BX_CPU_THIS_PTR PSC.hits[level] = 0;
+#endif
+
+  BX_INFO(("TLB: %u entries, %u-way set associative, %u address space(s)",
+      sets * BX_TLB_WAYS, BX_TLB_WAYS, BX_CPU_THIS_PTR TLB.n_asids));
+}
+
+// Invalidate all the entries of the address space, the entries of the
+// active address space are flushed but its split_large indication should
+// be updated by the caller.
+void BX_CPU_C::TLB_flushAddressSpace(unsigned asid)
+{
+  unsigned size = BX_TLB_WAYS * BX_CPU_THIS_PTR TLB.sets;
+  bx_TLB_entry *tlbEntry = BX_CPU_THIS_PTR TLB.entries + asid * size;
+
+  for (unsigned n=0; n<size; n++, tlbEntry++) {
+    tlbEntry->lpf = BX_INVALID_TLB_ENTRY;
+  }
+
+  BX_CPU_THIS_PTR TLB.space[asid].dirty = 0;
+#if BX_CPU_LEVEL >= 5
+  BX_CPU_THIS_PTR TLB.space[asid].split_large = 0;
+#endif
+}
+
+void BX_CPU_C::TLB_activateAddressSpace(unsigned asid)
+{
+  unsigned sets = BX_CPU_THIS_PTR TLB.sets;
+
+#if BX_CPU_LEVEL >= 5
+  BX_CPU_THIS_PTR TLB.space[BX_CPU_THIS_PTR TLB.asid].split_large =
+      BX_CPU_THIS_PTR TLB.split_large;
+  BX_CPU_THIS_PTR TLB.split_large = BX_CPU_THIS_PTR TLB.space[asid].split_large;
+#endif
+
+  BX_CPU_THIS_PTR TLB.asid = asid;
+  BX_CPU_THIS_PTR TLB.space[asid].lru_stamp = ++BX_CPU_THIS_PTR TLB.lru_clock;
+  BX_CPU_THIS_PTR TLB.entry = BX_CPU_THIS_PTR TLB.entries + asid * BX_TLB_WAYS * sets;
+  BX_CPU_THIS_PTR TLB.way1  = BX_CPU_THIS_PTR TLB.entry + sets;
+}
+
+// With more than one address space configured the TLB keeps entries
+// of the recently used CR3 values around instead of flushing them on
+// every CR3 reload. The entries are valid as long as the paging
+// structures they were built from are not modified, the page walker
+// marks the PDE/PTE cache lines in the pageWriteStampTable (separately
+// from the iCache lines) and any write to them ends in
+// TLB_pageTableWrite(), which drops the inactive address spaces and
+// prevents the active one from being kept over the next CR3 reload. Only legacy 32-bit paging is tracked, PAE and long
+// mode page walks fall back to the flush on every CR3 reload.
+bx_bool BX_CPU_C::TLB_switchAddressSpace(void)
+{
+  if (BX_CPU_THIS_PTR TLB.n_asids < 2) return 0;
+
+#if BX_CPU_LEVEL >= 6
+  if (BX_CPU_THIS_PTR cr4.get_PAE()) return 0;
+#endif
+#if BX_SUPPORT_VMX
+  if (BX_CPU_THIS_PTR in_vmx_guest) return 0;
+#endif
+
+  InstrTLB_Increment(tlbAddressSpaceSwitches);
+
+  invalidate_prefetch_q();
+
+  unsigned asid = BX_CPU_THIS_PTR TLB.asid;
+  if (BX_CPU_THIS_PTR TLB.space[asid].dirty) {
+    TLB_flushAddressSpace(asid);
+#if BX_CPU_LEVEL >= 5
+    BX_CPU_THIS_PTR TLB.split_large = 0;
+#endif
+  }
+
+  bx_phy_address cr3 = BX_CPU_THIS_PTR cr3 & BX_CR3_PAGING_MASK;
+  unsigned victim = asid;
+
+  for (unsigned n=0; n < BX_CPU_THIS_PTR TLB.n_asids; n++) {
+    if (! BX_CPU_THIS_PTR TLB.space[n].valid) {
+      if (BX_CPU_THIS_PTR TLB.space[victim].valid) victim = n;
+      continue;
+    }
+    if (BX_CPU_THIS_PTR TLB.space[n].cr3 == cr3) {
+      TLB_activateAddressSpace(n);
+      goto done;
+    }
+    if (BX_CPU_THIS_PTR TLB.space[victim].valid &&
+        BX_CPU_THIS_PTR TLB.space[n].lru_stamp < BX_CPU_THIS_PTR TLB.space[victim].lru_stamp)
+    {
+      victim = n;
+    }
+  }
+
+  // CR3 not found, reuse the least recently used address space
+  InstrTLB_Increment(tlbAddressSpaceMisses);
+  TLB_flushAddressSpace(victim);
+  BX_CPU_THIS_PTR TLB.space[victim].cr3 = cr3;
+  BX_CPU_THIS_PTR TLB.space[victim].valid = 1;
+  TLB_activateAddressSpace(victim);
+#if BX_CPU_LEVEL >= 5
+  BX_CPU_THIS_PTR TLB.split_large = 0;
+#endif
+
+done:
+
+#if BX_SUPPORT_MONITOR_MWAIT
+  BX_CPU_THIS_PTR monitor.reset_monitor();
+#endif
+
+  return 1;
+}
+
+// Paging structures cached by the TLB might have been modified
+void BX_CPU_C::TLB_pageTableWrite(void)
+{
+  if (BX_CPU_THIS_PTR TLB.n_asids < 2) return;
+
+  for (unsigned n=0; n < BX_CPU_THIS_PTR TLB.n_asids; n++) {
+    if (n != BX_CPU_THIS_PTR TLB.asid && BX_CPU_THIS_PTR TLB.space[n].valid) {
+      TLB_flushAddressSpace(n);
+      BX_CPU_THIS_PTR TLB.space[n].valid = 0;
+    }
+  }
+
+  BX_CPU_THIS_PTR TLB.space[BX_CPU_THIS_PTR TLB.asid].dirty = 1;
+}
+
 void BX_CPU_C::TLB_flush(void)
 {
 #if InstrumentTLB
@@ -375,14 +515,27 @@ void BX_CPU_C::TLB_flush(void)
 
   invalidate_prefetch_q();
 
-  for (unsigned n=0; n<BX_TLB_SIZE; n++) {
-    BX_CPU_THIS_PTR TLB.entry[n].lpf = BX_INVALID_TLB_ENTRY;
+  unsigned asid = BX_CPU_THIS_PTR TLB.asid;
+
+  for (unsigned n=0; n < BX_CPU_THIS_PTR TLB.n_asids; n++) {
+    if (n == asid || BX_CPU_THIS_PTR TLB.space[n].valid) {
+      TLB_flushAddressSpace(n);
+      BX_CPU_THIS_PTR TLB.space[n].valid = 0;
+    }
   }
 
+  // the active address space belongs to current CR3 now
+  BX_CPU_THIS_PTR TLB.space[asid].cr3 = BX_CPU_THIS_PTR cr3 & BX_CR3_PAGING_MASK;
+  BX_CPU_THIS_PTR TLB.space[asid].valid = 1;
+
 #if BX_CPU_LEVEL >= 5
   BX_CPU_THIS_PTR TLB.split_large = 0;  // flush whole TLB
 #endif
 
+#if BX_CPU_LEVEL >= 6
+  PSC_flush();
+#endif
+
 #if BX_SUPPORT_MONITOR_MWAIT
   // invalidating of the TLB might change translation for monitored page
   // and cause subsequent MWAIT instruction to wait forever
@@ -401,7 +554,8 @@ void BX_CPU_C::TLB_flushNonGlobal(void)
 
   BX_CPU_THIS_PTR TLB.split_large = 0;
 
-  for (unsigned n=0; n<BX_TLB_SIZE; n++) {
+  unsigned size = BX_TLB_WAYS * BX_CPU_THIS_PTR TLB.sets;
+  for (unsigned n=0; n<size; n++) {
     bx_TLB_entry *tlbEntry = &BX_CPU_THIS_PTR TLB.entry[n];
     if (!(tlbEntry->accessBits & TLB_GlobalPage)) {
       tlbEntry->lpf = BX_INVALID_TLB_ENTRY;
@@ -412,6 +566,18 @@ void BX_CPU_C::TLB_flushNonGlobal(void)
     }
   }
 
+  // entries of the other address spaces are not retained in this mode
+  for (unsigned n=0; n < BX_CPU_THIS_PTR TLB.n_asids; n++) {
+    if (n != BX_CPU_THIS_PTR TLB.asid && BX_CPU_THIS_PTR TLB.space[n].valid) {
+      TLB_flushAddressSpace(n);
+      BX_CPU_THIS_PTR TLB.space[n].valid = 0;
+    }
+  }
+  BX_CPU_THIS_PTR TLB.space[BX_CPU_THIS_PTR TLB.asid].cr3 =
+      BX_CPU_THIS_PTR cr3 & BX_CR3_PAGING_MASK;
+
+  PSC_flush();
+
 #if BX_SUPPORT_MONITOR_MWAIT
   // invalidating of the TLB might change translation for monitored page
   // and cause subsequent MWAIT instruction to wait forever
@@ -420,6 +586,9 @@ void BX_CPU_C::TLB_flushNonGlobal(void)
 }
 #endif
 
+// Entries of the inactive address spaces don't have to be invalidated,
+// the paging structure modification which INVLPG follows already dropped
+// them (see TLB_pageTableWrite).
 void BX_CPU_C::TLB_invlpg(bx_address laddr)
 {
   invalidate_prefetch_q();
@@ -431,7 +600,8 @@ void BX_CPU_C::TLB_invlpg(bx_address laddr)
 
   if (BX_CPU_THIS_PTR TLB.split_large) {
     // make sure INVLPG handles correctly large pages
-    for (unsigned n=0; n<BX_TLB_SIZE; n++) {
+    unsigned size = BX_TLB_WAYS * BX_CPU_THIS_PTR TLB.sets;
+    for (unsigned n=0; n<size; n++) {
       bx_TLB_entry *tlbEntry = &BX_CPU_THIS_PTR TLB.entry[n];
       bx_address lpf_mask = tlbEntry->lpf_mask;
       if ((laddr & ~lpf_mask) == (tlbEntry->lpf & ~lpf_mask)) {
@@ -453,8 +623,16 @@ void BX_CPU_C::TLB_invlpg(bx_address laddr)
     if (TLB_LPFOf(tlbEntry->lpf) == lpf) {
       tlbEntry->lpf = BX_INVALID_TLB_ENTRY;
     }
+    tlbEntry = &BX_CPU_THIS_PTR TLB.way1[TLB_index];
+    if (TLB_LPFOf(tlbEntry->lpf) == lpf) {
+      tlbEntry->lpf = BX_INVALID_TLB_ENTRY;
+    }
   }
 
+#if BX_CPU_LEVEL >= 6
+  PSC_flush();
+#endif
+
 #if BX_SUPPORT_MONITOR_MWAIT
   // invalidating of the TLB entry might change translation for monitored
   // page and cause subsequent MWAIT instruction to wait forever
@@ -526,6 +704,61 @@ static const char *bx_paging_level[4] = { "PTE", "PDE", "PDPE", "PML4" };
 
 #if BX_CPU_LEVEL >= 6
 
+// Like the paging-structure caches of real CPUs the cache is flushed
+// entirely on every TLB flush, including INVLPG of any address.
+void BX_CPU_C::PSC_flush(void)
+{
+  for (unsigned level=0; level<3; level++) {
+    for (unsigned n=0; n<BX_PSC_SIZE; n++) {
+      BX_CPU_THIS_PTR PSC.entry[level][n].tag = BX_INVALID_TLB_ENTRY;
+    }
+  }
+}
+
+// Find the deepest cached paging entry mapping the linear address at
+// levels BX_LEVEL_PDE..max_level. Returns the level the page walk should
+// continue from, max_level if nothing was found.
+int BX_CPU_C::PSC_lookup(bx_address laddr, int max_level, bx_phy_address &ppf, Bit32u &combined_access, bx_bool &nx)
+{
+  BX_CPU_THIS_PTR PSC.lookups++;
+
+  for (int level = BX_LEVEL_PDE; level <= max_level; level++) {
+    bx_address tag = laddr >> (12 + 9*level);
+    bx_PSC_entry *pscEntry = &BX_CPU_THIS_PTR PSC.entry[level-1][tag & (BX_PSC_SIZE-1)];
+    if (pscEntry->tag == tag) {
+      BX_CPU_THIS_PTR PSC.hits[level-1]++;
+      ppf = pscEntry->ppf;
+      combined_access = pscEntry->combined_access;
+      nx = pscEntry->nx;
+      return level-1;
+    }
+  }
+
+  return max_level;
+}
+
+void BX_CPU_C::PSC_update(bx_address laddr, int level, bx_phy_address ppf, Bit32u combined_access, bx_bool nx)
+{
+  bx_address tag = laddr >> (12 + 9*level);
+  bx_PSC_entry *pscEntry = &BX_CPU_THIS_PTR PSC.entry[level-1][tag & (BX_PSC_SIZE-1)];
+
+  pscEntry->tag = tag;
+  pscEntry->ppf = ppf;
+  pscEntry->combined_access = combined_access;
+  pscEntry->nx = nx;
+}
+
+void BX_CPU_C::reportPSCStats(void)
+{
+  Bit64u lookups = BX_CPU_THIS_PTR PSC.lookups;
+  if (lookups == 0) return;
+
+  Bit64u *hits = BX_CPU_THIS_PTR PSC.hits;
+  BX_INFO(("PSC lookups: " FMT_LL "u, PDE hits: " FMT_LL "u, PDPTE hits: " FMT_LL "u, PML4E hits: " FMT_LL "u, hit rate = %6.2f%%",
+          lookups, hits[0], hits[1], hits[2],
+          (hits[0] + hits[1] + hits[2]) * 100.0 / lookups));
+}
+
 int BX_CPU_C::check_entry_PAE(const char *s, Bit64u entry, Bit64u reserved, unsigned rw, bx_bool *nx_fault)
 {
   if (!(entry & 0x1)) {
@@ -652,12 +885,26 @@ bx_phy_address BX_CPU_C::translate_linear_long_mode(bx_address laddr, Bit32u &lp
   bx_phy_address entry_addr[4];
   bx_phy_address ppf = BX_CPU_THIS_PTR cr3 & BX_CR3_PAGING_MASK;
   Bit64u entry[4];
-  bx_bool nx_fault = 0;
+  Bit32u access[4];
+  bx_bool nx[4], nx_bit = 0, nx_fault = 0;
   unsigned pl = (curr_pl == 3);
   int leaf = BX_LEVEL_PTE;
   combined_access = 0x06;
 
-  for (leaf = BX_LEVEL_PML4;; --leaf) {
+  // skip the paging structures found in the paging-structure cache
+  int start = PSC_lookup(laddr, BX_LEVEL_PML4, ppf, combined_access, nx_bit);
+  if (nx_bit) {
+    if (! BX_CPU_THIS_PTR efer.get_NXE()) {
+      // NX bit became reserved, let the full walk report it
+      start = BX_LEVEL_PML4;
+      ppf = BX_CPU_THIS_PTR cr3 & BX_CR3_PAGING_MASK;
+      combined_access = 0x06;
+      nx_bit = 0;
+    }
+    else if (rw == BX_EXECUTE) nx_fault = 1;
+  }
+
+  for (leaf = start;; --leaf) {
     entry_addr[leaf] = ppf + ((laddr >> (9 + 9*leaf)) & 0xff8);
 #if BX_SUPPORT_VMX >= 2
     if (BX_CPU_THIS_PTR in_vmx_guest) {
@@ -676,6 +923,10 @@ bx_phy_address BX_CPU_C::translate_linear_long_mode(bx_address laddr, Bit32u &lp
     combined_access &= curr_entry & 0x06; // U/S and R/W
     ppf = curr_entry & BX_CONST64(0x000ffffffffff000);
 
+    if (curr_entry & PAGE_DIRECTORY_NX_BIT) nx_bit = 1;
+    access[leaf] = combined_access;
+    nx[leaf] = nx_bit;
+
     if (leaf == BX_LEVEL_PTE) break;
 
     if (curr_entry & 0x80) {
@@ -723,19 +974,19 @@ bx_phy_address BX_CPU_C::translate_linear_long_mode(bx_address laddr, Bit32u &lp
     combined_access |= (entry[leaf] & 0x100); // G
 
   // Update A bit if needed.
-  for (int level=BX_LEVEL_PML4; level > leaf; level--) {
+  for (int level=start; level > leaf; level--) {
     if (!(entry[level] & 0x20)) {
-      entry[level] |= 0x20;
-      access_write_physical(entry_addr[level], 8, &entry[level]);
+      update_paging_entry(entry_addr[level], 8, &entry[level], 0x20);
       BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, entry_addr[level], 8,
             (BX_PTE_ACCESS + (level<<4)) | BX_WRITE, (Bit8u*)(&entry[level]));
     }
+    PSC_update(laddr, level, entry[level] & BX_CONST64(0x000ffffffffff000), access[level], nx[level]);
   }
 
   // Update A/D bits if needed.
   if (!(entry[leaf] & 0x20) || (isWrite && !(entry[leaf] & 0x40))) {
-    entry[leaf] |= (0x20 | (isWrite<<6)); // Update A and possibly D bits
-    access_write_physical(entry_addr[leaf], 8, &entry[leaf]);
+    // Update A and possibly D bits
+    update_paging_entry(entry_addr[leaf], 8, &entry[leaf], 0x20 | (isWrite<<6));
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, entry_addr[leaf], 8, 
             (BX_PTE_ACCESS + (leaf<<4)) | BX_WRITE, (Bit8u*)(&entry[leaf]));
   }
@@ -812,9 +1063,10 @@ bx_phy_address BX_CPU_C::translate_linear_PAE(bx_address laddr, Bit32u &lpf_mask
 {
   bx_phy_address entry_addr[3], ppf;
   Bit64u entry[3];
-  bx_bool nx_fault = 0;
+  Bit32u pde_access = 0;
+  bx_bool nx_bit = 0, nx_fault = 0;
   unsigned pl = (curr_pl == 3);
-  int leaf = BX_LEVEL_PTE;
+  int leaf = BX_LEVEL_PTE, fault;
   combined_access = 0x06;
 
 #if BX_SUPPORT_X86_64
@@ -831,44 +1083,66 @@ bx_phy_address BX_CPU_C::translate_linear_PAE(bx_address laddr, Bit32u &lpf_mask
     }
   }
 
-  entry[BX_LEVEL_PDPE] = BX_CPU_THIS_PTR PDPTR_CACHE.entry[(laddr >> 30) & 3];
+  // the page table might be found in the paging-structure cache
+  int start = PSC_lookup(laddr, BX_LEVEL_PDE, ppf, combined_access, nx_bit);
+#if BX_SUPPORT_X86_64
+  if (nx_bit) {
+    if (! BX_CPU_THIS_PTR efer.get_NXE()) {
+      // NX bit became reserved, let the full walk report it
+      start = BX_LEVEL_PDE;
+      combined_access = 0x06;
+      nx_bit = 0;
+    }
+    else if (rw == BX_EXECUTE) nx_fault = 1;
+  }
+#endif
 
-  int fault = check_entry_PAE("PDPE", entry[BX_LEVEL_PDPE], PAGING_PAE_PDPTE_RESERVED_BITS, rw, &nx_fault);
-  if (fault >= 0)
-    page_fault(fault, laddr, pl, rw);
+  if (start == BX_LEVEL_PDE) {
+    entry[BX_LEVEL_PDPE] = BX_CPU_THIS_PTR PDPTR_CACHE.entry[(laddr >> 30) & 3];
 
-  entry_addr[BX_LEVEL_PDE] = (bx_phy_address)((entry[BX_LEVEL_PDPE] & BX_CONST64(0x000ffffffffff000))
-                         | ((laddr & 0x3fe00000) >> 18));
+    fault = check_entry_PAE("PDPE", entry[BX_LEVEL_PDPE], PAGING_PAE_PDPTE_RESERVED_BITS, rw, &nx_fault);
+    if (fault >= 0)
+      page_fault(fault, laddr, pl, rw);
+
+    entry_addr[BX_LEVEL_PDE] = (bx_phy_address)((entry[BX_LEVEL_PDPE] & BX_CONST64(0x000ffffffffff000))
+                           | ((laddr & 0x3fe00000) >> 18));
 #if BX_SUPPORT_VMX >= 2
-  if (BX_CPU_THIS_PTR in_vmx_guest) {
-    if (SECONDARY_VMEXEC_CONTROL(VMX_VM_EXEC_CTRL3_EPT_ENABLE))
-      entry_addr[BX_LEVEL_PDE] = translate_guest_physical(entry_addr[BX_LEVEL_PDE], laddr, 1, 1, BX_READ);
-  }
+    if (BX_CPU_THIS_PTR in_vmx_guest) {
+      if (SECONDARY_VMEXEC_CONTROL(VMX_VM_EXEC_CTRL3_EPT_ENABLE))
+        entry_addr[BX_LEVEL_PDE] = translate_guest_physical(entry_addr[BX_LEVEL_PDE], laddr, 1, 1, BX_READ);
+    }
 #endif
-  access_read_physical(entry_addr[BX_LEVEL_PDE], 8, &entry[BX_LEVEL_PDE]);
-  BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, entry_addr[BX_LEVEL_PDE], 8, BX_PDE_ACCESS | BX_READ, (Bit8u*)(&entry[BX_LEVEL_PDE]));
+    access_read_physical(entry_addr[BX_LEVEL_PDE], 8, &entry[BX_LEVEL_PDE]);
+    BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, entry_addr[BX_LEVEL_PDE], 8, BX_PDE_ACCESS | BX_READ, (Bit8u*)(&entry[BX_LEVEL_PDE]));
 
-  fault = check_entry_PAE("PDE", entry[BX_LEVEL_PDE], PAGING_PAE_RESERVED_BITS, rw, &nx_fault);
-  if (fault >= 0)
-    page_fault(fault, laddr, pl, rw);
+    fault = check_entry_PAE("PDE", entry[BX_LEVEL_PDE], PAGING_PAE_RESERVED_BITS, rw, &nx_fault);
+    if (fault >= 0)
+      page_fault(fault, laddr, pl, rw);
 
-  combined_access &= entry[BX_LEVEL_PDE] & 0x06; // U/S and R/W
+    combined_access &= entry[BX_LEVEL_PDE] & 0x06; // U/S and R/W
+#if BX_SUPPORT_X86_64
+    if (entry[BX_LEVEL_PDE] & PAGE_DIRECTORY_NX_BIT) nx_bit = 1;
+#endif
 
-  // Ignore CR4.PSE in PAE mode
-  if (entry[BX_LEVEL_PDE] & 0x80) {
-    if (entry[BX_LEVEL_PDE] & PAGING_PAE_PDE2M_RESERVED_BITS) {
-      BX_DEBUG(("PAE PDE2M: reserved bit is set PDE=%08x:%08x", GET32H(entry[BX_LEVEL_PDE]), GET32L(entry[BX_LEVEL_PDE])));
-      page_fault(ERROR_RESERVED | ERROR_PROTECTION, laddr, pl, rw);
-    }
+    // Ignore CR4.PSE in PAE mode
+    if (entry[BX_LEVEL_PDE] & 0x80) {
+      if (entry[BX_LEVEL_PDE] & PAGING_PAE_PDE2M_RESERVED_BITS) {
+        BX_DEBUG(("PAE PDE2M: reserved bit is set PDE=%08x:%08x", GET32H(entry[BX_LEVEL_PDE]), GET32L(entry[BX_LEVEL_PDE])));
+        page_fault(ERROR_RESERVED | ERROR_PROTECTION, laddr, pl, rw);
+      }
 
-    ppf = (bx_phy_address)((entry[BX_LEVEL_PDE] & BX_CONST64(0x000fffffffe00000)) | (laddr & 0x001ff000));
-    lpf_mask = 0x1fffff;
-    leaf = BX_LEVEL_PDE;
+      ppf = (bx_phy_address)((entry[BX_LEVEL_PDE] & BX_CONST64(0x000fffffffe00000)) | (laddr & 0x001ff000));
+      lpf_mask = 0x1fffff;
+      leaf = BX_LEVEL_PDE;
+    }
+    else {
+      ppf = (bx_phy_address)(entry[BX_LEVEL_PDE] & BX_CONST64(0x000ffffffffff000));
+    }
   }
-  else {
+
+  if (leaf == BX_LEVEL_PTE) {
     // 4k pages, Get page table entry.
-    entry_addr[BX_LEVEL_PTE] = (bx_phy_address)((entry[BX_LEVEL_PDE] & BX_CONST64(0x000ffffffffff000)) |
-                           ((laddr & 0x001ff000) >> 9));
+    entry_addr[BX_LEVEL_PTE] = ppf | ((laddr & 0x001ff000) >> 9);
 #if BX_SUPPORT_VMX >= 2
     if (BX_CPU_THIS_PTR in_vmx_guest) {
       if (SECONDARY_VMEXEC_CONTROL(VMX_VM_EXEC_CTRL3_EPT_ENABLE))
@@ -882,6 +1156,7 @@ bx_phy_address BX_CPU_C::translate_linear_PAE(bx_address laddr, Bit32u &lpf_mask
     if (fault >= 0)
       page_fault(fault, laddr, pl, rw);
 
+    pde_access = combined_access;
     combined_access &= entry[BX_LEVEL_PTE] & 0x06; // U/S and R/W
 
     // Make up the physical page frame address.
@@ -901,20 +1176,20 @@ bx_phy_address BX_CPU_C::translate_linear_PAE(bx_address laddr, Bit32u &lpf_mask
   if (BX_CPU_THIS_PTR cr4.get_PGE())
     combined_access |= (entry[leaf] & 0x100);     // G
 
-  if (leaf == BX_LEVEL_PTE) {
+  if (leaf == BX_LEVEL_PTE && start == BX_LEVEL_PDE) {
     // Update PDE A bit if needed.
     if (!(entry[BX_LEVEL_PDE] & 0x20)) {
-      entry[BX_LEVEL_PDE] |= 0x20;
-      access_write_physical(entry_addr[BX_LEVEL_PDE], 8, &entry[BX_LEVEL_PDE]);
+      update_paging_entry(entry_addr[BX_LEVEL_PDE], 8, &entry[BX_LEVEL_PDE], 0x20);
       BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, entry_addr[BX_LEVEL_PDE], 8,
              (BX_PDE_ACCESS | BX_WRITE), (Bit8u*)(&entry[BX_LEVEL_PDE]));
     }
+    PSC_update(laddr, BX_LEVEL_PDE, entry[BX_LEVEL_PDE] & BX_CONST64(0x000ffffffffff000), pde_access, nx_bit);
   }
 
   // Update A/D bits if needed.
   if (!(entry[leaf] & 0x20) || (isWrite && !(entry[leaf] & 0x40))) {
-    entry[leaf] |= (0x20 | (isWrite<<6)); // Update A and possibly D bits
-    access_write_physical(entry_addr[leaf], 8, &entry[leaf]);
+    // Update A and possibly D bits
+    update_paging_entry(entry_addr[leaf], 8, &entry[leaf], 0x20 | (isWrite<<6));
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, entry_addr[leaf], 8,
              (BX_PTE_ACCESS + (leaf<<4)) | BX_WRITE, (Bit8u*)(&entry[leaf]));
   }
@@ -945,6 +1220,15 @@ bx_phy_address BX_CPU_C::translate_linear_PAE(bx_address laddr, Bit32u &lpf_mask
 #define PAGING_PDE4M_RESERVED_BITS \
     (((1 << (41-BX_PHY_ADDRESS_WIDTH))-1) << (13 + BX_PHY_ADDRESS_WIDTH - 32))
 
+// Accessed/Dirty bits updates done by the page walker don't change any
+// translation cached in the TLB and must not drop the retained address
+// spaces (see TLB_switchAddressSpace).
+#define BX_UPDATE_PAGING_ENTRY(addr, data, bits) { \
+  BX_CPU_THIS_PTR TLB.walker_write = 1;               \
+  update_paging_entry((addr), 4, (data), (bits));     \
+  BX_CPU_THIS_PTR TLB.walker_write = 0;               \
+}
+
 // Translate a linear address to a physical address
 bx_phy_address BX_CPU_C::translate_linear(bx_address laddr, unsigned curr_pl, unsigned rw)
 {
@@ -958,19 +1242,19 @@ bx_phy_address BX_CPU_C::translate_linear(bx_address laddr, unsigned curr_pl, un
   bx_bool isWrite = rw & 1; // write or r-m-w
   unsigned pl = (curr_pl == 3);
 
-  InstrTLB_Increment(tlbLookups);
-  InstrTLB_Stats();
+  InstrTLB_Increment(tlbSlowPathLookups);
 
   bx_address lpf = LPFOf(laddr);
   unsigned TLB_index = BX_TLB_INDEX_OF(lpf, 0);
   bx_TLB_entry *tlbEntry = &BX_CPU_THIS_PTR TLB.entry[TLB_index];
+  bx_TLB_entry *tlbEntry1 = &BX_CPU_THIS_PTR TLB.way1[TLB_index];
+  bx_bool isExecute = (rw == BX_EXECUTE);
 
   // already looked up TLB for code access
   if (TLB_LPFOf(tlbEntry->lpf) == lpf)
   {
     paddress = tlbEntry->ppf | poffset;
 
-    bx_bool isExecute = (rw == BX_EXECUTE);
     if (! (tlbEntry->accessBits & ((isExecute<<2) | (isWrite<<1) | pl)))
       return paddress;
 
@@ -979,20 +1263,35 @@ bx_phy_address BX_CPU_C::translate_linear(bx_address laddr, unsigned curr_pl, un
     // updated information in the memory image, and let the long path code
     // generate an exception if one is warranted.
   }
+  else if (TLB_LPFOf(tlbEntry1->lpf) == lpf)
+  {
+    // Hit in the second way, swap the entries so the next access to the
+    // page will be served by the memory access fast path.
+    bx_TLB_entry tmpEntry = *tlbEntry;
+    *tlbEntry = *tlbEntry1;
+    *tlbEntry1 = tmpEntry;
+
+    paddress = tlbEntry->ppf | poffset;
+
+    if (! (tlbEntry->accessBits & ((isExecute<<2) | (isWrite<<1) | pl)))
+      return paddress;
+  }
+
+  InstrTLB_Increment(tlbMisses);
 
   if(BX_CPU_THIS_PTR cr0.get_PG())
   {
-    InstrTLB_Increment(tlbMisses);
-
     BX_DEBUG(("page walk for address 0x" FMT_LIN_ADDRX, laddr));
 
 #if BX_CPU_LEVEL >= 6
     if (BX_CPU_THIS_PTR cr4.get_PAE()) {
+      InstrTLB_Increment(pageWalks[long_mode() ? 2 : 1]);
       ppf = translate_linear_PAE(laddr, lpf_mask, combined_access, curr_pl, rw);
     }
     else
 #endif 
     {
+      InstrTLB_Increment(pageWalks[0]);
       // CR4.PAE==0 (and EFER.LMA==0)
       Bit32u pde, pte, cr3_masked = (Bit32u) BX_CPU_THIS_PTR cr3 & BX_CR3_PAGING_MASK;
 
@@ -1037,11 +1336,14 @@ bx_phy_address BX_CPU_C::translate_linear(bx_address laddr, unsigned curr_pl, un
 
         // Update PDE A/D bits if needed.
         if (!(pde & 0x20) || (isWrite && !(pde & 0x40))) {
-          pde |= (0x20 | (isWrite<<6)); // Update A and possibly D bits
-          access_write_physical(pde_addr, 4, &pde);
+          // Update A and possibly D bits
+          BX_UPDATE_PAGING_ENTRY(pde_addr, &pde, 0x20 | (isWrite<<6));
           BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, pde_addr, 4, BX_PDE_ACCESS | BX_WRITE, (Bit8u*)(&pde));
         }
 
+        if (BX_CPU_THIS_PTR TLB.n_asids > 1)
+          pageWriteStampTable.markPageTable(pde_addr);
+
         // make up the physical frame number
         ppf = (pde & 0xffc00000) | (laddr & 0x003ff000);
 #if BX_PHY_ADDRESS_WIDTH > 32
@@ -1094,18 +1396,22 @@ bx_phy_address BX_CPU_C::translate_linear(bx_address laddr, unsigned curr_pl, un
 
         // Update PDE A bit if needed.
         if (!(pde & 0x20)) {
-          pde |= 0x20;
-          access_write_physical(pde_addr, 4, &pde);
+          BX_UPDATE_PAGING_ENTRY(pde_addr, &pde, 0x20);
           BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, pde_addr, 4, BX_PDE_ACCESS | BX_WRITE, (Bit8u*)(&pde));
         }
 
         // Update PTE A/D bits if needed.
         if (!(pte & 0x20) || (isWrite && !(pte & 0x40))) {
-          pte |= (0x20 | (isWrite<<6)); // Update A and possibly D bits
-          access_write_physical(pte_addr, 4, &pte);
+          // Update A and possibly D bits
+          BX_UPDATE_PAGING_ENTRY(pte_addr, &pte, 0x20 | (isWrite<<6));
           BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID, pte_addr, 4, BX_PTE_ACCESS | BX_WRITE, (Bit8u*)(&pte));
         }
 
+        if (BX_CPU_THIS_PTR TLB.n_asids > 1) {
+          pageWriteStampTable.markPageTable(pde_addr);
+          pageWriteStampTable.markPageTable(pte_addr);
+        }
+
         // Make up the physical page frame address.
         ppf = pte & 0xfffff000;
       }
@@ -1132,6 +1438,12 @@ bx_phy_address BX_CPU_C::translate_linear(bx_address laddr, unsigned curr_pl, un
   // Calculate physical memory address and fill in TLB cache entry
   paddress = ppf | poffset;
 
+  // The entry being replaced moves to the second way
+  if (tlbEntry->lpf != BX_INVALID_TLB_ENTRY && TLB_LPFOf(tlbEntry->lpf) != lpf)
+    *tlbEntry1 = *tlbEntry;
+  else if (TLB_LPFOf(tlbEntry1->lpf) == lpf)
+    tlbEntry1->lpf = BX_INVALID_TLB_ENTRY;
+
   // direct memory access is NOT allowed by default
   tlbEntry->lpf = lpf | TLB_HostPtr;
   tlbEntry->lpf_mask = lpf_mask;
@@ -1649,6 +1961,30 @@ void BX_CPU_C::access_read_linear(bx_address laddr, unsigned len, unsigned curr_
     BX_CPU_THIS_PTR address_xlation.paddress1 =
         dtranslate_linear(laddr, curr_pl, xlate_rw);
     BX_CPU_THIS_PTR address_xlation.pages     = 1;
+#if BX_SUPPORT_ATOMIC_RMW
+    bx_hostpageaddr_t hostPageAddr = 0;
+    if (xlate_rw == BX_RW) {
+      // R-M-W access missed the TLB, use the host pointer anyway so the
+      // write back is atomic against the other CPU threads
+      hostPageAddr = getHostMemAddr(PPFOf(BX_CPU_THIS_PTR address_xlation.paddress1), BX_WRITE);
+      if (! hostPageAddr && bx_smp_self != NULL) {
+        // device or vetoed page, which the other CPU threads only write
+        // under the simulator lock: keep it until the instruction is done
+        bx_smp_lock_rmw();
+        BX_CPU_THIS_PTR set_async_event(1);
+      }
+    }
+    if (hostPageAddr) {
+      Bit8u *hostAddr = (Bit8u*) (hostPageAddr | pageOffset);
+      Bit64u val64 = 0;
+      pageWriteStampTable.decWriteStamp(BX_CPU_THIS_PTR address_xlation.paddress1, len);
+      memcpy(&val64, hostAddr, len);
+      memcpy(data, &val64, len);
+      BX_CPU_THIS_PTR address_xlation.rmw_value = val64;
+      BX_CPU_THIS_PTR address_xlation.pages = (bx_ptr_equiv_t) hostAddr;
+    }
+    else
+#endif
     access_read_physical(BX_CPU_THIS_PTR address_xlation.paddress1, len, data);
     BX_INSTR_LIN_ACCESS(BX_CPU_ID, laddr,
         BX_CPU_THIS_PTR address_xlation.paddress1, len, xlate_rw);
@@ -1657,6 +1993,10 @@ void BX_CPU_C::access_read_linear(bx_address laddr, unsigned len, unsigned curr_
         BX_READ, (Bit8u*) data);
   }
   else {
+#if BX_SUPPORT_ATOMIC_RMW
+    if (xlate_rw == BX_RW && bx_smp_self != NULL)
+      rmw_exclusive();
+#endif
     // access across 2 pages
     BX_CPU_THIS_PTR address_xlation.paddress1 =
         dtranslate_linear(laddr, curr_pl, xlate_rw);
@@ -1727,6 +2067,32 @@ void BX_CPU_C::access_write_physical(bx_phy_address paddr, unsigned len, void *d
   BX_MEM(0)->writePhysicalPage(BX_CPU_THIS, paddr, len, data);
 }
 
+// Set the Accessed/Dirty bits in a paging entry read by the page walker.
+// The other CPU threads walk and change the same paging structures, so
+// when the entry is in RAM the bits are ORed in atomically instead of
+// writing back the whole entry as it was read.
+void BX_CPU_C::update_paging_entry(bx_phy_address paddr, unsigned len, void *entry, Bit32u bits)
+{
+  if (len == 8)
+    *(Bit64u*) entry |= bits;
+  else
+    *(Bit32u*) entry |= bits;
+
+#if BX_SUPPORT_ATOMIC_RMW
+  if (bx_smp_self != NULL) {
+    bx_hostpageaddr_t hostPageAddr = getHostMemAddr(PPFOf(paddr), BX_WRITE);
+    if (hostPageAddr) {
+      pageWriteStampTable.decWriteStamp(paddr, len);
+      // the A/D bits are in the low dword of the entry
+      __sync_fetch_and_or((Bit32u*) (hostPageAddr | PAGE_OFFSET(paddr)), bits);
+      return;
+    }
+  }
+#endif
+
+  access_write_physical(paddr, len, entry);
+}
+
 void BX_CPU_C::access_read_physical(bx_phy_address paddr, unsigned len, void *data)
 {
 #if BX_SUPPORT_VMX >= 2
@@ -24,6 +24,7 @@
 #define NEED_CPU_REG_SHORTCUTS 1
 #include "bochs.h"
 #include "cpu.h"
+#include "host_simd.h"
 #define LOG_THIS BX_CPU_THIS_PTR
 
 /* ********************************************** */
@@ -918,6 +919,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKLBW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_unpacklo_epi8);
+#else
   op1.xmmubyte(0xF) = op2.xmmubyte(7);
   op1.xmmubyte(0xE) = op1.xmmubyte(7);
   op1.xmmubyte(0xD) = op2.xmmubyte(6);
@@ -934,6 +938,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKLBW_VdqWdqR(bxInstruction_c *i)
   op1.xmmubyte(0x2) = op1.xmmubyte(1);
   op1.xmmubyte(0x1) = op2.xmmubyte(0);
 //op1.xmmubyte(0x0) = op1.xmmubyte(0);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -946,6 +951,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKLWD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_unpacklo_epi16);
+#else
   op1.xmm16u(7) = op2.xmm16u(3);
   op1.xmm16u(6) = op1.xmm16u(3);
   op1.xmm16u(5) = op2.xmm16u(2);
@@ -954,6 +962,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKLWD_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(2) = op1.xmm16u(1);
   op1.xmm16u(1) = op2.xmm16u(0);
 //op1.xmm16u(0) = op1.xmm16u(0);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -983,6 +992,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PACKSSWB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_packs_epi16);
+#else
   op1.xmmsbyte(0x0) = SaturateWordSToByteS(op1.xmm16s(0));
   op1.xmmsbyte(0x1) = SaturateWordSToByteS(op1.xmm16s(1));
   op1.xmmsbyte(0x2) = SaturateWordSToByteS(op1.xmm16s(2));
@@ -1000,6 +1012,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PACKSSWB_VdqWdqR(bxInstruction_c *i)
   op1.xmmsbyte(0xD) = SaturateWordSToByteS(op2.xmm16s(5));
   op1.xmmsbyte(0xE) = SaturateWordSToByteS(op2.xmm16s(6));
   op1.xmmsbyte(0xF) = SaturateWordSToByteS(op2.xmm16s(7));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1012,9 +1025,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_cmpgt_epi8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmubyte(j) = (op1.xmmsbyte(j) > op2.xmmsbyte(j)) ? 0xff : 0;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1027,6 +1044,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_cmpgt_epi16);
+#else
   op1.xmm16u(0) = (op1.xmm16s(0) > op2.xmm16s(0)) ? 0xffff : 0;
   op1.xmm16u(1) = (op1.xmm16s(1) > op2.xmm16s(1)) ? 0xffff : 0;
   op1.xmm16u(2) = (op1.xmm16s(2) > op2.xmm16s(2)) ? 0xffff : 0;
@@ -1035,6 +1055,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = (op1.xmm16s(5) > op2.xmm16s(5)) ? 0xffff : 0;
   op1.xmm16u(6) = (op1.xmm16s(6) > op2.xmm16s(6)) ? 0xffff : 0;
   op1.xmm16u(7) = (op1.xmm16s(7) > op2.xmm16s(7)) ? 0xffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1047,10 +1068,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPGTD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_cmpgt_epi32);
+#else
   op1.xmm32u(0) = (op1.xmm32s(0) > op2.xmm32s(0)) ? 0xffffffff : 0;
   op1.xmm32u(1) = (op1.xmm32s(1) > op2.xmm32s(1)) ? 0xffffffff : 0;
   op1.xmm32u(2) = (op1.xmm32s(2) > op2.xmm32s(2)) ? 0xffffffff : 0;
   op1.xmm32u(3) = (op1.xmm32s(3) > op2.xmm32s(3)) ? 0xffffffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1063,6 +1088,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PACKUSWB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_packus_epi16);
+#else
   op1.xmmubyte(0x0) = SaturateWordSToByteU(op1.xmm16s(0));
   op1.xmmubyte(0x1) = SaturateWordSToByteU(op1.xmm16s(1));
   op1.xmmubyte(0x2) = SaturateWordSToByteU(op1.xmm16s(2));
@@ -1080,6 +1108,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PACKUSWB_VdqWdqR(bxInstruction_c *i)
   op1.xmmubyte(0xD) = SaturateWordSToByteU(op2.xmm16s(5));
   op1.xmmubyte(0xE) = SaturateWordSToByteU(op2.xmm16s(6));
   op1.xmmubyte(0xF) = SaturateWordSToByteU(op2.xmm16s(7));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1092,6 +1121,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKHBW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_unpackhi_epi8);
+#else
   op1.xmmubyte(0x0) = op1.xmmubyte(0x8);
   op1.xmmubyte(0x1) = op2.xmmubyte(0x8);
   op1.xmmubyte(0x2) = op1.xmmubyte(0x9);
@@ -1108,6 +1140,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKHBW_VdqWdqR(bxInstruction_c *i)
   op1.xmmubyte(0xD) = op2.xmmubyte(0xE);
   op1.xmmubyte(0xE) = op1.xmmubyte(0xF);
   op1.xmmubyte(0xF) = op2.xmmubyte(0xF);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1120,6 +1153,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKHWD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_unpackhi_epi16);
+#else
   op1.xmm16u(0) = op1.xmm16u(4);
   op1.xmm16u(1) = op2.xmm16u(4);
   op1.xmm16u(2) = op1.xmm16u(5);
@@ -1128,6 +1164,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PUNPCKHWD_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = op2.xmm16u(6);
   op1.xmm16u(6) = op1.xmm16u(7);
   op1.xmm16u(7) = op2.xmm16u(7);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1157,6 +1194,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PACKSSDW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_packs_epi32);
+#else
   op1.xmm16s(0) = SaturateDwordSToWordS(op1.xmm32s(0));
   op1.xmm16s(1) = SaturateDwordSToWordS(op1.xmm32s(1));
   op1.xmm16s(2) = SaturateDwordSToWordS(op1.xmm32s(2));
@@ -1166,6 +1206,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PACKSSDW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16s(5) = SaturateDwordSToWordS(op2.xmm32s(1));
   op1.xmm16s(6) = SaturateDwordSToWordS(op2.xmm32s(2));
   op1.xmm16s(7) = SaturateDwordSToWordS(op2.xmm32s(3));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1260,9 +1301,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_cmpeq_epi8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmubyte(j) = (op1.xmmubyte(j) == op2.xmmubyte(j)) ? 0xff : 0;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1275,6 +1320,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_cmpeq_epi16);
+#else
   op1.xmm16u(0) = (op1.xmm16u(0) == op2.xmm16u(0)) ? 0xffff : 0;
   op1.xmm16u(1) = (op1.xmm16u(1) == op2.xmm16u(1)) ? 0xffff : 0;
   op1.xmm16u(2) = (op1.xmm16u(2) == op2.xmm16u(2)) ? 0xffff : 0;
@@ -1283,6 +1331,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = (op1.xmm16u(5) == op2.xmm16u(5)) ? 0xffff : 0;
   op1.xmm16u(6) = (op1.xmm16u(6) == op2.xmm16u(6)) ? 0xffff : 0;
   op1.xmm16u(7) = (op1.xmm16u(7) == op2.xmm16u(7)) ? 0xffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1295,10 +1344,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PCMPEQD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_cmpeq_epi32);
+#else
   op1.xmm32u(0) = (op1.xmm32u(0) == op2.xmm32u(0)) ? 0xffffffff : 0;
   op1.xmm32u(1) = (op1.xmm32u(1) == op2.xmm32u(1)) ? 0xffffffff : 0;
   op1.xmm32u(2) = (op1.xmm32u(2) == op2.xmm32u(2)) ? 0xffffffff : 0;
   op1.xmm32u(3) = (op1.xmm32u(3) == op2.xmm32u(3)) ? 0xffffffff : 0;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1370,6 +1423,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_srl_epi16);
+#else
   if(op2.xmm64u(0) > 15)  /* looking only to low 64 bits */
   {
     op1.xmm64u(0) = 0;
@@ -1388,6 +1444,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLW_VdqWdqR(bxInstruction_c *i)
     op1.xmm16u(6) >>= shift;
     op1.xmm16u(7) >>= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1400,6 +1457,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_srl_epi32);
+#else
   if(op2.xmm64u(0) > 31)  /* looking only to low 64 bits */
   {
     op1.xmm64u(0) = 0;
@@ -1414,6 +1474,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLD_VdqWdqR(bxInstruction_c *i)
     op1.xmm32u(2) >>= shift;
     op1.xmm32u(3) >>= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1426,6 +1487,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLQ_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_srl_epi64);
+#else
   if(op2.xmm64u(0) > 63)  /* looking only to low 64 bits */
   {
     op1.xmm64u(0) = 0;
@@ -1438,6 +1502,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRLQ_VdqWdqR(bxInstruction_c *i)
     op1.xmm64u(0) >>= shift;
     op1.xmm64u(1) >>= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1450,8 +1515,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDQ_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_add_epi64);
+#else
   op1.xmm64u(0) += op2.xmm64u(0);
   op1.xmm64u(1) += op2.xmm64u(1);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1464,6 +1533,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULLW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_mullo_epi16);
+#else
   Bit32u product1 = Bit32u(op1.xmm16u(0)) * Bit32u(op2.xmm16u(0));
   Bit32u product2 = Bit32u(op1.xmm16u(1)) * Bit32u(op2.xmm16u(1));
   Bit32u product3 = Bit32u(op1.xmm16u(2)) * Bit32u(op2.xmm16u(2));
@@ -1481,6 +1553,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULLW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = product6 & 0xffff;
   op1.xmm16u(6) = product7 & 0xffff;
   op1.xmm16u(7) = product8 & 0xffff;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1493,6 +1566,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBUSB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_subs_epu8);
+#else
   for(unsigned j=0; j<16; j++)
   {
       if(op1.xmmubyte(j) > op2.xmmubyte(j))
@@ -1503,6 +1579,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBUSB_VdqWdqR(bxInstruction_c *i)
           op1.xmmubyte(j) = 0;
       }
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1515,6 +1592,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBUSW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_subs_epu16);
+#else
   for(unsigned j=0; j<8; j++)
   {
       if(op1.xmm16u(j) > op2.xmm16u(j))
@@ -1525,6 +1605,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBUSW_VdqWdqR(bxInstruction_c *i)
            op1.xmm16u(j) = 0;
       }
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1537,9 +1618,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMINUB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_min_epu8);
+#else
   for(unsigned j=0; j<16; j++) {
     if(op2.xmmubyte(j) < op1.xmmubyte(j)) op1.xmmubyte(j) = op2.xmmubyte(j);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1568,9 +1653,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDUSB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_adds_epu8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmubyte(j) = SaturateWordSToByteU(Bit16s(op1.xmmubyte(j)) + Bit16s(op2.xmmubyte(j)));
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1583,6 +1672,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDUSW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_adds_epu16);
+#else
   op1.xmm16u(0) = SaturateDwordSToWordU(Bit32s(op1.xmm16u(0)) + Bit32s(op2.xmm16u(0)));
   op1.xmm16u(1) = SaturateDwordSToWordU(Bit32s(op1.xmm16u(1)) + Bit32s(op2.xmm16u(1)));
   op1.xmm16u(2) = SaturateDwordSToWordU(Bit32s(op1.xmm16u(2)) + Bit32s(op2.xmm16u(2)));
@@ -1591,6 +1683,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDUSW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = SaturateDwordSToWordU(Bit32s(op1.xmm16u(5)) + Bit32s(op2.xmm16u(5)));
   op1.xmm16u(6) = SaturateDwordSToWordU(Bit32s(op1.xmm16u(6)) + Bit32s(op2.xmm16u(6)));
   op1.xmm16u(7) = SaturateDwordSToWordU(Bit32s(op1.xmm16u(7)) + Bit32s(op2.xmm16u(7)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1603,9 +1696,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMAXUB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_max_epu8);
+#else
   for(unsigned j=0; j<16; j++) {
     if(op2.xmmubyte(j) > op1.xmmubyte(j)) op1.xmmubyte(j) = op2.xmmubyte(j);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1634,9 +1731,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PAVGB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_avg_epu8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmubyte(j) = (op1.xmmubyte(j) + op2.xmmubyte(j) + 1) >> 1;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1649,6 +1750,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sra_epi16);
+#else
   if(op2.xmm64u(0) == 0) return;
 
   if(op2.xmm64u(0) > 15)  /* looking only to low 64 bits */
@@ -1675,6 +1779,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAW_VdqWdqR(bxInstruction_c *i)
     op1.xmm16u(6) = (Bit16u)(op1.xmm16s(6) >> shift);
     op1.xmm16u(7) = (Bit16u)(op1.xmm16s(7) >> shift);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1687,6 +1792,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sra_epi32);
+#else
   if(op2.xmm64u(0) == 0) return;
 
   if(op2.xmm64u(0) > 31)  /* looking only to low 64 bits */
@@ -1705,6 +1813,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSRAD_VdqWdqR(bxInstruction_c *i)
     op1.xmm32u(2) = (Bit32u)(op1.xmm32s(2) >> shift);
     op1.xmm32u(3) = (Bit32u)(op1.xmm32s(3) >> shift);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1717,6 +1826,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PAVGW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_avg_epu16);
+#else
   op1.xmm16u(0) = (op1.xmm16u(0) + op2.xmm16u(0) + 1) >> 1;
   op1.xmm16u(1) = (op1.xmm16u(1) + op2.xmm16u(1) + 1) >> 1;
   op1.xmm16u(2) = (op1.xmm16u(2) + op2.xmm16u(2) + 1) >> 1;
@@ -1725,6 +1837,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PAVGW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = (op1.xmm16u(5) + op2.xmm16u(5) + 1) >> 1;
   op1.xmm16u(6) = (op1.xmm16u(6) + op2.xmm16u(6) + 1) >> 1;
   op1.xmm16u(7) = (op1.xmm16u(7) + op2.xmm16u(7) + 1) >> 1;
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1737,6 +1850,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHUW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_mulhi_epu16);
+#else
   Bit32u product1 = Bit32u(op1.xmm16u(0)) * Bit32u(op2.xmm16u(0));
   Bit32u product2 = Bit32u(op1.xmm16u(1)) * Bit32u(op2.xmm16u(1));
   Bit32u product3 = Bit32u(op1.xmm16u(2)) * Bit32u(op2.xmm16u(2));
@@ -1754,6 +1870,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHUW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = (Bit16u)(product6 >> 16);
   op1.xmm16u(6) = (Bit16u)(product7 >> 16);
   op1.xmm16u(7) = (Bit16u)(product8 >> 16);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1766,6 +1883,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_mulhi_epi16);
+#else
   Bit32s product1 = Bit32s(op1.xmm16s(0)) * Bit32s(op2.xmm16s(0));
   Bit32s product2 = Bit32s(op1.xmm16s(1)) * Bit32s(op2.xmm16s(1));
   Bit32s product3 = Bit32s(op1.xmm16s(2)) * Bit32s(op2.xmm16s(2));
@@ -1783,6 +1903,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULHW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) = (Bit16u)(product6 >> 16);
   op1.xmm16u(6) = (Bit16u)(product7 >> 16);
   op1.xmm16u(7) = (Bit16u)(product8 >> 16);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1795,9 +1916,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBSB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_subs_epi8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmsbyte(j) = SaturateWordSToByteS(Bit16s(op1.xmmsbyte(j)) - Bit16s(op2.xmmsbyte(j)));
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1810,6 +1935,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBSW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_subs_epi16);
+#else
   op1.xmm16s(0) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(0)) - Bit32s(op2.xmm16s(0)));
   op1.xmm16s(1) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(1)) - Bit32s(op2.xmm16s(1)));
   op1.xmm16s(2) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(2)) - Bit32s(op2.xmm16s(2)));
@@ -1818,6 +1946,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBSW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16s(5) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(5)) - Bit32s(op2.xmm16s(5)));
   op1.xmm16s(6) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(6)) - Bit32s(op2.xmm16s(6)));
   op1.xmm16s(7) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(7)) - Bit32s(op2.xmm16s(7)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1830,6 +1959,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMINSW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_min_epi16);
+#else
   if(op2.xmm16s(0) < op1.xmm16s(0)) op1.xmm16s(0) = op2.xmm16s(0);
   if(op2.xmm16s(1) < op1.xmm16s(1)) op1.xmm16s(1) = op2.xmm16s(1);
   if(op2.xmm16s(2) < op1.xmm16s(2)) op1.xmm16s(2) = op2.xmm16s(2);
@@ -1838,6 +1970,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMINSW_VdqWdqR(bxInstruction_c *i)
   if(op2.xmm16s(5) < op1.xmm16s(5)) op1.xmm16s(5) = op2.xmm16s(5);
   if(op2.xmm16s(6) < op1.xmm16s(6)) op1.xmm16s(6) = op2.xmm16s(6);
   if(op2.xmm16s(7) < op1.xmm16s(7)) op1.xmm16s(7) = op2.xmm16s(7);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1866,9 +1999,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDSB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_adds_epi8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmsbyte(j) = SaturateWordSToByteS(Bit16s(op1.xmmsbyte(j)) + Bit16s(op2.xmmsbyte(j)));
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1881,6 +2018,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDSW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_adds_epi16);
+#else
   op1.xmm16s(0) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(0)) + Bit32s(op2.xmm16s(0)));
   op1.xmm16s(1) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(1)) + Bit32s(op2.xmm16s(1)));
   op1.xmm16s(2) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(2)) + Bit32s(op2.xmm16s(2)));
@@ -1889,6 +2029,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDSW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16s(5) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(5)) + Bit32s(op2.xmm16s(5)));
   op1.xmm16s(6) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(6)) + Bit32s(op2.xmm16s(6)));
   op1.xmm16s(7) = SaturateDwordSToWordS(Bit32s(op1.xmm16s(7)) + Bit32s(op2.xmm16s(7)));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1901,6 +2042,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMAXSW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_max_epi16);
+#else
   if(op2.xmm16s(0) > op1.xmm16s(0)) op1.xmm16s(0) = op2.xmm16s(0);
   if(op2.xmm16s(1) > op1.xmm16s(1)) op1.xmm16s(1) = op2.xmm16s(1);
   if(op2.xmm16s(2) > op1.xmm16s(2)) op1.xmm16s(2) = op2.xmm16s(2);
@@ -1909,6 +2053,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMAXSW_VdqWdqR(bxInstruction_c *i)
   if(op2.xmm16s(5) > op1.xmm16s(5)) op1.xmm16s(5) = op2.xmm16s(5);
   if(op2.xmm16s(6) > op1.xmm16s(6)) op1.xmm16s(6) = op2.xmm16s(6);
   if(op2.xmm16s(7) > op1.xmm16s(7)) op1.xmm16s(7) = op2.xmm16s(7);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1937,6 +2082,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sll_epi16);
+#else
   if(op2.xmm64u(0) > 15)  /* looking only to low 64 bits */
   {
     op1.xmm64u(0) = 0;
@@ -1955,6 +2103,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLW_VdqWdqR(bxInstruction_c *i)
     op1.xmm16u(6) <<= shift;
     op1.xmm16u(7) <<= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1967,6 +2116,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sll_epi32);
+#else
   if(op2.xmm64u(0) > 31)  /* looking only to low 64 bits */
   {
     op1.xmm64u(0) = 0;
@@ -1981,6 +2133,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLD_VdqWdqR(bxInstruction_c *i)
     op1.xmm32u(2) <<= shift;
     op1.xmm32u(3) <<= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -1993,6 +2146,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLQ_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sll_epi64);
+#else
   if(op2.xmm64u(0) > 63)  /* looking only to low 64 bits */
   {
     op1.xmm64u(0) = 0;
@@ -2005,6 +2161,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSLLQ_VdqWdqR(bxInstruction_c *i)
     op1.xmm64u(0) <<= shift;
     op1.xmm64u(1) <<= shift;
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2017,8 +2174,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMULUDQ_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_mul_epu32);
+#else
   op1.xmm64u(0) = Bit64u(op1.xmm32u(0)) * Bit64u(op2.xmm32u(0));
   op1.xmm64u(1) = Bit64u(op1.xmm32u(2)) * Bit64u(op2.xmm32u(2));
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2031,6 +2192,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMADDWD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_madd_epi16);
+#else
   for(unsigned j=0; j<4; j++)
   {
     if(op1.xmm32u(j) == 0x80008000 && op2.xmm32u(j) == 0x80008000) {
@@ -2042,6 +2206,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PMADDWD_VdqWdqR(bxInstruction_c *i)
         Bit32s(op1.xmm16s(2*j+1)) * Bit32s(op2.xmm16s(2*j+1));
     }
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2053,6 +2218,10 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSADBW_VdqWdqR(bxInstruction_c *i)
 {
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
+
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sad_epu8);
+#else
   Bit16u temp1 = 0, temp2 = 0;
 
   temp1 += abs(op1.xmmubyte(0x0) - op2.xmmubyte(0x0));
@@ -2075,6 +2244,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSADBW_VdqWdqR(bxInstruction_c *i)
 
   op1.xmm64u(0) = Bit64u(temp1);
   op1.xmm64u(1) = Bit64u(temp2);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2087,9 +2257,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sub_epi8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmubyte(j) -= op2.xmmubyte(j);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2102,6 +2276,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sub_epi16);
+#else
   op1.xmm16u(0) -= op2.xmm16u(0);
   op1.xmm16u(1) -= op2.xmm16u(1);
   op1.xmm16u(2) -= op2.xmm16u(2);
@@ -2110,6 +2287,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) -= op2.xmm16u(5);
   op1.xmm16u(6) -= op2.xmm16u(6);
   op1.xmm16u(7) -= op2.xmm16u(7);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2122,10 +2300,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sub_epi32);
+#else
   op1.xmm32u(0) -= op2.xmm32u(0);
   op1.xmm32u(1) -= op2.xmm32u(1);
   op1.xmm32u(2) -= op2.xmm32u(2);
   op1.xmm32u(3) -= op2.xmm32u(3);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2138,8 +2320,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PSUBQ_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_sub_epi64);
+#else
   op1.xmm64u(0) -= op2.xmm64u(0);
   op1.xmm64u(1) -= op2.xmm64u(1);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2152,9 +2338,13 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDB_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_add_epi8);
+#else
   for(unsigned j=0; j<16; j++) {
     op1.xmmubyte(j) += op2.xmmubyte(j);
   }
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2167,6 +2357,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDW_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_add_epi16);
+#else
   op1.xmm16u(0) += op2.xmm16u(0);
   op1.xmm16u(1) += op2.xmm16u(1);
   op1.xmm16u(2) += op2.xmm16u(2);
@@ -2175,6 +2368,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDW_VdqWdqR(bxInstruction_c *i)
   op1.xmm16u(5) += op2.xmm16u(5);
   op1.xmm16u(6) += op2.xmm16u(6);
   op1.xmm16u(7) += op2.xmm16u(7);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
@@ -2187,10 +2381,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::PADDD_VdqWdqR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  BX_HOST_SIMD_XMM(op1, op1, op2, _mm_add_epi32);
+#else
   op1.xmm32u(0) += op2.xmm32u(0);
   op1.xmm32u(1) += op2.xmm32u(1);
   op1.xmm32u(2) += op2.xmm32u(2);
   op1.xmm32u(3) += op2.xmm32u(3);
+#endif
 
   /* now write result back to destination */
   BX_WRITE_XMM_REG(i->nnn(), op1);
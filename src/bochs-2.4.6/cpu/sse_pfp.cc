@@ -24,6 +24,7 @@
 #define NEED_CPU_REG_SHORTCUTS 1
 #include "bochs.h"
 #include "cpu.h"
+#include "host_simd.h"
 #define LOG_THIS BX_CPU_THIS_PTR
 
 #if BX_CPU_LEVEL >= 6
@@ -947,6 +948,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::SQRTPS_VpsWpsR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ps, BX_MXCSR_REGISTER, op, op, bx_host_sqrt_ps);
+    BX_WRITE_XMM_REG(i->nnn(), op);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -978,6 +987,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::SQRTPD_VpdWpdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(pd, BX_MXCSR_REGISTER, op, op, bx_host_sqrt_pd);
+    BX_WRITE_XMM_REG(i->nnn(), op);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1043,6 +1060,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::ADDPS_VpsWpsR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ps, BX_MXCSR_REGISTER, op1, op2, _mm_add_ps);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1078,6 +1103,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::ADDPD_VpdWpdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(pd, BX_MXCSR_REGISTER, op1, op2, _mm_add_pd);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1107,6 +1140,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::ADDSD_VsdWsdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float64 op1 = BX_READ_XMM_REG_LO_QWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_QWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(sd, BX_MXCSR_REGISTER, op1, op2, _mm_add_sd);
+    BX_WRITE_XMM_REG_LO_QWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1132,6 +1173,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::ADDSS_VssWssR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float32 op1 = BX_READ_XMM_REG_LO_DWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_DWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ss, BX_MXCSR_REGISTER, op1, op2, _mm_add_ss);
+    BX_WRITE_XMM_REG_LO_DWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1157,6 +1206,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MULPS_VpsWpsR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ps, BX_MXCSR_REGISTER, op1, op2, _mm_mul_ps);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1192,6 +1249,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MULPD_VpdWpdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(pd, BX_MXCSR_REGISTER, op1, op2, _mm_mul_pd);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1221,6 +1286,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MULSD_VsdWsdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float64 op1 = BX_READ_XMM_REG_LO_QWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_QWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(sd, BX_MXCSR_REGISTER, op1, op2, _mm_mul_sd);
+    BX_WRITE_XMM_REG_LO_QWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1246,6 +1319,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MULSS_VssWssR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float32 op1 = BX_READ_XMM_REG_LO_DWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_DWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ss, BX_MXCSR_REGISTER, op1, op2, _mm_mul_ss);
+    BX_WRITE_XMM_REG_LO_DWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1271,6 +1352,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::SUBPS_VpsWpsR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ps, BX_MXCSR_REGISTER, op1, op2, _mm_sub_ps);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1306,6 +1395,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::SUBPD_VpdWpdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(pd, BX_MXCSR_REGISTER, op1, op2, _mm_sub_pd);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1335,6 +1432,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::SUBSD_VsdWsdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float64 op1 = BX_READ_XMM_REG_LO_QWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_QWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(sd, BX_MXCSR_REGISTER, op1, op2, _mm_sub_sd);
+    BX_WRITE_XMM_REG_LO_QWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1360,6 +1465,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::SUBSS_VssWssR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float32 op1 = BX_READ_XMM_REG_LO_DWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_DWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ss, BX_MXCSR_REGISTER, op1, op2, _mm_sub_ss);
+    BX_WRITE_XMM_REG_LO_DWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1385,6 +1498,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MINPS_VpsWpsR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ps, BX_MXCSR_REGISTER, op1, op2, _mm_min_ps);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
   int rc;
@@ -1425,6 +1546,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MINPD_VpdWpdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(pd, BX_MXCSR_REGISTER, op1, op2, _mm_min_pd);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
   int rc;
@@ -1457,6 +1586,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MINSD_VsdWsdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float64 op1 = BX_READ_XMM_REG_LO_QWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_QWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(sd, BX_MXCSR_REGISTER, op1, op2, _mm_min_sd);
+    BX_WRITE_XMM_REG_LO_QWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1483,6 +1620,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MINSS_VssWssR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float32 op1 = BX_READ_XMM_REG_LO_DWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_DWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ss, BX_MXCSR_REGISTER, op1, op2, _mm_min_ss);
+    BX_WRITE_XMM_REG_LO_DWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1509,6 +1654,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::DIVPS_VpsWpsR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ps, BX_MXCSR_REGISTER, op1, op2, _mm_div_ps);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1544,6 +1697,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::DIVPD_VpdWpdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(pd, BX_MXCSR_REGISTER, op1, op2, _mm_div_pd);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1573,6 +1734,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::DIVSD_VsdWsdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float64 op1 = BX_READ_XMM_REG_LO_QWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_QWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(sd, BX_MXCSR_REGISTER, op1, op2, _mm_div_sd);
+    BX_WRITE_XMM_REG_LO_QWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1598,6 +1767,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::DIVSS_VssWssR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float32 op1 = BX_READ_XMM_REG_LO_DWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_DWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ss, BX_MXCSR_REGISTER, op1, op2, _mm_div_ss);
+    BX_WRITE_XMM_REG_LO_DWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1623,6 +1800,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MAXPS_VpsWpsR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ps, BX_MXCSR_REGISTER, op1, op2, _mm_max_ps);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
   int rc;
@@ -1663,6 +1848,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MAXPD_VpdWpdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   BxPackedXmmRegister op1 = BX_READ_XMM_REG(i->nnn()), op2 = BX_READ_XMM_REG(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(pd, BX_MXCSR_REGISTER, op1, op2, _mm_max_pd);
+    BX_WRITE_XMM_REG(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
   int rc;
@@ -1695,6 +1888,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MAXSD_VsdWsdR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float64 op1 = BX_READ_XMM_REG_LO_QWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_QWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(sd, BX_MXCSR_REGISTER, op1, op2, _mm_max_sd);
+    BX_WRITE_XMM_REG_LO_QWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -1721,6 +1922,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MAXSS_VssWssR(bxInstruction_c *i)
 #if BX_CPU_LEVEL >= 6
   float32 op1 = BX_READ_XMM_REG_LO_DWORD(i->nnn()), op2 = BX_READ_XMM_REG_LO_DWORD(i->rm());
 
+#if BX_SupportHostSIMD
+  if (BX_HOST_SIMD_FP_MODE(BX_MXCSR_REGISTER)) {
+    BX_HOST_SIMD_FP(ss, BX_MXCSR_REGISTER, op1, op2, _mm_max_ss);
+    BX_WRITE_XMM_REG_LO_DWORD(i->nnn(), op1);
+    return;
+  }
+#endif
+
   float_status_t status_word;
   mxcsr_to_softfloat_status_word(status_word, MXCSR);
 
@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// stats.cc
+//
+// Per-CPU execution statistics (configure --enable-cpu-statistics).
+//
+/////////////////////////////////////////////////////////////////////////
+
+#define NEED_CPU_REG_SHORTCUTS 1
+#include "bochs.h"
+#include "cpu.h"
+#include "param_names.h"
+#define LOG_THIS BX_CPU_THIS_PTR
+
+#if BX_CPU_STATISTICS
+
+static const char *exception_names[BX_CPU_HANDLED_EXCEPTIONS] = {
+  "DE", "DB", "NMI", "BP", "OF", "BR", "UD", "NM", "DF", "CSO",
+  "TS", "NP", "SS", "GP", "PF", "reserved15", "MF", "AC", "MC", "XM"
+};
+
+// Export the counters of this CPU as shadow parameters, the tree
+// statistics.cpuN is what bx_write_statistics() dumps at exit.
+void BX_CPU_C::register_stats(void)
+{
+  char name[10];
+  unsigned n;
+
+  memset(&BX_CPU_THIS_PTR stats, 0, sizeof(BX_CPU_THIS_PTR stats));
+
+  bx_list_c *root = (bx_list_c*) SIM->get_param(BXPN_STATISTICS);
+  if (root == NULL) {
+    root = new bx_list_c(SIM->get_param("."), "statistics",
+                         "Emulator statistics", BX_MAX_SMP_THREADS_SUPPORTED);
+  }
+
+  sprintf(name, "cpu%d", BX_CPU_ID);
+  if (root->get_by_name(name) != NULL) return;
+  bx_list_c *cpu = new bx_list_c(root, name, name, 10);
+
+  // opcodes are named after their ia_opcode without the BX_IA_ prefix
+  bx_list_c *opcodes = new bx_list_c(cpu, "opcodes", "Executed instructions", BX_IA_LAST);
+#if BX_HOST_CYCLES
+  bx_list_c *cycles = new bx_list_c(cpu, "cycles", "Host cycles per handler", BX_IA_LAST);
+#endif
+  for (n=0; n < BX_IA_LAST; n++) {
+    const char *opname = get_bx_opcode_name(n);
+    if (! strncmp(opname, "BX_IA_", 6)) opname += 6;
+    new bx_shadow_num_c(opcodes, opname, &BX_CPU_THIS_PTR stats.opcodeCount[n]);
+#if BX_HOST_CYCLES
+    new bx_shadow_num_c(cycles, opname, &BX_CPU_THIS_PTR stats.opcodeCycles[n]);
+#endif
+  }
+
+  bx_list_c *icache = new bx_list_c(cpu, "icache", "Instruction cache");
+  new bx_shadow_num_c(icache, "hits", &BX_CPU_THIS_PTR iCache.stats.hits);
+  new bx_shadow_num_c(icache, "conflict_misses", &BX_CPU_THIS_PTR iCache.stats.conflictMisses);
+  new bx_shadow_num_c(icache, "cold_fills", &BX_CPU_THIS_PTR iCache.stats.coldFills);
+#if BX_SUPPORT_TRACE_CACHE
+  new bx_shadow_num_c(icache, "link_hits", &BX_CPU_THIS_PTR iCache.stats.linkHits);
+#endif
+
+  bx_list_c *tlb = new bx_list_c(cpu, "tlb", "TLB");
+  new bx_shadow_num_c(tlb, "slow_path_lookups", &BX_CPU_THIS_PTR stats.tlbSlowPathLookups);
+  new bx_shadow_num_c(tlb, "misses", &BX_CPU_THIS_PTR stats.tlbMisses);
+  new bx_shadow_num_c(tlb, "global_flushes", &BX_CPU_THIS_PTR stats.tlbGlobalFlushes);
+  new bx_shadow_num_c(tlb, "non_global_flushes", &BX_CPU_THIS_PTR stats.tlbNonGlobalFlushes);
+  new bx_shadow_num_c(tlb, "address_space_switches", &BX_CPU_THIS_PTR stats.tlbAddressSpaceSwitches);
+  new bx_shadow_num_c(tlb, "address_space_misses", &BX_CPU_THIS_PTR stats.tlbAddressSpaceMisses);
+
+  bx_list_c *walks = new bx_list_c(cpu, "page_walks", "Page walks", 7);
+  new bx_shadow_num_c(walks, "legacy", &BX_CPU_THIS_PTR stats.pageWalks[0]);
+  new bx_shadow_num_c(walks, "pae", &BX_CPU_THIS_PTR stats.pageWalks[1]);
+  new bx_shadow_num_c(walks, "long", &BX_CPU_THIS_PTR stats.pageWalks[2]);
+#if BX_CPU_LEVEL >= 6
+  new bx_shadow_num_c(walks, "psc_lookups", &BX_CPU_THIS_PTR PSC.lookups);
+  new bx_shadow_num_c(walks, "psc_pde_hits", &BX_CPU_THIS_PTR PSC.hits[0]);
+  new bx_shadow_num_c(walks, "psc_pdpte_hits", &BX_CPU_THIS_PTR PSC.hits[1]);
+  new bx_shadow_num_c(walks, "psc_pml4e_hits", &BX_CPU_THIS_PTR PSC.hits[2]);
+#endif
+
+  bx_list_c *events = new bx_list_c(cpu, "events", "Asynchronous events");
+  new bx_shadow_num_c(events, "async_events", &BX_CPU_THIS_PTR stats.asyncEvents);
+  new bx_shadow_num_c(events, "nmis", &BX_CPU_THIS_PTR stats.nmis);
+  new bx_shadow_num_c(events, "interrupts", &BX_CPU_THIS_PTR stats.interrupts);
+
+  bx_list_c *exceptions = new bx_list_c(cpu, "exceptions", "Exceptions", BX_CPU_HANDLED_EXCEPTIONS);
+  for (n=0; n < BX_CPU_HANDLED_EXCEPTIONS; n++) {
+    new bx_shadow_num_c(exceptions, exception_names[n], &BX_CPU_THIS_PTR stats.exceptions[n]);
+  }
+}
+
+#undef LOG_THIS
+#define LOG_THIS genlog->
+
+static void write_statistics_param(FILE *fp, bx_param_c *node, int level)
+{
+  for (int i=0; i<level; i++)
+    fprintf(fp, "  ");
+  fprintf(fp, "\"%s\": ", node->get_name());
+
+  if (node->get_type() == BXT_LIST) {
+    bx_list_c *list = (bx_list_c*) node;
+    fprintf(fp, "{\n");
+    for (int i=0; i < list->get_size(); i++) {
+      write_statistics_param(fp, list->get(i), level+1);
+      fprintf(fp, (i < list->get_size() - 1) ? ",\n" : "\n");
+    }
+    for (int i=0; i<level; i++)
+      fprintf(fp, "  ");
+    fprintf(fp, "}");
+  }
+  else {
+    fprintf(fp, FMT_LL "u", (Bit64u) ((bx_param_num_c*) node)->get64());
+  }
+}
+
+// Write the "statistics" parameter subtree as a JSON object
+void bx_write_statistics(const char *path)
+{
+  bx_list_c *root = (bx_list_c*) SIM->get_param(BXPN_STATISTICS);
+  if (root == NULL || path == NULL || path[0] == 0) return;
+
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    BX_ERROR(("cannot write statistics to '%s'", path));
+    return;
+  }
+
+  fprintf(fp, "{\n");
+  for (int i=0; i < root->get_size(); i++) {
+    write_statistics_param(fp, root->get(i), 1);
+    fprintf(fp, (i < root->get_size() - 1) ? ",\n" : "\n");
+  }
+  fprintf(fp, "}\n");
+  fclose(fp);
+
+  BX_INFO(("statistics written to '%s'", path));
+}
+
+#endif
@@ -528,7 +528,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MOVSB32_XbYb(bxInstruction_c *i)
       // one, since the main cpu loop will decrement one.  Also,
       // the count is predecremented before examined, so defintely
       // don't roll it under zero.
-      BX_TICKN(byteCount-1);
+      BX_INSN_TICKN(byteCount-1);
 
       // Decrement eCX. Note, the main loop will decrement 1 also, so
       // decrement by one less than expected, like the case above.
@@ -707,7 +707,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MOVSD32_XdYd(bxInstruction_c *i)
       // one, since the main cpu loop will decrement one.  Also,
       // the count is predecremented before examined, so defintely
       // don't roll it under zero.
-      BX_TICKN(dwordCount-1);
+      BX_INSN_TICKN(dwordCount-1);
 
       // Decrement eCX. Note, the main loop will decrement 1 also, so
       // decrement by one less than expected, like the case above.
@@ -1650,7 +1650,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::STOSB32_YbAL(bxInstruction_c *i)
       // one, since the main cpu loop will decrement one.  Also,
       // the count is predecremented before examined, so defintely
       // don't roll it under zero.
-      BX_TICKN(byteCount-1);
+      BX_INSN_TICKN(byteCount-1);
 
       // Decrement eCX.  Note, the main loop will decrement 1 also, so
       // decrement by one less than expected, like the case above.
@@ -1536,7 +1536,13 @@ Bit32u BX_CPU_C::VMenterLoadCheckGuestState(Bit64u *qualification)
   // Load Guest Non-Registers State -> VMENTER
   //
 
+#if BX_SUPPORT_SMP_THREADS
+  // keep the events posted by the other CPU threads, handleAsyncEvent()
+  // drops async_event once nothing is pending
+  BX_CPU_THIS_PTR set_async_event(1);
+#else
   BX_CPU_THIS_PTR async_event = 0;
+#endif
   if (guest.rflags & (EFlagsTFMask|EFlagsRFMask))
     BX_CPU_THIS_PTR async_event = 1;
 
@@ -62,6 +62,23 @@ float_status_t FPU_pre_exception_handling(Bit16u control_word)
 }
 
 #include "softfloatx80.h"
+#include "host_x87.h"
+
+// The divisions below go through this wrapper, which lets the host FPU
+// compute the result when it can reproduce softfloat exactly. The host
+// path needs #P to be already set in the guest status word (see
+// host_x87.h), which is the common state in floating point code. Only
+// FDIV gains from it, for FADD, FSUB and FMUL softfloat is about as fast
+// as loading and restoring the host control word.
+
+static BX_CPP_INLINE floatx80 FPU_div(floatx80 a, floatx80 b, float_status_t &status, Bit16u swd)
+{
+#if BX_HOST_X87
+  floatx80 r;
+  if ((swd & FPU_SW_Precision) && host_x87_div(a, b, r, status)) return r;
+#endif
+  return floatx80_div(a, b, status);
+}
 
 floatx80 FPU_handle_NaN(floatx80 a, int aIsNaN, float32 b32, int bIsNaN, float_status_t &status)
 {
@@ -842,7 +859,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIV_ST0_STj(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -867,7 +884,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIVR_ST0_STj(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -894,7 +911,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIV_STi_ST0(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags)) {
      BX_WRITE_FPU_REG(result, i->rm());
@@ -924,7 +941,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIVR_STi_ST0(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags)) {
      BX_WRITE_FPU_REG(result, i->rm());
@@ -954,7 +971,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIV_SINGLE_REAL(bxInstruction_c *i)
 
   floatx80 a = BX_READ_FPU_REG(0), result;
   if (! FPU_handle_NaN(a, load_reg, result, status))
-     result = floatx80_div(a, float32_to_floatx80(load_reg, status), status);
+     result = FPU_div(a, float32_to_floatx80(load_reg, status), status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -981,7 +998,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIVR_SINGLE_REAL(bxInstruction_c *i)
 
   floatx80 b = BX_READ_FPU_REG(0), result;
   if (! FPU_handle_NaN(b, load_reg, result, status))
-     result = floatx80_div(float32_to_floatx80(load_reg, status), b, status);
+     result = FPU_div(float32_to_floatx80(load_reg, status), b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -1008,7 +1025,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIV_DOUBLE_REAL(bxInstruction_c *i)
 
   floatx80 a = BX_READ_FPU_REG(0), result;
   if (! FPU_handle_NaN(a, load_reg, result, status))
-     result = floatx80_div(a, float64_to_floatx80(load_reg, status), status);
+     result = FPU_div(a, float64_to_floatx80(load_reg, status), status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -1035,7 +1052,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FDIVR_DOUBLE_REAL(bxInstruction_c *i)
 
   floatx80 b = BX_READ_FPU_REG(0), result;
   if (! FPU_handle_NaN(b, load_reg, result, status))
-     result = floatx80_div(float64_to_floatx80(load_reg, status), b, status);
+     result = FPU_div(float64_to_floatx80(load_reg, status), b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -1063,7 +1080,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FIDIV_WORD_INTEGER(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -1091,7 +1108,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FIDIVR_WORD_INTEGER(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -1119,7 +1136,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FIDIV_DWORD_INTEGER(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -1147,7 +1164,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::FIDIVR_DWORD_INTEGER(bxInstruction_c *i)
   float_status_t status =
      FPU_pre_exception_handling(BX_CPU_THIS_PTR the_i387.get_control_word());
 
-  floatx80 result = floatx80_div(a, b, status);
+  floatx80 result = FPU_div(a, b, status, FPU_PARTIAL_STATUS);
 
   if (! FPU_exception(status.float_exception_flags))
      BX_WRITE_FPU_REG(result, 0);
@@ -0,0 +1,132 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// host_x87.h
+//
+// x87 division executed by the host FPU.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_HOST_X87_H
+#define BX_HOST_X87_H
+
+#include "softfloat.h"
+
+//
+// x87 FDIV executed by the host FPU
+// (configure --enable-host-specific-asms, gcc on x86 hosts only).
+//
+// The floatx80 structure has the memory layout of an 80-bit x87 register,
+// so the operands are loaded with FLD TBYTE and the guest precision and
+// rounding control are loaded into the host control word. The host is
+// only trusted with the common case: all exceptions masked, both operands
+// zero or normalized finite numbers, and a normalized or exact zero result
+// which raised nothing but #P. Everything else returns 0 and the caller
+// falls back to softfloat, which owns NaN propagation, denormals, masked
+// and unmasked overflow/underflow responses and invalid operations.
+//
+// Clearing the sticky host exception flags (FNCLEX) costs more than the
+// whole softfloat operation, so it is done only after a rejected result
+// and the host #P flag is left set. The host therefore cannot tell an
+// exact result from an inexact one rounded down: #P is reported only
+// together with C1 (rounded up), and callers must use these routines only
+// when the guest status word already has #P set, where both look the same.
+//
+// Only the division is done on the host (see fpu_arith.cc), for FADD, FSUB
+// and FMUL the two control word loads cost as much as softfloat. The
+// BX_HOST_X87_FUNC() template is left defined so that misc/fpu-fuzz.cc can
+// build those three and compare them with softfloat next to host_x87_div().
+//
+
+#if BX_SupportHostAsms && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+#define BX_HOST_X87 1
+
+#define BX_HOST_X87_ALL_EXCEPTIONS_MASK 0x3f
+
+// zero or normalized finite number, the only operands the host gets
+BX_CPP_INLINE int host_x87_operand_ok(floatx80 a)
+{
+  Bit16u exp = a.exp & 0x7fff;
+  if (exp == 0) return a.fraction == 0;
+  return (exp != 0x7fff) && (a.fraction & BX_CONST64(0x8000000000000000));
+}
+
+// host control word reproducing the softfloat status, 0 if not possible
+BX_CPP_INLINE Bit16u host_x87_control_word(float_status_t &status)
+{
+  if (status.float_exception_masks != BX_HOST_X87_ALL_EXCEPTIONS_MASK)
+    return 0;
+
+  Bit16u cw = 0x0040 | BX_HOST_X87_ALL_EXCEPTIONS_MASK |
+              (status.float_rounding_mode << 10);
+
+  switch(status.float_rounding_precision) {
+    case 32:
+      break;
+    case 64:
+      cw |= 0x0200;
+      break;
+    default:
+      cw |= 0x0300;
+  }
+
+  return cw;
+}
+
+// Accept the host result only when it raised nothing but #P and is not
+// a denormal, merge the rounded up indication into the softfloat status.
+BX_CPP_INLINE int host_x87_result_ok(floatx80 r, Bit16u sw, float_status_t &status)
+{
+  if (sw & BX_HOST_X87_ALL_EXCEPTIONS_MASK & ~float_flag_inexact) {
+    __asm__ __volatile__ ("fnclex");
+    return 0;
+  }
+  if ((r.exp & 0x7fff) == 0 && r.fraction != 0)
+    return 0;
+
+  if (sw & RAISE_SW_C1)
+    set_float_rounding_up(status);
+
+  return 1;
+}
+
+// r = a <op> b, computed as ST(0) = ST(0) <op> ST(1) with a in ST(0).
+// The status word is read right after the operation, before the store
+// to memory clears C1.
+#define BX_HOST_X87_FUNC(name, insn)                                         \
+BX_CPP_INLINE int name(floatx80 a, floatx80 b, floatx80 &r, float_status_t &status) \
+{                                                                           \
+  Bit16u cw = host_x87_control_word(status);                               \
+  if (! cw || ! host_x87_operand_ok(a) || ! host_x87_operand_ok(b))         \
+    return 0;                                                               \
+                                                                            \
+  Bit16u host_cw, sw;                                                       \
+  floatx80 result;                                                          \
+  __asm__ __volatile__ (                                                    \
+    "fnstcw %[save]\n\t"                                                    \
+    "fldcw %[cw]\n\t"                                                       \
+    "fldt %[b]\n\t"                                                         \
+    "fldt %[a]\n\t"                                                         \
+    insn " %%st(1), %%st\n\t"                                               \
+    "fnstsw %[sw]\n\t"                                                      \
+    "fstpt %[r]\n\t"                                                        \
+    "fstp %%st(0)\n\t"                                                      \
+    "fldcw %[save]\n\t"                                                     \
+    : [r] "=m" (result), [sw] "=m" (sw), [save] "=m" (host_cw)              \
+    : [a] "m" (a), [b] "m" (b), [cw] "m" (cw)                               \
+    : "st", "st(1)");                                                       \
+                                                                            \
+  if (! host_x87_result_ok(result, sw, status))                             \
+    return 0;                                                               \
+                                                                            \
+  r = result;                                                               \
+  return 1;                                                                 \
+}
+
+BX_HOST_X87_FUNC(host_x87_div, "fdiv")
+
+#endif // BX_SupportHostAsms
+
+#endif
@@ -32,6 +32,11 @@ logfunctions *siminterface_log = NULL;
 bx_list_c *root_param = NULL;
 #define LOG_THIS siminterface_log->
 
+// maximum number of incremental saved states based on a complete one
+#define BX_SR_MAX_CHAIN 64
+
+extern void bx_sr_after_restore_state(void);
+
 // bx_simulator_interface just defines the interface that the Bochs simulator
 // and the gui will use to talk to each other.  None of the methods of
 // bx_simulator_interface are implemented; they are all virtual.  The
@@ -66,6 +71,13 @@ class bx_real_sim_c : public bx_simulator_interface_c {
   int exit_code;
   unsigned param_id;
   bx_bool wx_debug_gui;
+  // in-memory checkpoint of the save/restore tree (without the guest RAM)
+  Bit8u *sr_checkpoint;
+  Bit32u sr_checkpoint_len, sr_checkpoint_size;
+  // previous saved state for incremental saves, see save_state_incremental()
+  char sr_last_save[BX_PATHNAME_LEN];
+  unsigned sr_chain_len;
+  bx_param_c *sr_skip_data;
 public:
   bx_real_sim_c();
   virtual ~bx_real_sim_c() {}
@@ -169,6 +181,7 @@ public:
   // save/restore support
   virtual void init_save_restore();
   virtual bx_bool save_state(const char *checkpoint_path);
+  virtual bx_bool save_state_incremental(const char *checkpoint_path);
   virtual bx_bool restore_config();
   virtual bx_bool restore_logopts();
   virtual bx_bool restore_hardware();
@@ -176,9 +189,22 @@ public:
     return (bx_list_c*)get_param("bochs", NULL);
   }
   virtual bx_bool restore_bochs_param(bx_list_c *root, const char *sr_path, const char *restore_name);
+  virtual bx_bool checkpoint_state();
+  virtual bx_bool rollback_state();
+  virtual void discard_checkpoint();
+  virtual void request_state_op(Bit32u op) {
+    bx_pc_system.request_state_op(op);
+  }
 
 private:
+  bx_bool save_sr_files(const char *checkpoint_path);
   bx_bool save_sr_param(FILE *fp, bx_param_c *node, const char *sr_path, int level);
+  bx_bool restore_ram_chain(const char *sr_path);
+  bx_bool load_ram_chain(const char *sr_path, char (*chain)[BX_PATHNAME_LEN]);
+  void checkpoint_write(const void *data, Bit32u len);
+  void checkpoint_sr_param(bx_param_c *node);
+  void rollback_sr_param(bx_param_c *node, Bit32u *pos);
+  bx_bool writable_disk_attached(char *name, int maxlen);
 };
 
 #if BX_DEBUGGER && BX_DEBUGGER_GUI
@@ -318,6 +344,12 @@ bx_real_sim_c::bx_real_sim_c()
   exit_code = 0;
   param_id = BXP_NEW_PARAM_ID;
   user_options = NULL;
+  sr_checkpoint = NULL;
+  sr_checkpoint_len = 0;
+  sr_checkpoint_size = 0;
+  sr_last_save[0] = 0;
+  sr_chain_len = 0;
+  sr_skip_data = NULL;
 }
 
 void bx_real_sim_c::reset_all_param()
@@ -483,6 +515,7 @@ const char *hdimage_mode_names[] = {
   "z-undoable",
   "z-volatile",
   "vvfat",
+  "qcow",
   NULL
 };
 
@@ -915,12 +948,80 @@ void bx_real_sim_c::init_save_restore()
 }
 
 bx_bool bx_real_sim_c::save_state(const char *checkpoint_path)
+{
+  if (!save_sr_files(checkpoint_path))
+    return 0;
+
+  // from now on only the RAM pages written after this save are needed
+  if (get_param("memory.ram", get_bochs_root()) != NULL) {
+    BX_MEM(0)->start_dirty_log();
+    strncpy(sr_last_save, checkpoint_path, BX_PATHNAME_LEN);
+    sr_last_save[BX_PATHNAME_LEN - 1] = 0;
+    sr_chain_len = 0;
+  }
+  return 1;
+}
+
+// An incremental saved state is a complete one without the "memory.ram"
+// data file. Instead it holds the RAM pages written since the previous save
+// in "memory.dirty" and the path of the previous saved state in "parent",
+// so restoring it needs the whole chain back to a complete saved state.
+bx_bool bx_real_sim_c::save_state_incremental(const char *checkpoint_path)
+{
+  char sr_file[BX_PATHNAME_LEN];
+  Bit32s pages;
+  FILE *fp;
+
+  bx_param_c *ram = get_param("memory.ram", get_bochs_root());
+  if ((ram == NULL) || (sr_last_save[0] == 0) || (sr_chain_len >= BX_SR_MAX_CHAIN))
+    return save_state(checkpoint_path);
+
+  sr_skip_data = ram;
+  bx_bool ret = save_sr_files(checkpoint_path);
+  sr_skip_data = NULL;
+  if (!ret)
+    return 0;
+
+  sprintf(sr_file, "%s/memory.dirty", checkpoint_path);
+  fp = fopen(sr_file, "wb");
+  if (fp == NULL)
+    return 0;
+  pages = BX_MEM(0)->save_dirty_pages(fp);
+  if (fclose(fp) || (pages < 0)) {
+    // the dirty page log may already be cleared, start a new chain
+    sr_last_save[0] = 0;
+    return 0;
+  }
+  sprintf(sr_file, "%s/parent", checkpoint_path);
+  fp = fopen(sr_file, "w");
+  if (fp != NULL) {
+    fprintf(fp, "%s\n", sr_last_save);
+    ret = (fclose(fp) == 0);
+  } else {
+    ret = 0;
+  }
+  if (!ret) {
+    sr_last_save[0] = 0;
+    return 0;
+  }
+  BX_INFO(("saved %d RAM pages to '%s', based on '%s'", pages, checkpoint_path, sr_last_save));
+  strncpy(sr_last_save, checkpoint_path, BX_PATHNAME_LEN);
+  sr_last_save[BX_PATHNAME_LEN - 1] = 0;
+  sr_chain_len++;
+  return 1;
+}
+
+bx_bool bx_real_sim_c::save_sr_files(const char *checkpoint_path)
 {
   char sr_file[BX_PATHNAME_LEN];
   char prefix[8];
   int i, dev, ndev = SIM->get_n_log_modules();
   int type, ntype = SIM->get_max_log_level();
 
+  // the saved state gets a copy of the RAM, bring a shared RAM backing
+  // file up to date as well so it matches the saved state
+  BX_MEM(0)->sync_ram_file();
+
   sprintf(sr_file, "%s/config", checkpoint_path);
   if (write_rc(sr_file, 1) < 0)
     return 0;
@@ -1160,9 +1261,279 @@ bx_bool bx_real_sim_c::restore_hardware()
     if (!restore_bochs_param(sr_list, get_param_string(BXPN_RESTORE_PATH)->getptr(), sr_list->get(dev)->get_name()))
       return 0;
   }
+  return restore_ram_chain(get_param_string(BXPN_RESTORE_PATH)->getptr());
+}
+
+// Completes the guest RAM of an incremental saved state: the RAM of the
+// complete saved state at the start of the chain is loaded first, then the
+// pages of each incremental one are applied, oldest first.
+bx_bool bx_real_sim_c::restore_ram_chain(const char *sr_path)
+{
+  // the pathnames of a long chain take too much stack for a GUI thread
+  char (*chain)[BX_PATHNAME_LEN] = new char[BX_SR_MAX_CHAIN + 1][BX_PATHNAME_LEN];
+  bx_bool ret = load_ram_chain(sr_path, chain);
+  delete [] chain;
+  return ret;
+}
+
+bx_bool bx_real_sim_c::load_ram_chain(const char *sr_path, char (*chain)[BX_PATHNAME_LEN])
+{
+  char sr_file[BX_PATHNAME_LEN];
+  Bit32u index;
+  int i, depth = 0;
+  bx_bool ret = 1;
+  FILE *fp;
+
+  bx_shadow_data_c *ram = (bx_shadow_data_c*) get_param("memory.ram", get_bochs_root());
+  if (ram == NULL)
+    return 1;
+  Bit32u num_pages = ram->get_size() >> 12;
+
+  strncpy(chain[0], sr_path, BX_PATHNAME_LEN);
+  chain[0][BX_PATHNAME_LEN - 1] = 0;
+  while (1) {
+    sprintf(sr_file, "%s/parent", chain[depth]);
+    fp = fopen(sr_file, "r");
+    if (fp == NULL)
+      break;
+    if (depth == BX_SR_MAX_CHAIN) {
+      BX_ERROR(("restore_ram_chain(): saved state chain too long"));
+      fclose(fp);
+      return 0;
+    }
+    if (fgets(chain[depth+1], BX_PATHNAME_LEN, fp) == NULL)
+      chain[depth+1][0] = 0;
+    fclose(fp);
+    i = strlen(chain[depth+1]);
+    while ((i > 0) && (chain[depth+1][i-1] < ' ')) chain[depth+1][--i] = 0;
+    depth++;
+  }
+  // a complete saved state, its RAM has been restored with the param tree
+  if (depth == 0)
+    return 1;
+
+  sprintf(sr_file, "%s/memory.ram", chain[depth]);
+  BX_INFO(("restoring '%s'", sr_file));
+  fp = fopen(sr_file, "rb");
+  if (fp == NULL) {
+    BX_ERROR(("restore_ram_chain(): error in file open"));
+    return 0;
+  }
+  if (fread(ram->getptr(), 1, ram->get_size(), fp) != ram->get_size()) {
+    BX_ERROR(("restore_ram_chain(): error in file read"));
+    fclose(fp);
+    return 0;
+  }
+  fclose(fp);
+
+  for (i = depth - 1; (i >= 0) && ret; i--) {
+    sprintf(sr_file, "%s/memory.dirty", chain[i]);
+    BX_INFO(("restoring '%s'", sr_file));
+    fp = fopen(sr_file, "rb");
+    if (fp == NULL) {
+      ret = 0;
+      break;
+    }
+    while (fread(&index, sizeof(index), 1, fp) == 1) {
+      if ((index >= num_pages) ||
+          (fread(ram->getptr() + ((Bit64u) index << 12), 4096, 1, fp) != 1)) {
+        ret = 0;
+        break;
+      }
+    }
+    fclose(fp);
+    if (!ret) break;
+  }
+  if (!ret)
+    BX_ERROR(("restore_ram_chain(): error in saved state '%s'", chain[i]));
+  return ret;
+}
+
+// In-process checkpoints: the save/restore tree is copied into a memory
+// buffer, while the guest RAM is protected copy-on-write by the memory
+// object, so a checkpoint can be rolled back any number of times without
+// touching the disk. Must be called between instructions, like the
+// file based save/restore.
+
+void bx_real_sim_c::checkpoint_write(const void *data, Bit32u len)
+{
+  if (sr_checkpoint_len + len > sr_checkpoint_size) {
+    Bit32u new_size = sr_checkpoint_size ? sr_checkpoint_size * 2 : 65536;
+    while (sr_checkpoint_len + len > new_size) new_size *= 2;
+    Bit8u *new_buf = new Bit8u[new_size];
+    if (sr_checkpoint != NULL) {
+      memcpy(new_buf, sr_checkpoint, sr_checkpoint_len);
+      delete [] sr_checkpoint;
+    }
+    sr_checkpoint = new_buf;
+    sr_checkpoint_size = new_size;
+  }
+  memcpy(sr_checkpoint + sr_checkpoint_len, data, len);
+  sr_checkpoint_len += len;
+}
+
+void bx_real_sim_c::checkpoint_sr_param(bx_param_c *node)
+{
+  Bit64s value;
+
+  switch (node->get_type()) {
+    case BXT_PARAM_NUM:
+    case BXT_PARAM_BOOL:
+    case BXT_PARAM_ENUM:
+      value = ((bx_param_num_c*)node)->get64();
+      checkpoint_write(&value, sizeof(value));
+      break;
+    case BXT_PARAM_STRING:
+      checkpoint_write(((bx_param_string_c*)node)->getptr(),
+                       ((bx_param_string_c*)node)->get_maxsize());
+      break;
+    case BXT_PARAM_DATA:
+      checkpoint_write(((bx_shadow_data_c*)node)->getptr(),
+                       ((bx_shadow_data_c*)node)->get_size());
+      break;
+    case BXT_LIST:
+      {
+        bx_list_c *list = (bx_list_c*)node;
+        for (int i=0; i < list->get_size(); i++) {
+          checkpoint_sr_param(list->get(i));
+        }
+        break;
+      }
+    default:
+      BX_ERROR(("checkpoint_sr_param(): unknown parameter type"));
+  }
+}
+
+void bx_real_sim_c::rollback_sr_param(bx_param_c *node, Bit32u *pos)
+{
+  Bit64s value;
+  Bit32u len;
+
+  switch (node->get_type()) {
+    case BXT_PARAM_NUM:
+    case BXT_PARAM_BOOL:
+    case BXT_PARAM_ENUM:
+      memcpy(&value, sr_checkpoint + *pos, sizeof(value));
+      *pos += sizeof(value);
+      ((bx_param_num_c*)node)->set(value);
+      break;
+    case BXT_PARAM_STRING:
+      len = ((bx_param_string_c*)node)->get_maxsize();
+      ((bx_param_string_c*)node)->set((char*)(sr_checkpoint + *pos));
+      *pos += len;
+      break;
+    case BXT_PARAM_DATA:
+      len = ((bx_shadow_data_c*)node)->get_size();
+      memcpy(((bx_shadow_data_c*)node)->getptr(), sr_checkpoint + *pos, len);
+      *pos += len;
+      break;
+    case BXT_LIST:
+      {
+        bx_list_c *list = (bx_list_c*)node;
+        for (int i=0; i < list->get_size(); i++) {
+          rollback_sr_param(list->get(i), pos);
+        }
+        break;
+      }
+    default:
+      BX_ERROR(("rollback_sr_param(): unknown parameter type"));
+  }
+}
+
+// The hard disk writes after a checkpoint are kept in an overlay by the
+// hard drive and dropped on rollback. The floppy images are written
+// directly, rolling back with a writable floppy inserted would pair the old
+// machine state with newer disk contents, so only write protected floppies
+// are allowed.
+bx_bool bx_real_sim_c::writable_disk_attached(char *name, int maxlen)
+{
+  char pname[BX_PATHNAME_LEN];
+  bx_list_c *base;
+
+  for (int drive=0; drive<2; drive++) {
+    sprintf(pname, "floppy.%d", drive);
+    base = (bx_list_c*) get_param(pname);
+    if ((get_param_enum("devtype", base)->get() != BX_FDD_NONE) &&
+        get_param_bool("status", base)->get() &&
+        !get_param_bool("readonly", base)->get()) {
+      snprintf(name, maxlen, "floppy %c", 'A' + drive);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+bx_bool bx_real_sim_c::checkpoint_state()
+{
+  bx_list_c *sr_list = get_bochs_root();
+  int ndev = sr_list->get_size();
+  char disk[40];
+
+  if (writable_disk_attached(disk, sizeof(disk))) {
+    BX_ERROR(("checkpoint_state(): cannot take a checkpoint with the writable %s attached", disk));
+    return 0;
+  }
+  if (!DEV_hd_checkpoint_disks()) {
+    BX_ERROR(("checkpoint_state(): cannot keep the hard disk writes"));
+    return 0;
+  }
+
+  sr_checkpoint_len = 0;
+  for (int dev=0; dev<ndev; dev++) {
+    // guest RAM is handled copy-on-write by the memory object
+    if (!strcmp(sr_list->get(dev)->get_name(), "memory")) continue;
+    checkpoint_sr_param(sr_list->get(dev));
+  }
+  BX_MEM(0)->checkpoint_memory();
+  BX_INFO(("checkpoint taken (%u bytes of device state)", sr_checkpoint_len));
+  return 1;
+}
+
+bx_bool bx_real_sim_c::rollback_state()
+{
+  if (sr_checkpoint == NULL || !BX_MEM(0)->has_checkpoint()) {
+    BX_ERROR(("rollback_state(): no checkpoint"));
+    return 0;
+  }
+  // a floppy might have been changed since the checkpoint
+  char disk[40];
+  if (writable_disk_attached(disk, sizeof(disk))) {
+    BX_ERROR(("rollback_state(): cannot roll back with the writable %s attached", disk));
+    return 0;
+  }
+  if (!DEV_hd_rollback_disks()) {
+    BX_ERROR(("rollback_state(): cannot drop the hard disk writes"));
+    return 0;
+  }
+
+  bx_list_c *sr_list = get_bochs_root();
+  int ndev = sr_list->get_size();
+  Bit32u pos = 0;
+
+  // same sequence as restoring a saved state at startup: reset first, so
+  // that resources registered by the devices are released again
+  bx_pc_system.Reset(BX_RESET_HARDWARE);
+
+  for (int dev=0; dev<ndev; dev++) {
+    if (!strcmp(sr_list->get(dev)->get_name(), "memory")) continue;
+    rollback_sr_param(sr_list->get(dev), &pos);
+  }
+  BX_ASSERT(pos == sr_checkpoint_len);
+  BX_MEM(0)->rollback_memory();
+  bx_sr_after_restore_state();
+  BX_INFO(("rolled back to the checkpoint"));
   return 1;
 }
 
+void bx_real_sim_c::discard_checkpoint()
+{
+  delete [] sr_checkpoint;
+  sr_checkpoint = NULL;
+  sr_checkpoint_len = 0;
+  sr_checkpoint_size = 0;
+  BX_MEM(0)->discard_checkpoint();
+}
+
 bx_bool bx_real_sim_c::save_sr_param(FILE *fp, bx_param_c *node, const char *sr_path, int level)
 {
   int i;
@@ -1228,6 +1599,9 @@ bx_bool bx_real_sim_c::save_sr_param(FILE *fp, bx_param_c *node, const char *sr_
       break;
     case BXT_PARAM_DATA:
       fprintf(fp, "%s.%s\n", node->get_parent()->get_name(), node->get_name());
+      // written as the pages changed since the previous save instead
+      if (node == sr_skip_data)
+        break;
       if (sr_path)
         sprintf(tmpstr, "%s/%s.%s", sr_path, node->get_parent()->get_name(), node->get_name());
       else
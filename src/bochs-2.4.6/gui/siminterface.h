@@ -523,7 +523,8 @@ enum {
 #define BX_HDIMAGE_MODE_Z_UNDOABLE 10
 #define BX_HDIMAGE_MODE_Z_VOLATILE 11
 #define BX_HDIMAGE_MODE_VVFAT      12
-#define BX_HDIMAGE_MODE_LAST       12
+#define BX_HDIMAGE_MODE_QCOW       13
+#define BX_HDIMAGE_MODE_LAST       13
 
 #define BX_CLOCK_SYNC_NONE       0
 #define BX_CLOCK_SYNC_REALTIME   1
@@ -531,6 +532,9 @@ enum {
 #define BX_CLOCK_SYNC_BOTH       3
 #define BX_CLOCK_SYNC_LAST       3
 
+#define BX_MEM_FILE_PRIVATE      0
+#define BX_MEM_FILE_SHARED       1
+
 #define BX_CPUID_SUPPORT_NOSSE   0
 #define BX_CPUID_SUPPORT_SSE     1
 #define BX_CPUID_SUPPORT_SSE2    2
@@ -556,6 +560,12 @@ BOCHSAPI extern const char *hdimage_mode_names[];
 #include <setjmp.h>
 
 enum ci_command_t { CI_START, CI_RUNTIME_CONFIG, CI_SHUTDOWN };
+
+// operations on the whole machine state, see request_state_op()
+#define BX_STATE_OP_CHECKPOINT 0x1 // take an in-process checkpoint
+#define BX_STATE_OP_ROLLBACK   0x2 // roll back to the checkpoint
+#define BX_STATE_OP_SAVE       0x4 // periodic saved state (-checkpoint)
+
 enum ci_return_t {
   CI_OK,                  // normal return value
   CI_ERR_NO_TEXT_CONSOLE  // err: can't work because there's no text console
@@ -703,11 +713,19 @@ public:
   // save/restore support
   virtual void init_save_restore() {}
   virtual bx_bool save_state(const char *checkpoint_path) {return 0;}
+  virtual bx_bool save_state_incremental(const char *checkpoint_path) {return 0;}
   virtual bx_bool restore_config() {return 0;}
   virtual bx_bool restore_logopts() {return 0;}
   virtual bx_bool restore_hardware() {return 0;}
   virtual bx_list_c *get_bochs_root() {return NULL;}
   virtual bx_bool restore_bochs_param(bx_list_c *root, const char *sr_path, const char *restore_name) { return 0; }
+  // in-process checkpoint and rollback of the whole machine
+  virtual bx_bool checkpoint_state() {return 0;}
+  virtual bx_bool rollback_state() {return 0;}
+  virtual void discard_checkpoint() {}
+  // run BX_STATE_OP_* operations at the next instruction boundary, can be
+  // called from the runtime config interface or a device handler
+  virtual void request_state_op(Bit32u op) {}
 };
 
 BOCHSAPI extern bx_simulator_interface_c *SIM;
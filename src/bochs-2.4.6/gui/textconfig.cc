@@ -321,10 +321,12 @@ static const char *runtime_menu_prompt =
 "10. Instruction tracing: off (doesn't exist yet)\n"
 "11. USB runtime options\n"
 "12. Misc runtime options\n"
-"13. Continue simulation\n"
-"14. Quit now\n"
+"13. Take a checkpoint of the machine state\n"
+"14. Roll back to the checkpoint\n"
+"15. Continue simulation\n"
+"16. Quit now\n"
 "\n"
-"Please choose one:  [13] ";
+"Please choose one:  [15] ";
 
 #define NOT_IMPLEMENTED(choice) \
   fprintf(stderr, "ERROR: choice %d not implemented\n", choice);
@@ -522,6 +524,14 @@ int bx_config_interface(int menu)
             case BX_CI_RT_INST_TR: NOT_IMPLEMENTED(choice); break;
             case BX_CI_RT_USB: do_menu(BXPN_MENU_RUNTIME_USB); break;
             case BX_CI_RT_MISC: do_menu(BXPN_MENU_RUNTIME_MISC); break;
+            case BX_CI_RT_CHECKPOINT:
+              // taken when the simulation continues, at the next
+              // instruction boundary
+              SIM->request_state_op(BX_STATE_OP_CHECKPOINT);
+              break;
+            case BX_CI_RT_ROLLBACK:
+              SIM->request_state_op(BX_STATE_OP_ROLLBACK);
+              break;
             case BX_CI_RT_CONT: fprintf(stderr, "Continuing simulation\n"); return 0;
             case BX_CI_RT_QUIT:
               fprintf(stderr, "You chose quit on the configuration interface.\n");
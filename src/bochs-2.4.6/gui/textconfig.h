@@ -49,6 +49,8 @@ enum {
   BX_CI_RT_INST_TR,
   BX_CI_RT_USB,
   BX_CI_RT_MISC,
+  BX_CI_RT_CHECKPOINT,
+  BX_CI_RT_ROLLBACK,
   BX_CI_RT_CONT,
   BX_CI_RT_QUIT
 };
@@ -0,0 +1,81 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// bxtrace.h
+//
+// Binary execution trace file format.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_TRACE_FORMAT_H
+#define BX_TRACE_FORMAT_H
+
+//
+// Binary execution trace, written by the instrument/bxtrace module and
+// read by the offline decoder misc/bxtrace.cc.
+//
+// The file starts with a 16 byte header (magic, version and number of
+// CPUs as 32-bit values) followed by a stream of records. Every record
+// starts with its type and the number of the CPU it belongs to, multi-byte
+// fields are little endian. The records of one CPU are in execution order,
+// the records of different CPUs are interleaved in blocks.
+//
+
+#define BXTRACE_MAGIC       "BXTRACE"
+#define BXTRACE_VERSION     1
+#define BXTRACE_HEADER_SIZE 16
+
+enum {
+  // type, cpu, info, laddr(8), opcode bytes
+  BXTRACE_INSN = 1,
+  // type, cpu, info, opcode bytes: the instruction starts right after the
+  // previous instruction of the same CPU
+  BXTRACE_INSN_NEXT,
+  // type, cpu, cr3(8): address space of the following instructions
+  BXTRACE_CR3,
+  // type, cpu, rw, len, laddr(8): data access of the last instruction
+  BXTRACE_MEM,
+  // type, cpu, vector, error_code(4)
+  BXTRACE_EXCEPTION,
+  // type, cpu, vector
+  BXTRACE_HWINTERRUPT
+};
+
+// info byte of the instruction records
+#define BXTRACE_INFO(len, mode)  ((len) | ((mode) << 4))
+#define BXTRACE_INFO_LEN(info)   ((info) & 0xf)
+#define BXTRACE_INFO_MODE(info)  ((info) >> 4)
+
+enum {
+  BXTRACE_MODE_16 = 0,
+  BXTRACE_MODE_32,
+  BXTRACE_MODE_64
+};
+
+// longest record: BXTRACE_INSN with 15 opcode bytes
+#define BXTRACE_MAX_RECORD 26
+
+BX_CPP_INLINE void bxtrace_put32(Bit8u *p, Bit32u val)
+{
+  for (unsigned n=0; n<4; n++, val >>= 8)
+    p[n] = (Bit8u) val;
+}
+
+BX_CPP_INLINE void bxtrace_put64(Bit8u *p, Bit64u val)
+{
+  for (unsigned n=0; n<8; n++, val >>= 8)
+    p[n] = (Bit8u) val;
+}
+
+BX_CPP_INLINE Bit32u bxtrace_get32(const Bit8u *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((Bit32u) p[3] << 24);
+}
+
+BX_CPP_INLINE Bit64u bxtrace_get64(const Bit8u *p)
+{
+  return bxtrace_get32(p) | ((Bit64u) bxtrace_get32(p + 4) << 32);
+}
+
+#endif
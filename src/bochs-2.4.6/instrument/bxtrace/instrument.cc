@@ -0,0 +1,371 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// instrument.cc
+//
+// Binary execution trace recorder.
+//
+
+#include <assert.h>
+
+#include "bochs.h"
+#include "cpu/cpu.h"
+
+#if BX_HAVE_PTHREAD && !defined(WIN32)
+#include <pthread.h>
+#define BXTRACE_WRITER_THREAD 1
+#else
+#define BXTRACE_WRITER_THREAD 0
+#endif
+
+#define LOG_THIS genlog->
+
+bxInstrumentation *icpu = NULL;
+
+// Every CPU fills a block of its own, so recording needs no locking.
+// Full blocks are queued to the writer thread and replaced by a free one;
+// the CPU only waits when the writer is a whole buffer behind.
+#define BXTRACE_BLOCK_SIZE (1024 * 1024)
+
+struct bxtrace_block_t {
+  Bit8u *data;
+  unsigned used;
+  bxtrace_block_t *next;
+};
+
+static struct {
+  char *path;           // trace file, nothing is recorded without one
+  bx_bool memory;       // record the data accesses
+  unsigned buffer;      // size of all the blocks in megabytes
+  FILE *fp;
+  Bit64u bytes;         // written to the file
+  Bit64u stalls;        // CPU waited for a free block
+  bxtrace_block_t *free_list;
+  bxtrace_block_t *queue_head, *queue_tail;
+#if BXTRACE_WRITER_THREAD
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t queued;
+  pthread_cond_t freed;
+  bx_bool stop;
+#endif
+} bxtrace;
+
+static void bxtrace_write(bxtrace_block_t *block)
+{
+  if (fwrite(block->data, 1, block->used, bxtrace.fp) != block->used)
+    BX_ERROR(("bxtrace: write to '%s' failed", bxtrace.path));
+  bxtrace.bytes += block->used;
+  block->used = 0;
+}
+
+#if BXTRACE_WRITER_THREAD
+
+static void *bxtrace_writer(void *arg)
+{
+  pthread_mutex_lock(&bxtrace.lock);
+  for (;;) {
+    while (bxtrace.queue_head == NULL && !bxtrace.stop)
+      pthread_cond_wait(&bxtrace.queued, &bxtrace.lock);
+    bxtrace_block_t *block = bxtrace.queue_head;
+    if (block == NULL) break;
+    bxtrace.queue_head = block->next;
+    pthread_mutex_unlock(&bxtrace.lock);
+
+    bxtrace_write(block);
+
+    pthread_mutex_lock(&bxtrace.lock);
+    block->next = bxtrace.free_list;
+    bxtrace.free_list = block;
+    pthread_cond_signal(&bxtrace.freed);
+  }
+  pthread_mutex_unlock(&bxtrace.lock);
+  return NULL;
+}
+
+#endif
+
+// Queue a full (or the final) block for writing and return a free one
+static bxtrace_block_t *bxtrace_exchange(bxtrace_block_t *block, bx_bool need_free)
+{
+#if BXTRACE_WRITER_THREAD
+  pthread_mutex_lock(&bxtrace.lock);
+  if (block) {
+    block->next = NULL;
+    if (bxtrace.queue_head)
+      bxtrace.queue_tail->next = block;
+    else
+      bxtrace.queue_head = block;
+    bxtrace.queue_tail = block;
+    pthread_cond_signal(&bxtrace.queued);
+  }
+  block = NULL;
+  if (need_free) {
+    if (bxtrace.free_list == NULL) {
+      bxtrace.stalls++;
+      do {
+        pthread_cond_wait(&bxtrace.freed, &bxtrace.lock);
+      } while (bxtrace.free_list == NULL);
+    }
+    block = bxtrace.free_list;
+    bxtrace.free_list = block->next;
+  }
+  pthread_mutex_unlock(&bxtrace.lock);
+#else
+  if (block) {
+    bxtrace_write(block);
+    block->next = bxtrace.free_list;
+    bxtrace.free_list = block;
+  }
+  block = NULL;
+  if (need_free) {
+    block = bxtrace.free_list;
+    bxtrace.free_list = block->next;
+  }
+#endif
+  return block;
+}
+
+static void bxtrace_close(void)
+{
+  if (bxtrace.fp == NULL) return;
+
+  for (unsigned cpu=0; cpu<BX_SMP_PROCESSORS; cpu++) {
+    icpu[cpu].deactivate();
+    icpu[cpu].flush();
+  }
+
+#if BXTRACE_WRITER_THREAD
+  pthread_mutex_lock(&bxtrace.lock);
+  bxtrace.stop = 1;
+  pthread_cond_signal(&bxtrace.queued);
+  pthread_mutex_unlock(&bxtrace.lock);
+  pthread_join(bxtrace.writer, NULL);
+#endif
+
+  fclose(bxtrace.fp);
+  bxtrace.fp = NULL;
+
+  BX_INFO(("bxtrace: " FMT_LL "u bytes written to '%s', CPUs waited " FMT_LL "u times for the writer",
+    bxtrace.bytes + BXTRACE_HEADER_SIZE, bxtrace.path, bxtrace.stalls));
+}
+
+static void bxtrace_open(void)
+{
+  bxtrace.fp = fopen(bxtrace.path, "wb");
+  if (bxtrace.fp == NULL) {
+    BX_PANIC(("bxtrace: cannot create trace file '%s'", bxtrace.path));
+    return;
+  }
+
+  Bit8u header[BXTRACE_HEADER_SIZE];
+  memcpy(header, BXTRACE_MAGIC, 8);
+  bxtrace_put32(header + 8, BXTRACE_VERSION);
+  bxtrace_put32(header + 12, BX_SMP_PROCESSORS);
+  fwrite(header, 1, BXTRACE_HEADER_SIZE, bxtrace.fp);
+
+  // at least one block per CPU and two in flight
+  unsigned blocks = bxtrace.buffer * 1024 * 1024 / BXTRACE_BLOCK_SIZE;
+  if (blocks < BX_SMP_PROCESSORS + 2)
+    blocks = BX_SMP_PROCESSORS + 2;
+  for (unsigned n=0; n<blocks; n++) {
+    bxtrace_block_t *block = new bxtrace_block_t;
+    block->data = new Bit8u[BXTRACE_BLOCK_SIZE];
+    block->used = 0;
+    block->next = bxtrace.free_list;
+    bxtrace.free_list = block;
+  }
+
+#if BXTRACE_WRITER_THREAD
+  pthread_mutex_init(&bxtrace.lock, NULL);
+  pthread_cond_init(&bxtrace.queued, NULL);
+  pthread_cond_init(&bxtrace.freed, NULL);
+  bxtrace.stop = 0;
+  if (pthread_create(&bxtrace.writer, NULL, bxtrace_writer, NULL) != 0)
+    BX_PANIC(("bxtrace: cannot create the writer thread"));
+#endif
+
+  // the simulation often ends with exit() without reaching exit_env
+  atexit(bxtrace_close);
+
+  BX_INFO(("bxtrace: recording %s to '%s'",
+    bxtrace.memory ? "instructions and data accesses" : "instructions", bxtrace.path));
+}
+
+static Bit32s bxtrace_parse(const char *context, int num_params, char *params[])
+{
+  for (int i=1; i<num_params; i++) {
+    if (!strncmp(params[i], "file=", 5)) {
+      free(bxtrace.path);
+      bxtrace.path = strdup(&params[i][5]);
+    }
+    else if (!strncmp(params[i], "memory=", 7)) {
+      bxtrace.memory = atol(&params[i][7]);
+    }
+    else if (!strncmp(params[i], "buffer=", 7)) {
+      bxtrace.buffer = atol(&params[i][7]);
+    }
+    else {
+      BX_PANIC(("%s: unknown parameter '%s' for bxtrace", context, params[i]));
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static Bit32s bxtrace_save(FILE *fp)
+{
+  if (bxtrace.path != NULL) {
+    fprintf(fp, "bxtrace: file=%s, memory=%d, buffer=%u\n",
+      bxtrace.path, bxtrace.memory, bxtrace.buffer);
+  }
+  return 0;
+}
+
+void bx_instr_init_env(void)
+{
+  bxtrace.buffer = 32;
+  SIM->register_user_option("bxtrace", bxtrace_parse, bxtrace_save);
+}
+
+void bx_instr_exit_env(void)
+{
+  bxtrace_close();
+}
+
+void bx_instr_initialize(unsigned cpu)
+{
+  assert(cpu < BX_SMP_PROCESSORS);
+
+  if (icpu == NULL) {
+    icpu = new bxInstrumentation[BX_SMP_PROCESSORS];
+    if (bxtrace.path != NULL && bxtrace.path[0] != 0)
+      bxtrace_open();
+  }
+
+  icpu[cpu].set_cpu_id(cpu);
+}
+
+void bxInstrumentation::bx_instr_reset(unsigned type)
+{
+  // start with full records
+  cr3 = BX_CONST64(0xffffffffffffffff);
+  next_laddr = BX_CONST64(0xffffffffffffffff);
+  active = (bxtrace.fp != NULL);
+}
+
+void bxInstrumentation::flush(void)
+{
+  if (block)
+    block->used = ptr - block->data;
+
+  block = bxtrace_exchange(block, active);
+  if (block) {
+    ptr = block->data;
+    end = block->data + BXTRACE_BLOCK_SIZE;
+  }
+  else {
+    ptr = end = NULL;
+  }
+}
+
+// Copy the opcode bytes from the prefetch window, instructions crossing
+// a page boundary are read through the page tables.
+static void bxtrace_fetch(BX_CPU_C *cpu, bx_address rip, bx_address laddr, unsigned len, Bit8u *buf)
+{
+  bx_address eipBiased = rip + cpu->eipPageBias;
+
+  if (cpu->eipFetchPtr && eipBiased < cpu->eipPageWindowSize &&
+      len <= cpu->eipPageWindowSize - eipBiased)
+  {
+    memcpy(buf, cpu->eipFetchPtr + eipBiased, len);
+    return;
+  }
+
+  for (unsigned n=0; n<len; n++) {
+    bx_phy_address phy;
+    if (! cpu->dbg_xlate_linear2phy(laddr + n, &phy) ||
+        ! BX_MEM(0)->dbg_fetch_mem(cpu, phy, 1, buf + n))
+      buf[n] = 0;
+  }
+}
+
+void bxInstrumentation::bx_instr_before_execution(bxInstruction_c *i)
+{
+  if (!active) return;
+
+  BX_CPU_C *cpu = BX_CPU(cpu_id);
+  Bit8u *p = reserve();
+
+  if (cpu->cr3 != cr3) {
+    cr3 = cpu->cr3;
+    p[0] = BXTRACE_CR3;
+    p[1] = cpu_id;
+    bxtrace_put64(p + 2, cr3);
+    ptr = p + 10;
+    p = reserve();
+  }
+
+  unsigned mode = BXTRACE_MODE_16;
+  if (cpu->cpu_mode == BX_MODE_LONG_64)
+    mode = BXTRACE_MODE_64;
+  else if (cpu->sregs[BX_SEG_REG_CS].cache.u.segment.d_b)
+    mode = BXTRACE_MODE_32;
+
+  bx_address rip = cpu->get_instruction_pointer();
+  bx_address laddr = cpu->get_laddr(BX_SEG_REG_CS, rip);
+  unsigned len = i->ilen();
+
+  p[1] = cpu_id;
+  p[2] = BXTRACE_INFO(len, mode);
+  if (laddr == next_laddr) {
+    p[0] = BXTRACE_INSN_NEXT;
+    p += 3;
+  }
+  else {
+    p[0] = BXTRACE_INSN;
+    bxtrace_put64(p + 3, laddr);
+    p += 11;
+  }
+
+  bxtrace_fetch(cpu, rip, laddr, len, p);
+  ptr = p + len;
+  next_laddr = (Bit64u) laddr + len;
+}
+
+void bxInstrumentation::bx_instr_exception(unsigned vector, unsigned error_code)
+{
+  if (!active) return;
+
+  Bit8u *p = reserve();
+  p[0] = BXTRACE_EXCEPTION;
+  p[1] = cpu_id;
+  p[2] = vector;
+  bxtrace_put32(p + 3, error_code);
+  ptr = p + 7;
+}
+
+void bxInstrumentation::bx_instr_hwinterrupt(unsigned vector, Bit16u cs, bx_address eip)
+{
+  if (!active) return;
+
+  Bit8u *p = reserve();
+  p[0] = BXTRACE_HWINTERRUPT;
+  p[1] = cpu_id;
+  p[2] = vector;
+  ptr = p + 3;
+}
+
+void bxInstrumentation::bx_instr_mem_data_access(unsigned seg, bx_address offset, unsigned len, unsigned rw)
+{
+  if (!active || !bxtrace.memory) return;
+
+  Bit8u *p = reserve();
+  p[0] = BXTRACE_MEM;
+  p[1] = cpu_id;
+  p[2] = rw;
+  p[3] = len;
+  bxtrace_put64(p + 4, BX_CPU(cpu_id)->get_laddr(seg, offset));
+  ptr = p + 12;
+}
@@ -0,0 +1,224 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// instrument.h
+//
+// Binary execution trace recorder.
+//
+
+//
+// Binary execution trace recorder (bochsrc "bxtrace:" option).
+//
+// Every executed instruction is appended to a per-CPU block as a compact
+// record (linear address, opcode bytes and execution mode, CR3 only when
+// it changes), optionally followed by its data accesses. Full blocks are
+// written to the trace file by a host thread. Use misc/bxtrace.cc to
+// disassemble and filter the trace.
+//
+
+// possible types passed to BX_INSTR_TLB_CNTRL()
+#define BX_INSTR_MOV_CR3      10
+#define BX_INSTR_INVLPG       11
+#define BX_INSTR_TASKSWITCH   12
+
+// possible types passed to BX_INSTR_CACHE_CNTRL()
+#define BX_INSTR_INVD         20
+#define BX_INSTR_WBINVD       21
+
+// possible types passed to BX_INSTR_FAR_BRANCH()
+#define BX_INSTR_IS_CALL      10
+#define BX_INSTR_IS_RET       11
+#define BX_INSTR_IS_IRET      12
+#define BX_INSTR_IS_JMP       13
+#define BX_INSTR_IS_INT       14
+#define BX_INSTR_IS_SYSCALL   15
+#define BX_INSTR_IS_SYSRET    16
+#define BX_INSTR_IS_SYSENTER  17
+#define BX_INSTR_IS_SYSEXIT   18
+
+// possible types passed to BX_INSTR_PREFETCH_HINT()
+#define BX_INSTR_PREFETCH_NTA 0
+#define BX_INSTR_PREFETCH_T0  1
+#define BX_INSTR_PREFETCH_T1  2
+#define BX_INSTR_PREFETCH_T2  3
+
+
+#if BX_INSTRUMENTATION
+
+#include "bxtrace.h"
+
+class bxInstruction_c;
+
+void bx_instr_init_env(void);
+void bx_instr_exit_env(void);
+void bx_instr_initialize(unsigned cpu);
+
+struct bxtrace_block_t;
+
+class bxInstrumentation {
+public:
+  bxInstrumentation(): active(0), block(NULL), ptr(NULL), end(NULL) {}
+
+  void set_cpu_id(unsigned cpu) { cpu_id = cpu; }
+
+  void activate() { active = 1; }
+  void deactivate() { active = 0; }
+  void toggle_active() { active = !active; }
+  bx_bool is_active() const { return active; }
+
+  void bx_instr_reset(unsigned type);
+  void bx_instr_before_execution(bxInstruction_c *i);
+
+  void bx_instr_exception(unsigned vector, unsigned error_code);
+  void bx_instr_hwinterrupt(unsigned vector, Bit16u cs, bx_address eip);
+
+  void bx_instr_mem_data_access(unsigned seg, bx_address offset, unsigned len, unsigned rw);
+
+  // hand the records collected so far over to the writer
+  void flush(void);
+
+private:
+  Bit8u *reserve(void) {
+    if (ptr + BXTRACE_MAX_RECORD > end) flush();
+    return ptr;
+  }
+
+  unsigned cpu_id;
+  bx_bool active;
+
+  bxtrace_block_t *block;
+  Bit8u *ptr, *end;           // free space of the current block
+
+  Bit64u cr3;                 // CR3 of the last recorded instruction
+  Bit64u next_laddr;          // address right after the last instruction
+};
+
+extern bxInstrumentation *icpu;
+
+/* initialization/deinitialization of instrumentalization*/
+#define BX_INSTR_INIT_ENV() bx_instr_init_env()
+#define BX_INSTR_EXIT_ENV() bx_instr_exit_env()
+
+/* simulation init, shutdown, reset */
+#define BX_INSTR_INITIALIZE(cpu_id)	   bx_instr_initialize(cpu_id);
+#define BX_INSTR_EXIT(cpu_id)
+#define BX_INSTR_RESET(cpu_id, type)     icpu[cpu_id].bx_instr_reset(type)
+#define BX_INSTR_HLT(cpu_id)
+#define BX_INSTR_MWAIT(cpu_id, addr, len, flags)
+
+#define BX_INSTR_NEW_INSTRUCTION(cpu_id)
+
+/* called from command line debugger */
+#define BX_INSTR_DEBUG_PROMPT()
+#define BX_INSTR_DEBUG_CMD(cmd)
+
+/* branch resoultion */
+#define BX_INSTR_CNEAR_BRANCH_TAKEN(cpu_id, new_eip)
+#define BX_INSTR_CNEAR_BRANCH_NOT_TAKEN(cpu_id)
+#define BX_INSTR_UCNEAR_BRANCH(cpu_id, what, new_eip)
+#define BX_INSTR_FAR_BRANCH(cpu_id, what, new_cs, new_eip)
+
+/* decoding completed */
+#define BX_INSTR_OPCODE(cpu_id, opcode, len, is32, is64)
+
+/* exceptional case and interrupt */
+#define BX_INSTR_EXCEPTION(cpu_id, vector, error_code) \
+                       icpu[cpu_id].bx_instr_exception(vector, error_code)
+
+#define BX_INSTR_INTERRUPT(cpu_id, vector)
+#define BX_INSTR_HWINTERRUPT(cpu_id, vector, cs, eip) icpu[cpu_id].bx_instr_hwinterrupt(vector, cs, eip)
+
+/* TLB/CACHE control instruction executed */
+#define BX_INSTR_CLFLUSH(cpu_id, laddr, paddr)
+#define BX_INSTR_CACHE_CNTRL(cpu_id, what)
+#define BX_INSTR_TLB_CNTRL(cpu_id, what, new_cr3)
+#define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset)
+#define BX_INSTR_ICACHE_STATS(cpu_id, hits, conflict_misses, cold_fills)
+
+/* execution */
+#define BX_INSTR_BEFORE_EXECUTION(cpu_id, i) icpu[cpu_id].bx_instr_before_execution(i)
+#define BX_INSTR_AFTER_EXECUTION(cpu_id, i)
+#define BX_INSTR_REPEAT_ITERATION(cpu_id, i)
+
+/* memory access */
+#define BX_INSTR_LIN_ACCESS(cpu_id, lin, phy, len, rw)
+
+#define BX_INSTR_MEM_DATA_ACCESS(cpu_id, seg, offset, len, rw) \
+                    icpu[cpu_id].bx_instr_mem_data_access(seg, offset, len, rw)
+
+/* called from memory object */
+#define BX_INSTR_PHY_WRITE(cpu_id, addr, len)
+#define BX_INSTR_PHY_READ(cpu_id, addr, len)
+
+/* feedback from device units */
+#define BX_INSTR_INP(addr, len)
+#define BX_INSTR_INP2(addr, len, val)
+#define BX_INSTR_OUTP(addr, len, val)
+
+/* wrmsr callback */
+#define BX_INSTR_WRMSR(cpu_id, addr, value)
+
+#else // BX_INSTRUMENTATION
+
+/* initialization/deinitialization of instrumentalization */
+#define BX_INSTR_INIT_ENV()
+#define BX_INSTR_EXIT_ENV()
+
+/* simulation init, shutdown, reset */
+#define BX_INSTR_INITIALIZE(cpu_id)
+#define BX_INSTR_EXIT(cpu_id)
+#define BX_INSTR_RESET(cpu_id, type)
+#define BX_INSTR_HLT(cpu_id)
+#define BX_INSTR_MWAIT(cpu_id, addr, len, flags)
+#define BX_INSTR_NEW_INSTRUCTION(cpu_id)
+
+/* called from command line debugger */
+#define BX_INSTR_DEBUG_PROMPT()
+#define BX_INSTR_DEBUG_CMD(cmd)
+
+/* branch resoultion */
+#define BX_INSTR_CNEAR_BRANCH_TAKEN(cpu_id, new_eip)
+#define BX_INSTR_CNEAR_BRANCH_NOT_TAKEN(cpu_id)
+#define BX_INSTR_UCNEAR_BRANCH(cpu_id, what, new_eip)
+#define BX_INSTR_FAR_BRANCH(cpu_id, what, new_cs, new_eip)
+
+/* decoding completed */
+#define BX_INSTR_OPCODE(cpu_id, opcode, len, is32, is64)
+
+/* exceptional case and interrupt */
+#define BX_INSTR_EXCEPTION(cpu_id, vector, error_code)
+#define BX_INSTR_INTERRUPT(cpu_id, vector)
+#define BX_INSTR_HWINTERRUPT(cpu_id, vector, cs, eip)
+
+/* TLB/CACHE control instruction executed */
+#define BX_INSTR_CLFLUSH(cpu_id, laddr, paddr)
+#define BX_INSTR_CACHE_CNTRL(cpu_id, what)
+#define BX_INSTR_TLB_CNTRL(cpu_id, what, new_cr3)
+#define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset)
+#define BX_INSTR_ICACHE_STATS(cpu_id, hits, conflict_misses, cold_fills)
+
+/* execution */
+#define BX_INSTR_BEFORE_EXECUTION(cpu_id, i)
+#define BX_INSTR_AFTER_EXECUTION(cpu_id, i)
+#define BX_INSTR_REPEAT_ITERATION(cpu_id, i)
+
+/* memory access */
+#define BX_INSTR_LIN_ACCESS(cpu_id, lin, phy, len, rw)
+
+/* memory access */
+#define BX_INSTR_MEM_DATA_ACCESS(cpu_id, seg, offset, len, rw)
+
+/* called from memory object */
+#define BX_INSTR_PHY_WRITE(cpu_id, addr, len)
+#define BX_INSTR_PHY_READ(cpu_id, addr, len)
+
+/* feedback from device units */
+#define BX_INSTR_INP(addr, len)
+#define BX_INSTR_INP2(addr, len, val)
+#define BX_INSTR_OUTP(addr, len, val)
+
+/* wrmsr callback */
+#define BX_INSTR_WRMSR(cpu_id, addr, value)
+
+#endif // BX_INSTRUMENTATION
@@ -111,6 +111,7 @@ void bx_instr_mem_data_access(unsigned cpu, unsigned seg, bx_address offset, uns
 #define BX_INSTR_CACHE_CNTRL(cpu_id, what)
 #define BX_INSTR_TLB_CNTRL(cpu_id, what, new_cr3)
 #define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset)
+#define BX_INSTR_ICACHE_STATS(cpu_id, hits, conflict_misses, cold_fills)
 
 /* execution */
 #define BX_INSTR_BEFORE_EXECUTION(cpu_id, i)
@@ -173,6 +174,7 @@ void bx_instr_mem_data_access(unsigned cpu, unsigned seg, bx_address offset, uns
 #define BX_INSTR_CACHE_CNTRL(cpu_id, what)
 #define BX_INSTR_TLB_CNTRL(cpu_id, what, new_cr3)
 #define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset)
+#define BX_INSTR_ICACHE_STATS(cpu_id, hits, conflict_misses, cold_fills)
 
 /* execution */
 #define BX_INSTR_BEFORE_EXECUTION(cpu_id, i)
@@ -53,6 +53,8 @@ void bx_instr_clflush(unsigned cpu, bx_address laddr, bx_phy_address paddr) {}
 void bx_instr_cache_cntrl(unsigned cpu, unsigned what) {}
 void bx_instr_prefetch_hint(unsigned cpu, unsigned what, unsigned seg, bx_address offset) {}
 
+void bx_instr_icache_stats(unsigned cpu, Bit64u hits, Bit64u conflict_misses, Bit64u cold_fills) {}
+
 void bx_instr_before_execution(unsigned cpu, bxInstruction_c *i) {}
 void bx_instr_after_execution(unsigned cpu, bxInstruction_c *i) {}
 void bx_instr_repeat_iteration(unsigned cpu, bxInstruction_c *i) {}
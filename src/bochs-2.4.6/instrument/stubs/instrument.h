@@ -82,6 +82,8 @@ void bx_instr_cache_cntrl(unsigned cpu, unsigned what);
 void bx_instr_prefetch_hint(unsigned cpu, unsigned what, unsigned seg, bx_address offset);
 void bx_instr_clflush(unsigned cpu, bx_address laddr, bx_phy_address paddr);
 
+void bx_instr_icache_stats(unsigned cpu, Bit64u hits, Bit64u conflict_misses, Bit64u cold_fills);
+
 void bx_instr_before_execution(unsigned cpu, bxInstruction_c *i);
 void bx_instr_after_execution(unsigned cpu, bxInstruction_c *i);
 void bx_instr_repeat_iteration(unsigned cpu, bxInstruction_c *i);
@@ -141,6 +143,10 @@ void bx_instr_wrmsr(unsigned cpu, unsigned addr, Bit64u value);
 #define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset) \
                        bx_instr_prefetch_hint(cpu_id, what, seg, offset)
 
+/* instruction cache statistics */
+#define BX_INSTR_ICACHE_STATS(cpu_id, hits, conflict_misses, cold_fills) \
+                       bx_instr_icache_stats(cpu_id, hits, conflict_misses, cold_fills)
+
 /* execution */
 #define BX_INSTR_BEFORE_EXECUTION(cpu_id, i)  bx_instr_before_execution(cpu_id, i)
 #define BX_INSTR_AFTER_EXECUTION(cpu_id, i)   bx_instr_after_execution(cpu_id, i)
@@ -202,6 +208,9 @@ void bx_instr_wrmsr(unsigned cpu, unsigned addr, Bit64u value);
 #define BX_INSTR_TLB_CNTRL(cpu_id, what, new_cr3)
 #define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset)
 
+/* instruction cache statistics */
+#define BX_INSTR_ICACHE_STATS(cpu_id, hits, conflict_misses, cold_fills)
+
 /* execution */
 #define BX_INSTR_BEFORE_EXECUTION(cpu_id, i)
 #define BX_INSTR_AFTER_EXECUTION(cpu_id, i)
@@ -975,6 +975,9 @@ bx_devices_c::inp(Bit16u addr, unsigned io_len)
   struct io_handler_struct *io_read_handler;
   Bit32u ret;
 
+  // device models are not reentrant, serialize the CPU threads
+  BX_SMP_LOCK_SCOPE();
+
   BX_INSTR_INP(addr, io_len);
 
   io_read_handler = read_port_to_handler[addr];
@@ -1007,6 +1010,8 @@ bx_devices_c::outp(Bit16u addr, Bit32u value, unsigned io_len)
 {
   struct io_handler_struct *io_write_handler;
 
+  BX_SMP_LOCK_SCOPE();
+
   BX_INSTR_OUTP(addr, io_len, value);
   BX_DBG_IO_REPORT(addr, io_len, BX_WRITE, value);
 
@@ -1018,6 +1023,58 @@ bx_devices_c::outp(Bit16u addr, Bit32u value, unsigned io_len)
   }
 }
 
+/*
+ * Transfer a block of data from an IO port to host memory.
+ */
+
+unsigned bx_devices_c::inp_bulk(Bit16u addr, unsigned io_len, Bit8u *hostAddr, unsigned count)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  bulkIOHostAddr = hostAddr;
+  bulkIOQuantumsRequested = count;
+  bulkIOQuantumsTransferred = 0;
+
+  Bit32u value = inp(addr, io_len);
+  bulkIOQuantumsRequested = 0;
+  if (bulkIOQuantumsTransferred)
+    return bulkIOQuantumsTransferred;
+
+  // the device didn't handle bulk IO, store the single value
+  switch (io_len) {
+    case 1: *hostAddr = (Bit8u) value; break;
+    case 2: WriteHostWordToLittleEndian(hostAddr, (Bit16u) value); break;
+    default: WriteHostDWordToLittleEndian(hostAddr, value); break;
+  }
+  return 1;
+}
+
+/*
+ * Transfer a block of data from host memory to an IO port.
+ */
+
+unsigned bx_devices_c::outp_bulk(Bit16u addr, unsigned io_len, Bit8u *hostAddr, unsigned count)
+{
+  Bit16u value16;
+  Bit32u value;
+
+  BX_SMP_LOCK_SCOPE();
+
+  switch (io_len) {
+    case 1: value = *hostAddr; break;
+    case 2: ReadHostWordFromLittleEndian(hostAddr, value16); value = value16; break;
+    default: ReadHostDWordFromLittleEndian(hostAddr, value); break;
+  }
+
+  bulkIOHostAddr = hostAddr;
+  bulkIOQuantumsRequested = count;
+  bulkIOQuantumsTransferred = 0;
+
+  outp(addr, value, io_len);
+  bulkIOQuantumsRequested = 0;
+  return bulkIOQuantumsTransferred ? bulkIOQuantumsTransferred : 1;
+}
+
 bx_bool bx_devices_c::is_harddrv_enabled(void)
 {
   char pname[24];
@@ -66,6 +66,13 @@
 #define BX_SELECTED_IS_HD(c) (BX_DRIVE_IS_HD((c),BX_SLAVE_SELECTED((c))))
 #define BX_SELECTED_IS_CD(c) (BX_DRIVE_IS_CD((c),BX_SLAVE_SELECTED((c))))
 
+#define BX_DMA_READ_COMMAND(cmd) (((cmd) == 0xC8) || ((cmd) == 0xC9) || ((cmd) == 0x25) || \
+  ((cmd) == 0xC7) || ((cmd) == 0x26))
+#define BX_DMA_WRITE_COMMAND(cmd) (((cmd) == 0xCA) || ((cmd) == 0xCB) || ((cmd) == 0x35) || \
+  ((cmd) == 0xCC) || ((cmd) == 0x36))
+#define BX_DMA_QUEUED_COMMAND(cmd) (((cmd) == 0xC7) || ((cmd) == 0x26) || \
+  ((cmd) == 0xCC) || ((cmd) == 0x36))
+
 #define BX_SELECTED_MODEL(c) (BX_HD_THIS channels[(c)].drives[BX_HD_THIS channels[(c)].drive_select].model_no)
 #define BX_SELECTED_TYPE_STRING(channel) ((BX_SELECTED_IS_CD(channel)) ? "CD-ROM" : "DISK")
 
@@ -129,6 +136,7 @@ bx_hard_drive_c::bx_hard_drive_c()
   for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
     for (Bit8u device=0; device<2; device ++) {
       channels[channel].drives[device].hdimage =  NULL;
+      channels[channel].drives[device].overlay = 0;
 #ifdef LOWLEVEL_CDROM
       channels[channel].drives[device].cdrom.cd =  NULL;
 #endif
@@ -142,6 +150,11 @@ bx_hard_drive_c::~bx_hard_drive_c()
   for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
     for (Bit8u device=0; device<2; device ++) {
       if (channels[channel].drives[device].hdimage != NULL) {
+        // the data of queued or cached writes is lost if this fails
+        if (channels[channel].drives[device].hdimage->flush() < 0) {
+          BX_ERROR(("ata%d-%d: writing the image back failed, the image file is not up to date",
+                    channel, device));
+        }
         channels[channel].drives[device].hdimage->close();
         delete channels[channel].drives[device].hdimage;
         channels[channel].drives[device].hdimage = NULL;
@@ -352,6 +365,25 @@ void bx_hard_drive_c::init(void)
         } else if (geometry_detect) {
           BX_PANIC(("ata%d-%d image doesn't support geometry detection", channel, device));
         }
+        if (SIM->get_param_bool("mmap", base)->get()) {
+          if (BX_HD_THIS channels[channel].drives[device].hdimage->map_image() < 0) {
+            BX_ERROR(("ata%d-%d: image can't be memory mapped, using file I/O", channel, device));
+          } else {
+            BX_INFO(("ata%d-%d: image mapped into host memory", channel, device));
+          }
+        }
+        if (SIM->get_param_bool("async", base)->get()) {
+          BX_HD_THIS channels[channel].drives[device].hdimage = DEV_hdimage_init_async(
+            BX_HD_THIS channels[channel].drives[device].hdimage);
+          BX_INFO(("ata%d-%d: using asynchronous image I/O", channel, device));
+        }
+        Bit32u cache_size = SIM->get_param_num("cache", base)->get();
+        if (cache_size > 0) {
+          BX_HD_THIS channels[channel].drives[device].hdimage = DEV_hdimage_init_cache(
+            BX_HD_THIS channels[channel].drives[device].hdimage, cache_size,
+            SIM->get_param_num("cache_flush", base)->get());
+          BX_INFO(("ata%d-%d: using %dK sector cache", channel, device, cache_size));
+        }
       } else if (SIM->get_param_enum("type", base)->get() == BX_ATA_DEVICE_CDROM) {
         bx_list_c *cdrom_rt = (bx_list_c*)SIM->get_param(BXPN_MENU_RUNTIME_CDROM);
         cdrom_rt->add(base);
@@ -2361,11 +2393,25 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
           }
           break;
 
-        // power management & flush cache stubs
-        case 0xE0: // STANDBY NOW
-        case 0xE1: // IDLE IMMEDIATE
         case 0xE7: // FLUSH CACHE
         case 0xEA: // FLUSH CACHE EXT
+          if (BX_SELECTED_IS_HD(channel)) {
+            if (BX_SELECTED_DRIVE(channel).hdimage->flush() < 0) {
+              BX_ERROR(("could not flush the disk image"));
+              command_aborted(channel, value);
+              break;
+            }
+          }
+          BX_SELECTED_CONTROLLER(channel).status.busy = 0;
+          BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
+          BX_SELECTED_CONTROLLER(channel).status.write_fault = 0;
+          BX_SELECTED_CONTROLLER(channel).status.drq = 0;
+          raise_interrupt(channel);
+          break;
+
+        // power management stubs
+        case 0xE0: // STANDBY NOW
+        case 0xE1: // IDLE IMMEDIATE
           BX_SELECTED_CONTROLLER(channel).status.busy = 0;
           BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
           BX_SELECTED_CONTROLLER(channel).status.write_fault = 0;
@@ -2409,6 +2455,7 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
         case 0x25: // READ DMA EXT
           lba48 = 1;
         case 0xC8: // READ DMA
+        case 0xC9: // READ DMA NO RETRY
           if (BX_SELECTED_IS_HD(channel) && BX_HD_THIS bmdma_present()) {
             lba48_transform(channel, lba48);
             BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
@@ -2424,6 +2471,7 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
         case 0x35: // WRITE DMA EXT
           lba48 = 1;
         case 0xCA: // WRITE DMA
+        case 0xCB: // WRITE DMA NO RETRY
           if (BX_SELECTED_IS_HD(channel) && BX_HD_THIS bmdma_present()) {
             lba48_transform(channel, lba48);
             BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
@@ -2436,12 +2484,48 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
           }
           break;
 
+        case 0x26: // READ DMA QUEUED EXT
+        case 0x36: // WRITE DMA QUEUED EXT
+          lba48 = 1;
+        case 0xC7: // READ DMA QUEUED
+        case 0xCC: // WRITE DMA QUEUED
+          /* The queue depth is 1 and the device never releases the bus,
+           * so the data transfer starts right away like for READ/WRITE DMA.
+           * The sector count is taken from the features register, the
+           * sector count register keeps the tag of the command.
+           */
+          if (BX_SELECTED_IS_HD(channel) && BX_HD_THIS bmdma_present()) {
+            BX_SELECTED_CONTROLLER(channel).lba48 = lba48;
+            if (!lba48) {
+              if (!BX_SELECTED_CONTROLLER(channel).features)
+                BX_SELECTED_CONTROLLER(channel).num_sectors = 256;
+              else
+                BX_SELECTED_CONTROLLER(channel).num_sectors = BX_SELECTED_CONTROLLER(channel).features;
+            } else {
+              if (!BX_SELECTED_CONTROLLER(channel).features && !BX_SELECTED_CONTROLLER(channel).hob.feature)
+                BX_SELECTED_CONTROLLER(channel).num_sectors = 65536;
+              else
+                BX_SELECTED_CONTROLLER(channel).num_sectors = (BX_SELECTED_CONTROLLER(channel).hob.feature << 8) |
+                                                               BX_SELECTED_CONTROLLER(channel).features;
+            }
+            BX_SELECTED_CONTROLLER(channel).interrupt_reason.c_d = 0;
+            BX_SELECTED_CONTROLLER(channel).interrupt_reason.i_o = BX_DMA_READ_COMMAND(value);
+            BX_SELECTED_CONTROLLER(channel).interrupt_reason.rel = 0;
+            BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
+            BX_SELECTED_CONTROLLER(channel).status.seek_complete = 0; // SERV
+            BX_SELECTED_CONTROLLER(channel).status.drq   = 1;
+            BX_SELECTED_CONTROLLER(channel).current_command = value;
+          } else {
+            BX_ERROR(("write cmd 0x%02x (DMA QUEUED) not supported", value));
+            command_aborted(channel, value);
+          }
+          break;
+
 	// List all the write operations that are defined in the ATA/ATAPI spec
 	// that we don't support.  Commands that are listed here will cause a
 	// BX_ERROR, which is non-fatal, and the command will be aborted.
 	case 0x22: BX_ERROR(("write cmd 0x22 (READ LONG) not supported")); command_aborted(channel, 0x22); break;
 	case 0x23: BX_ERROR(("write cmd 0x23 (READ LONG NO RETRY) not supported")); command_aborted(channel, 0x23); break;
-	case 0x26: BX_ERROR(("write cmd 0x26 (READ DMA QUEUED EXT) not supported"));command_aborted(channel, 0x26); break;
 	case 0x27: BX_ERROR(("write cmd 0x27 (READ NATIVE MAX ADDRESS EXT) not supported"));command_aborted(channel, 0x27); break;
 	case 0x2A: BX_ERROR(("write cmd 0x2A (READ STREAM DMA) not supported"));command_aborted(channel, 0x2A); break;
 	case 0x2B: BX_ERROR(("write cmd 0x2B (READ STREAM PIO) not supported"));command_aborted(channel, 0x2B); break;
@@ -2449,7 +2533,6 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
 	case 0x31: BX_ERROR(("write cmd 0x31 (WRITE SECTORS NO RETRY) not supported")); command_aborted(channel, 0x31); break;
 	case 0x32: BX_ERROR(("write cmd 0x32 (WRITE LONG) not supported")); command_aborted(channel, 0x32); break;
 	case 0x33: BX_ERROR(("write cmd 0x33 (WRITE LONG NO RETRY) not supported")); command_aborted(channel, 0x33); break;
-	case 0x36: BX_ERROR(("write cmd 0x36 (WRITE DMA QUEUED EXT) not supported"));command_aborted(channel, 0x36); break;
 	case 0x37: BX_ERROR(("write cmd 0x37 (SET MAX ADDRESS EXT) not supported"));command_aborted(channel, 0x37); break;
 	case 0x38: BX_ERROR(("write cmd 0x38 (CFA WRITE SECTORS W/OUT ERASE) not supported"));command_aborted(channel, 0x38); break;
 	case 0x3A: BX_ERROR(("write cmd 0x3A (WRITE STREAM DMA) not supported"));command_aborted(channel, 0x3A); break;
@@ -2468,9 +2551,6 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
 	case 0xB0: BX_ERROR(("write cmd 0xB0 (SMART commands) not supported"));command_aborted(channel, 0xB0); break;
 	case 0xB1: BX_ERROR(("write cmd 0xB1 (DEVICE CONFIGURATION commands) not supported"));command_aborted(channel, 0xB1); break;
 	case 0xC0: BX_ERROR(("write cmd 0xC0 (CFA ERASE SECTORS) not supported"));command_aborted(channel, 0xC0); break;
-	case 0xC7: BX_ERROR(("write cmd 0xC7 (READ DMA QUEUED) not supported"));command_aborted(channel, 0xC7); break;
-	case 0xC9: BX_ERROR(("write cmd 0xC9 (READ DMA NO RETRY) not supported")); command_aborted(channel, 0xC9); break;
-	case 0xCC: BX_ERROR(("write cmd 0xCC (WRITE DMA QUEUED) not supported"));command_aborted(channel, 0xCC); break;
 	case 0xCD: BX_ERROR(("write cmd 0xCD (CFA WRITE MULTIPLE W/OUT ERASE) not supported"));command_aborted(channel, 0xCD); break;
 	case 0xD1: BX_ERROR(("write cmd 0xD1 (CHECK MEDIA CARD TYPE) not supported"));command_aborted(channel, 0xD1); break;
 	case 0xDA: BX_ERROR(("write cmd 0xDA (GET MEDIA STATUS) not supported"));command_aborted(channel, 0xDA); break;
@@ -2600,7 +2680,9 @@ bx_hard_drive_c::calculate_logical_address(Bit8u channel, Bit64s *sector)
   void BX_CPP_AttrRegparmN(1)
 bx_hard_drive_c::increment_address(Bit8u channel)
 {
-  BX_SELECTED_CONTROLLER(channel).sector_count--;
+  // the sector count register holds the tag of a queued command
+  if (!BX_DMA_QUEUED_COMMAND(BX_SELECTED_CONTROLLER(channel).current_command))
+    BX_SELECTED_CONTROLLER(channel).sector_count--;
   BX_SELECTED_CONTROLLER(channel).num_sectors--;
 
   if (BX_SELECTED_CONTROLLER(channel).lba_mode) {
@@ -2978,6 +3060,9 @@ void bx_hard_drive_c::identify_drive(Bit8u channel)
   //           1 READ/WRITE DMA QUEUED commands supported
   //           0 Download MicroCode supported
   BX_SELECTED_DRIVE(channel).id_drive[83] = (1 << 14) | (1 << 13) | (1 << 12) | (1 << 10);
+  if (BX_HD_THIS bmdma_present()) {
+    BX_SELECTED_DRIVE(channel).id_drive[83] |= (1 << 1);
+  }
   BX_SELECTED_DRIVE(channel).id_drive[84] = 1 << 14;
   BX_SELECTED_DRIVE(channel).id_drive[85] = 1 << 14;
 
@@ -2998,6 +3083,9 @@ void bx_hard_drive_c::identify_drive(Bit8u channel)
   //           1 READ/WRITE DMA QUEUED commands enabled
   //           0 Download MicroCode enabled
   BX_SELECTED_DRIVE(channel).id_drive[86] = (1 << 14) | (1 << 13) | (1 << 12) | (1 << 10);
+  if (BX_HD_THIS bmdma_present()) {
+    BX_SELECTED_DRIVE(channel).id_drive[86] |= (1 << 1);
+  }
   BX_SELECTED_DRIVE(channel).id_drive[87] = 1 << 14;
 
   if (BX_HD_THIS bmdma_present()) {
@@ -3170,6 +3258,57 @@ Bit32u bx_hard_drive_c::get_device_handle(Bit8u channel, Bit8u device)
   return BX_MAX_ATA_CHANNEL*2;
 }
 
+// Keep the writes to the disk images in an overlay from now on, so that
+// rollback_disks() can drop them. The writes kept for a previous
+// checkpoint are written to the image first.
+bx_bool bx_hard_drive_c::checkpoint_disks(void)
+{
+  char ata_name[20];
+
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    for (Bit8u device=0; device<2; device++) {
+      if (!BX_DRIVE_IS_HD(channel, device) || (BX_DRIVE(channel, device).hdimage == NULL))
+        continue;
+      if (BX_DRIVE(channel, device).overlay) {
+        device_image_t *image = DEV_hdimage_release_overlay(BX_DRIVE(channel, device).hdimage);
+        if (image == NULL) {
+          BX_ERROR(("ata%d-%d: could not write the checkpoint overlay to the image", channel, device));
+          return 0;
+        }
+        BX_DRIVE(channel, device).hdimage = image;
+        BX_DRIVE(channel, device).overlay = 0;
+      }
+      sprintf(ata_name, "ata.%d.%s", channel, (device==0)?"master":"slave");
+      bx_list_c *base = (bx_list_c*) SIM->get_param(ata_name);
+      device_image_t *overlay = DEV_hdimage_init_overlay(BX_DRIVE(channel, device).hdimage,
+                                  SIM->get_param_string("path", base)->getptr());
+      if (overlay == NULL) {
+        BX_ERROR(("ata%d-%d: could not create the checkpoint overlay", channel, device));
+        return 0;
+      }
+      BX_DRIVE(channel, device).hdimage = overlay;
+      BX_DRIVE(channel, device).overlay = 1;
+    }
+  }
+  return 1;
+}
+
+// Drop the disk writes since the last checkpoint_disks().
+bx_bool bx_hard_drive_c::rollback_disks(void)
+{
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    for (Bit8u device=0; device<2; device++) {
+      if (!BX_DRIVE(channel, device).overlay)
+        continue;
+      if (DEV_hdimage_rollback_overlay(BX_DRIVE(channel, device).hdimage) < 0) {
+        BX_ERROR(("ata%d-%d: could not reset the checkpoint overlay", channel, device));
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
 Bit32u bx_hard_drive_c::get_first_cd_handle(void)
 {
   for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
@@ -3256,10 +3395,14 @@ bx_bool bx_hard_drive_c::bmdma_present(void)
 #if BX_SUPPORT_PCI
 bx_bool bx_hard_drive_c::bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size)
 {
-  if ((BX_SELECTED_CONTROLLER(channel).current_command == 0xC8) ||
-      (BX_SELECTED_CONTROLLER(channel).current_command == 0x25)) {
-    *sector_size = 512;
-    if (!ide_read_sector(channel, buffer, 512)) {
+  if (BX_DMA_READ_COMMAND(BX_SELECTED_CONTROLLER(channel).current_command)) {
+    // transfer as many sectors of the command as fit into the request
+    Bit32u count = *sector_size / 512;
+    if (count > BX_SELECTED_CONTROLLER(channel).num_sectors)
+      count = BX_SELECTED_CONTROLLER(channel).num_sectors;
+    if (count == 0) count = 1;
+    *sector_size = count * 512;
+    if (!ide_read_sector(channel, buffer, *sector_size)) {
       return 0;
     }
   } else if (BX_SELECTED_CONTROLLER(channel).current_command == 0xA0) {
@@ -3304,15 +3447,52 @@ bx_bool bx_hard_drive_c::bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u
   return 1;
 }
 
-bx_bool bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer)
+// Returns the host address of the next size bytes of a DMA read if the
+// image has them mapped, so that they can be copied to guest memory
+// directly. Returns NULL if they must be read with bmdma_read_sector().
+Bit8u* bx_hard_drive_c::bmdma_read_mapped(Bit8u channel, Bit32u size)
+{
+  Bit64s logical_sector = 0;
+  Bit32u count = size / 512;
+
+  if (!BX_DMA_READ_COMMAND(BX_SELECTED_CONTROLLER(channel).current_command) ||
+      (count == 0) || (count > BX_SELECTED_CONTROLLER(channel).num_sectors)) {
+    return NULL;
+  }
+  if (!calculate_logical_address(channel, &logical_sector)) {
+    return NULL;
+  }
+  Bit64s disk_sectors = (Bit64s)BX_SELECTED_DRIVE(channel).hdimage->cylinders *
+    BX_SELECTED_DRIVE(channel).hdimage->heads * BX_SELECTED_DRIVE(channel).hdimage->sectors;
+  if ((logical_sector + count) > disk_sectors) {
+    return NULL;
+  }
+  Bit8u *data = BX_SELECTED_DRIVE(channel).hdimage->get_mapped_sectors(logical_sector * 512, count);
+  if (data != NULL) {
+    /* set status bar conditions for device */
+    if (!BX_SELECTED_DRIVE(channel).iolight_counter)
+      bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
+    BX_SELECTED_DRIVE(channel).iolight_counter = 5;
+    bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
+    for (unsigned n = 0; n < count; n++)
+      increment_address(channel);
+  }
+  return data;
+}
+
+bx_bool bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size)
 {
-  if ((BX_SELECTED_CONTROLLER(channel).current_command != 0xCA) &&
-      (BX_SELECTED_CONTROLLER(channel).current_command != 0x35)) {
+  if (!BX_DMA_WRITE_COMMAND(BX_SELECTED_CONTROLLER(channel).current_command)) {
     BX_ERROR(("DMA write not active"));
     command_aborted (channel, BX_SELECTED_CONTROLLER(channel).current_command);
     return 0;
   }
-  if (!ide_write_sector(channel, buffer, 512)) {
+  Bit32u count = *sector_size / 512;
+  if (count > BX_SELECTED_CONTROLLER(channel).num_sectors)
+    count = BX_SELECTED_CONTROLLER(channel).num_sectors;
+  if (count == 0) count = 1;
+  *sector_size = count * 512;
+  if (!ide_write_sector(channel, buffer, *sector_size)) {
     return 0;
   }
   return 1;
@@ -3332,6 +3512,13 @@ void bx_hard_drive_c::bmdma_complete(Bit8u channel)
     BX_SELECTED_CONTROLLER(channel).status.write_fault = 0;
     BX_SELECTED_CONTROLLER(channel).status.seek_complete = 1;
     BX_SELECTED_CONTROLLER(channel).status.corrected_data = 0;
+    if (BX_DMA_QUEUED_COMMAND(BX_SELECTED_CONTROLLER(channel).current_command)) {
+      // no other command waits for service
+      BX_SELECTED_CONTROLLER(channel).status.seek_complete = 0;
+      BX_SELECTED_CONTROLLER(channel).interrupt_reason.i_o = 1;
+      BX_SELECTED_CONTROLLER(channel).interrupt_reason.c_d = 1;
+      BX_SELECTED_CONTROLLER(channel).interrupt_reason.rel = 0;
+    }
   }
   raise_interrupt(channel);
 }
@@ -3358,34 +3545,47 @@ bx_bool bx_hard_drive_c::ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u bu
   Bit64s logical_sector = 0;
   Bit64s ret;
 
-  int sector_count = (buffer_size / 512);
-  Bit8u *bufptr = buffer;
-  do {
-    if (!calculate_logical_address(channel, &logical_sector)) {
-      BX_ERROR(("ide_read_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * 512, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file"));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    /* set status bar conditions for device */
-    if (!BX_SELECTED_DRIVE(channel).iolight_counter)
-      bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
-    BX_SELECTED_DRIVE(channel).iolight_counter = 5;
-    bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
-    ret = BX_SELECTED_DRIVE(channel).hdimage->read((bx_ptr_t)bufptr, 512);
-    if (ret < 512) {
-      BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
+  unsigned sector_count = (buffer_size / 512);
+  unsigned count = sector_count;
+  if (!calculate_logical_address(channel, &logical_sector)) {
+    BX_ERROR(("ide_read_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  // the sectors of a transfer are consecutive in the image, so all of
+  // them up to the end of the disk are read at once
+  Bit64s disk_sectors = (Bit64s)BX_SELECTED_DRIVE(channel).hdimage->cylinders *
+    BX_SELECTED_DRIVE(channel).hdimage->heads * BX_SELECTED_DRIVE(channel).hdimage->sectors;
+  if ((logical_sector + count) > disk_sectors)
+    count = (unsigned)(disk_sectors - logical_sector);
+  /* set status bar conditions for device */
+  if (!BX_SELECTED_DRIVE(channel).iolight_counter)
+    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
+  BX_SELECTED_DRIVE(channel).iolight_counter = 5;
+  bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
+  ret = BX_SELECTED_DRIVE(channel).hdimage->read_sectors(logical_sector * 512, buffer, count);
+  if (ret < (Bit64s)count * 512) {
+    BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  for (unsigned n = 0; n < count; n++)
     increment_address(channel);
-    bufptr += 512;
-  } while (--sector_count > 0);
+
+  if (count < sector_count) {
+    BX_ERROR(("ide_read_sector() reached invalid sector %lu, aborting", (unsigned long)(logical_sector + count)));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+
+  // the next block of the command follows this one, let the image
+  // start reading it while the guest takes the data
+  Bit32u next_count = BX_SELECTED_CONTROLLER(channel).num_sectors;
+  if (next_count > 0) {
+    if (next_count > sector_count) next_count = sector_count;
+    if ((logical_sector + count + next_count) <= disk_sectors)
+      BX_SELECTED_DRIVE(channel).hdimage->read_ahead((logical_sector + count) * 512, next_count);
+  }
 
   return 1;
 }
@@ -3395,34 +3595,36 @@ bx_bool bx_hard_drive_c::ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u b
   Bit64s logical_sector = 0;
   Bit64s ret;
 
-  int sector_count = (buffer_size / 512);
-  Bit8u *bufptr = buffer;
-  do {
-    if (!calculate_logical_address(channel, &logical_sector)) {
-      BX_ERROR(("ide_write_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * 512, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file at byte %lu", (unsigned long)logical_sector * 512));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    /* set status bar conditions for device */
-    if (!BX_SELECTED_DRIVE(channel).iolight_counter)
-      bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
-    BX_SELECTED_DRIVE(channel).iolight_counter = 5;
-    bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
-    ret = BX_SELECTED_DRIVE(channel).hdimage->write((bx_ptr_t)bufptr, 512);
-    if (ret < 512) {
-      BX_ERROR(("could not write() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
+  unsigned sector_count = (buffer_size / 512);
+  unsigned count = sector_count;
+  if (!calculate_logical_address(channel, &logical_sector)) {
+    BX_ERROR(("ide_write_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  Bit64s disk_sectors = (Bit64s)BX_SELECTED_DRIVE(channel).hdimage->cylinders *
+    BX_SELECTED_DRIVE(channel).hdimage->heads * BX_SELECTED_DRIVE(channel).hdimage->sectors;
+  if ((logical_sector + count) > disk_sectors)
+    count = (unsigned)(disk_sectors - logical_sector);
+  /* set status bar conditions for device */
+  if (!BX_SELECTED_DRIVE(channel).iolight_counter)
+    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
+  BX_SELECTED_DRIVE(channel).iolight_counter = 5;
+  bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
+  ret = BX_SELECTED_DRIVE(channel).hdimage->write_sectors(logical_sector * 512, buffer, count);
+  if (ret < (Bit64s)count * 512) {
+    BX_ERROR(("could not write() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  for (unsigned n = 0; n < count; n++)
     increment_address(channel);
-    bufptr += 512;
-  } while (--sector_count > 0);
+
+  if (count < sector_count) {
+    BX_ERROR(("ide_write_sector() reached invalid sector %lu, aborting", (unsigned long)(logical_sector + count)));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
 
   return 1;
 }
@@ -174,10 +174,13 @@ public:
   virtual unsigned set_cd_media_status(Bit32u handle, unsigned status);
 #if BX_SUPPORT_PCI
   virtual bx_bool  bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
-  virtual bx_bool  bmdma_write_sector(Bit8u channel, Bit8u *buffer);
+  virtual bx_bool  bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
+  virtual Bit8u*   bmdma_read_mapped(Bit8u channel, Bit32u size);
   virtual void     bmdma_complete(Bit8u channel);
 #endif
   virtual void     register_state(void);
+  virtual bx_bool  checkpoint_disks(void);
+  virtual bx_bool  rollback_disks(void);
 
   virtual Bit32u virt_read_handler(Bit32u address, unsigned io_len)
   {
@@ -225,6 +228,7 @@ private:
   struct channel_t {
     struct drive_t {
       device_image_t* hdimage;
+      bx_bool overlay; // hdimage is a checkpoint overlay
       device_type_t device_type;
       // 512 byte buffer for ID drive command
       // These words are stored in native word endian format, as
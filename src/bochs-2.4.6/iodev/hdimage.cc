@@ -126,6 +126,12 @@ device_image_t* bx_hdimage_ctl_c::init_image(Bit8u image_mode, Bit64u disk_size,
       hdimage = new vvfat_image_t(disk_size, journal);
       break;
 
+#if BX_COMPRESSED_HD_SUPPORT
+    case BX_HDIMAGE_MODE_QCOW:
+      hdimage = new qcow_image_t();
+      break;
+#endif //BX_COMPRESSED_HD_SUPPORT
+
     default:
       BX_PANIC(("unsupported HD mode : '%s'", hdimage_mode_names[image_mode]));
       break;
@@ -133,6 +139,76 @@ device_image_t* bx_hdimage_ctl_c::init_image(Bit8u image_mode, Bit64u disk_size,
   return hdimage;
 }
 
+device_image_t* bx_hdimage_ctl_c::init_cache(device_image_t *image, Bit32u cache_size, Bit32u flush_interval)
+{
+  return new cached_image_t(image, cache_size, flush_interval);
+}
+
+device_image_t* bx_hdimage_ctl_c::init_async(device_image_t *image)
+{
+#if BX_SUPPORT_ASYNC_DISK
+  return new async_image_t(image);
+#else
+  BX_ERROR(("asynchronous disk I/O not compiled in (--enable-async-disk)"));
+  return image;
+#endif
+}
+
+device_image_t* bx_hdimage_ctl_c::init_overlay(device_image_t *image, const char *pathname)
+{
+  overlay_image_t *overlay = new overlay_image_t(image, pathname);
+  if (overlay->open(pathname) < 0) {
+    overlay->release();
+    delete overlay;
+    return NULL;
+  }
+  return overlay;
+}
+
+int bx_hdimage_ctl_c::rollback_overlay(device_image_t *image)
+{
+  return ((overlay_image_t*)image)->discard();
+}
+
+device_image_t* bx_hdimage_ctl_c::release_overlay(device_image_t *image)
+{
+  device_image_t *base = ((overlay_image_t*)image)->release();
+  if (base != NULL)
+    delete image;
+  return base;
+}
+
+// positional file access, emulated with lseek() where not available
+
+static ssize_t bx_pread(int fd, void *buf, size_t count, Bit64s offset)
+{
+#if BX_HAVE_PREAD
+  return ::pread(fd, (char*) buf, count, (off_t)offset);
+#else
+  if (::lseek(fd, (off_t)offset, SEEK_SET) < 0) return -1;
+  return ::read(fd, (char*) buf, count);
+#endif
+}
+
+static ssize_t bx_pwrite(int fd, const void *buf, size_t count, Bit64s offset)
+{
+#if BX_HAVE_PWRITE
+  return ::pwrite(fd, (const char*) buf, count, (off_t)offset);
+#else
+  if (::lseek(fd, (off_t)offset, SEEK_SET) < 0) return -1;
+  return ::write(fd, (const char*) buf, count);
+#endif
+}
+
+static int bx_fsync(int fd)
+{
+#ifdef WIN32
+  return _commit(fd);
+#else
+  return fsync(fd);
+#endif
+}
+
 /*** base class device_image_t ***/
 
 device_image_t::device_image_t()
@@ -140,13 +216,57 @@ device_image_t::device_image_t()
   hd_size = 0;
 }
 
+int device_image_t::flush()
+{
+  return 0;
+}
+
 Bit32u device_image_t::get_capabilities()
 {
   return (cylinders == 0) ? HDIMAGE_AUTO_GEOMETRY : 0;
 }
 
+// images without a native implementation are accessed sector by sector
+
+ssize_t device_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+
+  for (unsigned n = 0; n < count; n++) {
+    if (lseek(offset + n * 512, SEEK_SET) < 0)
+      return -1;
+    if (read(bufptr, 512) < 512)
+      return -1;
+    bufptr += 512;
+  }
+  return (ssize_t)count * 512;
+}
+
+ssize_t device_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  const Bit8u *bufptr = (const Bit8u*) buf;
+
+  for (unsigned n = 0; n < count; n++) {
+    if (lseek(offset + n * 512, SEEK_SET) < 0)
+      return -1;
+    if (write(bufptr, 512) < 512)
+      return -1;
+    bufptr += 512;
+  }
+  return (ssize_t)count * 512;
+}
+
 /*** default_image_t function definitions ***/
 
+default_image_t::default_image_t()
+{
+  fd = -1;
+#ifdef _POSIX_MAPPED_FILES
+  mmap_base = NULL;
+  mmap_length = 0;
+#endif
+}
+
 int default_image_t::open(const char* pathname)
 {
   return open(pathname, O_RDWR);
@@ -198,8 +318,15 @@ int default_image_t::open(const char* pathname, int flags)
 
 void default_image_t::close()
 {
+#ifdef _POSIX_MAPPED_FILES
+  if (mmap_base != NULL) {
+    munmap(mmap_base, mmap_length);
+    mmap_base = NULL;
+  }
+#endif
   if (fd > -1) {
     ::close(fd);
+    fd = -1;
   }
 }
 
@@ -218,6 +345,60 @@ ssize_t default_image_t::write(const void* buf, size_t count)
   return ::write(fd, (char*) buf, count);
 }
 
+ssize_t default_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  Bit8u *data = get_mapped_sectors(offset, count);
+
+  if (data != NULL) {
+    memcpy(buf, data, (size_t)count * 512);
+    return (ssize_t)count * 512;
+  }
+  return bx_pread(fd, buf, (size_t)count * 512, offset);
+}
+
+// Writes never go through the mapping, see map_image().
+ssize_t default_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  return bx_pwrite(fd, buf, (size_t)count * 512, offset);
+}
+
+int default_image_t::map_image()
+{
+#ifdef _POSIX_MAPPED_FILES
+  if (mmap_base != NULL) {
+    return 0;
+  }
+  if ((fd < 0) || (hd_size == 0) || ((Bit64u)(size_t)hd_size != hd_size)) {
+    return -1;
+  }
+  // The mapping is read-only. A store into a hole of a sparse image has
+  // to allocate a block, and if the host disk is full that raises SIGBUS
+  // instead of returning an error, so the writes use pwrite(). The mapping
+  // is shared, it sees the data written to the file.
+  void *addr = mmap(NULL, (size_t)hd_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    BX_ERROR(("mmap() of the disk image failed: %s", strerror(errno)));
+    return -1;
+  }
+  mmap_base = (Bit8u*)addr;
+  mmap_length = (size_t)hd_size;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+Bit8u* default_image_t::get_mapped_sectors(Bit64s offset, unsigned count)
+{
+#ifdef _POSIX_MAPPED_FILES
+  if ((mmap_base != NULL) && (offset >= 0) &&
+      ((Bit64u)offset + (Bit64u)count * 512 <= (Bit64u)mmap_length)) {
+    return mmap_base + offset;
+  }
+#endif
+  return NULL;
+}
+
 char increment_string(char *str, int diff)
 {
   // find the last character of the string, and increment it.
@@ -364,6 +545,45 @@ ssize_t concat_image_t::write(const void* buf, size_t count)
   return ::write(fd, (char*) buf, count);
 }
 
+ssize_t concat_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+  size_t bytes = (size_t)count * 512;
+
+  // a request may span several of the partial images
+  for (int i=0; (i < maxfd) && (bytes > 0); i++) {
+    Bit64s end = start_offset_table[i] + length_table[i];
+    if (offset >= end) continue;
+    size_t n = bytes;
+    if ((Bit64s)n > (end - offset)) n = (size_t)(end - offset);
+    if (bx_pread(fd_table[i], bufptr, n, offset - start_offset_table[i]) != (ssize_t)n)
+      return -1;
+    bufptr += n;
+    offset += n;
+    bytes -= n;
+  }
+  return (bytes > 0) ? -1 : (ssize_t)count * 512;
+}
+
+ssize_t concat_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  const Bit8u *bufptr = (const Bit8u*) buf;
+  size_t bytes = (size_t)count * 512;
+
+  for (int i=0; (i < maxfd) && (bytes > 0); i++) {
+    Bit64s end = start_offset_table[i] + length_table[i];
+    if (offset >= end) continue;
+    size_t n = bytes;
+    if ((Bit64s)n > (end - offset)) n = (size_t)(end - offset);
+    if (bx_pwrite(fd_table[i], bufptr, n, offset - start_offset_table[i]) != (ssize_t)n)
+      return -1;
+    bufptr += n;
+    offset += n;
+    bytes -= n;
+  }
+  return (bytes > 0) ? -1 : (ssize_t)count * 512;
+}
+
 /*** sparse_image_t function definitions ***/
 
 sparse_image_t::sparse_image_t ()
@@ -676,10 +896,9 @@ ssize_t sparse_image_t::read(void* buf, size_t count)
 
     BX_ASSERT (can_read != 0);
 
-#if BX_ASSERT_ENABLE
     size_t was_read = read_page_fragment(position_virtual_page, position_page_offset, can_read, buf);
-#endif
     BX_ASSERT(was_read == can_read);
+    UNUSED(was_read);
 
     total_read += can_read;
 
@@ -699,6 +918,33 @@ ssize_t sparse_image_t::read(void* buf, size_t count)
   return total_read;
 }
 
+ssize_t sparse_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+  size_t bytes = (size_t)count * 512;
+
+  if ((offset + (Bit64s)bytes) > total_size) {
+    BX_ERROR(("sparse_image_t.read_sectors beyond end of image"));
+    return -1;
+  }
+
+  while (bytes > 0)
+  {
+    Bit32u virtual_page = (Bit32u)(offset >> pagesize_shift);
+    Bit32u page_offset = (Bit32u)(offset & pagesize_mask);
+    size_t can_read = pagesize - page_offset;
+    if (bytes < can_read) can_read = bytes;
+
+    read_page_fragment(virtual_page, page_offset, can_read, bufptr);
+
+    bufptr += can_read;
+    offset += can_read;
+    bytes -= can_read;
+  }
+
+  return (ssize_t)count * 512;
+}
+
 void sparse_image_t::panic(const char * message)
 {
   char buffer[1024];
@@ -963,7 +1209,12 @@ redolog_t::redolog_t()
 {
   fd = -1;
   catalog = NULL;
-  bitmap = NULL;
+  catalog_dirty_lo = 0;
+  catalog_dirty_hi = 0;
+  bitmaps = NULL;
+  bitmap_dirty = NULL;
+  dirty_bitmaps = 0;
+  is_volatile = 0;
   extent_index = (Bit32u)0;
   extent_offset = (Bit32u)0;
   extent_next = (Bit32u)0;
@@ -1002,6 +1253,7 @@ int redolog_t::make_header(const char* type, Bit64u size)
   strcpy((char*)header.standard.magic, STANDARD_HEADER_MAGIC);
   strcpy((char*)header.standard.type, REDOLOG_TYPE);
   strcpy((char*)header.standard.subtype, type);
+  is_volatile = (strcmp(type, REDOLOG_SUBTYPE_VOLATILE) == 0);
   header.standard.version = htod32(STANDARD_HEADER_VERSION);
   header.standard.header = htod32(STANDARD_HEADER_SIZE);
 
@@ -1029,10 +1281,11 @@ int redolog_t::make_header(const char* type, Bit64u size)
   print_header();
 
   catalog = (Bit32u*)malloc(dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap = (Bit8u*)malloc(dtoh32(header.specific.bitmap));
 
-  if ((catalog == NULL) || (bitmap==NULL))
-    BX_PANIC(("redolog : could not malloc catalog or bitmap"));
+  if (catalog == NULL)
+    BX_PANIC(("redolog : could not malloc catalog"));
+
+  init_bitmaps();
 
   for (Bit32u i=0; i<dtoh32(header.specific.catalog); i++)
     catalog[i] = htod32(REDOLOG_PAGE_NOT_ALLOCATED);
@@ -1123,6 +1376,7 @@ int redolog_t::open(const char* filename, const char *type)
     BX_PANIC(("redolog : Bad header subtype"));
     return -1;
   }
+  is_volatile = (strcmp(type, REDOLOG_SUBTYPE_VOLATILE) == 0);
 
   if ((dtoh32(header.standard.version) != STANDARD_HEADER_VERSION) &&
       (dtoh32(header.standard.version) != STANDARD_HEADER_V1))
@@ -1162,8 +1416,7 @@ int redolog_t::open(const char* filename, const char *type)
   }
   BX_INFO(("redolog : next extent will be at index %d",extent_next));
 
-  // memory used for storing bitmaps
-  bitmap = (Bit8u *)malloc(dtoh32(header.specific.bitmap));
+  init_bitmaps();
 
   bitmap_blocks = 1 + (dtoh32(header.specific.bitmap) - 1) / 512;
   extent_blocks = 1 + (dtoh32(header.specific.extent) - 1) / 512;
@@ -1176,16 +1429,44 @@ int redolog_t::open(const char* filename, const char *type)
   return 0;
 }
 
+void redolog_t::init_bitmaps()
+{
+  Bit32u entries = dtoh32(header.specific.catalog);
+
+  bitmaps = (Bit8u**)calloc(entries, sizeof(Bit8u*));
+  bitmap_dirty = (bx_bool*)calloc(entries, sizeof(bx_bool));
+
+  if ((bitmaps == NULL) || (bitmap_dirty == NULL))
+    BX_PANIC(("redolog : could not malloc bitmap cache"));
+
+  dirty_bitmaps = 0;
+  catalog_dirty_lo = entries;
+  catalog_dirty_hi = 0;
+}
+
 void redolog_t::close()
 {
+  if ((fd >= 0) && (catalog != NULL) && (bitmaps != NULL))
+    flush();
+
   if (fd >= 0)
     ::close(fd);
+  fd = -1;
+
+  if (bitmaps != NULL) {
+    for (Bit32u i=0; i<dtoh32(header.specific.catalog); i++) {
+      if (bitmaps[i] != NULL)
+        free(bitmaps[i]);
+    }
+    free(bitmaps);
+    free(bitmap_dirty);
+    bitmaps = NULL;
+    bitmap_dirty = NULL;
+  }
 
   if (catalog != NULL)
     free(catalog);
-
-  if (bitmap != NULL)
-    free(bitmap);
+  catalog = NULL;
 }
 
 Bit64u redolog_t::get_size()
@@ -1237,19 +1518,14 @@ ssize_t redolog_t::read(void* buf, size_t count)
     return 0;
   }
 
-  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocks + bitmap_blocks);
+  bitmap_offset   = bitmap_offset_of(extent_index);
   block_offset    = bitmap_offset + ((Bit64s)512 * (bitmap_blocks + extent_offset));
 
   BX_DEBUG(("redolog : bitmap offset is %x", (Bit32u)bitmap_offset));
   BX_DEBUG(("redolog : block offset is %x", (Bit32u)block_offset));
 
-  // FIXME if same extent_index as before we can skip bitmap read
-
-  ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-
-  if (::read(fd, bitmap,  dtoh32(header.specific.bitmap)) != (ssize_t)dtoh32(header.specific.bitmap)) {
-    BX_PANIC(("redolog : failed to read bitmap for extent %d", extent_index));
+  Bit8u *bitmap = get_bitmap(extent_index);
+  if (bitmap == NULL) {
     return -1;
   }
 
@@ -1269,10 +1545,7 @@ ssize_t redolog_t::read(void* buf, size_t count)
 
 ssize_t redolog_t::write(const void* buf, size_t count)
 {
-  Bit32u i;
-  Bit64s block_offset, bitmap_offset, catalog_offset;
   ssize_t written;
-  bx_bool update_catalog = 0;
 
   if (count != 512) {
     BX_PANIC(("redolog : write() with count not 512"));
@@ -1281,79 +1554,303 @@ ssize_t redolog_t::write(const void* buf, size_t count)
 
   BX_DEBUG(("redolog : writing index %d, mapping to %d", extent_index, dtoh32(catalog[extent_index])));
 
-  if (dtoh32(catalog[extent_index]) == REDOLOG_PAGE_NOT_ALLOCATED) {
-    if (extent_next >= dtoh32(header.specific.catalog)) {
-      BX_PANIC(("redolog : can't allocate new extent... catalog is full"));
-      return -1;
+  written = write_sectors(imagepos, buf, 1);
+  if (written >= 0) lseek(512, SEEK_CUR);
+
+  return written;
+}
+
+Bit64s redolog_t::bitmap_offset_of(Bit32u index)
+{
+  Bit64s bitmap_offset;
+
+  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
+  bitmap_offset += (Bit64s)512 * dtoh32(catalog[index]) * (extent_blocks + bitmap_blocks);
+  return bitmap_offset;
+}
+
+bx_bool redolog_t::alloc_extent(Bit32u index)
+{
+  if (extent_next >= dtoh32(header.specific.catalog)) {
+    BX_PANIC(("redolog : can't allocate new extent... catalog is full"));
+    return 0;
+  }
+
+  BX_DEBUG(("redolog : allocating new extent at %d", extent_next));
+
+  Bit32u bitmap_size = dtoh32(header.specific.bitmap);
+  Bit8u *bitmap = (Bit8u*)calloc(1, bitmap_size);
+  char *zerobuffer = (char*)calloc(bitmap_blocks, 512);
+  if ((bitmap == NULL) || (zerobuffer == NULL))
+    BX_PANIC(("redolog : could not malloc bitmap"));
+
+  // Extent not allocated, allocate new
+  catalog[index] = htod32(extent_next);
+
+  // Write the empty bitmap and the last block of the extent now, so the
+  // file holds the extent before the catalog entry is written back
+  Bit64s bitmap_offset = bitmap_offset_of(index);
+  Bit64s last_offset = bitmap_offset + (Bit64s)512 * (bitmap_blocks + extent_blocks - 1);
+  if ((bx_pwrite(fd, zerobuffer, bitmap_blocks * 512, bitmap_offset) != (ssize_t)(bitmap_blocks * 512)) ||
+      (bx_pwrite(fd, zerobuffer, 512, last_offset) != 512)) {
+    BX_ERROR(("redolog : failed to write new extent %d", extent_next));
+    catalog[index] = htod32(REDOLOG_PAGE_NOT_ALLOCATED);
+    free(zerobuffer);
+    free(bitmap);
+    return 0;
+  }
+  free(zerobuffer);
+
+  extent_next += 1;
+
+  bitmaps[index] = bitmap;
+  if (index < catalog_dirty_lo) catalog_dirty_lo = index;
+  if (index >= catalog_dirty_hi) catalog_dirty_hi = index + 1;
+  return 1;
+}
+
+Bit8u* redolog_t::get_bitmap(Bit32u index)
+{
+  if (bitmaps[index] == NULL) {
+    Bit32u bitmap_size = dtoh32(header.specific.bitmap);
+    Bit8u *bitmap = (Bit8u*)malloc(bitmap_size);
+    if (bitmap == NULL)
+      BX_PANIC(("redolog : could not malloc bitmap"));
+    if (bx_pread(fd, bitmap, bitmap_size, bitmap_offset_of(index)) != (ssize_t)bitmap_size) {
+      BX_PANIC(("redolog : failed to read bitmap for extent %d", index));
+      free(bitmap);
+      return NULL;
     }
+    bitmaps[index] = bitmap;
+  }
+  return bitmaps[index];
+}
+
+void redolog_t::set_bitmap_dirty(Bit32u index)
+{
+  if (!bitmap_dirty[index]) {
+    bitmap_dirty[index] = 1;
+    dirty_bitmaps++;
+  }
+}
 
-    BX_DEBUG(("redolog : allocating new extent at %d", extent_next));
+// The catalog and the bitmaps are kept in memory and written back here,
+// in an order that keeps the file consistent if the host crashes:
+// first the data blocks and the empty bitmaps of new extents are synced,
+// then the bitmaps and catalog entries referring to them are written and
+// synced. A catalog entry is never on disk before its empty bitmap, and a
+// bitmap bit is never on disk before its data block.
+// A volatile redolog is deleted when it is closed: its catalog and bitmaps
+// stay in memory and are never written back.
+int redolog_t::flush()
+{
+  Bit32u bitmap_size = dtoh32(header.specific.bitmap);
+  int ret = 0;
 
-    // Extent not allocated, allocate new
-    catalog[extent_index] = htod32(extent_next);
+  if (is_volatile)
+    return 0;
 
-    extent_next += 1;
+  if ((dirty_bitmaps == 0) && (catalog_dirty_lo >= catalog_dirty_hi))
+    return 0;
 
-    char *zerobuffer = (char*)malloc(512);
-    memset(zerobuffer, 0, 512);
+  if (bx_fsync(fd) < 0) {
+    BX_ERROR(("redolog : failed to sync data blocks"));
+    return -1;
+  }
 
-    // Write bitmap
-    bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-    bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocks + bitmap_blocks);
-    ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-    for (i=0; i<bitmap_blocks; i++) {
-      ::write(fd, zerobuffer, 512);
+  for (Bit32u i=0; (i<dtoh32(header.specific.catalog)) && (dirty_bitmaps > 0); i++) {
+    if (bitmap_dirty[i]) {
+      if (bx_pwrite(fd, bitmaps[i], bitmap_size, bitmap_offset_of(i)) != (ssize_t)bitmap_size) {
+        BX_ERROR(("redolog : failed to write bitmap for extent %d", i));
+        ret = -1;
+      }
+      bitmap_dirty[i] = 0;
+      dirty_bitmaps--;
     }
-    // Write extent
-    for (i=0; i<extent_blocks; i++) {
-      ::write(fd, zerobuffer, 512);
+  }
+
+  if (catalog_dirty_lo < catalog_dirty_hi) {
+    Bit64s catalog_offset = (Bit64s)STANDARD_HEADER_SIZE + (catalog_dirty_lo * sizeof(Bit32u));
+    ssize_t bytes = (catalog_dirty_hi - catalog_dirty_lo) * sizeof(Bit32u);
+    BX_DEBUG(("redolog : writing catalog at offset %x", (Bit32u)catalog_offset));
+    if (bx_pwrite(fd, &catalog[catalog_dirty_lo], bytes, catalog_offset) != bytes) {
+      BX_ERROR(("redolog : failed to write catalog"));
+      ret = -1;
     }
+    catalog_dirty_lo = dtoh32(header.specific.catalog);
+    catalog_dirty_hi = 0;
+  }
 
-    free(zerobuffer);
+  if (bx_fsync(fd) < 0) {
+    BX_ERROR(("redolog : failed to sync metadata"));
+    ret = -1;
+  }
+  return ret;
+}
+
+ssize_t redolog_t::read_sectors(Bit64s offset, void* buf, unsigned count, device_image_t *base)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+  Bit32u extent_size = dtoh32(header.specific.extent);
 
-    update_catalog = 1;
+  if ((offset + (Bit64s)count * 512) > (Bit64s)dtoh64(header.specific.disk)) {
+    BX_ERROR(("redolog : read_sectors() beyond end of disk"));
+    return -1;
   }
 
-  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocks + bitmap_blocks);
-  block_offset    = bitmap_offset + ((Bit64s)512 * (bitmap_blocks + extent_offset));
+  while (count > 0) {
+    Bit32u index = (Bit32u)(offset / extent_size);
+    Bit32u first = (Bit32u)((offset % extent_size) / 512);
+    unsigned n = extent_blocks - first;
+    if (n > count) n = count;
+
+    bx_bool allocated = (dtoh32(catalog[index]) != REDOLOG_PAGE_NOT_ALLOCATED);
+    Bit64s bitmap_offset = 0;
+    Bit8u *bitmap = NULL;
+    if (allocated) {
+      bitmap_offset = bitmap_offset_of(index);
+      bitmap = get_bitmap(index);
+      if (bitmap == NULL)
+        return -1;
+    }
 
-  BX_DEBUG(("redolog : bitmap offset is %x", (Bit32u)bitmap_offset));
-  BX_DEBUG(("redolog : block offset is %x", (Bit32u)block_offset));
+    // split the extent part into runs of sectors which are all in the
+    // redolog or all missing, and transfer each run at once
+    unsigned done = 0;
+    while (done < n) {
+      Bit32u block = first + done;
+      bx_bool in_log = allocated && ((bitmap[block/8] >> (block%8)) & 0x01);
+      unsigned run = 1;
+      while (done + run < n) {
+        Bit32u next = block + run;
+        bx_bool next_in_log = allocated && ((bitmap[next/8] >> (next%8)) & 0x01);
+        if (next_in_log != in_log) break;
+        run++;
+      }
+      ssize_t bytes = (ssize_t)run * 512;
+      if (in_log) {
+        Bit64s block_offset = bitmap_offset + ((Bit64s)512 * (bitmap_blocks + block));
+        if (bx_pread(fd, bufptr, bytes, block_offset) != bytes)
+          return -1;
+      } else if (base != NULL) {
+        if (base->read_sectors(offset, bufptr, run) != bytes)
+          return -1;
+      } else {
+        memset(bufptr, 0, bytes);
+      }
+      bufptr += bytes;
+      offset += bytes;
+      done += run;
+    }
+    count -= n;
+  }
 
-  // Write block
-  ::lseek(fd, (off_t)block_offset, SEEK_SET);
-  written = ::write(fd, buf, count);
+  return (ssize_t)(bufptr - (Bit8u*) buf);
+}
 
-  // Write bitmap
-  // FIXME if same extent_index as before we can skip bitmap read
-  ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-  if (::read(fd, bitmap,  dtoh32(header.specific.bitmap)) != (ssize_t)dtoh32(header.specific.bitmap)) {
-    BX_PANIC(("redolog : failed to read bitmap for extent %d", extent_index));
-    return 0;
+ssize_t redolog_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  const Bit8u *bufptr = (const Bit8u*) buf;
+  Bit32u extent_size = dtoh32(header.specific.extent);
+
+  if ((offset + (Bit64s)count * 512) > (Bit64s)dtoh64(header.specific.disk)) {
+    BX_ERROR(("redolog : write_sectors() beyond end of disk"));
+    return -1;
   }
 
-  // If bloc does not belong to extent yet
-  if (((bitmap[extent_offset/8] >> (extent_offset%8)) & 0x01) == 0x00) {
-    bitmap[extent_offset/8] |= 1 << (extent_offset%8);
-    ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-    ::write(fd, bitmap,  dtoh32(header.specific.bitmap));
+  while (count > 0) {
+    Bit32u index = (Bit32u)(offset / extent_size);
+    Bit32u first = (Bit32u)((offset % extent_size) / 512);
+    unsigned n = extent_blocks - first;
+    if (n > count) n = count;
+    bx_bool update_bitmap = 0;
+
+    if (dtoh32(catalog[index]) == REDOLOG_PAGE_NOT_ALLOCATED) {
+      if (!alloc_extent(index))
+        return -1;
+    }
+
+    Bit64s bitmap_offset = bitmap_offset_of(index);
+    Bit64s block_offset  = bitmap_offset + ((Bit64s)512 * (bitmap_blocks + first));
+    ssize_t bytes = (ssize_t)n * 512;
+
+    // the blocks of an extent are contiguous in the file
+    if (bx_pwrite(fd, bufptr, bytes, block_offset) != bytes)
+      return -1;
+
+    Bit8u *bitmap = get_bitmap(index);
+    if (bitmap == NULL)
+      return -1;
+    for (Bit32u block = first; block < first + n; block++) {
+      if (((bitmap[block/8] >> (block%8)) & 0x01) == 0x00) {
+        bitmap[block/8] |= 1 << (block%8);
+        update_bitmap = 1;
+      }
+    }
+    // the bitmap is written back by flush()
+    if (update_bitmap)
+      set_bitmap_dirty(index);
+
+    bufptr += bytes;
+    offset += bytes;
+    count -= n;
   }
 
-  // Write catalog
-  if (update_catalog) {
-    // FIXME if mmap
-    catalog_offset  = (Bit64s)STANDARD_HEADER_SIZE + (extent_index * sizeof(Bit32u));
+  if ((dirty_bitmaps >= REDOLOG_MAX_DIRTY_BITMAPS) && !is_volatile) {
+    if (flush() < 0)
+      return -1;
+  }
 
-    BX_DEBUG(("redolog : writing catalog at offset %x", (Bit32u)catalog_offset));
+  return (ssize_t)(bufptr - (const Bit8u*) buf);
+}
+
+Bit64s redolog_t::commit_sectors(device_image_t *image)
+{
+  Bit32u extent_size = dtoh32(header.specific.extent);
+  Bit64s committed = 0;
 
-    ::lseek(fd, (off_t)catalog_offset, SEEK_SET);
-    ::write(fd, &catalog[extent_index], sizeof(Bit32u));
+  Bit8u *buffer = (Bit8u*)malloc(extent_size);
+  if (buffer == NULL) {
+    BX_ERROR(("redolog : could not malloc commit buffer"));
+    return -1;
   }
 
-  if (written >= 0) lseek(512, SEEK_CUR);
+  for (Bit32u index = 0; index < dtoh32(header.specific.catalog); index++) {
+    if (dtoh32(catalog[index]) == REDOLOG_PAGE_NOT_ALLOCATED)
+      continue;
 
-  return written;
+    Bit8u *bitmap = get_bitmap(index);
+    if (bitmap == NULL) {
+      committed = -1;
+      break;
+    }
+    Bit64s bitmap_offset = bitmap_offset_of(index);
+    Bit32u block = 0;
+    while (block < extent_blocks) {
+      if (((bitmap[block/8] >> (block%8)) & 0x01) == 0x00) {
+        block++;
+        continue;
+      }
+      unsigned run = 1;
+      while ((block + run < extent_blocks) &&
+             ((bitmap[(block+run)/8] >> ((block+run)%8)) & 0x01)) {
+        run++;
+      }
+      ssize_t bytes = (ssize_t)run * 512;
+      Bit64s offset = (Bit64s)index * extent_size + (Bit64s)block * 512;
+      if ((bx_pread(fd, buffer, bytes, bitmap_offset + ((Bit64s)512 * (bitmap_blocks + block))) != bytes) ||
+          (image->write_sectors(offset, buffer, run) != bytes)) {
+        BX_ERROR(("redolog : failed to commit the sectors at offset " FMT_LL "d", offset));
+        free(buffer);
+        return -1;
+      }
+      committed += run;
+      block += run;
+    }
+  }
+
+  free(buffer);
+  return committed;
 }
 
 /*** growing_image_t function definitions ***/
@@ -1413,6 +1910,21 @@ ssize_t growing_image_t::write(const void* buf, size_t count)
   return (ret < 0) ? ret : count;
 }
 
+ssize_t growing_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  return redolog->read_sectors(offset, buf, count, NULL);
+}
+
+ssize_t growing_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(offset, buf, count);
+}
+
+int growing_image_t::flush()
+{
+  return redolog->flush();
+}
+
 /*** undoable_image_t function definitions ***/
 
 undoable_image_t::undoable_image_t(const char* _redolog_name)
@@ -1519,6 +2031,21 @@ ssize_t undoable_image_t::write(const void* buf, size_t count)
   return (ret < 0) ? ret : count;
 }
 
+ssize_t undoable_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  return redolog->read_sectors(offset, buf, count, ro_disk);
+}
+
+ssize_t undoable_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(offset, buf, count);
+}
+
+int undoable_image_t::flush()
+{
+  return redolog->flush();
+}
+
 /*** volatile_image_t function definitions ***/
 
 volatile_image_t::volatile_image_t(const char* _redolog_name)
@@ -1637,18 +2164,928 @@ ssize_t volatile_image_t::write(const void* buf, size_t count)
   return (ret < 0) ? ret : count;
 }
 
-#if BX_COMPRESSED_HD_SUPPORT
-
-/*** z_ro_image_t function definitions ***/
+ssize_t volatile_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  return redolog->read_sectors(offset, buf, count, ro_disk);
+}
 
-z_ro_image_t::z_ro_image_t()
+ssize_t volatile_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
 {
-  offset = (Bit64s)0;
+  return redolog->write_sectors(offset, buf, count);
 }
 
-int z_ro_image_t::open(const char* pathname)
+/*** overlay_image_t function definitions ***/
+
+overlay_image_t::overlay_image_t(device_image_t *_image, const char* pathname)
 {
-  fd = ::open(pathname, O_RDONLY
+  image = _image;
+  cylinders = image->cylinders;
+  heads = image->heads;
+  sectors = image->sectors;
+  hd_size = image->hd_size;
+  if (hd_size != 0) {
+    total_sectors = (Bit64s)(hd_size >> 9);
+  } else {
+    total_sectors = (Bit64s)cylinders * heads * sectors;
+  }
+  redolog = NULL;
+  redolog_name = strdup(pathname);
+  redolog_temp = NULL;
+  position = 0;
+}
+
+overlay_image_t::~overlay_image_t()
+{
+  delete redolog;
+  delete image;
+  free(redolog_name);
+}
+
+int overlay_image_t::open(const char* pathname)
+{
+  redolog_temp = (char*)malloc(strlen(redolog_name) + VOLATILE_REDOLOG_EXTENSION_LENGTH + 1);
+  sprintf(redolog_temp, "%s%s", redolog_name, VOLATILE_REDOLOG_EXTENSION);
+
+  int filedes = mkstemp(redolog_temp);
+  if (filedes < 0) {
+    BX_ERROR(("Can't create checkpoint redolog '%s'", redolog_temp));
+    free(redolog_temp);
+    redolog_temp = NULL;
+    return -1;
+  }
+  redolog = new redolog_t();
+  if (redolog->create(filedes, REDOLOG_SUBTYPE_VOLATILE, total_sectors * 512) < 0) {
+    BX_ERROR(("Can't create checkpoint redolog '%s'", redolog_temp));
+    ::close(filedes);
+    unlink(redolog_temp);
+    free(redolog_temp);
+    redolog_temp = NULL;
+    delete redolog;
+    redolog = NULL;
+    return -1;
+  }
+
+#if (!defined(WIN32)) && !BX_WITH_MACOS
+  // on unix it is legal to delete an open file
+  unlink(redolog_temp);
+#endif
+
+  BX_DEBUG(("checkpoint redolog for '%s' is '%s'", pathname, redolog_temp));
+  return 0;
+}
+
+device_image_t* overlay_image_t::release()
+{
+  if (redolog != NULL) {
+    Bit64s committed = redolog->commit_sectors(image);
+    if (committed < 0)
+      return NULL;
+    BX_DEBUG(("checkpoint redolog: " FMT_LL "d sectors written to the image", committed));
+    redolog->close();
+    delete redolog;
+    redolog = NULL;
+#if defined(WIN32) || BX_WITH_MACOS
+    // on non-unix we have to wait till the file is closed to delete it
+    unlink(redolog_temp);
+#endif
+    free(redolog_temp);
+    redolog_temp = NULL;
+  }
+
+  device_image_t *base = image;
+  image = NULL;
+  return base;
+}
+
+int overlay_image_t::discard()
+{
+  if (redolog != NULL) {
+    redolog->close();
+    delete redolog;
+    redolog = NULL;
+#if defined(WIN32) || BX_WITH_MACOS
+    unlink(redolog_temp);
+#endif
+    free(redolog_temp);
+    redolog_temp = NULL;
+  }
+  return open(redolog_name);
+}
+
+void overlay_image_t::close()
+{
+  device_image_t *base = release();
+  if (base == NULL) {
+    BX_ERROR(("checkpoint redolog could not be written back, the image is not up to date"));
+    return;
+  }
+  image = base;
+  image->close();
+}
+
+Bit64s overlay_image_t::lseek(Bit64s offset, int whence)
+{
+  if ((offset % 512) != 0)
+    BX_PANIC(("overlay: lseek() offset not sector aligned"));
+  switch (whence) {
+    case SEEK_SET:
+      position = offset;
+      break;
+    case SEEK_CUR:
+      position += offset;
+      break;
+    default:
+      BX_PANIC(("overlay: lseek() mode not supported yet"));
+      return -1;
+  }
+  if ((position < 0) || ((position >> 9) > total_sectors))
+    return -1;
+  return position;
+}
+
+ssize_t overlay_image_t::read(void* buf, size_t count)
+{
+  ssize_t ret = read_sectors(position, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+ssize_t overlay_image_t::write(const void* buf, size_t count)
+{
+  ssize_t ret = write_sectors(position, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+ssize_t overlay_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  return redolog->read_sectors(offset, buf, count, image);
+}
+
+ssize_t overlay_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(offset, buf, count);
+}
+
+int overlay_image_t::flush()
+{
+  return image->flush();
+}
+
+Bit32u overlay_image_t::get_capabilities()
+{
+  return image->get_capabilities();
+}
+
+/*** cached_image_t function definitions ***/
+
+cached_image_t::cached_image_t(device_image_t *_image, Bit32u cache_size, Bit32u _flush_interval)
+{
+  int i;
+
+  image = _image;
+  cylinders = image->cylinders;
+  heads = image->heads;
+  sectors = image->sectors;
+  hd_size = image->hd_size;
+  if (hd_size != 0) {
+    total_sectors = (Bit64s)(hd_size >> 9);
+  } else {
+    total_sectors = (Bit64s)cylinders * heads * sectors;
+  }
+
+  // cache_size is given in KB, keep room for a read-ahead window
+  num_extents = (int)(cache_size >> (HDCACHE_EXTENT_SHIFT - 10));
+  if (num_extents < (2 * HDCACHE_READAHEAD))
+    num_extents = 2 * HDCACHE_READAHEAD;
+  extents = new extent_t[num_extents];
+  for (i = 0; i < num_extents; i++) {
+    extents[i].index = HDCACHE_NONE;
+    extents[i].data = new Bit8u[HDCACHE_EXTENT_SIZE];
+    extents[i].lru_prev = i - 1;
+    extents[i].lru_next = (i < (num_extents - 1)) ? (i + 1) : HDCACHE_NONE;
+    extents[i].hash_next = HDCACHE_NONE;
+    extents[i].dirty_count = 0;
+    memset(extents[i].dirty, 0, sizeof(extents[i].dirty));
+  }
+  lru_head = 0;
+  lru_tail = num_extents - 1;
+
+  hash_mask = 1;
+  while (hash_mask < (unsigned)num_extents) hash_mask <<= 1;
+  hash = new int[hash_mask];
+  for (i = 0; i < (int)hash_mask; i++) hash[i] = HDCACHE_NONE;
+  hash_mask--;
+
+  readahead_buffer = new Bit8u[HDCACHE_READAHEAD * HDCACHE_EXTENT_SIZE];
+  position = 0;
+  next_sequential = -1;
+  sequential_count = 0;
+  hits = misses = prefetched = written_back = 0;
+
+  flush_interval = _flush_interval;
+  timer_index = BX_NULL_TIMER_HANDLE;
+  if (flush_interval > 0) {
+    timer_index = bx_pc_system.register_timer(this, flush_timer_handler,
+      flush_interval * 1000, 1, 1, "hdcache");
+  }
+}
+
+cached_image_t::~cached_image_t()
+{
+  for (int i = 0; i < num_extents; i++) {
+    delete [] extents[i].data;
+  }
+  delete [] extents;
+  delete [] hash;
+  delete [] readahead_buffer;
+  delete image;
+}
+
+int cached_image_t::open(const char* pathname)
+{
+  // the underlying image is opened before it is wrapped
+  return -1;
+}
+
+void cached_image_t::close()
+{
+  if (timer_index != BX_NULL_TIMER_HANDLE) {
+    bx_pc_system.deactivate_timer(timer_index);
+    bx_pc_system.unregisterTimer(timer_index);
+    timer_index = BX_NULL_TIMER_HANDLE;
+  }
+  if (flush() < 0)
+    BX_ERROR(("cache: dirty sectors could not be written back, the image is not up to date"));
+  BX_INFO(("cache: " FMT_LL "u hits, " FMT_LL "u misses, " FMT_LL "u extents read ahead, " FMT_LL "u sectors written back",
+           hits, misses, prefetched, written_back));
+  image->close();
+}
+
+Bit64s cached_image_t::lseek(Bit64s offset, int whence)
+{
+  if ((offset % 512) != 0)
+    BX_PANIC(("cache: lseek() offset not sector aligned"));
+  switch (whence) {
+    case SEEK_SET:
+      position = offset;
+      break;
+    case SEEK_CUR:
+      position += offset;
+      break;
+    default:
+      BX_PANIC(("cache: lseek() mode not supported yet"));
+      return -1;
+  }
+  if ((position < 0) || ((position >> 9) > total_sectors))
+    return -1;
+  return position;
+}
+
+ssize_t cached_image_t::read(void* buf, size_t count)
+{
+  ssize_t ret = read_sectors(position, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+ssize_t cached_image_t::write(const void* buf, size_t count)
+{
+  ssize_t ret = write_sectors(position, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+Bit32u cached_image_t::get_capabilities()
+{
+  return image->get_capabilities();
+}
+
+ssize_t cached_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+  Bit64s sector = offset >> 9;
+  Bit64s index = HDCACHE_NONE;
+  unsigned done = 0;
+  int slot;
+
+  if ((sector + count) > total_sectors)
+    return -1;
+
+  if (offset == next_sequential) {
+    sequential_count++;
+  } else {
+    sequential_count = 0;
+  }
+  next_sequential = offset + (Bit64s)count * 512;
+
+  while (done < count) {
+    index = sector >> (HDCACHE_EXTENT_SHIFT - 9);
+    unsigned start = (unsigned)(sector & (HDCACHE_EXTENT_SECTORS - 1));
+    unsigned n = HDCACHE_EXTENT_SECTORS - start;
+    if (n > (count - done)) n = count - done;
+
+    slot = lookup(index);
+    if (slot != HDCACHE_NONE) {
+      hits++;
+      lru_unlink(slot);
+      lru_push_front(slot);
+    } else {
+      misses++;
+      slot = fetch(index);
+      if (slot == HDCACHE_NONE)
+        return -1;
+    }
+    memcpy(bufptr, extents[slot].data + start * 512, n * 512);
+    bufptr += n * 512;
+    sector += n;
+    done += n;
+  }
+
+  // a stream of back-to-back reads: fetch the extents that follow
+  if (sequential_count > 0)
+    readahead(index);
+
+  return (ssize_t)count * 512;
+}
+
+ssize_t cached_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  const Bit8u *bufptr = (const Bit8u*) buf;
+  Bit64s sector = offset >> 9;
+  unsigned done = 0;
+  int slot;
+
+  if ((sector + count) > total_sectors)
+    return -1;
+
+  next_sequential = -1;
+  if (flush_interval == 0) {
+    if (image->write_sectors(offset, buf, count) < 0)
+      return -1;
+  }
+
+  while (done < count) {
+    Bit64s index = sector >> (HDCACHE_EXTENT_SHIFT - 9);
+    unsigned start = (unsigned)(sector & (HDCACHE_EXTENT_SECTORS - 1));
+    unsigned n = HDCACHE_EXTENT_SECTORS - start;
+    if (n > (count - done)) n = count - done;
+
+    slot = lookup(index);
+    if (slot != HDCACHE_NONE) {
+      hits++;
+      lru_unlink(slot);
+      lru_push_front(slot);
+    } else if (flush_interval > 0) {
+      misses++;
+      if (n == extent_sectors(index)) {
+        // the whole extent is overwritten, no need to read it first
+        slot = alloc_slot();
+        if (slot == HDCACHE_NONE)
+          return -1;
+        extents[slot].index = index;
+        hash_insert(slot);
+        lru_unlink(slot);
+        lru_push_front(slot);
+      } else {
+        slot = fetch(index);
+        if (slot == HDCACHE_NONE)
+          return -1;
+      }
+    }
+    if (slot != HDCACHE_NONE) {
+      memcpy(extents[slot].data + start * 512, bufptr, n * 512);
+      if (flush_interval > 0) {
+        for (unsigned i = start; i < (start + n); i++) {
+          if (!(extents[slot].dirty[i >> 3] & (1 << (i & 7)))) {
+            extents[slot].dirty[i >> 3] |= (1 << (i & 7));
+            extents[slot].dirty_count++;
+          }
+        }
+      }
+    }
+    bufptr += n * 512;
+    sector += n;
+    done += n;
+  }
+
+  return (ssize_t)count * 512;
+}
+
+int cached_image_t::flush()
+{
+  int ret = 0;
+
+  for (int i = 0; i < num_extents; i++) {
+    if (extents[i].dirty_count > 0) {
+      if (write_back(i) < 0) ret = -1;
+    }
+  }
+  if (image->flush() < 0) ret = -1;
+  return ret;
+}
+
+void cached_image_t::read_ahead(Bit64s offset, unsigned count)
+{
+  Bit64s index = offset >> HDCACHE_EXTENT_SHIFT;
+  Bit64s last = (offset + (Bit64s)count * 512 - 1) >> HDCACHE_EXTENT_SHIFT;
+
+  if (((offset >> 9) + count) > total_sectors)
+    return;
+  for (; index <= last; index++) {
+    if (lookup(index) == HDCACHE_NONE)
+      image->read_ahead(index << HDCACHE_EXTENT_SHIFT, extent_sectors(index));
+  }
+}
+
+void cached_image_t::flush_timer_handler(void *this_ptr)
+{
+  ((cached_image_t *) this_ptr)->flush();
+}
+
+int cached_image_t::lookup(Bit64s index)
+{
+  int slot = hash[(unsigned)index & hash_mask];
+
+  while (slot != HDCACHE_NONE) {
+    if (extents[slot].index == index) break;
+    slot = extents[slot].hash_next;
+  }
+  return slot;
+}
+
+// read an extent into the least recently used slot
+int cached_image_t::fetch(Bit64s index)
+{
+  int slot = alloc_slot();
+
+  if (slot == HDCACHE_NONE)
+    return HDCACHE_NONE;
+  if (image->read_sectors(index << HDCACHE_EXTENT_SHIFT, extents[slot].data,
+                          extent_sectors(index)) < 0) {
+    BX_ERROR(("cache: could not read extent " FMT_LL "d", index));
+    return HDCACHE_NONE;
+  }
+  extents[slot].index = index;
+  hash_insert(slot);
+  lru_unlink(slot);
+  lru_push_front(slot);
+  return slot;
+}
+
+// read the uncached extents following 'index' with a single request
+void cached_image_t::readahead(Bit64s index)
+{
+  Bit64s last = (total_sectors - 1) >> (HDCACHE_EXTENT_SHIFT - 9);
+  unsigned num = 0, sectors = 0, i;
+
+  while ((num < HDCACHE_READAHEAD) && ((index + num + 1) <= last) &&
+         (lookup(index + num + 1) == HDCACHE_NONE)) {
+    sectors += extent_sectors(index + num + 1);
+    num++;
+  }
+  if (num == 0) return;
+
+  if (image->read_sectors((index + 1) << HDCACHE_EXTENT_SHIFT, readahead_buffer, sectors) < 0)
+    return;
+
+  for (i = 0; i < num; i++) {
+    int slot = alloc_slot();
+    if (slot == HDCACHE_NONE)
+      break;
+    memcpy(extents[slot].data, readahead_buffer + i * HDCACHE_EXTENT_SIZE,
+           extent_sectors(index + i + 1) * 512);
+    extents[slot].index = index + i + 1;
+    hash_insert(slot);
+    lru_unlink(slot);
+    lru_push_front(slot);
+  }
+  prefetched += i;
+}
+
+// Evict the least recently used extent and return its slot. An extent
+// which cannot be written back keeps its dirty sectors and stays cached,
+// the next one is tried instead. Returns HDCACHE_NONE if no extent can
+// be evicted.
+int cached_image_t::alloc_slot()
+{
+  int slot;
+
+  for (slot = lru_tail; slot != HDCACHE_NONE; slot = extents[slot].lru_prev) {
+    if (extents[slot].index == HDCACHE_NONE)
+      return slot;
+    if ((extents[slot].dirty_count > 0) && (write_back(slot) < 0)) {
+      BX_ERROR(("cache: write back of extent " FMT_LL "d failed", extents[slot].index));
+      continue;
+    }
+    hash_remove(slot);
+    extents[slot].index = HDCACHE_NONE;
+    return slot;
+  }
+  BX_ERROR(("cache: no extent can be evicted"));
+  return HDCACHE_NONE;
+}
+
+void cached_image_t::hash_insert(int slot)
+{
+  unsigned bucket = (unsigned)extents[slot].index & hash_mask;
+
+  extents[slot].hash_next = hash[bucket];
+  hash[bucket] = slot;
+}
+
+void cached_image_t::hash_remove(int slot)
+{
+  int *link = &hash[(unsigned)extents[slot].index & hash_mask];
+
+  while (*link != slot) {
+    link = &extents[*link].hash_next;
+  }
+  *link = extents[slot].hash_next;
+  extents[slot].hash_next = HDCACHE_NONE;
+}
+
+void cached_image_t::lru_unlink(int slot)
+{
+  if (extents[slot].lru_prev != HDCACHE_NONE)
+    extents[extents[slot].lru_prev].lru_next = extents[slot].lru_next;
+  else
+    lru_head = extents[slot].lru_next;
+  if (extents[slot].lru_next != HDCACHE_NONE)
+    extents[extents[slot].lru_next].lru_prev = extents[slot].lru_prev;
+  else
+    lru_tail = extents[slot].lru_prev;
+}
+
+void cached_image_t::lru_push_front(int slot)
+{
+  extents[slot].lru_prev = HDCACHE_NONE;
+  extents[slot].lru_next = lru_head;
+  if (lru_head != HDCACHE_NONE)
+    extents[lru_head].lru_prev = slot;
+  else
+    lru_tail = slot;
+  lru_head = slot;
+}
+
+// the last extent may be cut short by the end of the disk
+unsigned cached_image_t::extent_sectors(Bit64s index)
+{
+  Bit64s left = total_sectors - (index << (HDCACHE_EXTENT_SHIFT - 9));
+
+  return (left < HDCACHE_EXTENT_SECTORS) ? (unsigned)left : HDCACHE_EXTENT_SECTORS;
+}
+
+// Write each run of dirty sectors of an extent with a single request.
+// Only the runs which were written are marked clean.
+int cached_image_t::write_back(int slot)
+{
+  extent_t *extent = &extents[slot];
+  Bit64s base = extent->index << HDCACHE_EXTENT_SHIFT;
+  int ret = 0;
+  unsigned i = 0;
+
+  while (i < HDCACHE_EXTENT_SECTORS) {
+    if (!(extent->dirty[i >> 3] & (1 << (i & 7)))) {
+      i++;
+      continue;
+    }
+    unsigned start = i;
+    while ((i < HDCACHE_EXTENT_SECTORS) && (extent->dirty[i >> 3] & (1 << (i & 7)))) i++;
+    if (image->write_sectors(base + start * 512, extent->data + start * 512, i - start) < 0) {
+      ret = -1;
+    } else {
+      written_back += i - start;
+      for (unsigned j = start; j < i; j++)
+        extent->dirty[j >> 3] &= ~(1 << (j & 7));
+      extent->dirty_count -= i - start;
+    }
+  }
+  return ret;
+}
+
+#if BX_SUPPORT_ASYNC_DISK
+
+/*** async_image_t function definitions ***/
+
+async_image_t::async_image_t(device_image_t *_image)
+{
+  image = _image;
+  cylinders = image->cylinders;
+  heads = image->heads;
+  sectors = image->sectors;
+  hd_size = image->hd_size;
+  if (hd_size != 0) {
+    total_sectors = (Bit64s)(hd_size >> 9);
+  } else {
+    total_sectors = (Bit64s)cylinders * heads * sectors;
+  }
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&work_cond, NULL);
+  pthread_cond_init(&done_cond, NULL);
+  queue_head = queue_tail = NULL;
+  pending = pending_writes = 0;
+  write_error = 0;
+  write_error_offset = 0;
+  quit = 0;
+  for (int i = 0; i < HDASYNC_MAX_PREFETCH; i++) prefetch[i] = NULL;
+  next_prefetch = 0;
+  position = 0;
+
+  running = (pthread_create(&thread, NULL, worker_thread, this) == 0);
+  if (!running) {
+    BX_ERROR(("async: could not create the I/O thread, using synchronous I/O"));
+  }
+}
+
+async_image_t::~async_image_t()
+{
+  pthread_cond_destroy(&done_cond);
+  pthread_cond_destroy(&work_cond);
+  pthread_mutex_destroy(&lock);
+  delete image;
+}
+
+int async_image_t::open(const char* pathname)
+{
+  // the underlying image is opened before it is wrapped
+  return -1;
+}
+
+void async_image_t::close()
+{
+  if (flush() < 0)
+    BX_ERROR(("async: closing the image after failed writes, the image is not up to date"));
+  for (int i = 0; i < HDASYNC_MAX_PREFETCH; i++) drop_prefetch(i);
+  if (running) {
+    pthread_mutex_lock(&lock);
+    quit = 1;
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    running = 0;
+  }
+  image->close();
+}
+
+Bit64s async_image_t::lseek(Bit64s offset, int whence)
+{
+  if ((offset % 512) != 0)
+    BX_PANIC(("async: lseek() offset not sector aligned"));
+  switch (whence) {
+    case SEEK_SET:
+      position = offset;
+      break;
+    case SEEK_CUR:
+      position += offset;
+      break;
+    default:
+      BX_PANIC(("async: lseek() mode not supported yet"));
+      return -1;
+  }
+  if ((position < 0) || ((position >> 9) > total_sectors))
+    return -1;
+  return position;
+}
+
+ssize_t async_image_t::read(void* buf, size_t count)
+{
+  ssize_t ret = read_sectors(position, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+ssize_t async_image_t::write(const void* buf, size_t count)
+{
+  ssize_t ret = write_sectors(position, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+Bit32u async_image_t::get_capabilities()
+{
+  return image->get_capabilities();
+}
+
+ssize_t async_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  async_request_t *req;
+  ssize_t ret;
+
+  if (!running)
+    return image->read_sectors(offset, buf, count);
+
+  for (int i = 0; i < HDASYNC_MAX_PREFETCH; i++) {
+    req = prefetch[i];
+    if ((req != NULL) && (req->offset == offset) && (req->count == count)) {
+      wait(req);
+      ret = req->result;
+      if (ret > 0) memcpy(buf, req->buf, count * 512);
+      drop_prefetch(i);
+      return ret;
+    }
+  }
+
+  req = submit(0, offset, (Bit8u*) buf, count);
+  wait(req);
+  ret = req->result;
+  delete req;
+  return ret;
+}
+
+ssize_t async_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  Bit64s end = offset + (Bit64s)count * 512;
+
+  if (!running)
+    return image->write_sectors(offset, buf, count);
+
+  // data read ahead from these sectors is stale now
+  for (int i = 0; i < HDASYNC_MAX_PREFETCH; i++) {
+    async_request_t *req = prefetch[i];
+    if ((req != NULL) && (req->offset < end) &&
+        ((req->offset + (Bit64s)req->count * 512) > offset)) {
+      drop_prefetch(i);
+    }
+  }
+
+  pthread_mutex_lock(&lock);
+  while (pending_writes >= HDASYNC_MAX_WRITES) {
+    pthread_cond_wait(&done_cond, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+  // an earlier queued write failed, fail this one so the guest sees it
+  if (take_write_error())
+    return -1;
+  Bit8u *data = new Bit8u[count * 512];
+  memcpy(data, buf, count * 512);
+  submit(1, offset, data, count);
+  return (ssize_t)count * 512;
+}
+
+void async_image_t::read_ahead(Bit64s offset, unsigned count)
+{
+  if (!running || (count == 0) || (((offset >> 9) + count) > total_sectors))
+    return;
+
+  for (int i = 0; i < HDASYNC_MAX_PREFETCH; i++) {
+    if ((prefetch[i] != NULL) && (prefetch[i]->offset == offset) &&
+        (prefetch[i]->count == count))
+      return;
+  }
+  drop_prefetch(next_prefetch);
+  prefetch[next_prefetch] = submit(0, offset, new Bit8u[count * 512], count);
+  next_prefetch = (next_prefetch + 1) % HDASYNC_MAX_PREFETCH;
+}
+
+int async_image_t::flush()
+{
+  int ret = 0;
+
+  if (running) {
+    drain();
+    if (take_write_error()) ret = -1;
+  }
+  if (image->flush() < 0) ret = -1;
+  return ret;
+}
+
+// report and clear the error of a queued write
+bx_bool async_image_t::take_write_error()
+{
+  bx_bool error;
+  Bit64s offset;
+
+  pthread_mutex_lock(&lock);
+  error = write_error;
+  offset = write_error_offset;
+  write_error = 0;
+  pthread_mutex_unlock(&lock);
+  if (error) {
+    BX_ERROR(("async: a queued write to the image at byte " FMT_LL "d failed", offset));
+  }
+  return error;
+}
+
+// queue a request for the worker thread
+async_image_t::async_request_t* async_image_t::submit(bx_bool write, Bit64s offset, Bit8u *buf, unsigned count)
+{
+  async_request_t *req = new async_request_t;
+
+  req->write = write;
+  req->offset = offset;
+  req->count = count;
+  req->buf = buf;
+  req->result = 0;
+  req->done = 0;
+  req->next = NULL;
+
+  pthread_mutex_lock(&lock);
+  if (queue_tail != NULL) {
+    queue_tail->next = req;
+  } else {
+    queue_head = req;
+  }
+  queue_tail = req;
+  pending++;
+  if (write) pending_writes++;
+  pthread_cond_signal(&work_cond);
+  pthread_mutex_unlock(&lock);
+  return req;
+}
+
+void async_image_t::wait(async_request_t *req)
+{
+  pthread_mutex_lock(&lock);
+  while (!req->done) {
+    pthread_cond_wait(&done_cond, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+// wait until all queued requests are served
+void async_image_t::drain()
+{
+  pthread_mutex_lock(&lock);
+  while (pending > 0) {
+    pthread_cond_wait(&done_cond, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+void async_image_t::drop_prefetch(int n)
+{
+  if (prefetch[n] != NULL) {
+    wait(prefetch[n]);
+    delete [] prefetch[n]->buf;
+    delete prefetch[n];
+    prefetch[n] = NULL;
+  }
+}
+
+void *async_image_t::worker_thread(void *this_ptr)
+{
+  ((async_image_t *) this_ptr)->worker();
+  return NULL;
+}
+
+// The worker owns the queued writes and frees them when they are done.
+// Reads stay owned by the thread that submitted them.
+void async_image_t::worker()
+{
+  async_request_t *req;
+
+  pthread_mutex_lock(&lock);
+  while (1) {
+    while ((queue_head == NULL) && !quit) {
+      pthread_cond_wait(&work_cond, &lock);
+    }
+    if (queue_head == NULL) break;
+    req = queue_head;
+    queue_head = req->next;
+    if (queue_head == NULL) queue_tail = NULL;
+    pthread_mutex_unlock(&lock);
+
+    if (req->write) {
+      req->result = image->write_sectors(req->offset, req->buf, req->count);
+    } else {
+      req->result = image->read_sectors(req->offset, req->buf, req->count);
+    }
+
+    pthread_mutex_lock(&lock);
+    pending--;
+    if (req->write) {
+      if ((req->result < (ssize_t)req->count * 512) && !write_error) {
+        // keep the first error until it is reported
+        write_error = 1;
+        write_error_offset = req->offset;
+      }
+      pending_writes--;
+      delete [] req->buf;
+      delete req;
+    } else {
+      req->done = 1;
+    }
+    pthread_cond_broadcast(&done_cond);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+#endif
+
+#if BX_COMPRESSED_HD_SUPPORT
+
+/*** z_ro_image_t function definitions ***/
+
+z_ro_image_t::z_ro_image_t()
+{
+  offset = (Bit64s)0;
+}
+
+int z_ro_image_t::open(const char* pathname)
+{
+  fd = ::open(pathname, O_RDONLY
 #ifdef O_BINARY
               | O_BINARY
 #endif
@@ -1894,4 +3331,429 @@ ssize_t z_volatile_image_t::write (const void* buf, size_t count)
   return redolog->write((char*) buf, count);
 }
 
+/*** qcow_image_t function definitions ***/
+
+qcow_image_t::qcow_image_t()
+{
+  fd = -1;
+  l1_table = NULL;
+  l2_cache = NULL;
+  cluster_cache = NULL;
+  cluster_data = NULL;
+  backing = NULL;
+  imagepos = 0;
+}
+
+qcow_image_t::~qcow_image_t()
+{
+  close();
+}
+
+int qcow_image_t::open(const char* pathname)
+{
+  return open(pathname, O_RDWR);
+}
+
+int qcow_image_t::open(const char* pathname, int flags)
+{
+  Bit32u i, shift;
+
+  fd = ::open(pathname, flags
+#ifdef O_BINARY
+              | O_BINARY
+#endif
+              );
+  if (fd < 0) {
+    return fd;
+  }
+
+  if (bx_pread(fd, &header, QCOW_HEADER_SIZE, 0) != QCOW_HEADER_SIZE) {
+    BX_ERROR(("qcow: could not read header of '%s'", pathname));
+    close();
+    return -1;
+  }
+  if (btoh32(header.magic) != QCOW_MAGIC) {
+    BX_ERROR(("qcow: '%s' is not a qcow image", pathname));
+    close();
+    return -1;
+  }
+  if (btoh32(header.version) != QCOW_VERSION) {
+    BX_ERROR(("qcow: unsupported version %d in '%s'", btoh32(header.version), pathname));
+    close();
+    return -1;
+  }
+  if (header.crypt_method != 0) {
+    BX_ERROR(("qcow: encrypted images are not supported"));
+    close();
+    return -1;
+  }
+  cluster_bits = header.cluster_bits;
+  l2_bits = header.l2_bits;
+  if ((cluster_bits < 9) || (cluster_bits > 16) || (l2_bits < 6) || (l2_bits > 16)) {
+    BX_ERROR(("qcow: bad cluster or L2 table size in '%s'", pathname));
+    close();
+    return -1;
+  }
+  cluster_size = 1 << cluster_bits;
+  l2_size = 1 << l2_bits;
+  cluster_offset_mask = (((Bit64u)1) << (63 - cluster_bits)) - 1;
+  hd_size = btoh64(header.size);
+
+  shift = cluster_bits + l2_bits;
+  l1_size = (Bit32u)((hd_size + (((Bit64u)1) << shift) - 1) >> shift);
+  l1_table = new Bit64u[l1_size];
+  if (bx_pread(fd, l1_table, l1_size * 8, btoh64(header.l1_table_offset)) != (ssize_t)(l1_size * 8)) {
+    BX_ERROR(("qcow: could not read L1 table of '%s'", pathname));
+    close();
+    return -1;
+  }
+  for (i = 0; i < l1_size; i++) {
+    l1_table[i] = btoh64(l1_table[i]);
+  }
+
+  l2_cache = new Bit64u[QCOW_L2_CACHE_SIZE << l2_bits];
+  for (i = 0; i < QCOW_L2_CACHE_SIZE; i++) {
+    l2_cache_offsets[i] = 0;
+    l2_cache_stamps[i] = 0;
+  }
+  l2_cache_clock = 0;
+  cluster_cache = new Bit8u[cluster_size];
+  cluster_data = new Bit8u[cluster_size];
+  cluster_cache_offset = 0;
+  file_end = (Bit64u)::lseek(fd, 0, SEEK_END);
+
+  if (header.backing_file_offset != 0) {
+    char backing_name[BX_PATHNAME_LEN];
+    Bit32u len = btoh32(header.backing_file_size);
+
+    if ((len >= BX_PATHNAME_LEN) ||
+        (bx_pread(fd, backing_name, len, btoh64(header.backing_file_offset)) != (ssize_t)len)) {
+      BX_ERROR(("qcow: could not read backing file name of '%s'", pathname));
+      close();
+      return -1;
+    }
+    backing_name[len] = 0;
+    if (!open_backing_file(pathname, backing_name)) {
+      close();
+      return -1;
+    }
+  }
+  imagepos = 0;
+
+  BX_INFO(("'qcow' disk opened: '%s', cluster size %d, %s backing file", pathname,
+           cluster_size, (backing != NULL) ? "with" : "no"));
+  return fd;
+}
+
+// the backing file name is relative to the directory of the image
+bx_bool qcow_image_t::open_backing_file(const char *pathname, const char *backing_name)
+{
+  char path[BX_PATHNAME_LEN];
+  Bit32u magic = 0;
+  int ret, bfd;
+
+  const char *sep = strrchr(pathname, '/');
+#ifdef WIN32
+  const char *sep2 = strrchr(pathname, '\\');
+  if (sep2 > sep) sep = sep2;
+  if ((backing_name[0] == '\\') || (backing_name[0] != 0 && backing_name[1] == ':'))
+    sep = NULL;
+#endif
+  if ((sep == NULL) || (backing_name[0] == '/')) {
+    sep = pathname - 1;
+  }
+  if ((size_t)(sep - pathname + 1) + strlen(backing_name) >= BX_PATHNAME_LEN) {
+    BX_ERROR(("qcow: backing file name too long"));
+    return 0;
+  }
+  memcpy(path, pathname, sep - pathname + 1);
+  strcpy(path + (sep - pathname + 1), backing_name);
+
+  // the backing file is either another qcow image or a flat image
+  bfd = ::open(path, O_RDONLY
+#ifdef O_BINARY
+               | O_BINARY
+#endif
+               );
+  if (bfd < 0) {
+    BX_ERROR(("qcow: could not open backing file '%s'", path));
+    return 0;
+  }
+  bx_pread(bfd, &magic, 4, 0);
+  ::close(bfd);
+  if (btoh32(magic) == QCOW_MAGIC) {
+    qcow_image_t *image = new qcow_image_t();
+    ret = image->open(path, O_RDONLY);
+    backing = image;
+  } else {
+    default_image_t *image = new default_image_t();
+    ret = image->open(path, O_RDONLY);
+    backing = image;
+  }
+  if (ret < 0) {
+    BX_ERROR(("qcow: could not open backing file '%s'", path));
+    delete backing;
+    backing = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+void qcow_image_t::close()
+{
+  if (fd > -1) {
+    ::close(fd);
+    fd = -1;
+  }
+  if (backing != NULL) {
+    backing->close();
+    delete backing;
+    backing = NULL;
+  }
+  delete [] l1_table;
+  delete [] l2_cache;
+  delete [] cluster_cache;
+  delete [] cluster_data;
+  l1_table = NULL;
+  l2_cache = NULL;
+  cluster_cache = NULL;
+  cluster_data = NULL;
+}
+
+Bit64s qcow_image_t::lseek(Bit64s offset, int whence)
+{
+  if ((offset % 512) != 0) {
+    BX_PANIC(("qcow: lseek() offset not multiple of 512"));
+    return -1;
+  }
+  if (whence == SEEK_SET) {
+    imagepos = offset;
+  } else if (whence == SEEK_CUR) {
+    imagepos += offset;
+  } else {
+    BX_PANIC(("qcow: lseek() mode not supported yet"));
+    return -1;
+  }
+  if (imagepos > (Bit64s)hd_size) {
+    BX_PANIC(("qcow: lseek() to byte %ld failed", (long)offset));
+    return -1;
+  }
+  return imagepos;
+}
+
+ssize_t qcow_image_t::read(void* buf, size_t count)
+{
+  ssize_t ret = read_sectors(imagepos, buf, (unsigned)(count / 512));
+  if (ret > 0) imagepos += ret;
+  return ret;
+}
+
+ssize_t qcow_image_t::write(const void* buf, size_t count)
+{
+  ssize_t ret = write_sectors(imagepos, buf, (unsigned)(count / 512));
+  if (ret > 0) imagepos += ret;
+  return ret;
+}
+
+// look up an L2 table in the cache, loading it (or a new empty one)
+// in place of the least recently used entry if necessary
+Bit64u* qcow_image_t::get_l2_table(Bit64u l2_offset, bx_bool create)
+{
+  unsigned i, slot = 0;
+
+  for (i = 0; i < QCOW_L2_CACHE_SIZE; i++) {
+    if (l2_cache_offsets[i] == l2_offset) {
+      l2_cache_stamps[i] = ++l2_cache_clock;
+      return &l2_cache[i << l2_bits];
+    }
+    if (l2_cache_stamps[i] < l2_cache_stamps[slot]) slot = i;
+  }
+
+  Bit64u *table = &l2_cache[slot << l2_bits];
+  if (create) {
+    memset(table, 0, l2_size * 8);
+  } else {
+    if (bx_pread(fd, table, l2_size * 8, l2_offset) != (ssize_t)(l2_size * 8)) {
+      BX_ERROR(("qcow: could not read L2 table at offset " FMT_LL "u", l2_offset));
+      l2_cache_offsets[slot] = 0;
+      l2_cache_stamps[slot] = 0;
+      return NULL;
+    }
+    for (i = 0; i < l2_size; i++) {
+      table[i] = btoh64(table[i]);
+    }
+  }
+  l2_cache_offsets[slot] = l2_offset;
+  l2_cache_stamps[slot] = ++l2_cache_clock;
+  return table;
+}
+
+// get the L2 entry of the cluster containing offset, 0 if not allocated
+bx_bool qcow_image_t::get_cluster_entry(Bit64u offset, Bit64u *entry)
+{
+  Bit64u l2_offset = l1_table[offset >> (l2_bits + cluster_bits)];
+
+  *entry = 0;
+  if (l2_offset != 0) {
+    Bit64u *l2_table = get_l2_table(l2_offset, 0);
+    if (l2_table == NULL) return 0;
+    *entry = l2_table[(offset >> cluster_bits) & (l2_size - 1)];
+  }
+  return 1;
+}
+
+// update the L2 entry of the cluster containing offset, allocating the
+// L2 table first if needed. The L1 entry is written after the table.
+bx_bool qcow_image_t::set_cluster_entry(Bit64u offset, Bit64u entry)
+{
+  Bit32u l1_index = (Bit32u)(offset >> (l2_bits + cluster_bits));
+  Bit32u l2_index = (Bit32u)(offset >> cluster_bits) & (l2_size - 1);
+  Bit64u l2_offset = l1_table[l1_index];
+  Bit64u *l2_table, value;
+
+  if (l2_offset == 0) {
+    l2_offset = alloc_space(l2_size * 8);
+    l2_table = get_l2_table(l2_offset, 1);
+    if (bx_pwrite(fd, l2_table, l2_size * 8, l2_offset) != (ssize_t)(l2_size * 8))
+      return 0;
+    value = htob64(l2_offset);
+    if (bx_pwrite(fd, &value, 8, btoh64(header.l1_table_offset) + l1_index * 8) != 8)
+      return 0;
+    l1_table[l1_index] = l2_offset;
+  } else {
+    l2_table = get_l2_table(l2_offset, 0);
+    if (l2_table == NULL) return 0;
+  }
+  value = htob64(entry);
+  if (bx_pwrite(fd, &value, 8, l2_offset + l2_index * 8) != 8)
+    return 0;
+  l2_table[l2_index] = entry;
+  return 1;
+}
+
+// allocate cluster aligned space at the end of the image file
+Bit64u qcow_image_t::alloc_space(Bit64u size)
+{
+  Bit64u offset = (file_end + cluster_size - 1) & ~((Bit64u)cluster_size - 1);
+  file_end = offset + size;
+  return offset;
+}
+
+bx_bool qcow_image_t::decompress_cluster(Bit64u entry)
+{
+  Bit64u coffset = entry & cluster_offset_mask;
+  Bit32u csize = (Bit32u)(entry >> (63 - cluster_bits)) & (cluster_size - 1);
+  z_stream strm;
+  int ret;
+
+  if (coffset == cluster_cache_offset)
+    return 1;
+  cluster_cache_offset = 0;
+  if (bx_pread(fd, cluster_data, csize, coffset) != (ssize_t)csize) {
+    BX_ERROR(("qcow: could not read compressed cluster at offset " FMT_LL "u", coffset));
+    return 0;
+  }
+  memset(&strm, 0, sizeof(strm));
+  if (inflateInit2(&strm, -12) != Z_OK)
+    return 0;
+  strm.next_in = cluster_data;
+  strm.avail_in = csize;
+  strm.next_out = cluster_cache;
+  strm.avail_out = cluster_size;
+  ret = inflate(&strm, Z_FINISH);
+  inflateEnd(&strm);
+  if (((ret != Z_STREAM_END) && (ret != Z_BUF_ERROR)) || (strm.avail_out != 0)) {
+    BX_ERROR(("qcow: corrupt compressed cluster at offset " FMT_LL "u", coffset));
+    return 0;
+  }
+  cluster_cache_offset = coffset;
+  return 1;
+}
+
+// read len bytes at offset from one cluster, described by its L2 entry
+bx_bool qcow_image_t::read_cluster_data(Bit64u offset, Bit64u entry, Bit8u *buf, unsigned len)
+{
+  Bit32u in_cluster = (Bit32u)offset & (cluster_size - 1);
+
+  if (entry == 0) {
+    unsigned n = 0;
+    if ((backing != NULL) && (offset < backing->hd_size)) {
+      n = len;
+      if ((offset + n) > backing->hd_size)
+        n = (unsigned)(backing->hd_size - offset);
+      if (backing->read_sectors(offset, buf, n / 512) != (ssize_t)n)
+        return 0;
+    }
+    memset(buf + n, 0, len - n);
+  } else if (entry & QCOW_OFLAG_COMPRESSED) {
+    if (!decompress_cluster(entry))
+      return 0;
+    memcpy(buf, cluster_cache + in_cluster, len);
+  } else {
+    if (bx_pread(fd, buf, len, entry + in_cluster) != (ssize_t)len)
+      return 0;
+  }
+  return 1;
+}
+
+ssize_t qcow_image_t::read_sectors(Bit64s offset, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+  Bit64u entry;
+
+  if ((Bit64u)(offset + (Bit64s)count * 512) > hd_size)
+    return -1;
+
+  while (count > 0) {
+    Bit32u in_cluster = (Bit32u)offset & (cluster_size - 1);
+    unsigned n = (cluster_size - in_cluster) >> 9;
+    if (n > count) n = count;
+    if (!get_cluster_entry(offset, &entry) ||
+        !read_cluster_data(offset, entry, bufptr, n * 512))
+      return -1;
+    bufptr += n * 512;
+    offset += n * 512;
+    count -= n;
+  }
+  return (ssize_t)(bufptr - (Bit8u*) buf);
+}
+
+ssize_t qcow_image_t::write_sectors(Bit64s offset, const void* buf, unsigned count)
+{
+  const Bit8u *bufptr = (const Bit8u*) buf;
+  Bit64u entry;
+
+  if ((Bit64u)(offset + (Bit64s)count * 512) > hd_size)
+    return -1;
+
+  while (count > 0) {
+    Bit32u in_cluster = (Bit32u)offset & (cluster_size - 1);
+    unsigned n = (cluster_size - in_cluster) >> 9;
+    if (n > count) n = count;
+    if (!get_cluster_entry(offset, &entry))
+      return -1;
+    if ((entry != 0) && !(entry & QCOW_OFLAG_COMPRESSED)) {
+      if (bx_pwrite(fd, bufptr, n * 512, entry + in_cluster) != (ssize_t)(n * 512))
+        return -1;
+    } else {
+      // copy on write: the cluster is unallocated (data comes from the
+      // backing file) or compressed, so rebuild it in a new cluster
+      Bit64u cluster_start = offset - in_cluster;
+      if ((n * 512) < cluster_size) {
+        if (!read_cluster_data(cluster_start, entry, cluster_data, cluster_size))
+          return -1;
+      }
+      memcpy(cluster_data + in_cluster, bufptr, n * 512);
+      Bit64u new_offset = alloc_space(cluster_size);
+      if ((bx_pwrite(fd, cluster_data, cluster_size, new_offset) != (ssize_t)cluster_size) ||
+          !set_cluster_entry(offset, new_offset))
+        return -1;
+    }
+    bufptr += n * 512;
+    offset += n * 512;
+    count -= n;
+  }
+  return (ssize_t)(bufptr - (const Bit8u*) buf);
+}
+
 #endif
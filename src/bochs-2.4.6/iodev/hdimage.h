@@ -69,6 +69,10 @@
 
 #define REDOLOG_PAGE_NOT_ALLOCATED (0xffffffff)
 
+// the catalog and bitmap changes are written back at the latest when
+// this many extents have modified bitmaps
+#define REDOLOG_MAX_DIRTY_BITMAPS 64
+
 #define UNDOABLE_REDOLOG_EXTENSION ".redolog"
 #define UNDOABLE_REDOLOG_EXTENSION_LENGTH (strlen(UNDOABLE_REDOLOG_EXTENSION))
 #define VOLATILE_REDOLOG_EXTENSION ".XXXXXX"
@@ -109,6 +113,30 @@
    Bit8u padding[STANDARD_HEADER_SIZE - (sizeof (standard_header_t) + sizeof (redolog_specific_header_v1_t))];
  } redolog_header_v1_t;
 
+// QCOW IMAGES HEADER (compatible with qcow version 1)
+#define QCOW_MAGIC            (0x514649fb) // 'Q' 'F' 'I' 0xfb
+#define QCOW_VERSION          1
+#define QCOW_HEADER_SIZE      (48)
+#define QCOW_CLUSTER_BITS     12           // defaults for new images
+#define QCOW_L2_BITS          9
+#define QCOW_OFLAG_COMPRESSED (((Bit64u)1) << 63)
+
+ // WARNING : qcow headers and tables are kept in big endianness
+ typedef struct
+ {
+   Bit32u  magic;
+   Bit32u  version;
+   Bit64u  backing_file_offset;
+   Bit32u  backing_file_size;
+   Bit32u  mtime;
+   Bit64u  size;
+   Bit8u   cluster_bits;
+   Bit8u   l2_bits;
+   Bit16u  padding;
+   Bit32u  crypt_method;
+   Bit64u  l1_table_offset;
+ } qcow_header_t;
+
 // htod : convert host to disk (little) endianness
 // dtoh : convert disk (little) to host endianness
 #if defined (BX_LITTLE_ENDIAN)
@@ -123,6 +151,20 @@
 #define dtoh64(val) htod64(val)
 #endif
 
+// htob : convert host to big endianness
+// btoh : convert big endianness to host
+#if defined (BX_LITTLE_ENDIAN)
+#define htob32(val) ( (((val)&0xff000000)>>24) | (((val)&0xff0000)>>8) | (((val)&0xff00)<<8) | (((val)&0xff)<<24) )
+#define btoh32(val) htob32(val)
+#define htob64(val) ( (((val)&0xff00000000000000LL)>>56) | (((val)&0xff000000000000LL)>>40) | (((val)&0xff0000000000LL)>>24) | (((val)&0xff00000000LL)>>8) | (((val)&0xff000000LL)<<8) | (((val)&0xff0000LL)<<24) | (((val)&0xff00LL)<<40) | (((val)&0xffLL)<<56) )
+#define btoh64(val) htob64(val)
+#else
+#define htob32(val) (val)
+#define btoh32(val) (val)
+#define htob64(val) (val)
+#define btoh64(val) (val)
+#endif
+
 #ifndef HDIMAGE_HEADERS_ONLY
 
 class device_image_t
@@ -150,6 +192,29 @@ class device_image_t
       // written (count).
       virtual ssize_t write(const void* buf, size_t count) = 0;
 
+      // Read count sectors at byte offset into buf, without using the
+      // current position. Return the number of bytes read (count*512).
+      virtual ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+
+      // Write count sectors from buf at byte offset, without using the
+      // current position. Return the number of bytes written (count*512).
+      virtual ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Hint that count sectors at byte offset will be read next.
+      virtual void read_ahead(Bit64s offset, unsigned count) {}
+
+      // Map the whole image into host memory and serve the sector reads
+      // and writes from the mapping. Returns non-negative if successful.
+      virtual int map_image() { return -1; }
+
+      // Return the host address of count sectors at byte offset in the
+      // mapping of the image, or NULL if they are not mapped.
+      virtual Bit8u* get_mapped_sectors(Bit64s offset, unsigned count) { return NULL; }
+
+      // Write back any data held in memory. Returns non-negative if
+      // successful.
+      virtual int flush();
+
       // Get image capabilities
       virtual Bit32u get_capabilities();
 
@@ -163,6 +228,9 @@ class device_image_t
 class default_image_t : public device_image_t
 {
   public:
+      // Default constructor
+      default_image_t();
+
       // Open a image. Returns non-negative if successful.
       int open(const char* pathname);
 
@@ -184,9 +252,22 @@ class default_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Map the image file read-only with mmap(). Reads are served from
+      // the mapping, writes still go to the file.
+      int map_image();
+      Bit8u* get_mapped_sectors(Bit64s offset, unsigned count);
+
   private:
       int fd;
 
+#ifdef _POSIX_MAPPED_FILES
+      Bit8u  *mmap_base;
+      size_t  mmap_length;
+#endif
 };
 
 // CONCAT MODE
@@ -214,6 +295,10 @@ class concat_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
   private:
 #define BX_CONCAT_MAX_IMAGES 8
       int fd_table[BX_CONCAT_MAX_IMAGES];
@@ -266,6 +351,9 @@ class sparse_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+
   private:
  int fd;
 
@@ -358,12 +446,35 @@ class redolog_t
       ssize_t read(void* buf, size_t count);
       ssize_t write(const void* buf, size_t count);
 
+      // Positional multi-sector access. Sectors missing from the redolog
+      // are read from base, or returned as zeros if base is NULL.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count, device_image_t *base);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Write the modified catalog entries and bitmaps to the file and
+      // sync it. Returns non-negative if successful.
+      int flush();
+
+      // Write all sectors held in the redolog to image. Returns the number
+      // of sectors written or -1 on error.
+      Bit64s commit_sectors(device_image_t *image);
+
   private:
       void             print_header();
+      void             init_bitmaps();
+      bx_bool          alloc_extent(Bit32u index);
+      Bit64s           bitmap_offset_of(Bit32u index);
+      Bit8u           *get_bitmap(Bit32u index);
+      void             set_bitmap_dirty(Bit32u index);
       int              fd;
       redolog_header_t header;     // Header is kept in x86 (little) endianness
       Bit32u          *catalog;
-      Bit8u           *bitmap;
+      Bit32u           catalog_dirty_lo; // range of catalog entries not
+      Bit32u           catalog_dirty_hi; // written to the file yet
+      Bit8u          **bitmaps;    // bitmaps of the extents, loaded on first use
+      bx_bool         *bitmap_dirty;
+      Bit32u           dirty_bitmaps;
+      bx_bool          is_volatile; // deleted on close, never flushed
       Bit32u           extent_index;
       Bit32u           extent_offset;
       Bit32u           extent_next;
@@ -400,6 +511,13 @@ class growing_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Write the redolog metadata back and sync the file.
+      int flush();
+
   private:
       redolog_t *redolog;
 };
@@ -430,6 +548,13 @@ class undoable_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Write the redolog metadata back and sync the file.
+      int flush();
+
   private:
       redolog_t       *redolog;       // Redolog instance
       default_image_t *ro_disk;       // Read-only flat disk instance
@@ -463,6 +588,10 @@ class volatile_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
   private:
       redolog_t       *redolog;       // Redolog instance
       default_image_t *ro_disk;       // Read-only flat disk instance
@@ -470,6 +599,249 @@ class volatile_image_t : public device_image_t
       char            *redolog_temp;  // Redolog temporary file name
 };
 
+// CHECKPOINT OVERLAY
+// Wraps an opened image while a checkpoint of the machine state is held
+// (see bx_real_sim_c::checkpoint_state()). The writes since the checkpoint
+// go to a volatile redolog next to the image, so a rollback only has to
+// empty it. They are written to the image when the overlay is released or
+// closed.
+class overlay_image_t : public device_image_t
+{
+  public:
+      // Contructor
+      overlay_image_t(device_image_t *image, const char* pathname);
+      virtual ~overlay_image_t();
+
+      // Create the redolog. Returns non-negative if successful.
+      int open(const char* pathname);
+
+      // Write the redolog to the image, then close both.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Flush the image, the redolog is never made durable.
+      int flush();
+
+      Bit32u get_capabilities();
+
+      // Drop the writes since the checkpoint. Returns non-negative if
+      // successful.
+      int discard();
+
+      // Write the redolog to the image and hand the image back, the
+      // overlay can be deleted then. Returns NULL on error.
+      device_image_t *release();
+
+  private:
+      device_image_t *image;          // image below the overlay
+      redolog_t       *redolog;       // writes since the checkpoint
+      char            *redolog_name;  // template of the redolog name
+      char            *redolog_temp;  // Redolog temporary file name
+      Bit64s           total_sectors;
+      Bit64s           position;
+};
+
+// SECTOR CACHE
+#define HDCACHE_EXTENT_SHIFT    16
+#define HDCACHE_EXTENT_SIZE     (1 << HDCACHE_EXTENT_SHIFT)
+#define HDCACHE_EXTENT_SECTORS  (HDCACHE_EXTENT_SIZE / 512)
+#define HDCACHE_READAHEAD       4
+#define HDCACHE_NONE            (-1)
+
+// Caches an opened image in memory. The cache holds 64KB extents of the
+// image with LRU replacement. Sequential reads fetch the following extents
+// ahead of time. Writes are kept in memory and written back on eviction,
+// flush() or every flush_interval msecs of emulated time. A flush_interval
+// of 0 selects write-through.
+class cached_image_t : public device_image_t
+{
+  public:
+      // Contructor
+      cached_image_t(device_image_t *image, Bit32u cache_size, Bit32u flush_interval);
+      virtual ~cached_image_t();
+
+      // Open a image. Returns non-negative if successful.
+      int open(const char* pathname);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Write back all dirty sectors.
+      int flush();
+
+      // Pass the hint on for the extents that are not cached.
+      void read_ahead(Bit64s offset, unsigned count);
+
+      Bit32u get_capabilities();
+
+  private:
+      typedef struct {
+        Bit64s index;       // extent number in the image, or HDCACHE_NONE
+        Bit8u *data;
+        int    lru_prev;
+        int    lru_next;
+        int    hash_next;
+        Bit32u dirty_count;
+        Bit8u  dirty[HDCACHE_EXTENT_SECTORS / 8];
+      } extent_t;
+
+      int  lookup(Bit64s index);
+      int  fetch(Bit64s index);
+      void readahead(Bit64s index);
+      int  alloc_slot();
+      void hash_insert(int slot);
+      void hash_remove(int slot);
+      void lru_unlink(int slot);
+      void lru_push_front(int slot);
+      unsigned extent_sectors(Bit64s index);
+      int  write_back(int slot);
+
+      static void flush_timer_handler(void *this_ptr);
+
+      device_image_t *image;
+      extent_t  *extents;
+      int        num_extents;
+      int       *hash;
+      unsigned   hash_mask;
+      int        lru_head;
+      int        lru_tail;
+      Bit8u     *readahead_buffer;
+      Bit64s     total_sectors;
+      Bit64s     position;
+      Bit64s     next_sequential;
+      unsigned   sequential_count;
+      Bit32u     flush_interval;
+      int        timer_index;
+
+      // statistics
+      Bit64u     hits;
+      Bit64u     misses;
+      Bit64u     prefetched;
+      Bit64u     written_back;
+};
+
+#if BX_SUPPORT_ASYNC_DISK
+
+#include <pthread.h>
+
+// ASYNCHRONOUS I/O
+#define HDASYNC_MAX_PREFETCH    4
+#define HDASYNC_MAX_WRITES      64
+
+// Runs the I/O of an opened image on a worker thread. Requests are served
+// in the order they are issued. Writes return as soon as they are queued,
+// reads wait for their data unless it was requested with read_ahead()
+// earlier. The first error of a queued write is kept until the next
+// write_sectors() or flush() fails with it.
+class async_image_t : public device_image_t
+{
+  public:
+      // Contructor
+      async_image_t(device_image_t *image);
+      virtual ~async_image_t();
+
+      // Open a image. Returns non-negative if successful.
+      int open(const char* pathname);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+      // Start reading count sectors at byte offset in the background.
+      void read_ahead(Bit64s offset, unsigned count);
+
+      // Wait for the queued writes, then flush the image.
+      int flush();
+
+      Bit32u get_capabilities();
+
+  private:
+      typedef struct async_request_t {
+        bx_bool write;
+        Bit64s  offset;
+        unsigned count;
+        Bit8u  *buf;
+        ssize_t result;
+        bx_bool done;
+        struct async_request_t *next;
+      } async_request_t;
+
+      async_request_t *submit(bx_bool write, Bit64s offset, Bit8u *buf, unsigned count);
+      void wait(async_request_t *req);
+      void drain();
+      void drop_prefetch(int n);
+      bx_bool take_write_error();
+
+      static void *worker_thread(void *this_ptr);
+      void worker();
+
+      device_image_t *image;
+      pthread_t       thread;
+      pthread_mutex_t lock;
+      pthread_cond_t  work_cond;
+      pthread_cond_t  done_cond;
+      async_request_t *queue_head;
+      async_request_t *queue_tail;
+      unsigned        pending;
+      unsigned        pending_writes;
+      bx_bool         write_error;
+      Bit64s          write_error_offset;
+      bx_bool         quit;
+      bx_bool         running;
+      async_request_t *prefetch[HDASYNC_MAX_PREFETCH];
+      unsigned        next_prefetch;
+      Bit64s          total_sectors;
+      Bit64s          position;
+};
+
+#endif
+
 
 #if BX_COMPRESSED_HD_SUPPORT
 
@@ -575,6 +947,83 @@ class z_volatile_image_t : public device_image_t
       char            *redolog_temp;  // Redolog temporary file name
 };
 
+// QCOW MODE
+#define QCOW_L2_CACHE_SIZE    16
+
+class qcow_image_t : public device_image_t
+{
+
+// Format of a qcow file (all values big endian):
+// 48 byte header, optionally followed by the name of the backing file
+// L1 table, pointing to the L2 tables
+// L2 tables, pointing to the (optionally compressed) clusters
+// Clusters till end of file
+
+  public:
+      // Contructor
+      qcow_image_t();
+      virtual ~qcow_image_t();
+
+      // Open a image. Returns non-negative if successful.
+      int open(const char* pathname);
+
+      // Open an image with specific flags. Returns non-negative if successful.
+      int open(const char* pathname, int flags);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Read/write count sectors at byte offset.
+      ssize_t read_sectors(Bit64s offset, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count);
+
+  private:
+      Bit64u *get_l2_table(Bit64u l2_offset, bx_bool create);
+      bx_bool get_cluster_entry(Bit64u offset, Bit64u *entry);
+      bx_bool set_cluster_entry(Bit64u offset, Bit64u entry);
+      bx_bool read_cluster_data(Bit64u offset, Bit64u entry, Bit8u *buf, unsigned len);
+      bx_bool decompress_cluster(Bit64u entry);
+      bx_bool open_backing_file(const char *pathname, const char *backing_name);
+      Bit64u  alloc_space(Bit64u size);
+
+      int      fd;
+      qcow_header_t header;      // Header is kept in big endianness
+      Bit32u   cluster_size;
+      Bit32u   cluster_bits;
+      Bit32u   l2_size;
+      Bit32u   l2_bits;
+      Bit32u   l1_size;
+      Bit64u  *l1_table;         // L1 table, kept in host endianness
+      Bit64u   cluster_offset_mask;
+      Bit64u   file_end;         // next free byte in the image file
+
+      // L2 tables cache, kept in host endianness
+      Bit64u  *l2_cache;
+      Bit64u   l2_cache_offsets[QCOW_L2_CACHE_SIZE];
+      Bit32u   l2_cache_stamps[QCOW_L2_CACHE_SIZE];
+      Bit32u   l2_cache_clock;
+
+      // last decompressed cluster
+      Bit8u   *cluster_cache;
+      Bit64u   cluster_cache_offset;
+      Bit8u   *cluster_data;
+
+      device_image_t *backing;   // backing image, or NULL
+      Bit64s   imagepos;
+};
+
 #endif
 
 class bx_hdimage_ctl_c : public bx_hdimage_ctl_stub_c {
@@ -582,6 +1031,11 @@ public:
   bx_hdimage_ctl_c();
   virtual ~bx_hdimage_ctl_c() {}
   virtual device_image_t *init_image(Bit8u image_mode, Bit64u disk_size, const char *journal);
+  virtual device_image_t *init_cache(device_image_t *image, Bit32u cache_size, Bit32u flush_interval);
+  virtual device_image_t *init_async(device_image_t *image);
+  virtual device_image_t *init_overlay(device_image_t *image, const char *pathname);
+  virtual int rollback_overlay(device_image_t *image);
+  virtual device_image_t *release_overlay(device_image_t *image);
 };
 
 
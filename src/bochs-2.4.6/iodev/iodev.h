@@ -150,12 +150,18 @@ public:
   virtual bx_bool bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size) {
     STUBFUNC(HD, bmdma_read_sector); return 0;
   }
-  virtual bx_bool bmdma_write_sector(Bit8u channel, Bit8u *buffer) {
+  virtual bx_bool bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size) {
     STUBFUNC(HD, bmdma_write_sector); return 0;
   }
+  virtual Bit8u* bmdma_read_mapped(Bit8u channel, Bit32u size) {
+    STUBFUNC(HD, bmdma_read_mapped); return NULL;
+  }
   virtual void bmdma_complete(Bit8u channel) {
     STUBFUNC(HD, bmdma_complete);
   }
+  // without hard drives there are no disk writes to keep
+  virtual bx_bool checkpoint_disks(void) { return 1; }
+  virtual bx_bool rollback_disks(void) { return 1; }
 };
 
 class BOCHSAPI bx_floppy_stub_c : public bx_devmodel_c {
@@ -356,6 +362,21 @@ public:
   virtual device_image_t* init_image(Bit8u image_mode, Bit64u disk_size, const char *journal) {
     STUBFUNC(hdimage_ctl, init_image); return NULL;
   }
+  virtual device_image_t* init_cache(device_image_t *image, Bit32u cache_size, Bit32u flush_interval) {
+    return image;
+  }
+  virtual device_image_t* init_async(device_image_t *image) {
+    return image;
+  }
+  virtual device_image_t* init_overlay(device_image_t *image, const char *pathname) {
+    STUBFUNC(hdimage_ctl, init_overlay); return NULL;
+  }
+  virtual int rollback_overlay(device_image_t *image) {
+    STUBFUNC(hdimage_ctl, rollback_overlay); return -1;
+  }
+  virtual device_image_t* release_overlay(device_image_t *image) {
+    STUBFUNC(hdimage_ctl, release_overlay); return NULL;
+  }
 };
 
 #if BX_SUPPORT_SB16
@@ -411,6 +432,12 @@ public:
   bx_bool unregister_irq(unsigned irq, const char *name);
   Bit32u inp(Bit16u addr, unsigned io_len) BX_CPP_AttrRegparmN(2);
   void   outp(Bit16u addr, Bit32u value, unsigned io_len) BX_CPP_AttrRegparmN(3);
+  // Block I/O for string instructions: move up to 'count' quantums of
+  // 'io_len' bytes between the port and host memory in one call. Devices
+  // which don't handle bulk IO are accessed once. Returns the number of
+  // quantums transferred.
+  unsigned inp_bulk(Bit16u addr, unsigned io_len, Bit8u *hostAddr, unsigned count);
+  unsigned outp_bulk(Bit16u addr, unsigned io_len, Bit8u *hostAddr, unsigned count);
 
   void register_removable_keyboard(void *dev, bx_keyb_enq_t keyb_enq);
   void unregister_removable_keyboard(void *dev);
@@ -488,12 +515,10 @@ public:
   bx_soundmod_ctl_stub_c  stubSoundModCtl;
 #endif
 
-  // Some info to pass to devices which can handled bulk IO.  This allows
+  // Some info to pass to devices which can handle bulk IO.  This allows
   // the interface to remain the same for IO devices which can't handle
-  // bulk IO.  We should probably implement special INPBulk() and OUTBulk()
-  // functions which stick these values in the bx_devices_c class, and
-  // then call the normal functions rather than having gross globals
-  // variables.
+  // bulk IO.  Only inp_bulk() and outp_bulk() set these values, with the
+  // device lock held, before calling the normal port handler.
   Bit8u*   bulkIOHostAddr;
   unsigned bulkIOQuantumsRequested;
   unsigned bulkIOQuantumsTransferred;
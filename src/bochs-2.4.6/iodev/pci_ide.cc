@@ -259,22 +259,31 @@ void bx_pci_ide_c::timer()
   if (BX_PIDE_THIS s.bmdma[channel].cmd_rwcon) {
     BX_DEBUG(("READ DMA to addr=0x%08x, size=0x%08x", prd.addr, size));
     count = size - (BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx);
-    while (count > 0) {
-      sector_size = count;
-      if (DEV_hd_bmdma_read_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_top, &sector_size)) {
-        BX_PIDE_THIS s.bmdma[channel].buffer_top += sector_size;
-        count -= sector_size;
+    // whole sectors from a memory mapped image go to guest memory directly
+    Bit8u *data = NULL;
+    if ((count == (int)size) && ((size & 0x1ff) == 0)) {
+      data = DEV_hd_bmdma_read_mapped(channel, size);
+    }
+    if (data != NULL) {
+      DEV_MEM_WRITE_PHYSICAL_BLOCK(prd.addr, size, data);
+    } else {
+      while (count > 0) {
+        sector_size = count;
+        if (DEV_hd_bmdma_read_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_top, &sector_size)) {
+          BX_PIDE_THIS s.bmdma[channel].buffer_top += sector_size;
+          count -= sector_size;
+        } else {
+          break;
+        }
+      };
+      if (count > 0) {
+        BX_PIDE_THIS s.bmdma[channel].status &= ~0x01;
+        BX_PIDE_THIS s.bmdma[channel].status |= 0x06;
+        return;
       } else {
-        break;
+        DEV_MEM_WRITE_PHYSICAL_BLOCK(prd.addr, size, BX_PIDE_THIS s.bmdma[channel].buffer_idx);
+        BX_PIDE_THIS s.bmdma[channel].buffer_idx += size;
       }
-    };
-    if (count > 0) {
-      BX_PIDE_THIS s.bmdma[channel].status &= ~0x01;
-      BX_PIDE_THIS s.bmdma[channel].status |= 0x06;
-      return;
-    } else {
-      DEV_MEM_WRITE_PHYSICAL_BLOCK(prd.addr, size, BX_PIDE_THIS s.bmdma[channel].buffer_idx);
-      BX_PIDE_THIS s.bmdma[channel].buffer_idx += size;
     }
   } else {
     BX_DEBUG(("WRITE DMA from addr=0x%08x, size=0x%08x", prd.addr, size));
@@ -282,9 +291,10 @@ void bx_pci_ide_c::timer()
     BX_PIDE_THIS s.bmdma[channel].buffer_top += size;
     count = BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx;
     while (count > 511) {
-      if (DEV_hd_bmdma_write_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_idx)) {
-        BX_PIDE_THIS s.bmdma[channel].buffer_idx += 512;
-        count -= 512;
+      sector_size = count;
+      if (DEV_hd_bmdma_write_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_idx, &sector_size)) {
+        BX_PIDE_THIS s.bmdma[channel].buffer_idx += sector_size;
+        count -= sector_size;
       } else {
         break;
       }
@@ -295,6 +305,16 @@ void bx_pci_ide_c::timer()
       return;
     }
   }
+  // move the bytes left for the next PRD region to the start of the
+  // buffer, so transfers of any length fit into it
+  count = BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx;
+  if (BX_PIDE_THIS s.bmdma[channel].buffer_idx != BX_PIDE_THIS s.bmdma[channel].buffer) {
+    if (count > 0) {
+      memmove(BX_PIDE_THIS s.bmdma[channel].buffer, BX_PIDE_THIS s.bmdma[channel].buffer_idx, count);
+    }
+    BX_PIDE_THIS s.bmdma[channel].buffer_idx = BX_PIDE_THIS s.bmdma[channel].buffer;
+    BX_PIDE_THIS s.bmdma[channel].buffer_top = BX_PIDE_THIS s.bmdma[channel].buffer + count;
+  }
   if (prd.size & 0x80000000) {
     BX_PIDE_THIS s.bmdma[channel].status &= ~0x01;
     BX_PIDE_THIS s.bmdma[channel].status |= 0x04;
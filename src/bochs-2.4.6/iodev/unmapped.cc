@@ -112,6 +112,12 @@ Bit32u bx_unmapped_c::read(Bit32u address, unsigned io_len)
       }
       break;
 
+    // Shutdown port: the number of rollbacks since the checkpoint was
+    // taken, so a guest can tell a rolled back run from the first one
+    case 0x8900:
+      retval = bx_pc_system.rollback_count;
+      break;
+
     case 0x03df:
       retval = 0xffffffff;
       BX_DEBUG(("unsupported IO read from port %04x (CGA)", address));
@@ -248,6 +254,10 @@ void bx_unmapped_c::write(Bit32u address, Bit32u value, unsigned io_len)
         // output 'D' to port 8900, and bochs quits to debugger
         case 'D': bx_debug_break(); break;
 #endif
+        // take a checkpoint of the machine state after this instruction
+        // or roll back to it (see bx_real_sim_c::checkpoint_state())
+        case 'C': bx_pc_system.request_state_op(BX_STATE_OP_CHECKPOINT); break;
+        case 'R': bx_pc_system.request_state_op(BX_STATE_OP_ROLLBACK); break;
         default : BX_UM_THIS s.shutdown = 0; break;
       }
       if (BX_UM_THIS s.shutdown == 8) {
@@ -98,7 +98,7 @@ void vmware4_image_t::close()
     if(file_descriptor == -1)
         return;
 
-    flush();
+    flush_tlb();
     delete [] tlb; tlb = 0;
 
     ::close(file_descriptor);
@@ -247,7 +247,7 @@ off_t vmware4_image_t::perform_seek()
     if(tlb_offset / (header.tlb_size_sectors * SECTOR_SIZE) == current_offset / (header.tlb_size_sectors * SECTOR_SIZE))
         return (header.tlb_size_sectors * SECTOR_SIZE) - (current_offset - tlb_offset);
 
-    flush();
+    flush_tlb();
 
     Bit64u index = current_offset / (header.tlb_size_sectors * SECTOR_SIZE);
     Bit32u slb_index = (Bit32u)(index % header.slb_count);
@@ -296,7 +296,7 @@ off_t vmware4_image_t::perform_seek()
     return (header.tlb_size_sectors * SECTOR_SIZE) - (current_offset - tlb_offset);
 }
 
-void vmware4_image_t::flush()
+void vmware4_image_t::flush_tlb()
 {
     if(!is_dirty)
         return;
@@ -81,7 +81,7 @@ class vmware4_image_t : public device_image_t
 
         bool read_header();
         off_t perform_seek();
-        void flush();
+        void flush_tlb();
         Bit32u read_block_index(Bit64u sector, Bit32u index);
         void write_block_index(Bit64u sector, Bit32u index, Bit32u block_sector);
 
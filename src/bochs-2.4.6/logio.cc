@@ -183,6 +183,10 @@ void iofunctions::set_log_prefix(const char* prefix)
 void iofunctions::out(int level, const char *prefix, const char *fmt, va_list ap)
 {
   char c=' ', *s;
+
+  // keep the lines of the CPU threads apart
+  BX_SMP_LOCK_SCOPE();
+
   assert(magic==MAGIC_LOGNUM);
   assert(this != NULL);
   assert(logfd != NULL);
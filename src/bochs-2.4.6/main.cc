@@ -20,6 +20,7 @@
 
 #include "bochs.h"
 #include "param_names.h"
+#include "profiler.h"
 #include "gui/textconfig.h"
 #if BX_USE_TEXTCONFIG && defined(WIN32)
 #include "gui/win32dialog.h"
@@ -58,6 +59,10 @@ extern "C" {
 #include <signal.h>
 }
 
+#if BX_SUPPORT_SMP_THREADS
+#include <pthread.h>
+#endif
+
 #if BX_GUI_SIGHANDLER
 bx_bool bx_gui_sighandler = 0;
 #endif
@@ -69,6 +74,9 @@ void   bx_unmapped_io_write_handler(Bit32u address, Bit32u value,
                                     unsigned io_len);
 
 void bx_init_hardware(void);
+#if BX_SUPPORT_SMP_THREADS
+static void bx_smp_run_threads(void);
+#endif
 void bx_init_options(void);
 void bx_init_bx_dbg(void);
 
@@ -499,6 +507,8 @@ void print_usage(void)
     "  -q               quick start (skip configuration interface)\n"
     "  -benchmark n     run bochs in benchmark mode for millions of emulated ticks\n"
     "  -r path          restore the Bochs state from path\n"
+    "  -checkpoint n path\n"
+    "                   save the Bochs state to path every n millions of ticks\n"
     "  -log filename    specify Bochs log file name\n"
 #if BX_DEBUGGER
     "  -rc filename     execute debugger commands stored in file\n"
@@ -585,6 +595,13 @@ int bx_init_main(int argc, char *argv[])
         SIM->get_param_string(BXPN_RESTORE_PATH)->set(argv[arg]);
       }
     }
+    else if (!strcmp("-checkpoint", argv[arg])) {
+      if (arg + 2 >= argc) BX_PANIC(("-checkpoint must be followed by a number and a path"));
+      else {
+        SIM->get_param_num(BXPN_CHECKPOINT_INTERVAL)->set(atoi(argv[++arg]));
+        SIM->get_param_string(BXPN_CHECKPOINT_PATH)->set(argv[++arg]);
+      }
+    }
 #if BX_WITH_CARBON
     else if (!strncmp("-psn", argv[arg], 4)) {
       // "-psn" is passed if we are launched by double-clicking
@@ -940,6 +957,12 @@ int bx_begin_simulation (int argc, char *argv[])
       // for one processor, the only reason for cpu_loop to return is
       // that kill_bochs_request was set by the GUI interface.
     }
+#if BX_SUPPORT_SMP_THREADS
+    else {
+      // SMP simulation: every processor runs on its own host thread
+      bx_smp_run_threads();
+    }
+#else
     else {
       // SMP simulation: do a few instructions on each processor, then switch
       // to another.  Increasing quantum speeds up overall performance, but
@@ -956,6 +979,7 @@ int bx_begin_simulation (int argc, char *argv[])
           BX_TICKN(quantum);
       }
     }
+#endif
   }
 #endif /* BX_DEBUGGER == 0 */
   BX_INFO(("cpu loop quit, shutting down simulator"));
@@ -963,13 +987,181 @@ int bx_begin_simulation (int argc, char *argv[])
   return(0);
 }
 
+#if BX_SUPPORT_SMP_THREADS
+
+//
+// Multithreaded SMP simulation. Each CPU thread executes a round of
+// BX_SMP_THREADS_QUANTUM instructions (less when the CPU is halted) and
+// then waits for the others. Between two rounds this thread has the
+// machine for itself: it advances the timers and devices by the same
+// number of instructions and serves a pending system reset.
+//
+// While a round is running the CPU threads serialize on the simulator
+// lock whenever they touch shared state: I/O ports, memory mapped devices,
+// the local APICs and the interrupt acknowledge cycle. Changes to the TLB
+// or iCache of another CPU are posted to it (see handle_remote_requests).
+// A R-M-W access to a memory mapped device keeps the lock until the
+// instruction completes. One split across two pages cannot be made atomic
+// against the compare and swap of the other threads, this thread executes
+// that instruction between two rounds instead (see rmw_exclusive).
+//
+
+__thread BX_CPU_C *bx_smp_self = NULL;
+
+static pthread_mutex_t bx_smp_big_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread unsigned bx_smp_lock_depth = 0;
+static __thread bx_bool bx_smp_rmw_locked = 0;
+
+static pthread_mutex_t bx_smp_round_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bx_smp_round_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bx_smp_round_done = PTHREAD_COND_INITIALIZER;
+static Bit32u bx_smp_round = 0;
+static unsigned bx_smp_running = 0;
+static bx_bool bx_smp_exit = 0;
+
+volatile bx_bool bx_smp_reset_pending = 0;
+static unsigned bx_smp_reset_type;
+
+void bx_smp_lock(void)
+{
+  if (bx_smp_self && bx_smp_lock_depth++ == 0)
+    pthread_mutex_lock(&bx_smp_big_lock);
+}
+
+void bx_smp_unlock(void)
+{
+  if (bx_smp_self && --bx_smp_lock_depth == 0)
+    pthread_mutex_unlock(&bx_smp_big_lock);
+}
+
+void bx_smp_lock_rmw(void)
+{
+  if (bx_smp_self && ! bx_smp_rmw_locked) {
+    bx_smp_lock();
+    bx_smp_rmw_locked = 1;
+  }
+}
+
+void bx_smp_unlock_rmw(void)
+{
+  if (bx_smp_rmw_locked) {
+    bx_smp_rmw_locked = 0;
+    bx_smp_unlock();
+  }
+}
+
+void bx_smp_unlock_all(void)
+{
+  bx_smp_rmw_locked = 0;
+  if (bx_smp_lock_depth > 0) {
+    bx_smp_lock_depth = 0;
+    pthread_mutex_unlock(&bx_smp_big_lock);
+  }
+}
+
+void bx_smp_request_reset(unsigned type)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  if (! bx_smp_reset_pending || type == BX_RESET_HARDWARE)
+    bx_smp_reset_type = type;
+  bx_smp_reset_pending = 1;
+
+  // stop all CPUs at the next instruction boundary
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+    BX_CPU(i)->set_async_event(1);
+}
+
+static void *bx_smp_cpu_thread(void *arg)
+{
+  BX_CPU_C *cpu = (BX_CPU_C *) arg;
+  Bit32u round = 0;
+  bx_bool exit;
+
+  bx_smp_self = cpu;
+
+  while (1) {
+    pthread_mutex_lock(&bx_smp_round_mutex);
+    while (bx_smp_round == round && ! bx_smp_exit)
+      pthread_cond_wait(&bx_smp_round_start, &bx_smp_round_mutex);
+    round = bx_smp_round;
+    exit = bx_smp_exit;
+    pthread_mutex_unlock(&bx_smp_round_mutex);
+    if (exit) break;
+
+    cpu->cpu_loop(BX_SMP_THREADS_QUANTUM);
+    // the round might end right after a R-M-W access to a device
+    bx_smp_unlock_rmw();
+
+    pthread_mutex_lock(&bx_smp_round_mutex);
+    if (--bx_smp_running == 0)
+      pthread_cond_signal(&bx_smp_round_done);
+    pthread_mutex_unlock(&bx_smp_round_mutex);
+  }
+
+  return NULL;
+}
+
+static void bx_smp_run_threads(void)
+{
+  pthread_t *threads = new pthread_t[BX_SMP_PROCESSORS];
+  unsigned i;
+
+  BX_INFO(("running %d processors on separate host threads", BX_SMP_PROCESSORS));
+
+  for (i=0; i<BX_SMP_PROCESSORS; i++) {
+    if (pthread_create(&threads[i], NULL, bx_smp_cpu_thread, BX_CPU(i)) != 0)
+      BX_PANIC(("failed to create the host thread for CPU %d", i));
+  }
+
+  while (1) {
+    pthread_mutex_lock(&bx_smp_round_mutex);
+    bx_smp_running = BX_SMP_PROCESSORS;
+    bx_smp_round++;
+    pthread_cond_broadcast(&bx_smp_round_start);
+    while (bx_smp_running > 0)
+      pthread_cond_wait(&bx_smp_round_done, &bx_smp_round_mutex);
+    pthread_mutex_unlock(&bx_smp_round_mutex);
+
+    // all CPU threads wait for the next round now
+#if BX_SUPPORT_ATOMIC_RMW
+    for (i=0; i<BX_SMP_PROCESSORS; i++) {
+      if (BX_CPU(i)->rmw_exclusive_pending) {
+        BX_CPU(i)->rmw_exclusive_pending = 0;
+        BX_CPU(i)->cpu_loop(1);
+      }
+    }
+#endif
+    if (bx_smp_reset_pending) {
+      bx_smp_reset_pending = 0;
+      bx_pc_system.Reset(bx_smp_reset_type);
+    }
+    if (bx_pc_system.state_ops_pending)
+      bx_pc_system.handle_state_ops();
+    if (bx_pc_system.kill_bochs_request)
+      break;
+    BX_TICKN(BX_SMP_THREADS_QUANTUM);
+  }
+
+  pthread_mutex_lock(&bx_smp_round_mutex);
+  bx_smp_exit = 1;
+  pthread_cond_broadcast(&bx_smp_round_start);
+  pthread_mutex_unlock(&bx_smp_round_mutex);
+
+  for (i=0; i<BX_SMP_PROCESSORS; i++)
+    pthread_join(threads[i], NULL);
+  delete [] threads;
+}
+
+#endif
+
 void bx_stop_simulation(void)
 {
   // in wxWidgets, the whole simulator is running in a separate thread.
   // our only job is to end the thread as soon as possible, NOT to shut
   // down the whole application with an exit.
-  BX_CPU(0)->async_event = 1;
   bx_pc_system.kill_bochs_request = 1;
+  BX_CPU(0)->set_async_event(1);
   // the cpu loop will exit very soon after this condition is set.
 }
 
@@ -982,6 +1174,7 @@ void bx_sr_after_restore_state(void)
     BX_CPU(i)->after_restore_state();
   }
 #endif
+  bx_pc_system.after_restore_state();
   DEV_after_restore_state();
 }
 
@@ -1043,7 +1236,9 @@ void bx_init_hardware()
 #endif
   BX_INFO(("CPU configuration"));
   BX_INFO(("  level: %d",BX_CPU_LEVEL));
-#if BX_SUPPORT_SMP
+#if BX_SUPPORT_SMP_THREADS
+  BX_INFO(("  SMP support: yes, one host thread per processor, quantum=%d", BX_SMP_THREADS_QUANTUM));
+#elif BX_SUPPORT_SMP
   BX_INFO(("  SMP support: yes, quantum=%d", SIM->get_param_num(BXPN_SMP_QUANTUM)->get()));
 #else
   BX_INFO(("  SMP support: no"));
@@ -1178,6 +1373,19 @@ void bx_init_hardware()
     }
   }
 
+  // periodic saved states, the first one is complete and the following
+  // ones only hold the guest RAM pages written in between. Registered after
+  // the save/restore tree is built, so the saved states don't depend on it.
+  int checkpoint_interval = SIM->get_param_num(BXPN_CHECKPOINT_INTERVAL)->get();
+  if (checkpoint_interval) {
+    BX_INFO(("saving the Bochs state to '%s' every ~%d millions of ticks",
+      SIM->get_param_string(BXPN_CHECKPOINT_PATH)->getptr(), checkpoint_interval));
+    bx_pc_system.register_timer_ticks(&bx_pc_system, bx_pc_system_c::checkpointTimer,
+        (Bit64u) checkpoint_interval * 1000000, 1, 1, "checkpoint.timer");
+  }
+
+  bx_profiler.init();
+
   bx_gui->init_signal_handlers();
   bx_pc_system.start_timers();
 
@@ -1221,6 +1429,12 @@ int bx_atexit(void)
   }
 #endif
 
+#if BX_CPU_STATISTICS
+  bx_write_statistics(SIM->get_param_string(BXPN_CPU_STATS_FILE)->getptr());
+#endif
+
+  bx_profiler.exit();
+
   BX_MEM(0)->cleanup_memory();
 
   bx_pc_system.exit();
@@ -42,6 +42,10 @@ void BX_MEM_C::writePhysicalPage(BX_CPU_C *cpu, bx_phy_address addr, unsigned le
   bx_phy_address a20addr = A20ADDR(addr);
   struct memory_handler_struct *memory_handler = NULL;
 
+  // memory handlers, SMRAM and MONITOR state are shared by all CPU threads,
+  // plain RAM needs no lock (see is_plain_ram)
+  BX_SMP_LOCK_SCOPE_IF(! BX_MEM_THIS is_plain_ram(a20addr, len, 1));
+
   // Note: accesses should always be contained within a single page now
   if ((addr>>12) != ((addr+len-1)>>12)) {
     BX_PANIC(("writePhysicalPage: cross page access at address 0x" FMT_PHY_ADDRX ", len=%d", addr, len));
@@ -86,6 +90,7 @@ mem_write:
 
   // all memory access fits in single 4K page
   if (a20addr < BX_MEM_THIS len && ! is_bios) {
+    BX_MEM_THIS cow_write_check(a20addr);
     // all of data is within limits of physical memory
     if (a20addr < 0x000a0000 || a20addr >= 0x00100000)
     {
@@ -195,6 +200,9 @@ void BX_MEM_C::readPhysicalPage(BX_CPU_C *cpu, bx_phy_address addr, unsigned len
   bx_phy_address a20addr = A20ADDR(addr);
   struct memory_handler_struct *memory_handler = NULL;
 
+  // see writePhysicalPage
+  BX_SMP_LOCK_SCOPE_IF(! BX_MEM_THIS is_plain_ram(a20addr, len, 0));
+
   // Note: accesses should always be contained within a single page now
   if ((addr>>12) != ((addr+len-1)>>12)) {
     BX_PANIC(("readPhysicalPage: cross page access at address 0x" FMT_PHY_ADDRX ", len=%d", addr, len));
@@ -74,6 +74,24 @@ private:
   Bit8u   *bogus;    // 4k for unexisting memory
   unsigned used_blocks;
   bx_bool rom_present[65];
+  bx_bool ram_mapped; // guest RAM is a mapping of the backing file
+  bx_bool ram_shared; // ... and guest writes go to the file
+
+  // copy-on-write checkpoint of the guest RAM, see checkpoint_memory()
+  bx_bool  cow_active;
+  Bit32u   cow_num_pages;
+  Bit8u   *cow_dirty;      // 1 bit per 4K page written since the checkpoint
+  Bit8u  **cow_pages;      // checkpoint contents of the pages copied so far
+  Bit32u  *cow_dirty_list; // dirty pages, in order of first write
+  Bit32u   cow_dirty_count;
+  Bit32u   cow_copies;
+
+  // pages written since the last saved state, see start_dirty_log()
+  bx_bool  dirty_log_active;
+  Bit8u   *dirty_log;      // 1 byte per 4K page, so CPU threads need no lock
+
+  BX_MEM_SMF void copy_on_write(Bit32u page);
+  BX_MEM_SMF Bit8u* map_ram_file(const char *path, Bit64u size, bx_bool shared);
 
 public:
   BX_MEM_C();
@@ -106,12 +124,29 @@ public:
   BX_MEM_SMF Bit64u  get_memory_len(void);
   BX_MEM_SMF void allocate_block(Bit32u index);
   BX_MEM_SMF Bit8u* alloc_vector_aligned(Bit32u bytes, Bit32u alignment);
+  BX_MEM_SMF void    sync_ram_file(void);
+
+  // in-process RAM checkpoints
+  BX_MEM_SMF void    checkpoint_memory(void);
+  BX_MEM_SMF bx_bool rollback_memory(void);
+  BX_MEM_SMF void    discard_checkpoint(void);
+  BX_MEM_SMF bx_bool has_checkpoint(void);
+  BX_MEM_SMF void    cow_write_check(bx_phy_address a20addr);
+
+  // incremental save/restore
+  BX_MEM_SMF void    start_dirty_log(void);
+  BX_MEM_SMF void    stop_dirty_log(void);
+  BX_MEM_SMF Bit32s  save_dirty_pages(FILE *fp);
 
 #if BX_SUPPORT_MONITOR_MWAIT
   BX_MEM_SMF bx_bool is_monitor(bx_phy_address begin_addr, unsigned len);
   BX_MEM_SMF void    check_monitor(bx_phy_address addr, unsigned len);
 #endif
 
+#if BX_SUPPORT_SMP_THREADS
+  BX_MEM_SMF bx_bool is_plain_ram(bx_phy_address a20addr, unsigned len, bx_bool write);
+#endif
+
   void register_state(void);
 
   friend Bit64s memory_param_save_handler(void *devptr, bx_param_c *param);
@@ -137,6 +172,59 @@ BX_CPP_INLINE Bit8u* BX_MEM_C::get_vector(bx_phy_address addr)
   return BX_MEM_THIS blocks[block] + (Bit32u)(addr & (BX_MEM_BLOCK_LEN-1));
 }
 
+// Must be called before guest RAM at a20addr is modified, either directly
+// or by handing out a host pointer for writing. Saves the page contents on
+// the first write after a checkpoint and notes the page in the dirty log.
+BX_CPP_INLINE void BX_MEM_C::cow_write_check(bx_phy_address a20addr)
+{
+  Bit32u page = (Bit32u)(a20addr >> 12);
+  if (BX_MEM_THIS cow_active) {
+    if (! (BX_MEM_THIS cow_dirty[page >> 3] & (1 << (page & 7))))
+      copy_on_write(page);
+  }
+  if (BX_MEM_THIS dirty_log_active)
+    BX_MEM_THIS dirty_log[page] = 1;
+}
+
+#if BX_SUPPORT_SMP_THREADS
+// Guest RAM outside the legacy area A0000-FFFFF and not claimed by a memory
+// handler is accessed by readPhysicalPage/writePhysicalPage without the
+// simulator lock, like through the host pointers in the TLBs: the
+// block vector and the copy-on-write state take the lock themselves when
+// they change. A write to a page watched by MONITOR wakes up other CPUs
+// and takes the lock as well.
+BX_CPP_INLINE bx_bool BX_MEM_C::is_plain_ram(bx_phy_address a20addr, unsigned len, bx_bool write)
+{
+#if BX_SUPPORT_IODEBUG
+  // the I/O debugger sees every access
+  return 0;
+#else
+  if (a20addr >= BX_MEM_THIS len) return 0;
+  if (a20addr >= 0x000a0000 && a20addr < 0x00100000) return 0;
+  bx_bool is_bios = (a20addr >= (bx_phy_address)~BIOS_MASK);
+#if BX_PHY_ADDRESS_LONG
+  if (a20addr > BX_CONST64(0xffffffff)) is_bios = 0;
+#endif
+  if (is_bios) return 0;
+  struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
+  while (memory_handler) {
+    if (memory_handler->begin <= a20addr && memory_handler->end >= a20addr)
+      return 0;
+    memory_handler = memory_handler->next;
+  }
+#if BX_SUPPORT_MONITOR_MWAIT
+  if (write && BX_MEM_THIS is_monitor(a20addr, len)) return 0;
+#endif
+  return 1;
+#endif
+}
+#endif
+
+BX_CPP_INLINE bx_bool BX_MEM_C::has_checkpoint(void)
+{
+  return BX_MEM_THIS cow_active;
+}
+
 BX_CPP_INLINE Bit64u BX_MEM_C::get_memory_len(void)
 {
   return (BX_MEM_THIS len);
@@ -28,6 +28,10 @@
 #include "iodev/iodev.h"
 #define LOG_THIS BX_MEM(0)->
 
+#if BX_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 // alignment of memory vector, must be a power of 2
 #define BX_MEM_VECTOR_ALIGN 4096
 #define BX_MEM_HANDLERS   ((BX_CONST64(1) << BX_PHY_ADDRESS_WIDTH) >> 20) /* one per megabyte */
@@ -41,9 +45,22 @@ BX_MEM_C::BX_MEM_C()
   blocks = NULL;
   len    = 0;
   used_blocks = 0;
+  ram_mapped = 0;
+  ram_shared = 0;
   for (int i = 0; i < 65; i++)
     rom_present[i] = 0;
 
+  cow_active = 0;
+  cow_num_pages = 0;
+  cow_dirty = NULL;
+  cow_pages = NULL;
+  cow_dirty_list = NULL;
+  cow_dirty_count = 0;
+  cow_copies = 0;
+
+  dirty_log_active = 0;
+  dirty_log = NULL;
+
   memory_handlers = NULL;
 }
 
@@ -81,21 +98,38 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
   BX_ASSERT((host & 0xfffff) == 0);
   BX_ASSERT((guest & 0xfffff) == 0);
 
+  discard_checkpoint();
+  stop_dirty_log();
+
   if (BX_MEM_THIS actual_vector != NULL) {
     BX_INFO(("freeing existing memory vector"));
-    delete [] BX_MEM_THIS actual_vector;
-    BX_MEM_THIS actual_vector = NULL;
-    BX_MEM_THIS vector = NULL;
-    BX_MEM_THIS blocks = NULL;
+    cleanup_memory();
+  }
+
+  const char *ram_file = SIM->get_param_string(BXPN_MEM_FILE)->getptr();
+  if ((strlen(ram_file) > 0) && strcmp(ram_file, "none")) {
+    bx_bool shared = (SIM->get_param_enum(BXPN_MEM_FILE_MODE)->get() == BX_MEM_FILE_SHARED);
+    BX_MEM_THIS vector = map_ram_file(ram_file, guest, shared);
+    if (BX_MEM_THIS vector != NULL) {
+      // the file holds the whole guest RAM, physical address == file offset
+      BX_MEM_THIS ram_mapped = 1;
+      BX_MEM_THIS ram_shared = shared;
+      host = guest;
+      BX_MEM_THIS rom = alloc_vector_aligned(BIOSROMSZ + EXROMSIZE + 4096, BX_MEM_VECTOR_ALIGN);
+      BX_INFO(("mapped RAM file '%s' (%s) at %p", ram_file, shared ? "shared" : "private",
+        BX_MEM_THIS vector));
+    }
+  }
+  if (! BX_MEM_THIS ram_mapped) {
+    BX_MEM_THIS vector = alloc_vector_aligned(host + BIOSROMSZ + EXROMSIZE + 4096, BX_MEM_VECTOR_ALIGN);
+    BX_INFO(("allocated memory at %p. after alignment, vector=%p",
+	  BX_MEM_THIS actual_vector, BX_MEM_THIS vector));
+    BX_MEM_THIS rom = &BX_MEM_THIS vector[host];
   }
-  BX_MEM_THIS vector = alloc_vector_aligned(host + BIOSROMSZ + EXROMSIZE + 4096, BX_MEM_VECTOR_ALIGN);
-  BX_INFO(("allocated memory at %p. after alignment, vector=%p",
-	BX_MEM_THIS actual_vector, BX_MEM_THIS vector));
 
   BX_MEM_THIS len = guest;
   BX_MEM_THIS allocated = host;
-  BX_MEM_THIS rom = &BX_MEM_THIS vector[host];
-  BX_MEM_THIS bogus = &BX_MEM_THIS vector[host + BIOSROMSZ + EXROMSIZE];
+  BX_MEM_THIS bogus = &BX_MEM_THIS rom[BIOSROMSZ + EXROMSIZE];
   memset(BX_MEM_THIS rom, 0xff, BIOSROMSZ + EXROMSIZE + 4096);
 
   // block must be large enough to fit num_blocks in 32-bit
@@ -105,7 +139,7 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
   BX_INFO(("%.2fMB", (float)(BX_MEM_THIS len / (1024.0*1024.0))));
   BX_INFO(("mem block size = 0x%08x, blocks=%u", BX_MEM_BLOCK_LEN, num_blocks));
   BX_MEM_THIS blocks = new Bit8u* [num_blocks];
-  if (0) {
+  if (BX_MEM_THIS ram_mapped) {
     // all guest memory is allocated, just map it
     for (idx = 0; idx < num_blocks; idx++) {
       BX_MEM_THIS blocks[idx] = BX_MEM_THIS vector + (idx * BX_MEM_BLOCK_LEN);
@@ -134,6 +168,11 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
 
 void BX_MEM_C::allocate_block(Bit32u block)
 {
+  BX_SMP_LOCK_SCOPE();
+
+  // another CPU thread might have allocated the block meanwhile
+  if (BX_MEM_THIS blocks[block]) return;
+
   Bit32u max_blocks = BX_MEM_THIS allocated / BX_MEM_BLOCK_LEN;
   if (BX_MEM_THIS used_blocks >= max_blocks) {
     BX_PANIC(("FATAL ERROR: all available memory is already allocated !"));
@@ -178,6 +217,8 @@ void memory_param_restore_handler(void *devptr, bx_param_c *param, Bit64s val)
 void BX_MEM_C::register_state()
 {
   bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "memory", "Memory State", 6);
+  // also for a shared RAM file: the file keeps changing after the save, so
+  // a saved state must hold its own copy (restoring it rewrites the file)
   new bx_shadow_data_c(list, "ram", BX_MEM_THIS vector, BX_MEM_THIS allocated);
   BXRS_DEC_PARAM_FIELD(list, len, BX_MEM_THIS len);
   BXRS_DEC_PARAM_FIELD(list, allocated, BX_MEM_THIS allocated);
@@ -194,11 +235,260 @@ void BX_MEM_C::register_state()
   }
 }
 
+//
+// Copy-on-write checkpoints of the guest RAM.
+//
+// After checkpoint_memory() every RAM page is write protected: the first
+// write to a page, or the first host pointer handed out for writing it,
+// saves the page contents and puts the page on the dirty list. Rolling
+// back copies only the dirty pages back, so both taking a checkpoint and
+// returning to it cost O(dirty pages) and the checkpoint stays valid for
+// any number of rollbacks.
+//
+// Only the RAM is covered here, CPU and device state is captured by
+// bx_real_sim_c::checkpoint_state() through the save/restore param tree.
+//
+
+void BX_MEM_C::copy_on_write(Bit32u page)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  // another CPU thread might have saved the page meanwhile
+  if (BX_MEM_THIS cow_dirty[page >> 3] & (1 << (page & 7))) return;
+
+  if (BX_MEM_THIS cow_pages[page] == NULL) {
+    BX_MEM_THIS cow_pages[page] = new Bit8u[4096];
+    BX_MEM_THIS cow_copies++;
+  }
+  // a write protected page always holds the checkpoint contents
+  memcpy(BX_MEM_THIS cow_pages[page], BX_MEM_THIS get_vector((bx_phy_address) page << 12), 4096);
+  BX_MEM_THIS cow_dirty[page >> 3] |= (1 << (page & 7));
+  BX_MEM_THIS cow_dirty_list[BX_MEM_THIS cow_dirty_count++] = page;
+}
+
+void BX_MEM_C::checkpoint_memory(void)
+{
+  Bit32u n;
+
+  if (! BX_MEM_THIS cow_active) {
+    BX_MEM_THIS cow_num_pages = (Bit32u)(BX_MEM_THIS len >> 12);
+    n = (BX_MEM_THIS cow_num_pages + 7) / 8;
+    BX_MEM_THIS cow_dirty = new Bit8u[n];
+    memset(BX_MEM_THIS cow_dirty, 0, n);
+    BX_MEM_THIS cow_pages = new Bit8u* [BX_MEM_THIS cow_num_pages];
+    memset(BX_MEM_THIS cow_pages, 0, BX_MEM_THIS cow_num_pages * sizeof(Bit8u*));
+    BX_MEM_THIS cow_dirty_list = new Bit32u[BX_MEM_THIS cow_num_pages];
+    BX_MEM_THIS cow_dirty_count = 0;
+    BX_MEM_THIS cow_copies = 0;
+    BX_MEM_THIS cow_active = 1;
+  }
+  else {
+    // pages not written since the previous checkpoint are still protected
+    // and their saved copies remain valid
+    for (n = 0; n < BX_MEM_THIS cow_dirty_count; n++) {
+      Bit32u page = BX_MEM_THIS cow_dirty_list[n];
+      BX_MEM_THIS cow_dirty[page >> 3] &= ~(1 << (page & 7));
+    }
+    BX_MEM_THIS cow_dirty_count = 0;
+  }
+
+  // revoke the direct write pointers cached in the TLBs
+  bx_pc_system.MemoryMappingChanged();
+
+  BX_DEBUG(("memory checkpoint taken, %u pages saved", BX_MEM_THIS cow_copies));
+}
+
+bx_bool BX_MEM_C::rollback_memory(void)
+{
+  if (! BX_MEM_THIS cow_active) {
+    BX_ERROR(("rollback_memory: no memory checkpoint"));
+    return 0;
+  }
+
+  BX_DEBUG(("memory rollback, %u dirty pages", BX_MEM_THIS cow_dirty_count));
+
+  for (Bit32u n = 0; n < BX_MEM_THIS cow_dirty_count; n++) {
+    Bit32u page = BX_MEM_THIS cow_dirty_list[n];
+    memcpy(BX_MEM_THIS get_vector((bx_phy_address) page << 12), BX_MEM_THIS cow_pages[page], 4096);
+    BX_MEM_THIS cow_dirty[page >> 3] &= ~(1 << (page & 7));
+    if (BX_MEM_THIS dirty_log_active)
+      BX_MEM_THIS dirty_log[page] = 1;
+  }
+  BX_MEM_THIS cow_dirty_count = 0;
+
+  // the TLBs and decoded instructions refer to the old contents
+  bx_pc_system.MemoryMappingChanged();
+  flushICaches();
+
+  return 1;
+}
+
+void BX_MEM_C::discard_checkpoint(void)
+{
+  if (! BX_MEM_THIS cow_active) return;
+
+  for (Bit32u page = 0; page < BX_MEM_THIS cow_num_pages; page++)
+    delete [] BX_MEM_THIS cow_pages[page];
+  delete [] BX_MEM_THIS cow_pages;
+  delete [] BX_MEM_THIS cow_dirty;
+  delete [] BX_MEM_THIS cow_dirty_list;
+  BX_MEM_THIS cow_pages = NULL;
+  BX_MEM_THIS cow_dirty = NULL;
+  BX_MEM_THIS cow_dirty_list = NULL;
+  BX_MEM_THIS cow_dirty_count = 0;
+  BX_MEM_THIS cow_copies = 0;
+  BX_MEM_THIS cow_active = 0;
+}
+
+//
+// Dirty page log for incremental saved states.
+//
+// Once the log is started every page written by the guest, the debugger or
+// a device is marked, using the same hooks as the copy-on-write checkpoints
+// above. save_dirty_pages() writes out the marked pages and starts over, so
+// a saved state only needs the pages changed since the previous one. The
+// records are a Bit32u page index into the RAM vector (the layout of the
+// "memory.ram" data file) followed by the 4K page contents.
+//
+
+void BX_MEM_C::start_dirty_log(void)
+{
+  Bit32u num_pages = (Bit32u)(BX_MEM_THIS len >> 12);
+
+  if (BX_MEM_THIS dirty_log == NULL)
+    BX_MEM_THIS dirty_log = new Bit8u[num_pages];
+  memset(BX_MEM_THIS dirty_log, 0, num_pages);
+  BX_MEM_THIS dirty_log_active = 1;
+
+  // the first write to each page must go through cow_write_check() again
+  bx_pc_system.MemoryMappingChanged();
+}
+
+void BX_MEM_C::stop_dirty_log(void)
+{
+  BX_MEM_THIS dirty_log_active = 0;
+  delete [] BX_MEM_THIS dirty_log;
+  BX_MEM_THIS dirty_log = NULL;
+}
+
+Bit32s BX_MEM_C::save_dirty_pages(FILE *fp)
+{
+  Bit32u num_pages = (Bit32u)(BX_MEM_THIS len >> 12);
+  Bit32u page, index;
+  Bit32s count = 0;
+
+  if (! BX_MEM_THIS dirty_log_active) {
+    BX_ERROR(("save_dirty_pages: dirty page log not started"));
+    return -1;
+  }
+
+  for (page = 0; page < num_pages; page++) {
+    if (! BX_MEM_THIS dirty_log[page]) continue;
+    // a page can only be written after its block has been allocated
+    Bit8u *blk = BX_MEM_THIS blocks[page / (BX_MEM_BLOCK_LEN >> 12)];
+    if (blk == NULL) continue;
+    Bit8u *data = blk + ((page & ((BX_MEM_BLOCK_LEN >> 12) - 1)) << 12);
+    index = (Bit32u)((data - BX_MEM_THIS vector) >> 12);
+    if ((fwrite(&index, sizeof(index), 1, fp) != 1) ||
+        (fwrite(data, 4096, 1, fp) != 1)) {
+      BX_ERROR(("save_dirty_pages: write error"));
+      return -1;
+    }
+    count++;
+  }
+
+  // start over, also for the pages with a host pointer cached in the TLBs
+  start_dirty_log();
+
+  BX_DEBUG(("save_dirty_pages: %d pages saved", count));
+  return count;
+}
+
+//
+// Guest RAM backed by a file or a shared memory object (e.g. /dev/shm/name).
+// A shared mapping writes the guest RAM through to the file, so external
+// tools can watch it live; saved states still copy the RAM. A private
+// mapping starts from the file contents and keeps the guest writes in
+// copy-on-write pages, so many instances can share one base image.
+//
+Bit8u* BX_MEM_C::map_ram_file(const char *path, Bit64u size, bx_bool shared)
+{
+#ifdef _POSIX_MAPPED_FILES
+  struct stat stat_buf;
+  Bit8u *ptr;
+
+  int fd = open(path, shared ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+  if (fd < 0) {
+    BX_PANIC(("couldn't open RAM file '%s'", path));
+    return NULL;
+  }
+  if (fstat(fd, &stat_buf)) {
+    BX_PANIC(("couldn't stat RAM file '%s'", path));
+    close(fd);
+    return NULL;
+  }
+
+  if (shared) {
+    if ((Bit64u) stat_buf.st_size < size) {
+      if (ftruncate(fd, (off_t) size)) {
+        BX_PANIC(("couldn't resize RAM file '%s'", path));
+        close(fd);
+        return NULL;
+      }
+    }
+    ptr = (Bit8u*) mmap(NULL, (size_t) size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  else {
+    // pages beyond the end of a short base image must not fault, so map the
+    // file over anonymous memory of the full size
+    ptr = (Bit8u*) mmap(NULL, (size_t) size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    Bit64u file_size = (Bit64u) stat_buf.st_size;
+    if (file_size > size) file_size = size;
+    if ((ptr != (Bit8u*) MAP_FAILED) && (file_size > 0)) {
+      if (mmap(ptr, (size_t) file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(ptr, (size_t) size);
+        ptr = (Bit8u*) MAP_FAILED;
+      }
+    }
+  }
+  close(fd);
+
+  if (ptr == (Bit8u*) MAP_FAILED) {
+    BX_PANIC(("couldn't map RAM file '%s'", path));
+    return NULL;
+  }
+  return ptr;
+#else
+  BX_PANIC(("RAM backing files are not supported on this platform"));
+  return NULL;
+#endif
+}
+
+void BX_MEM_C::sync_ram_file(void)
+{
+#ifdef _POSIX_MAPPED_FILES
+  if (BX_MEM_THIS ram_shared) {
+    if (msync(BX_MEM_THIS vector, (size_t) BX_MEM_THIS len, MS_SYNC))
+      BX_ERROR(("sync_ram_file: msync failed"));
+  }
+#endif
+}
+
 void BX_MEM_C::cleanup_memory()
 {
   unsigned idx;
 
+  discard_checkpoint();
+  stop_dirty_log();
+
   if (BX_MEM_THIS vector != NULL) {
+#ifdef _POSIX_MAPPED_FILES
+    if (BX_MEM_THIS ram_mapped) {
+      munmap(BX_MEM_THIS vector, (size_t) BX_MEM_THIS len);
+      BX_MEM_THIS ram_mapped = 0;
+      BX_MEM_THIS ram_shared = 0;
+    }
+#endif
     delete [] BX_MEM_THIS actual_vector;
     BX_MEM_THIS actual_vector = NULL;
     BX_MEM_THIS vector = NULL;
@@ -488,6 +778,8 @@ bx_bool BX_MEM_C::dbg_set_mem(bx_phy_address addr, unsigned len, Bit8u *buf)
     return(0); // error, beyond limits of memory
   }
   for (; len>0; len--) {
+    if (addr < BX_MEM_THIS len)
+      BX_MEM_THIS cow_write_check(addr);
     // Write to standard PCI/ISA Video Mem / SMMRAM
     if (addr >= 0x000a0000 && addr < 0x000c0000) {
       if (BX_MEM_THIS smram_enable)
@@ -674,6 +966,7 @@ Bit8u *BX_MEM_C::getHostMemAddr(BX_CPU_C *cpu, bx_phy_address addr, unsigned rw)
     else
     {
       if (a20addr < 0x000c0000 || a20addr >= 0x00100000) {
+        BX_MEM_THIS cow_write_check(a20addr);
         return BX_MEM_THIS get_vector(a20addr);
       }
       else {
@@ -3,6 +3,7 @@
  * $Id: bxcommit.c,v 1.14 2009/04/14 09:45:22 sshwarts Exp $
  *
  * Commits a redolog file in a flat file for bochs images.
+ * Converts flat and qcow images into compressed qcow images and back.
  *
  */
 
@@ -45,9 +46,29 @@ int snprintf(char *s, size_t maxlen, const char *format, ...)
 
 #include "../osdep.h"
 
+#if BX_HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+
+/* a redolog is committed by a pool of threads if positional I/O is
+   available, which lets them share the file descriptors */
+#if BX_HAVE_PTHREAD && BX_HAVE_PREAD && BX_HAVE_PWRITE
+#define BXCOMMIT_THREADS 1
+#define BXCOMMIT_WORKERS 4
+#include <pthread.h>
+#else
+#define BXCOMMIT_THREADS 0
+#endif
+
 #define HDIMAGE_HEADERS_ONLY 1
 #include "../iodev/hdimage.h"
 
+#if BX_COMPRESSED_HD_SUPPORT
+#include <zlib.h>
+#endif
+
 char *EOF_ERR = "ERROR: End of input";
 char *rcsid = "$Id: bxcommit.c,v 1.14 2009/04/14 09:45:22 sshwarts Exp $";
 char *divider = "========================================================================";
@@ -210,15 +231,147 @@ int ask_string(const char *prompt, char *the_default, char *out)
   return 0;
 }
 
+/* positional reads and writes, which several threads can issue on the
+   same file descriptors if pread() and pwrite() are available */
+int pread_at(int fd, Bit64u offset, void *buf, Bit32u len)
+{
+#if BX_HAVE_PREAD
+  return (Bit32u) pread(fd, buf, len, (off_t)offset) == len;
+#else
+  if (lseek(fd, (off_t)offset, SEEK_SET) < 0)
+    return 0;
+  return (Bit32u) read(fd, buf, len) == len;
+#endif
+}
+
+int pwrite_at(int fd, Bit64u offset, const void *buf, Bit32u len)
+{
+#if BX_HAVE_PWRITE
+  return (Bit32u) pwrite(fd, buf, len, (off_t)offset) == len;
+#else
+  if (lseek(fd, (off_t)offset, SEEK_SET) < 0)
+    return 0;
+  return (Bit32u) write(fd, buf, len) == len;
+#endif
+}
+
+double get_time()
+{
+#if BX_HAVE_GETTIMEOFDAY
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#else
+  return (double)time(NULL);
+#endif
+}
+
+/* state shared by the threads committing a redolog */
+typedef struct commit_state
+{
+  int     flatfd;
+  int     redologfd;
+  Bit32u *catalog;
+  Bit32u  extent_size;
+  Bit32u  bitmap_size;
+  Bit32u  bitmap_blocs;
+  Bit32u  extent_blocs;
+  Bit64u  data_start;   // offset of the first extent in the redolog
+  Bit32u *extents;      // catalog indices of the allocated extents, in file order
+  Bit32u  n_extents;
+  Bit32u  next;         // next entry of extents to commit
+  Bit32u  done;
+  Bit64u  blocks;       // number of blocks written to the flat image
+#if BXCOMMIT_THREADS
+  pthread_mutex_t mutex;
+#endif
+} commit_state_t;
+
+/* commit extents until all are taken. Each extent is read from the redolog
+   in runs of blocks which are set in its bitmap, and every run is written
+   to the flat image at once. */
+void *commit_worker(void *arg)
+{
+  commit_state_t *cs = (commit_state_t *) arg;
+  Bit8u  *bitmap, *buffer;
+  Bit32u  k, index, block, run;
+  Bit64u  extent_offset, blocks;
+
+  bitmap = (Bit8u*)malloc(cs->bitmap_size);
+  buffer = (Bit8u*)malloc(cs->extent_blocs * 512);
+  if ((bitmap == NULL) || (buffer == NULL))
+    fatal("\nERROR: not enough memory!");
+
+  for (;;) {
+#if BXCOMMIT_THREADS
+    pthread_mutex_lock(&cs->mutex);
+#endif
+    k = cs->next;
+    if (k < cs->n_extents)
+      cs->next++;
+#if BXCOMMIT_THREADS
+    pthread_mutex_unlock(&cs->mutex);
+#endif
+    if (k >= cs->n_extents)
+      break;
+
+    index = cs->extents[k];
+    extent_offset = cs->data_start + (Bit64u)512 * dtoh32(cs->catalog[index]) * (cs->extent_blocs + cs->bitmap_blocs);
+
+    // Read bitmap
+    if (!pread_at(cs->redologfd, extent_offset, bitmap, cs->bitmap_size))
+      fatal("\nERROR: while reading bitmap from redolog !");
+
+    blocks = 0;
+    block = 0;
+    while (block < cs->extent_blocs) {
+      if ((bitmap[block/8] & (1 << (block%8))) == 0) {
+        block++;
+        continue;
+      }
+      run = 1;
+      while ((block + run < cs->extent_blocs) &&
+             ((bitmap[(block+run)/8] & (1 << ((block+run)%8))) != 0)) {
+        run++;
+      }
+      if (!pread_at(cs->redologfd, extent_offset + (Bit64u)512 * (cs->bitmap_blocs + block), buffer, run * 512))
+        fatal("\nERROR: while reading bloc from redolog !");
+      if (!pwrite_at(cs->flatfd, (Bit64u)index * cs->extent_size + (Bit64u)512 * block, buffer, run * 512))
+        fatal("\nERROR: while writing bloc in flatfile !");
+      blocks += run;
+      block += run;
+    }
+
+#if BXCOMMIT_THREADS
+    pthread_mutex_lock(&cs->mutex);
+#endif
+    cs->blocks += blocks;
+    cs->done++;
+    printf("\x8\x8\x8\x8\x8%3d%%]", (int)((Bit64u)cs->done * 100 / cs->n_extents));
+    fflush(stdout);
+#if BXCOMMIT_THREADS
+    pthread_mutex_unlock(&cs->mutex);
+#endif
+  }
+
+  free(buffer);
+  free(bitmap);
+  return NULL;
+}
+
 /* produce the image file */
 int commit_redolog(const char *flatname, const char *redologname)
 {
   int flatfd, redologfd;
   redolog_header_t header;
-  Bit32u *catalog, catalog_size;
-  Bit8u  *bitmap;
-  Bit32u i, bitmap_blocs, extent_blocs;
-  Bit8u  buffer[512];
+  Bit32u *catalog, *extents, catalog_size, entries;
+  Bit32u i, n_extents;
+  commit_state_t cs;
+  double start, seconds, mbytes;
+#if BXCOMMIT_THREADS
+  pthread_t threads[BXCOMMIT_WORKERS];
+  int n_threads = 0;
+#endif
 
   // check if flat file exists
   flatfd = open (flatname, O_WRONLY
@@ -271,81 +424,399 @@ int commit_redolog(const char *flatname, const char *redologname)
          dtoh32(header.specific.bitmap),
          dtoh32(header.specific.extent));
 
-  catalog = (Bit32u*)malloc(dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap = (Bit8u*)malloc(dtoh32(header.specific.bitmap));
+  entries = dtoh32(header.specific.catalog);
+  catalog = (Bit32u*)malloc(entries * sizeof(Bit32u));
+  extents = (Bit32u*)malloc(entries * sizeof(Bit32u));
+  if ((catalog == NULL) || (extents == NULL))
+     fatal("\nERROR: not enough memory!");
   printf("\nReading Catalog: [");
 
   lseek(redologfd, dtoh32(header.standard.header), SEEK_SET);
 
-  catalog_size = dtoh32(header.specific.catalog) * sizeof(Bit32u);
+  catalog_size = entries * sizeof(Bit32u);
   if ((Bit32u) read(redologfd, catalog, catalog_size) != catalog_size)
      fatal("\nERROR: while reading redolog catalog!");
 
-  printf("] Done.");
+  // list the allocated extents in the order they are stored in the
+  // redolog, so that it is read from start to end
+  for (i=0; i<entries; i++)
+     extents[i] = REDOLOG_PAGE_NOT_ALLOCATED;
+  for (i=0; i<entries; i++) {
+     if (dtoh32(catalog[i]) != REDOLOG_PAGE_NOT_ALLOCATED) {
+        if ((dtoh32(catalog[i]) >= entries) || (extents[dtoh32(catalog[i])] != REDOLOG_PAGE_NOT_ALLOCATED))
+           fatal("\nERROR: bad entry in redolog catalog!");
+        extents[dtoh32(catalog[i])] = i;
+     }
+  }
+  n_extents = 0;
+  for (i=0; i<entries; i++) {
+     if (extents[i] != REDOLOG_PAGE_NOT_ALLOCATED)
+        extents[n_extents++] = extents[i];
+  }
+
+  printf("%d extents used] Done.", n_extents);
 
   printf("\nCommitting changes to flat file: [  0%%]");
+  fflush(stdout);
+
+  memset(&cs, 0, sizeof(cs));
+  cs.flatfd = flatfd;
+  cs.redologfd = redologfd;
+  cs.catalog = catalog;
+  cs.extent_size = dtoh32(header.specific.extent);
+  cs.bitmap_size = dtoh32(header.specific.bitmap);
+  cs.bitmap_blocs = 1 + (dtoh32(header.specific.bitmap) - 1) / 512;
+  cs.extent_blocs = 1 + (dtoh32(header.specific.extent) - 1) / 512;
+  cs.data_start = (Bit64u)STANDARD_HEADER_SIZE + catalog_size;
+  cs.extents = extents;
+  cs.n_extents = n_extents;
+
+  start = get_time();
+#if BXCOMMIT_THREADS
+  // the calling thread is one of the workers
+  pthread_mutex_init(&cs.mutex, NULL);
+  while ((n_threads < BXCOMMIT_WORKERS - 1) && ((Bit32u)n_threads + 1 < n_extents)) {
+     if (pthread_create(&threads[n_threads], NULL, commit_worker, &cs) != 0)
+        break;
+     n_threads++;
+  }
+  commit_worker(&cs);
+  while (n_threads > 0)
+     pthread_join(threads[--n_threads], NULL);
+  pthread_mutex_destroy(&cs.mutex);
+#else
+  commit_worker(&cs);
+#endif
+  seconds = get_time() - start;
 
-  bitmap_blocs = 1 + (dtoh32(header.specific.bitmap) - 1) / 512;
-  extent_blocs = 1 + (dtoh32(header.specific.extent) - 1) / 512;
+  if (n_extents == 0)
+     printf("\x8\x8\x8\x8\x8" "100%%]");
+  printf(" Done.");
+  printf("\n");
 
-  for(i=0; i<dtoh32(header.specific.catalog); i++)
-  {
-     printf("\x8\x8\x8\x8\x8%3d%%]", (i+1)*100/dtoh32(header.specific.catalog));
-     fflush(stdout);
+  mbytes = (double)cs.blocks * 512 / (1024 * 1024);
+  printf("\nCommitted " FMT_LL "u blocks (%.1f MB) in %.2f seconds", cs.blocks, mbytes, seconds);
+  if (seconds > 0)
+     printf(", %.1f MB/s", mbytes / seconds);
+  printf("\n");
 
-     if (dtoh32(catalog[i]) != REDOLOG_PAGE_NOT_ALLOCATED) {
-        Bit64s bitmap_offset;
-        Bit32u bitmap_size, j;
+  free(extents);
+  free(catalog);
 
-        bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-        bitmap_offset += (Bit64s)512 * dtoh32(catalog[i]) * (extent_blocs + bitmap_blocs);
+  close(flatfd);
+  close(redologfd);
 
-        // Read bitmap
-        lseek(redologfd, bitmap_offset, SEEK_SET);
+  return 0;
+}
 
-        bitmap_size = dtoh32(header.specific.bitmap);
-        if ((Bit32u) read(redologfd, bitmap, bitmap_size) != bitmap_size)
-           fatal("\nERROR: while reading bitmap from redolog !");
+#if BX_COMPRESSED_HD_SUPPORT
 
-        for(j=0; j<dtoh32(header.specific.bitmap); j++)
-        {
-           Bit32u bit;
+/* read-only access to a flat or qcow image and its backing images */
+typedef struct image_reader
+{
+  int     fd;
+  int     qcow;
+  Bit64u  size;
+  Bit32u  cluster_bits;
+  Bit32u  l2_bits;
+  Bit64u *l1_table;
+  Bit64u *l2_table;
+  Bit64u  l2_offset;
+  Bit8u  *cluster;
+  Bit8u  *zdata;
+  Bit64u  cluster_offset;
+  struct image_reader *backing;
+} image_reader_t;
+
+image_reader_t *open_image(const char *filename)
+{
+  image_reader_t *img = (image_reader_t*)calloc(1, sizeof(image_reader_t));
+  qcow_header_t header;
+  Bit32u i, l1_size;
 
-           for(bit=0; bit<8; bit++)
-           {
-              if ( (bitmap[j] & (1<<bit)) != 0)
-              {
-                  Bit64s flat_offset, bloc_offset;
+  img->fd = open(filename, O_RDONLY
+#ifdef O_BINARY
+                 | O_BINARY
+#endif
+                 );
+  if (img->fd < 0)
+    fatal("\nERROR: image file not found");
+
+  if (!pread_at(img->fd, 0, &header, QCOW_HEADER_SIZE) || (btoh32(header.magic) != QCOW_MAGIC)) {
+    // flat image
+    img->size = (Bit64u)lseek(img->fd, 0, SEEK_END);
+    return img;
+  }
+  if ((btoh32(header.version) != QCOW_VERSION) || (header.crypt_method != 0) ||
+      (header.cluster_bits < 9) || (header.cluster_bits > 16) ||
+      (header.l2_bits < 6) || (header.l2_bits > 16))
+    fatal("\nERROR: unsupported qcow image!");
+
+  img->qcow = 1;
+  img->size = btoh64(header.size);
+  img->cluster_bits = header.cluster_bits;
+  img->l2_bits = header.l2_bits;
+  l1_size = (Bit32u)((img->size + ((Bit64u)1 << (img->cluster_bits + img->l2_bits)) - 1) >>
+                     (img->cluster_bits + img->l2_bits));
+  img->l1_table = (Bit64u*)malloc(l1_size * 8);
+  img->l2_table = (Bit64u*)malloc(8 << img->l2_bits);
+  img->cluster = (Bit8u*)malloc(1 << img->cluster_bits);
+  img->zdata = (Bit8u*)malloc(1 << img->cluster_bits);
+  if (!pread_at(img->fd, btoh64(header.l1_table_offset), img->l1_table, l1_size * 8))
+    fatal("\nERROR: while reading qcow L1 table!");
+  for (i=0; i<l1_size; i++)
+    img->l1_table[i] = btoh64(img->l1_table[i]);
+
+  if (header.backing_file_offset != 0) {
+    char backing[256], path[512];
+    const char *sep = strrchr(filename, '/');
+    Bit32u len = btoh32(header.backing_file_size);
+
+    if ((len >= sizeof(backing)) ||
+        !pread_at(img->fd, btoh64(header.backing_file_offset), backing, len))
+      fatal("\nERROR: while reading qcow backing file name!");
+    backing[len] = 0;
+#ifdef WIN32
+    if (strrchr(filename, '\\') > sep) sep = strrchr(filename, '\\');
+    if ((backing[0] == '\\') || (backing[0] != 0 && backing[1] == ':')) sep = NULL;
+#endif
+    if ((sep == NULL) || (backing[0] == '/')) sep = filename - 1;
+    snprintf(path, sizeof(path), "%.*s%s", (int)(sep - filename + 1), filename, backing);
+    img->backing = open_image(path);
+  }
+  return img;
+}
 
-                  bloc_offset = bitmap_offset + ((Bit64s)512 * (bitmap_blocs + ((j*8)+bit)));
+void close_image(image_reader_t *img)
+{
+  if (img->backing != NULL)
+    close_image(img->backing);
+  close(img->fd);
+  free(img->l1_table);
+  free(img->l2_table);
+  free(img->cluster);
+  free(img->zdata);
+  free(img);
+}
 
-                  lseek(redologfd, (off_t)bloc_offset, SEEK_SET);
+/* read len bytes at offset, not crossing a cluster of a qcow image */
+void read_image_data(image_reader_t *img, Bit64u offset, Bit8u *buf, Bit32u len)
+{
+  Bit64u entry = 0, l2_offset;
 
-                  if (read(redologfd, buffer, 512) != 512)
-                     fatal("\nERROR: while reading bloc from redolog !");
+  if (offset >= img->size) {
+    memset(buf, 0, len);
+    return;
+  }
+  if (!img->qcow) {
+    Bit32u n = len;
+    if ((offset + n) > img->size) n = (Bit32u)(img->size - offset);
+    if (!pread_at(img->fd, offset, buf, n))
+      fatal("\nERROR: while reading image data!");
+    memset(buf + n, 0, len - n);
+    return;
+  }
 
-                  flat_offset  = (Bit64s)i * (dtoh32(header.specific.extent));
-                  flat_offset += (Bit64s)512 * ((j * 8) + bit);
+  l2_offset = img->l1_table[offset >> (img->cluster_bits + img->l2_bits)];
+  if (l2_offset != 0) {
+    if (l2_offset != img->l2_offset) {
+      Bit32u i;
+      if (!pread_at(img->fd, l2_offset, img->l2_table, 8 << img->l2_bits))
+        fatal("\nERROR: while reading qcow L2 table!");
+      for (i=0; i<((Bit32u)1 << img->l2_bits); i++)
+        img->l2_table[i] = btoh64(img->l2_table[i]);
+      img->l2_offset = l2_offset;
+    }
+    entry = img->l2_table[(offset >> img->cluster_bits) & ((1 << img->l2_bits) - 1)];
+  }
 
-                  lseek(flatfd, (off_t)flat_offset, SEEK_SET);
+  if (entry == 0) {
+    if (img->backing != NULL)
+      read_image_data(img->backing, offset, buf, len);
+    else
+      memset(buf, 0, len);
+  } else if (entry & QCOW_OFLAG_COMPRESSED) {
+    Bit32u cluster_size = 1 << img->cluster_bits;
+    Bit64u coffset = entry & ((((Bit64u)1) << (63 - img->cluster_bits)) - 1);
+    Bit32u csize = (Bit32u)(entry >> (63 - img->cluster_bits)) & (cluster_size - 1);
+    if (coffset != img->cluster_offset) {
+      z_stream strm;
+      int ret;
+      if (!pread_at(img->fd, coffset, img->zdata, csize))
+        fatal("\nERROR: while reading compressed cluster!");
+      memset(&strm, 0, sizeof(strm));
+      inflateInit2(&strm, -12);
+      strm.next_in = img->zdata;
+      strm.avail_in = csize;
+      strm.next_out = img->cluster;
+      strm.avail_out = cluster_size;
+      ret = inflate(&strm, Z_FINISH);
+      inflateEnd(&strm);
+      if (((ret != Z_STREAM_END) && (ret != Z_BUF_ERROR)) || (strm.avail_out != 0))
+        fatal("\nERROR: corrupt compressed cluster!");
+      img->cluster_offset = coffset;
+    }
+    memcpy(buf, img->cluster + (offset & (cluster_size - 1)), len);
+  } else {
+    if (!pread_at(img->fd, entry + (offset & ((1 << img->cluster_bits) - 1)), buf, len))
+      fatal("\nERROR: while reading image data!");
+  }
+}
 
-                  if (write(flatfd, buffer, 512) != 512)
-                     fatal("\nERROR: while writing bloc in flatfile !");
-               }
-           }
-        }
-     }
+int create_image_file(const char *filename)
+{
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC
+#ifdef O_BINARY
+                | O_BINARY
+#endif
+                , 0644);
+  if (fd < 0)
+    fatal("ERROR: could not create the output image");
+  return fd;
+}
+
+void write_at(int fd, Bit64u offset, const void *buf, Bit32u len)
+{
+  if (!pwrite_at(fd, offset, buf, len))
+    fatal("\nERROR: while writing the output image!");
+}
+
+/* convert a flat or qcow image (with its backing images) into a
+   standalone qcow image with compressed clusters */
+int compress_image(const char *srcname, const char *dstname)
+{
+  image_reader_t *img = open_image(srcname);
+  Bit32u cluster_size = 1 << QCOW_CLUSTER_BITS, l2_size = 1 << QCOW_L2_BITS;
+  Bit32u shift = QCOW_CLUSTER_BITS + QCOW_L2_BITS;
+  Bit32u i, j, l1_size, nonzero = 0, compressed = 0;
+  Bit64u *l1_table, *l2_table, file_end, offset;
+  Bit8u *buffer, *zdata;
+  qcow_header_t header;
+  int fd;
+
+  l1_size = (Bit32u)((img->size + ((Bit64u)1 << shift) - 1) >> shift);
+  l1_table = (Bit64u*)calloc(l1_size, 8);
+  l2_table = (Bit64u*)malloc(l2_size * 8);
+  buffer = (Bit8u*)malloc(cluster_size);
+  zdata = (Bit8u*)malloc(cluster_size);
+  fd = create_image_file(dstname);
+  file_end = QCOW_HEADER_SIZE + (Bit64u)l1_size * 8;
+
+  printf("\nCompressing " FMT_LL "u bytes: [  0%%]", img->size);
+  for (i=0; i<l1_size; i++) {
+    int allocated = 0;
+
+    printf("\x8\x8\x8\x8\x8%3d%%]", (i+1)*100/l1_size);
+    fflush(stdout);
+    memset(l2_table, 0, l2_size * 8);
+    for (j=0; j<l2_size; j++) {
+      Bit64u entry;
+      Bit32u k;
+      z_stream strm;
+      int ret;
+
+      offset = ((Bit64u)i << shift) + ((Bit64u)j << QCOW_CLUSTER_BITS);
+      if (offset >= img->size) break;
+      read_image_data(img, offset, buffer, cluster_size);
+      for (k=0; (k<cluster_size) && (buffer[k] == 0); k++);
+      if (k == cluster_size) continue; // leave empty clusters unallocated
+      nonzero++;
+
+      memset(&strm, 0, sizeof(strm));
+      if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -12, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        fatal("\nERROR: deflateInit2() failed!");
+      strm.next_in = buffer;
+      strm.avail_in = cluster_size;
+      strm.next_out = zdata;
+      strm.avail_out = cluster_size;
+      ret = deflate(&strm, Z_FINISH);
+      deflateEnd(&strm);
+      if ((ret == Z_STREAM_END) && (strm.total_out < cluster_size)) {
+        // compressed clusters are packed without alignment
+        write_at(fd, file_end, zdata, strm.total_out);
+        entry = QCOW_OFLAG_COMPRESSED | ((Bit64u)strm.total_out << (63 - QCOW_CLUSTER_BITS)) | file_end;
+        file_end += strm.total_out;
+        compressed++;
+      } else {
+        file_end = (file_end + cluster_size - 1) & ~((Bit64u)cluster_size - 1);
+        write_at(fd, file_end, buffer, cluster_size);
+        entry = file_end;
+        file_end += cluster_size;
+      }
+      l2_table[j] = htob64(entry);
+      allocated = 1;
+    }
+    if (allocated) {
+      file_end = (file_end + cluster_size - 1) & ~((Bit64u)cluster_size - 1);
+      write_at(fd, file_end, l2_table, l2_size * 8);
+      l1_table[i] = htob64(file_end);
+      file_end += l2_size * 8;
+    }
   }
 
-  printf(" Done.");
-  printf("\n");
+  memset(&header, 0, sizeof(header));
+  header.magic = htob32(QCOW_MAGIC);
+  header.version = htob32(QCOW_VERSION);
+  header.size = htob64(img->size);
+  header.cluster_bits = QCOW_CLUSTER_BITS;
+  header.l2_bits = QCOW_L2_BITS;
+  header.l1_table_offset = htob64((Bit64u)QCOW_HEADER_SIZE);
+  write_at(fd, 0, &header, QCOW_HEADER_SIZE);
+  write_at(fd, QCOW_HEADER_SIZE, l1_table, l1_size * 8);
+
+  printf(" Done.\n%d non-empty clusters, %d of them compressed, image size " FMT_LL "u bytes\n",
+         nonzero, compressed, file_end);
+
+  close(fd);
+  close_image(img);
+  free(l1_table);
+  free(l2_table);
+  free(buffer);
+  free(zdata);
+  return 0;
+}
 
-  close(flatfd);
-  close(redologfd);
+/* convert a qcow image (with its backing images) into a flat image */
+int expand_image(const char *srcname, const char *dstname)
+{
+  image_reader_t *img = open_image(srcname);
+  Bit32u chunk;
+  Bit64u offset;
+  Bit8u *buffer;
+  int fd;
+
+  if (!img->qcow)
+    fatal("\nERROR: not a qcow image!");
+  chunk = 1 << img->cluster_bits;
+  buffer = (Bit8u*)malloc(chunk);
+  fd = create_image_file(dstname);
+
+  printf("\nExpanding " FMT_LL "u bytes: [  0%%]", img->size);
+  for (offset=0; offset<img->size; offset+=chunk) {
+    Bit32u len = chunk;
+    if ((offset + len) > img->size) len = (Bit32u)(img->size - offset);
+    if ((offset % (chunk * 256)) == 0) {
+      printf("\x8\x8\x8\x8\x8%3d%%]", (int)(offset*100/img->size));
+      fflush(stdout);
+    }
+    read_image_data(img, offset, buffer, len);
+    write_at(fd, offset, buffer, len);
+  }
+  printf("\x8\x8\x8\x8\x8" "100%%] Done.\n");
 
+  close(fd);
+  close_image(img);
+  free(buffer);
   return 0;
 }
 
+/* menu data for choosing the operation */
+char *op_menu = "\nWhat should I do?\nPlease type commit (redolog into flat image), compress (flat/qcow into compressed qcow)\nor expand (qcow into flat image). ";
+char *op_choices[] = { "commit", "compress", "expand" };
+int op_n_choices = 3;
+
+#endif
+
 int CDECL main()
 {
   char filename[256];
@@ -357,6 +828,29 @@ int CDECL main()
   filename[0] = 0;
   redologname[0] = 0;
 
+#if BX_COMPRESSED_HD_SUPPORT
+  {
+    int op;
+    char srcname[256], dstname[256];
+
+    if (ask_menu(op_menu, op_n_choices, op_choices, 0, &op) < 0)
+      fatal(EOF_ERR);
+    if (op > 0) {
+      if (ask_string("\nWhat is the source image name?\n", (op == 1) ? "c.img" : "c.qcow", srcname) < 0)
+        fatal(EOF_ERR);
+      if (ask_string("\nWhat should I name the new image?\n", (op == 1) ? "c.qcow" : "c.img", dstname) < 0)
+        fatal(EOF_ERR);
+      if (!strcmp(srcname, dstname))
+        fatal("ERROR: source and new image must be different files");
+      if (op == 1)
+        compress_image(srcname, dstname);
+      else
+        expand_image(srcname, dstname);
+      myexit(0);
+    }
+  }
+#endif
+
   if (ask_string("\nWhat is the flat image name?\n", "c.img", filename) < 0)
     fatal(EOF_ERR);
 
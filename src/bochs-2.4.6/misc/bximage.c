@@ -34,6 +34,7 @@ int bx_hdsize;
 int bx_hdimagemode;
 int bx_interactive;
 char bx_filename[256];
+char bx_backing[256];
 
 typedef int (*WRITE_IMAGE)(FILE*, Bit64u);
 #ifdef WIN32
@@ -55,9 +56,9 @@ char *fdsize_choices[] = { "0.16","0.18","0.32","0.36","0.72","1.2","1.44","1.68
 int fdsize_n_choices = 10;
 
 /* menu data for choosing disk mode */
-char *hdmode_menu = "\nWhat kind of image should I create?\nPlease type flat, sparse or growing. ";
-                char *hdmode_choices[] = {"flat", "sparse", "growing" };
-int hdmode_n_choices = 3;
+char *hdmode_menu = "\nWhat kind of image should I create?\nPlease type flat, sparse, growing or qcow. ";
+                char *hdmode_choices[] = {"flat", "sparse", "growing", "qcow" };
+int hdmode_n_choices = 4;
 
 void myexit(int code)
 {
@@ -420,6 +421,71 @@ int make_growing_image(FILE *fp, Bit64u sec)
   return 0;
 }
 
+/* produce a qcow image file, optionally backed by bx_backing */
+int make_qcow_image(FILE *fp, Bit64u sec)
+{
+  qcow_header_t header;
+  Bit32u l1_size, l1_offset, backing_len, shift = QCOW_CLUSTER_BITS + QCOW_L2_BITS;
+  Bit64u size = sec * 512;
+
+  backing_len = strlen(bx_backing);
+  l1_offset = (QCOW_HEADER_SIZE + backing_len + 7) & ~7;
+  l1_size = (Bit32u)((size + ((Bit64u)1 << shift) - 1) >> shift);
+
+  memset(&header, 0, sizeof(header));
+  header.magic = htob32(QCOW_MAGIC);
+  header.version = htob32(QCOW_VERSION);
+  if (backing_len > 0) {
+    header.backing_file_offset = htob64((Bit64u)QCOW_HEADER_SIZE);
+    header.backing_file_size = htob32(backing_len);
+  }
+  header.size = htob64(size);
+  header.cluster_bits = QCOW_CLUSTER_BITS;
+  header.l2_bits = QCOW_L2_BITS;
+  header.l1_table_offset = htob64((Bit64u)l1_offset);
+
+  if ((fwrite(&header, QCOW_HEADER_SIZE, 1, fp) != 1) ||
+      ((backing_len > 0) && (fwrite(bx_backing, backing_len, 1, fp) != 1))) {
+    fclose(fp);
+    fatal("ERROR: The disk image is not complete - could not write header!");
+  }
+
+  // empty L1 table
+  fileset(fp, 0, l1_offset - QCOW_HEADER_SIZE - backing_len + l1_size * 8);
+
+  return 0;
+}
+
+/* get the disk size of a flat or qcow image, which is the backing file
+   of image 'filename' */
+Bit64u get_backing_size(const char *filename, const char *backing)
+{
+  char path[512];
+  qcow_header_t header;
+  const char *sep = strrchr(filename, '/');
+  Bit64u size = 0;
+  FILE *fp;
+
+#ifdef WIN32
+  if (strrchr(filename, '\\') > sep) sep = strrchr(filename, '\\');
+  if ((backing[0] == '\\') || (backing[0] != 0 && backing[1] == ':')) sep = NULL;
+#endif
+  if ((sep == NULL) || (backing[0] == '/')) sep = filename - 1;
+  snprintf(path, sizeof(path), "%.*s%s", (int)(sep - filename + 1), filename, backing);
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+    fatal("ERROR: Could not open the backing file");
+  if ((fread(&header, QCOW_HEADER_SIZE, 1, fp) == 1) && (btoh32(header.magic) == QCOW_MAGIC)) {
+    size = btoh64(header.size);
+  } else {
+    fseek(fp, 0, SEEK_END);
+    size = (Bit64u)ftell(fp);
+  }
+  fclose(fp);
+  return size;
+}
+
 /* produce the image file */
 #ifdef WIN32
 int make_image_win32 (Bit64u sec, char *filename, WRITE_IMAGE_WIN32 write_image)
@@ -508,6 +574,7 @@ void print_usage()
     "  -hd              create hard disk image\n"
     "  -mode=...        image mode (hard disks only)\n"
     "  -size=...        image size in megabytes\n"
+    "  -backing=...     backing image name (qcow mode only)\n"
     "  -q               quiet mode (don't prompt for user input)\n"
     "  --help           display this help and exit\n\n");
 }
@@ -523,6 +590,7 @@ int parse_cmdline(int argc, char *argv[])
   bx_hdimagemode = -1;
   bx_interactive = 1;
   bx_filename[0] = 0;
+  bx_backing[0] = 0;
   while ((arg < argc) && (ret == 1)) {
     // parse next arg
     if (!strcmp("--help", argv[arg]) || !strncmp("/?", argv[arg], 2)) {
@@ -568,6 +636,10 @@ int parse_cmdline(int argc, char *argv[])
         printf("Image type (fd/hd) not specified\n\n");
       }
     }
+    else if (!strncmp("-backing=", argv[arg], 9)) {
+      strncpy(bx_backing, &argv[arg][9], sizeof(bx_backing) - 1);
+      bx_backing[sizeof(bx_backing) - 1] = 0;
+    }
     else if (!strcmp("-q", argv[arg])) {
       bx_interactive = 0;
     }
@@ -584,12 +656,16 @@ int parse_cmdline(int argc, char *argv[])
     bx_fdsize_idx = 6;
     bx_interactive = 1;
   }
+  if ((strlen(bx_backing) > 0) && ((bx_hdimage != 1) || (bx_hdimagemode != 3))) {
+    printf("Backing image option only supported for qcow hard disk images\n\n");
+    ret = 0;
+  }
   if (bx_hdimage == 1) {
     if (bx_hdimagemode == -1) {
       bx_hdimagemode = 0;
       bx_interactive = 1;
     }
-    if (bx_hdsize == -1) {
+    if ((bx_hdsize == -1) && (strlen(bx_backing) == 0)) {
       bx_hdsize = 10;
       bx_interactive = 1;
     }
@@ -632,15 +708,31 @@ int CDECL main(int argc, char *argv[])
     if (bx_interactive) {
       if (ask_menu(hdmode_menu, hdmode_n_choices, hdmode_choices, bx_hdimagemode, &mode) < 0)
         fatal (EOF_ERR);
-      if (ask_int("\nEnter the hard disk size in megabytes, between 1 and 129023\n", 1, 129023, bx_hdsize, &hdsize) < 0)
+      if (mode == 3) {
+        char backing[256];
+        if (ask_string("\nWhat is the name of the backing image? (none for a standalone image)\n",
+                       strlen(bx_backing) ? bx_backing : "none", backing) < 0)
+          fatal(EOF_ERR);
+        strcpy(bx_backing, strcmp(backing, "none") ? backing : "");
+      }
+      if ((strlen(bx_backing) == 0) &&
+          (ask_int("\nEnter the hard disk size in megabytes, between 1 and 129023\n", 1, 129023, bx_hdsize, &hdsize) < 0))
         fatal(EOF_ERR);
     } else {
       mode = bx_hdimagemode;
       hdsize = bx_hdsize;
     }
-    cyl = (unsigned int) (hdsize*1024.0*1024.0/16.0/63.0/512.0);
+    if (strlen(bx_backing) > 0) {
+      // a qcow image has the size of its backing image
+      sectors = get_backing_size(strlen(bx_filename) ? bx_filename : "c.img", bx_backing) / 512;
+      cyl = (unsigned int) (sectors / (heads * spt));
+      if (sectors < 1)
+        fatal("ERROR: Illegal backing image size!");
+    } else {
+      cyl = (unsigned int) (hdsize*1024.0*1024.0/16.0/63.0/512.0);
+      sectors = cyl*heads*spt;
+    }
     assert (cyl < 262144);
-    sectors = cyl*heads*spt;
     printf("\nI will create a '%s' hard disk image with\n", hdmode_choices[mode]);
     printf("  cyl=%d\n", cyl);
     printf("  heads=%d\n", heads);
@@ -664,6 +756,9 @@ int CDECL main(int argc, char *argv[])
       case 2:
         write_function=make_growing_image;
         break;
+      case 3:
+        write_function=make_qcow_image;
+        break;
       default:
 #ifdef WIN32
         writefn_win32=make_flat_image_win32;
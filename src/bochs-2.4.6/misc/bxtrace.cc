@@ -0,0 +1,327 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// bxtrace.cc
+//
+// Offline decoder for the binary execution traces recorded by the
+// instrument/bxtrace module. The instructions are disassembled with the
+// Bochs disassembler and printed one per line as
+//
+//   cpu linear-address: disassembly ; opcode bytes
+//
+// together with the address space (CR3) switches, exceptions, external
+// interrupts and optionally the data accesses. The output can be limited
+// to one CPU, one address space, an address range or to the last lines
+// before the end of the trace, which usually is where a test failed.
+//
+// Build it with "make bxtrace" in a configured build directory, then run
+// "bxtrace [options] tracefile" (see usage below).
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+#include "osdep.h"
+#include "disasm/disasm.h"
+#include "instrument/bxtrace/bxtrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// access types as in bochs.h
+#define BX_READ  0
+#define BX_WRITE 1
+
+#define BUFFER_SIZE (4 * 1024 * 1024)
+
+static const char *exception_names[20] = {
+  "DE", "DB", "NMI", "BP", "OF", "BR", "UD", "NM", "DF", "CSO",
+  "TS", "NP", "SS", "GP", "PF", "reserved15", "MF", "AC", "MC", "XM"
+};
+
+static struct {
+  bx_bool filter_cpu;
+  unsigned cpu;
+  bx_bool filter_cr3;
+  Bit64u cr3;
+  Bit64u from, to;
+  bx_bool memory;
+  unsigned last;    // lines to keep, 0 prints everything
+} opt;
+
+// per CPU decoder state
+static struct {
+  Bit64u cr3;
+  Bit64u next_laddr;
+  bx_bool shown;    // last instruction passed the filters
+  Bit64u instructions;
+} cpus[256];
+
+// a record with the per CPU state resolved, ready to be printed
+typedef struct {
+  Bit8u type;
+  Bit8u cpu;
+  Bit8u mode;
+  Bit8u len;        // opcode bytes or size of the data access
+  Bit8u bytes[16];
+  Bit32u value;     // vector or access type
+  Bit32u error_code;
+  Bit64u addr;      // instruction or data address, CR3
+} trace_event_t;
+
+// with -l only the last events are kept and disassembled at the end
+static trace_event_t *ring;
+static unsigned ring_next, ring_used;
+
+static bx_bool cpu_shown(unsigned cpu)
+{
+  return !opt.filter_cpu || cpu == opt.cpu;
+}
+
+// size of the record at p, 0 if the type is unknown
+static unsigned record_size(const Bit8u *p)
+{
+  switch(p[0]) {
+    case BXTRACE_INSN:
+      return 11 + BXTRACE_INFO_LEN(p[2]);
+    case BXTRACE_INSN_NEXT:
+      return 3 + BXTRACE_INFO_LEN(p[2]);
+    case BXTRACE_CR3:
+      return 10;
+    case BXTRACE_MEM:
+      return 12;
+    case BXTRACE_EXCEPTION:
+      return 7;
+    case BXTRACE_HWINTERRUPT:
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+// Update the CPU state with the record at p, return 1 and fill ev if
+// the record passes the filters. Records other than instructions are
+// shown when the last instruction of their CPU was.
+static bx_bool decode_record(const Bit8u *p, trace_event_t *ev)
+{
+  unsigned cpu = p[1];
+
+  ev->type = p[0];
+  ev->cpu = cpu;
+
+  switch(p[0]) {
+    case BXTRACE_INSN:
+    case BXTRACE_INSN_NEXT:
+      ev->len = BXTRACE_INFO_LEN(p[2]);
+      ev->mode = BXTRACE_INFO_MODE(p[2]);
+      if (p[0] == BXTRACE_INSN) {
+        ev->addr = bxtrace_get64(p + 3);
+        memcpy(ev->bytes, p + 11, ev->len);
+      }
+      else {
+        ev->addr = cpus[cpu].next_laddr;
+        memcpy(ev->bytes, p + 3, ev->len);
+      }
+      cpus[cpu].next_laddr = ev->addr + ev->len;
+      cpus[cpu].instructions++;
+      cpus[cpu].shown = cpu_shown(cpu) &&
+        (!opt.filter_cr3 || cpus[cpu].cr3 == opt.cr3) &&
+        ev->addr >= opt.from && ev->addr <= opt.to;
+      return cpus[cpu].shown;
+
+    case BXTRACE_CR3:
+      ev->addr = cpus[cpu].cr3 = bxtrace_get64(p + 2);
+      return cpus[cpu].shown;
+
+    case BXTRACE_MEM:
+      ev->value = p[2];
+      ev->len = p[3];
+      ev->addr = bxtrace_get64(p + 4);
+      return opt.memory && cpus[cpu].shown;
+
+    case BXTRACE_EXCEPTION:
+      ev->value = p[2];
+      ev->error_code = bxtrace_get32(p + 3);
+      return cpus[cpu].shown;
+
+    case BXTRACE_HWINTERRUPT:
+      ev->value = p[2];
+      return cpus[cpu].shown;
+  }
+
+  return 0;
+}
+
+static void print_event(disassembler &dis, const trace_event_t *ev)
+{
+  char text[512];
+
+  switch(ev->type) {
+    case BXTRACE_INSN:
+    case BXTRACE_INSN_NEXT:
+      {
+        // the disassembler may look at up to 16 bytes
+        Bit8u ibuf[16];
+        memset(ibuf, 0, sizeof(ibuf));
+        memcpy(ibuf, ev->bytes, ev->len);
+        dis.disasm(ev->mode != BXTRACE_MODE_16, ev->mode == BXTRACE_MODE_64, 0,
+          (bx_address) ev->addr, ibuf, text);
+      }
+      if (ev->mode == BXTRACE_MODE_64)
+        printf("%u " FMT_ADDRX64 ": %s ; ", ev->cpu, ev->addr, text);
+      else
+        printf("%u %08x: %s ; ", ev->cpu, (Bit32u) ev->addr, text);
+      for (unsigned n=0; n<ev->len; n++)
+        printf("%02x", ev->bytes[n]);
+      printf("\n");
+      break;
+
+    case BXTRACE_CR3:
+      printf("%u cr3=0x" FMT_LL "x\n", ev->cpu, ev->addr);
+      break;
+
+    case BXTRACE_MEM:
+      printf("%u   %s %u bytes at 0x" FMT_LL "x\n", ev->cpu,
+        (ev->value == BX_READ) ? "read" : (ev->value == BX_WRITE) ? "write" : "read-modify-write",
+        ev->len, ev->addr);
+      break;
+
+    case BXTRACE_EXCEPTION:
+      printf("%u exception %u (%s) error_code=0x%x\n", ev->cpu, ev->value,
+        (ev->value < 20) ? exception_names[ev->value] : "?", ev->error_code);
+      break;
+
+    case BXTRACE_HWINTERRUPT:
+      printf("%u hardware interrupt 0x%02x\n", ev->cpu, ev->value);
+      break;
+  }
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+    "usage: bxtrace [options] tracefile\n"
+    "  -c cpu        only show this CPU\n"
+    "  -a cr3        only show instructions executed in this address space\n"
+    "  -r from:to    only show instructions in this linear address range\n"
+    "  -m            show the data accesses (if recorded)\n"
+    "  -l count      only show the last count lines of the trace\n"
+    "  -t            AT&T syntax disassembly\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  disassembler dis;
+  int i;
+
+  memset(&opt, 0, sizeof(opt));
+  opt.to = BX_CONST64(0xffffffffffffffff);
+
+  for (i=1; i<argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-m")) {
+      opt.memory = 1;
+    }
+    else if (!strcmp(argv[i], "-t")) {
+      dis.set_syntax_att();
+    }
+    else if (i+1 < argc && !strcmp(argv[i], "-c")) {
+      opt.filter_cpu = 1;
+      opt.cpu = strtoul(argv[++i], NULL, 0);
+    }
+    else if (i+1 < argc && !strcmp(argv[i], "-a")) {
+      opt.filter_cr3 = 1;
+      opt.cr3 = strtoull(argv[++i], NULL, 16);
+    }
+    else if (i+1 < argc && !strcmp(argv[i], "-r")) {
+      char *end;
+      opt.from = strtoull(argv[++i], &end, 16);
+      if (*end != ':') usage();
+      opt.to = strtoull(end + 1, NULL, 16);
+    }
+    else if (i+1 < argc && !strcmp(argv[i], "-l")) {
+      opt.last = strtoul(argv[++i], NULL, 0);
+    }
+    else {
+      usage();
+    }
+  }
+  if (i != argc - 1) usage();
+
+  FILE *fp = fopen(argv[i], "rb");
+  if (fp == NULL) {
+    perror(argv[i]);
+    return 1;
+  }
+
+  Bit8u *buf = new Bit8u[BUFFER_SIZE];
+  if (fread(buf, 1, BXTRACE_HEADER_SIZE, fp) != BXTRACE_HEADER_SIZE ||
+      memcmp(buf, BXTRACE_MAGIC, 8) != 0)
+  {
+    fprintf(stderr, "%s: not a Bochs execution trace\n", argv[i]);
+    return 1;
+  }
+  if (bxtrace_get32(buf + 8) != BXTRACE_VERSION) {
+    fprintf(stderr, "%s: unsupported trace version %u\n", argv[i], bxtrace_get32(buf + 8));
+    return 1;
+  }
+
+  for (unsigned cpu=0; cpu<256; cpu++) {
+    cpus[cpu].cr3 = cpus[cpu].next_laddr = BX_CONST64(0xffffffffffffffff);
+    cpus[cpu].shown = cpu_shown(cpu);
+  }
+  if (opt.last) {
+    ring = new trace_event_t[opt.last];
+  }
+
+  // records never span a read, the remainder is moved to the front
+  unsigned avail = 0, pos = 0, size;
+  Bit64u records = 0;
+  for (;;) {
+    if (avail - pos < BXTRACE_MAX_RECORD) {
+      memmove(buf, buf + pos, avail - pos);
+      avail -= pos;
+      pos = 0;
+      avail += fread(buf + avail, 1, BUFFER_SIZE - avail, fp);
+      if (avail == 0) break;
+    }
+    size = record_size(buf + pos);
+    if (size == 0) {
+      fprintf(stderr, "bad record type %u after " FMT_LL "u records\n", buf[pos], records);
+      break;
+    }
+    if (pos + size > avail) {
+      fprintf(stderr, "trace truncated after " FMT_LL "u records\n", records);
+      break;
+    }
+    if (opt.last) {
+      if (decode_record(buf + pos, &ring[ring_next])) {
+        ring_next = (ring_next + 1) % opt.last;
+        if (ring_used < opt.last) ring_used++;
+      }
+    }
+    else {
+      trace_event_t ev;
+      if (decode_record(buf + pos, &ev))
+        print_event(dis, &ev);
+    }
+    pos += size;
+    records++;
+  }
+  fclose(fp);
+
+  if (opt.last) {
+    unsigned n = (ring_next + opt.last - ring_used) % opt.last;
+    for (; ring_used > 0; ring_used--) {
+      print_event(dis, &ring[n]);
+      n = (n + 1) % opt.last;
+    }
+  }
+
+  for (unsigned cpu=0; cpu<256; cpu++) {
+    if (cpus[cpu].instructions)
+      fprintf(stderr, "cpu %u: " FMT_LL "u instructions\n", cpu, cpus[cpu].instructions);
+  }
+  return 0;
+}
@@ -0,0 +1,263 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// fpu-fuzz.cc
+//
+// This program is a differential fuzzer for the host x87 fast path in
+// fpu/host_x87.h. Random operand pairs, precision and rounding control
+// settings and exception masks are fed both to the host routines and to
+// the softfloat floatx80 routines, and the results and exception flags
+// (including C1) must agree bit for bit whenever the host accepted the
+// operation. The host reports #P only together with C1 and is used only
+// when the guest already has #P set, so #P alone is not compared. The
+// operands are biased towards the interesting classes: zeros, denormals,
+// pseudo-denormals, unnormals, infinities, NaNs and values close to each
+// other, to the overflow and to the underflow limit.
+//
+// Build it with "make fpu-fuzz" in a configured build directory, it is
+// linked with the softfloat code of fpu/libfpu.a. Then run
+// "fpu-fuzz [iterations] [seed]". The program exits with status 1 if any
+// mismatch was found. The host path is compiled in regardless of the
+// --enable-host-specific-asms setting of the build directory.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#undef  BX_SupportHostAsms
+#define BX_SupportHostAsms 1
+
+#include "softfloat.h"
+#include "host_x87.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#if BX_HOST_X87
+
+// The FPU only runs FDIV on the host, the other operations are built here
+// from the same template to be compared and timed as well.
+BX_HOST_X87_FUNC(host_x87_add, "fadd")
+BX_HOST_X87_FUNC(host_x87_sub, "fsub")
+BX_HOST_X87_FUNC(host_x87_mul, "fmul")
+
+typedef floatx80 (*soft_func_t)(floatx80, floatx80, float_status_t &);
+typedef int (*host_func_t)(floatx80, floatx80, floatx80 &, float_status_t &);
+
+static struct {
+  const char *name;
+  soft_func_t soft;
+  host_func_t host;
+} ops[] = {
+  { "fadd", floatx80_add, host_x87_add },
+  { "fsub", floatx80_sub, host_x87_sub },
+  { "fmul", floatx80_mul, host_x87_mul },
+  { "fdiv", floatx80_div, host_x87_div }
+};
+
+#define NUM_OPS (sizeof(ops) / sizeof(ops[0]))
+
+static Bit64u rng_state;
+
+static Bit64u rnd64(void)
+{
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * BX_CONST64(2685821657736338717);
+}
+
+static unsigned rnd(unsigned n)
+{
+  return (unsigned)(rnd64() >> 33) % n;
+}
+
+static floatx80 make_floatx80(Bit16u exp, Bit64u fraction)
+{
+  floatx80 f;
+  memset(&f, 0, sizeof(f));
+  f.exp = exp;
+  f.fraction = fraction;
+  return f;
+}
+
+// short runs of ones and zeros make carries and ties far more likely
+static Bit64u random_fraction(void)
+{
+  switch(rnd(4)) {
+    case 0:
+      return rnd64() & ~(rnd64() << rnd(64));
+    case 1:
+      return rnd64() | (rnd64() >> rnd(64));
+    case 2:
+      return rnd64() & (BX_CONST64(0xffffffffffffffff) << rnd(64));
+    default:
+      return rnd64();
+  }
+}
+
+static floatx80 random_operand(floatx80 other)
+{
+  Bit16u sign = rnd(2) ? 0x8000 : 0;
+  Bit64u frac = random_fraction() | BX_CONST64(0x8000000000000000);
+
+  switch(rnd(16)) {
+    case 0:  // zero
+      return make_floatx80(sign, 0);
+    case 1:  // denormal
+      return make_floatx80(sign, frac & BX_CONST64(0x7fffffffffffffff));
+    case 2:  // pseudo-denormal
+      return make_floatx80(sign, frac);
+    case 3:  // unnormal
+      return make_floatx80(sign | (1 + rnd(0x7ffe)), frac & BX_CONST64(0x7fffffffffffffff));
+    case 4:  // infinity, NaN or pseudo-NaN
+      switch(rnd(3)) {
+        case 0:
+          return make_floatx80(sign | 0x7fff, BX_CONST64(0x8000000000000000));
+        case 1:
+          return make_floatx80(sign | 0x7fff, frac);
+        default:
+          return make_floatx80(sign | 0x7fff, frac & BX_CONST64(0x7fffffffffffffff));
+      }
+    case 5:  // near the underflow limit
+      return make_floatx80(sign | (1 + rnd(80)), frac);
+    case 6:  // near the overflow limit
+      return make_floatx80(sign | (0x7ffe - rnd(80)), frac);
+    case 7:  // same magnitude as the other operand
+      return make_floatx80(sign | (other.exp & 0x7fff), other.fraction ^ (rnd64() >> rnd(64)));
+    case 8:
+    case 9:
+    case 10: // close exponent
+      return make_floatx80(sign | (((other.exp & 0x7fff) + rnd(140) - 70) & 0x7fff), frac);
+    default: // any normal number, mostly of moderate magnitude
+      if (rnd(2))
+        return make_floatx80(sign | (0x3fff + rnd(256) - 128), frac);
+      return make_floatx80(sign | (1 + rnd(0x7ffe)), frac);
+  }
+}
+
+static float_status_t random_status(void)
+{
+  static const int precisions[3] = { 32, 64, 80 };
+  float_status_t status;
+
+  status.float_rounding_precision = precisions[rnd(3)];
+  status.float_rounding_mode = rnd(4);
+  status.float_exception_flags = 0;
+  // the host path is only taken with all exceptions masked
+  status.float_exception_masks = rnd(8) ? BX_HOST_X87_ALL_EXCEPTIONS_MASK : rnd(64);
+  status.float_nan_handling_mode = float_first_operand_nan;
+  status.flush_underflow_to_zero = 0;
+  return status;
+}
+
+static void print_floatx80(const char *name, floatx80 f)
+{
+  printf(" %s=%04x:%08x%08x", name, f.exp,
+    (Bit32u)(f.fraction >> 32), (Bit32u)(f.fraction & 0xffffffff));
+}
+
+static double get_time(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// time both paths on operands the host accepts
+static void benchmark(unsigned op)
+{
+  enum { N = 1024, ROUNDS = 2000 };
+  static floatx80 a[N], b[N];
+  float_status_t status = random_status();
+  status.float_exception_masks = BX_HOST_X87_ALL_EXCEPTIONS_MASK;
+
+  for (unsigned n = 0; n < N; n++) {
+    a[n] = make_floatx80(0x3fff + rnd(64) - 32, random_fraction() | BX_CONST64(0x8000000000000000));
+    b[n] = make_floatx80(0x3fff + rnd(64) - 32, random_fraction() | BX_CONST64(0x8000000000000000));
+  }
+
+  Bit64u sum = 0;
+  double start = get_time();
+  for (unsigned k = 0; k < ROUNDS; k++)
+    for (unsigned n = 0; n < N; n++)
+      sum += ops[op].soft(a[n], b[n], status).fraction;
+  double soft_time = get_time() - start;
+
+  floatx80 r;
+  start = get_time();
+  for (unsigned k = 0; k < ROUNDS; k++)
+    for (unsigned n = 0; n < N; n++)
+      if (ops[op].host(a[n], b[n], r, status)) sum += r.fraction;
+  double host_time = get_time() - start;
+
+  printf("%s: softfloat %.1f ns, host %.1f ns per operation (%x)\n", ops[op].name,
+    soft_time * 1e9 / (N * ROUNDS), host_time * 1e9 / (N * ROUNDS), (unsigned) sum & 0xf);
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long iterations = (argc > 1) ? strtoul(argv[1], NULL, 0) : 10000000;
+  rng_state = (argc > 2) ? strtoull(argv[2], NULL, 0) : BX_CONST64(0x9e3779b97f4a7c15);
+  if (! rng_state) rng_state = 1;
+
+  unsigned long accepted[NUM_OPS], total[NUM_OPS], mismatches = 0;
+  memset(accepted, 0, sizeof(accepted));
+  memset(total, 0, sizeof(total));
+
+  for (unsigned long n = 0; n < iterations; n++) {
+    unsigned op = rnd(NUM_OPS);
+    floatx80 a = random_operand(make_floatx80(0x3fff, BX_CONST64(0x8000000000000000)));
+    floatx80 b = random_operand(a);
+    if (rnd(2)) { floatx80 t = a; a = b; b = t; }
+
+    float_status_t soft_status = random_status(), host_status = soft_status;
+    floatx80 soft_r = ops[op].soft(a, b, soft_status), host_r;
+
+    total[op]++;
+    if (! ops[op].host(a, b, host_r, host_status))
+      continue;
+    accepted[op]++;
+
+    if (soft_r.exp != host_r.exp || soft_r.fraction != host_r.fraction ||
+        (soft_status.float_exception_flags & ~float_flag_inexact) !=
+        (host_status.float_exception_flags & ~float_flag_inexact))
+    {
+      if (mismatches++ < 20) {
+        printf("%s pc=%d rc=%d:", ops[op].name,
+          soft_status.float_rounding_precision, soft_status.float_rounding_mode);
+        print_floatx80("a", a);
+        print_floatx80("b", b);
+        print_floatx80("soft", soft_r);
+        print_floatx80("host", host_r);
+        printf(" flags soft=%03x host=%03x\n",
+          soft_status.float_exception_flags, host_status.float_exception_flags);
+      }
+    }
+  }
+
+  for (unsigned op = 0; op < NUM_OPS; op++) {
+    printf("%s: %lu operations, %lu taken by the host\n",
+      ops[op].name, total[op], accepted[op]);
+  }
+  printf("%lu mismatches\n", mismatches);
+
+  for (unsigned op = 0; op < NUM_OPS; op++)
+    benchmark(op);
+
+  return mismatches ? 1 : 0;
+}
+
+#else
+
+int main(void)
+{
+  fprintf(stderr, "fpu-fuzz: the host x87 path needs gcc on an x86 host\n");
+  return 1;
+}
+
+#endif
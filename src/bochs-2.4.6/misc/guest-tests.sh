@@ -0,0 +1,123 @@
+#!/bin/sh
+#
+# $Id$
+#
+# guest-tests.sh
+#
+# Boots the guest tests of misc/ (see the header of each .S file) from
+# floppy in a Bochs binary and checks the "<test>: PASS" line they write
+# to the port 0xE9 console before they stop the simulation. Run it with
+# "make guest-tests" in a build directory, or as
+#   sh misc/guest-tests.sh <bochs> <srcdir> <test image>...
+# from the build directory (config.h tells which tests can run). Tests
+# which need a feature that is not configured in are skipped. The exit
+# status is 1 if any test failed.
+#
+
+if [ $# -lt 3 ]; then
+  echo "usage: $0 <bochs> <srcdir> <test image>..." >&2
+  exit 2
+fi
+
+BOCHS=$1
+SRCDIR=$2
+shift 2
+
+WORK=${TMPDIR:-/tmp}/bochs-guest-tests.$$
+mkdir -p $WORK || exit 2
+trap 'rm -rf $WORK' 0
+
+# a guest which never reaches the shutdown port must not hang the run
+TIMEOUT=""
+if (timeout --version) >/dev/null 2>&1; then
+  TIMEOUT="timeout 600"
+fi
+
+configured() {
+  grep "^#define $1 1" config.h >/dev/null 2>&1
+}
+
+# run_guest <name> <floppy> <extra bochsrc lines> [bochs options]
+run_guest() {
+  name=$1
+  floppy=$2
+  extra=$3
+  shift 3
+  cat > $WORK/bochsrc <<EOF
+megs: 32
+romimage: file=$SRCDIR/bios/BIOS-bochs-latest
+vgaromimage: file=$SRCDIR/bios/VGABIOS-lgpl-latest
+floppya: 1_44=$floppy
+boot: floppy
+port_e9_hack: enabled=1
+display_library: nogui
+clock: sync=none
+log: $WORK/$name.log
+panic: action=fatal
+$extra
+EOF
+  $TIMEOUT $BOCHS -q -f $WORK/bochsrc "$@" < /dev/null > $WORK/$name.out 2>&1
+  grep "^$name: PASS" $WORK/$name.out >/dev/null
+}
+
+failed=0
+for image in "$@"; do
+  name=`basename $image .img`
+  skip=""
+  case $name in
+    smp-rmw-test)
+      configured BX_SUPPORT_SMP || skip="needs --enable-smp"
+      ;;
+  esac
+  if [ -n "$skip" ]; then
+    echo "$name: skipped ($skip)"
+    continue
+  fi
+
+  ok=1
+  case $name in
+    checkpoint-test)
+      # the disk writes after the checkpoint must reach the image when
+      # bochs exits, sector 1 then holds DISK_FINAL (0x600dd15c)
+      dd if=/dev/zero of=$WORK/disk.img bs=512 count=20160 2>/dev/null
+      run_guest $name "$image, status=inserted, write_protected=1" \
+        "cpu: count=1, ips=50000000
+ata0-master: type=disk, path=$WORK/disk.img, mode=flat, cylinders=20, heads=16, spt=63" || ok=0
+      final=`od -An -tx4 -j512 -N4 $WORK/disk.img | tr -d ' '`
+      if [ "$final" != "600dd15c" ]; then
+        echo "$name: disk sector 1 is '$final' after exit" >> $WORK/$name.out
+        ok=0
+      fi
+      ;;
+    sr-chain-test)
+      # save a state every 20M ticks, then restore the first incremental
+      # state and the last one, each run must finish with the same result
+      mkdir $WORK/states
+      run_guest $name "$image, status=inserted" "cpu: count=1, ips=50000000" \
+        -checkpoint 20 $WORK/states || ok=0
+      states=`ls $WORK/states | sed -n -e 2p -e '$p' | uniq`
+      [ -n "$states" ] || ok=0
+      for state in $states; do
+        run_guest $name "$image, status=inserted" "cpu: count=1, ips=50000000" \
+          -r $WORK/states/$state || ok=0
+      done
+      ;;
+    smp-rmw-test)
+      run_guest $name "$image, status=inserted" "cpu: count=4, ips=50000000" || ok=0
+      ;;
+    *)
+      run_guest $name "$image, status=inserted" "cpu: count=1, ips=50000000" || ok=0
+      ;;
+  esac
+
+  if [ $ok = 1 ]; then
+    echo "$name: PASS"
+  else
+    echo "$name: FAIL"
+    grep "^$name:" $WORK/$name.out
+    tail -5 $WORK/$name.log
+    failed=1
+  fi
+done
+
+exit $failed
@@ -0,0 +1,227 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// hdimage-test.cc
+//
+// Tests for the asynchronous hard disk image I/O (async_image_t in
+// iodev/hdimage.cc). The image below the worker thread is kept in memory
+// and its writes are slowed down, so the guest side always runs ahead of
+// the queue. The program checks that
+//
+//  - reads return the data of all writes issued before them, also when
+//    the writes are still queued or the sectors were read ahead
+//  - a failed queued write makes the next write_sectors() fail, once
+//  - flush() reports a failed queued write, once
+//
+// Build it with "make hdimage-test" in a build directory configured with
+// --enable-async-disk, it is linked with the Bochs objects except main.o.
+// It prints "hdimage-test: PASS" or the failed checks.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "cpu/cpu.h"
+#include "iodev/iodev.h"
+#include "iodev/hdimage.h"
+
+#if BX_SUPPORT_ASYNC_DISK
+#include <unistd.h>
+#endif
+
+// The globals of main.cc, the test does not start a simulation.
+static logfunctions thePluginLog;
+logfunctions *pluginlog = &thePluginLog;
+
+bx_startup_flags_t bx_startup_flags;
+bx_bool bx_user_quit;
+Bit8u bx_cpu_count;
+Bit32u apic_id_mask;
+bx_bool simulate_xapic;
+
+bx_pc_system_c bx_pc_system;
+
+bx_debug_t bx_dbg;
+
+#if BX_SUPPORT_SMP
+BOCHSAPI BX_CPU_C **bx_cpu_array = NULL;
+#else
+BOCHSAPI BX_CPU_C bx_cpu;
+#endif
+
+BOCHSAPI BX_MEM_C bx_mem;
+
+int bx_begin_simulation(int argc, char *argv[]) { return 0; }
+int bx_atexit(void) { return 0; }
+void bx_sr_after_restore_state(void) {}
+
+#if BX_SUPPORT_SMP_THREADS
+// there are no CPU threads, so the SMP lock is not needed
+__thread BX_CPU_C *bx_smp_self = NULL;
+volatile bx_bool bx_smp_reset_pending = 0;
+void bx_smp_lock(void) {}
+void bx_smp_unlock(void) {}
+void bx_smp_unlock_all(void) {}
+void bx_smp_request_reset(unsigned type) {}
+#endif
+
+#if BX_SUPPORT_ASYNC_DISK
+
+#define TEST_SECTORS 256
+
+// An image in memory with slow writes. Writes to the sectors from
+// fail_from to fail_to fail.
+class test_image_t : public device_image_t {
+public:
+  test_image_t()
+  {
+    cylinders = heads = sectors = 0;
+    hd_size = TEST_SECTORS * 512;
+    data = new Bit8u[TEST_SECTORS * 512];
+    memset(data, 0, TEST_SECTORS * 512);
+    fail_from = fail_to = -1;
+  }
+  virtual ~test_image_t() { delete [] data; }
+
+  int open(const char* pathname) { return 0; }
+  void close() {}
+  Bit64s lseek(Bit64s offset, int whence) { return -1; }
+  ssize_t read(void* buf, size_t count) { return -1; }
+  ssize_t write(const void* buf, size_t count) { return -1; }
+
+  ssize_t read_sectors(Bit64s offset, void* buf, unsigned count)
+  {
+    memcpy(buf, data + offset, count * 512);
+    return (ssize_t)count * 512;
+  }
+
+  ssize_t write_sectors(Bit64s offset, const void* buf, unsigned count)
+  {
+    Bit64s sector = offset >> 9;
+
+    usleep(200);
+    if ((sector <= fail_to) && ((sector + count) > fail_from))
+      return -1;
+    memcpy(data + offset, buf, count * 512);
+    return (ssize_t)count * 512;
+  }
+
+  Bit8u *data;
+  volatile Bit64s fail_from, fail_to;
+};
+
+static int failures = 0;
+
+static void check(bx_bool ok, const char *what)
+{
+  if (!ok) {
+    printf("hdimage-test: FAIL %s\n", what);
+    failures++;
+  }
+}
+
+static void fill(Bit8u *buf, unsigned sectors, Bit32u seed)
+{
+  for (unsigned i = 0; i < sectors * 512; i++)
+    buf[i] = (Bit8u)(seed * 31 + i * 7 + (i >> 9));
+}
+
+// Random writes, reads and read-aheads, every read is compared with a
+// shadow copy which holds the data of all writes issued so far.
+static void test_ordering(void)
+{
+  test_image_t *image = new test_image_t;
+  async_image_t *async = new async_image_t(image);
+  Bit8u *shadow = new Bit8u[TEST_SECTORS * 512];
+  Bit8u buf[16 * 512];
+  Bit32u rand_state = 1;
+  unsigned mismatches = 0;
+
+  memset(shadow, 0, TEST_SECTORS * 512);
+  for (unsigned n = 0; n < 4000; n++) {
+    rand_state = rand_state * 1103515245 + 12345;
+    Bit32u r = rand_state >> 8;
+    unsigned count = 1 + (r % 16);
+    Bit64s sector = (r >> 4) % (TEST_SECTORS - count);
+    Bit64s offset = sector * 512;
+    switch ((r >> 12) % 4) {
+      case 0:
+      case 1:
+        fill(buf, count, n);
+        memcpy(shadow + offset, buf, count * 512);
+        check(async->write_sectors(offset, buf, count) == (ssize_t)count * 512, "write");
+        break;
+      case 2:
+        async->read_ahead(offset, count);
+        break;
+      case 3:
+        if (async->read_sectors(offset, buf, count) != (ssize_t)count * 512 ||
+            memcmp(buf, shadow + offset, count * 512) != 0)
+          mismatches++;
+        break;
+    }
+  }
+  check(mismatches == 0, "read after queued writes returned stale data");
+
+  // a read-ahead of sectors which are then written is not used
+  fill(buf, 8, 1000);
+  async->read_ahead(64 * 512, 8);
+  check(async->write_sectors(68 * 512, buf, 2) == 2 * 512, "write");
+  memcpy(shadow + 68 * 512, buf, 2 * 512);
+  check(async->read_sectors(64 * 512, buf, 8) == 8 * 512, "read");
+  check(memcmp(buf, shadow + 64 * 512, 8 * 512) == 0, "read-ahead overtook a write");
+
+  check(async->flush() == 0, "flush");
+  check(memcmp(image->data, shadow, TEST_SECTORS * 512) == 0, "image differs after flush");
+  async->close();
+  delete async;
+  delete [] shadow;
+}
+
+static void test_errors(void)
+{
+  test_image_t *image = new test_image_t;
+  async_image_t *async = new async_image_t(image);
+  Bit8u buf[512];
+
+  fill(buf, 1, 1);
+  image->fail_from = image->fail_to = 10;
+  // queued, the error is not known yet
+  check(async->write_sectors(10 * 512, buf, 1) == 512, "queued write");
+  // the read is served after the write, so the write has failed then
+  check(async->read_sectors(0, buf, 1) == 512, "read");
+  check(async->write_sectors(20 * 512, buf, 1) < 0, "write after a failed write");
+  check(async->write_sectors(21 * 512, buf, 1) == 512, "error reported twice");
+
+  check(async->write_sectors(10 * 512, buf, 1) == 512, "queued write");
+  check(async->flush() < 0, "flush after a failed write");
+  check(async->flush() == 0, "flush reported the error twice");
+
+  image->fail_from = image->fail_to = -1;
+  check(async->write_sectors(10 * 512, buf, 1) == 512, "write");
+  check(async->flush() == 0, "flush");
+  async->close();
+  delete async;
+}
+
+int main(int argc, char *argv[])
+{
+  // the image classes log through the hdimage plugin
+  libhdimage_LTX_plugin_init(NULL, PLUGTYPE_CORE, 0, NULL);
+
+  test_ordering();
+  test_errors();
+  if (failures == 0)
+    printf("hdimage-test: PASS\n");
+  return failures != 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  printf("hdimage-test: configure with --enable-async-disk\n");
+  return 1;
+}
+
+#endif
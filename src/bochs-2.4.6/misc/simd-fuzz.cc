@@ -0,0 +1,646 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// simd-fuzz.cc
+//
+// This program is a differential fuzzer for the host SSE2 paths of the
+// MMX and SSE instructions (cpu/host_simd.h, used by cpu/mmx.cc, cpu/sse.cc
+// and cpu/sse_pfp.cc).
+//
+//  - The packed integer intrinsics are run through BX_HOST_SIMD_MMX and
+//    BX_HOST_SIMD_XMM and compared with scalar reference code written
+//    after the code of the instructions without --enable-host-simd. The
+//    MMX form must leave the upper half of the host register image alone.
+//  - The floating point operations are run through BX_HOST_SIMD_FP with a
+//    random guest MXCSR (all four rounding modes, DAZ, FTZ, exception
+//    masks and sticky flags) and compared with the softfloat code of
+//    sse_pfp.cc. Whenever BX_HOST_SIMD_FP_MODE() accepts the MXCSR the
+//    results and the resulting MXCSR must agree bit for bit.
+//
+// The operands are biased towards the interesting values: zeros, all
+// ones, the signed and unsigned limits and equal lanes for the integer
+// operations, zeros, denormals, infinities, quiet and signaling NaNs and
+// values close to each other, to the overflow and to the underflow limit
+// for the floating point operations.
+//
+// Build it with "make simd-fuzz" in a configured build directory, it is
+// linked with the softfloat code of fpu/libfpu.a (32-bit x86 hosts need
+// -msse2 in CXXFLAGS). Then run "simd-fuzz [iterations] [seed]". The
+// program exits with status 1 if any mismatch was found. The host path is
+// compiled in regardless of the --enable-host-simd setting of the build
+// directory.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#undef  BX_SupportHostSIMD
+#define BX_SupportHostSIMD 1
+
+#include "softfloat.h"
+#include "softfloat-compare.h"
+#include "cpu/xmm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#if defined(__SSE2__)
+
+#include "cpu/host_simd.h"
+
+static Bit64u rng_state;
+
+static Bit64u rnd64(void)
+{
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * BX_CONST64(2685821657736338717);
+}
+
+static unsigned rnd(unsigned n)
+{
+  return (unsigned)(rnd64() >> 33) % n;
+}
+
+static void print_xmm(const char *name, const BxPackedXmmRegister &r)
+{
+  printf(" %s=%08x%08x%08x%08x", name,
+    r.xmm32u(3), r.xmm32u(2), r.xmm32u(1), r.xmm32u(0));
+}
+
+static double get_time(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// packed integer operations
+/////////////////////////////////////////////////////////////////////////
+
+typedef void (*int_func_t)(BxPackedXmmRegister &r,
+  const BxPackedXmmRegister &a, const BxPackedXmmRegister &b, unsigned bytes);
+
+// reference: r = a op b on the low 'bytes' bytes, lane by lane
+#define REF_LANES(name, n, expr)                                        \
+static void ref_##name(BxPackedXmmRegister &r,                          \
+  const BxPackedXmmRegister &a, const BxPackedXmmRegister &b, unsigned bytes) \
+{                                                                       \
+  for (unsigned i = 0; i < bytes / (n); i++) { expr; }                  \
+}
+
+// the shift count is the whole low quadword of the second operand
+#define SHIFT_COUNT (b.xmm64u(0))
+
+REF_LANES(add_epi8,    1, r.xmmubyte(i) = a.xmmubyte(i) + b.xmmubyte(i))
+REF_LANES(add_epi16,   2, r.xmm16u(i) = a.xmm16u(i) + b.xmm16u(i))
+REF_LANES(add_epi32,   4, r.xmm32u(i) = a.xmm32u(i) + b.xmm32u(i))
+REF_LANES(add_epi64,   8, r.xmm64u(i) = a.xmm64u(i) + b.xmm64u(i))
+REF_LANES(sub_epi8,    1, r.xmmubyte(i) = a.xmmubyte(i) - b.xmmubyte(i))
+REF_LANES(sub_epi16,   2, r.xmm16u(i) = a.xmm16u(i) - b.xmm16u(i))
+REF_LANES(sub_epi32,   4, r.xmm32u(i) = a.xmm32u(i) - b.xmm32u(i))
+REF_LANES(sub_epi64,   8, r.xmm64u(i) = a.xmm64u(i) - b.xmm64u(i))
+REF_LANES(adds_epi8,   1, r.xmmsbyte(i) = SaturateWordSToByteS(Bit16s(a.xmmsbyte(i)) + b.xmmsbyte(i)))
+REF_LANES(adds_epi16,  2, r.xmm16s(i) = SaturateDwordSToWordS(Bit32s(a.xmm16s(i)) + b.xmm16s(i)))
+REF_LANES(adds_epu8,   1, r.xmmubyte(i) = SaturateWordSToByteU(Bit16s(a.xmmubyte(i)) + b.xmmubyte(i)))
+REF_LANES(adds_epu16,  2, r.xmm16u(i) = SaturateDwordSToWordU(Bit32s(a.xmm16u(i)) + b.xmm16u(i)))
+REF_LANES(subs_epi8,   1, r.xmmsbyte(i) = SaturateWordSToByteS(Bit16s(a.xmmsbyte(i)) - b.xmmsbyte(i)))
+REF_LANES(subs_epi16,  2, r.xmm16s(i) = SaturateDwordSToWordS(Bit32s(a.xmm16s(i)) - b.xmm16s(i)))
+REF_LANES(subs_epu8,   1, r.xmmubyte(i) = (a.xmmubyte(i) > b.xmmubyte(i)) ? a.xmmubyte(i) - b.xmmubyte(i) : 0)
+REF_LANES(subs_epu16,  2, r.xmm16u(i) = (a.xmm16u(i) > b.xmm16u(i)) ? a.xmm16u(i) - b.xmm16u(i) : 0)
+REF_LANES(cmpeq_epi8,  1, r.xmmubyte(i) = (a.xmmubyte(i) == b.xmmubyte(i)) ? 0xff : 0)
+REF_LANES(cmpeq_epi16, 2, r.xmm16u(i) = (a.xmm16u(i) == b.xmm16u(i)) ? 0xffff : 0)
+REF_LANES(cmpeq_epi32, 4, r.xmm32u(i) = (a.xmm32u(i) == b.xmm32u(i)) ? 0xffffffff : 0)
+REF_LANES(cmpgt_epi8,  1, r.xmmubyte(i) = (a.xmmsbyte(i) > b.xmmsbyte(i)) ? 0xff : 0)
+REF_LANES(cmpgt_epi16, 2, r.xmm16u(i) = (a.xmm16s(i) > b.xmm16s(i)) ? 0xffff : 0)
+REF_LANES(cmpgt_epi32, 4, r.xmm32u(i) = (a.xmm32s(i) > b.xmm32s(i)) ? 0xffffffff : 0)
+REF_LANES(min_epu8,    1, r.xmmubyte(i) = (a.xmmubyte(i) < b.xmmubyte(i)) ? a.xmmubyte(i) : b.xmmubyte(i))
+REF_LANES(max_epu8,    1, r.xmmubyte(i) = (a.xmmubyte(i) > b.xmmubyte(i)) ? a.xmmubyte(i) : b.xmmubyte(i))
+REF_LANES(min_epi16,   2, r.xmm16s(i) = (a.xmm16s(i) < b.xmm16s(i)) ? a.xmm16s(i) : b.xmm16s(i))
+REF_LANES(max_epi16,   2, r.xmm16s(i) = (a.xmm16s(i) > b.xmm16s(i)) ? a.xmm16s(i) : b.xmm16s(i))
+REF_LANES(avg_epu8,    1, r.xmmubyte(i) = (a.xmmubyte(i) + b.xmmubyte(i) + 1) >> 1)
+REF_LANES(avg_epu16,   2, r.xmm16u(i) = (a.xmm16u(i) + b.xmm16u(i) + 1) >> 1)
+REF_LANES(mullo_epi16, 2, r.xmm16u(i) = Bit32u(a.xmm16u(i)) * b.xmm16u(i))
+REF_LANES(mulhi_epu16, 2, r.xmm16u(i) = (Bit32u(a.xmm16u(i)) * b.xmm16u(i)) >> 16)
+REF_LANES(mulhi_epi16, 2, r.xmm16u(i) = Bit16u((Bit32s(a.xmm16s(i)) * b.xmm16s(i)) >> 16))
+REF_LANES(mul_epu32,   8, r.xmm64u(i) = Bit64u(a.xmm32u(2*i)) * b.xmm32u(2*i))
+REF_LANES(madd_epi16,  4, r.xmm32u(i) = Bit32u(Bit32s(a.xmm16s(2*i)) * b.xmm16s(2*i)) +
+                                        Bit32u(Bit32s(a.xmm16s(2*i+1)) * b.xmm16s(2*i+1)))
+REF_LANES(and_si128,   8, r.xmm64u(i) = a.xmm64u(i) & b.xmm64u(i))
+REF_LANES(andnot_si128, 8, r.xmm64u(i) = ~a.xmm64u(i) & b.xmm64u(i))
+REF_LANES(or_si128,    8, r.xmm64u(i) = a.xmm64u(i) | b.xmm64u(i))
+REF_LANES(xor_si128,   8, r.xmm64u(i) = a.xmm64u(i) ^ b.xmm64u(i))
+REF_LANES(sll_epi16,   2, r.xmm16u(i) = (SHIFT_COUNT > 15) ? 0 : a.xmm16u(i) << SHIFT_COUNT)
+REF_LANES(sll_epi32,   4, r.xmm32u(i) = (SHIFT_COUNT > 31) ? 0 : a.xmm32u(i) << SHIFT_COUNT)
+REF_LANES(sll_epi64,   8, r.xmm64u(i) = (SHIFT_COUNT > 63) ? 0 : a.xmm64u(i) << SHIFT_COUNT)
+REF_LANES(srl_epi16,   2, r.xmm16u(i) = (SHIFT_COUNT > 15) ? 0 : a.xmm16u(i) >> SHIFT_COUNT)
+REF_LANES(srl_epi32,   4, r.xmm32u(i) = (SHIFT_COUNT > 31) ? 0 : a.xmm32u(i) >> SHIFT_COUNT)
+REF_LANES(srl_epi64,   8, r.xmm64u(i) = (SHIFT_COUNT > 63) ? 0 : a.xmm64u(i) >> SHIFT_COUNT)
+REF_LANES(sra_epi16,   2, r.xmm16s(i) = a.xmm16s(i) >> ((SHIFT_COUNT > 15) ? 15 : SHIFT_COUNT))
+REF_LANES(sra_epi32,   4, r.xmm32s(i) = a.xmm32s(i) >> ((SHIFT_COUNT > 31) ? 31 : SHIFT_COUNT))
+REF_LANES(unpacklo_epi8,  1, r.xmmubyte(i) = (i & 1) ? b.xmmubyte(i/2) : a.xmmubyte(i/2))
+REF_LANES(unpackhi_epi8,  1, r.xmmubyte(i) = (i & 1) ? b.xmmubyte(i/2 + bytes/2) : a.xmmubyte(i/2 + bytes/2))
+REF_LANES(unpacklo_epi16, 2, r.xmm16u(i) = (i & 1) ? b.xmm16u(i/2) : a.xmm16u(i/2))
+REF_LANES(unpackhi_epi16, 2, r.xmm16u(i) = (i & 1) ? b.xmm16u(i/2 + bytes/4) : a.xmm16u(i/2 + bytes/4))
+REF_LANES(packs_epi16,  1, r.xmmsbyte(i) = SaturateWordSToByteS((i < bytes/2) ? a.xmm16s(i) : b.xmm16s(i - bytes/2)))
+REF_LANES(packus_epi16, 1, r.xmmubyte(i) = SaturateWordSToByteU((i < bytes/2) ? a.xmm16s(i) : b.xmm16s(i - bytes/2)))
+REF_LANES(packs_epi32,  2, r.xmm16s(i) = SaturateDwordSToWordS((i < bytes/4) ? a.xmm32s(i) : b.xmm32s(i - bytes/4)))
+
+static void ref_sad_epu8(BxPackedXmmRegister &r,
+  const BxPackedXmmRegister &a, const BxPackedXmmRegister &b, unsigned bytes)
+{
+  for (unsigned q = 0; q < bytes / 8; q++) {
+    Bit16u temp = 0;
+    for (unsigned i = q * 8; i < q * 8 + 8; i++)
+      temp += abs(a.xmmubyte(i) - b.xmmubyte(i));
+    r.xmm64u(q) = temp;
+  }
+}
+
+#define INT_XMM 1
+#define INT_MMX 2
+
+// the operations of cpu/sse.cc (XMM) and cpu/mmx.cc (MMX)
+#define INT_OPS(X)                              \
+  X(add_epi8,       INT_XMM | INT_MMX)          \
+  X(add_epi16,      INT_XMM | INT_MMX)          \
+  X(add_epi32,      INT_XMM | INT_MMX)          \
+  X(add_epi64,      INT_XMM | INT_MMX)          \
+  X(sub_epi8,       INT_XMM | INT_MMX)          \
+  X(sub_epi16,      INT_XMM | INT_MMX)          \
+  X(sub_epi32,      INT_XMM | INT_MMX)          \
+  X(sub_epi64,      INT_XMM | INT_MMX)          \
+  X(adds_epi8,      INT_XMM | INT_MMX)          \
+  X(adds_epi16,     INT_XMM | INT_MMX)          \
+  X(adds_epu8,      INT_XMM | INT_MMX)          \
+  X(adds_epu16,     INT_XMM | INT_MMX)          \
+  X(subs_epi8,      INT_XMM | INT_MMX)          \
+  X(subs_epi16,     INT_XMM | INT_MMX)          \
+  X(subs_epu8,      INT_XMM | INT_MMX)          \
+  X(subs_epu16,     INT_XMM | INT_MMX)          \
+  X(cmpeq_epi8,     INT_XMM | INT_MMX)          \
+  X(cmpeq_epi16,    INT_XMM | INT_MMX)          \
+  X(cmpeq_epi32,    INT_XMM | INT_MMX)          \
+  X(cmpgt_epi8,     INT_XMM | INT_MMX)          \
+  X(cmpgt_epi16,    INT_XMM | INT_MMX)          \
+  X(cmpgt_epi32,    INT_XMM | INT_MMX)          \
+  X(min_epu8,       INT_XMM | INT_MMX)          \
+  X(max_epu8,       INT_XMM | INT_MMX)          \
+  X(min_epi16,      INT_XMM | INT_MMX)          \
+  X(max_epi16,      INT_XMM | INT_MMX)          \
+  X(avg_epu8,       INT_XMM | INT_MMX)          \
+  X(avg_epu16,      INT_XMM | INT_MMX)          \
+  X(mullo_epi16,    INT_XMM | INT_MMX)          \
+  X(mulhi_epu16,    INT_XMM | INT_MMX)          \
+  X(mulhi_epi16,    INT_XMM | INT_MMX)          \
+  X(mul_epu32,      INT_XMM | INT_MMX)          \
+  X(madd_epi16,     INT_XMM | INT_MMX)          \
+  X(sad_epu8,       INT_XMM | INT_MMX)          \
+  X(and_si128,      INT_MMX)                    \
+  X(andnot_si128,   INT_MMX)                    \
+  X(or_si128,       INT_MMX)                    \
+  X(xor_si128,      INT_MMX)                    \
+  X(sll_epi16,      INT_XMM | INT_MMX)          \
+  X(sll_epi32,      INT_XMM | INT_MMX)          \
+  X(sll_epi64,      INT_XMM | INT_MMX)          \
+  X(srl_epi16,      INT_XMM | INT_MMX)          \
+  X(srl_epi32,      INT_XMM | INT_MMX)          \
+  X(srl_epi64,      INT_XMM | INT_MMX)          \
+  X(sra_epi16,      INT_XMM | INT_MMX)          \
+  X(sra_epi32,      INT_XMM | INT_MMX)          \
+  X(unpacklo_epi8,  INT_XMM)                    \
+  X(unpackhi_epi8,  INT_XMM)                    \
+  X(unpacklo_epi16, INT_XMM)                    \
+  X(unpackhi_epi16, INT_XMM)                    \
+  X(packs_epi16,    INT_XMM)                    \
+  X(packus_epi16,   INT_XMM)                    \
+  X(packs_epi32,    INT_XMM)
+
+#define HOST_INT_OP(name, forms)                                        \
+static void host_##name(BxPackedXmmRegister &r,                         \
+  const BxPackedXmmRegister &a, const BxPackedXmmRegister &b, unsigned bytes) \
+{                                                                       \
+  if (bytes == 16)                                                      \
+    BX_HOST_SIMD_XMM(r, a, b, _mm_##name);                              \
+  else                                                                  \
+    BX_HOST_SIMD_MMX(r, a, b, _mm_##name);                              \
+}
+
+INT_OPS(HOST_INT_OP)
+
+#define INT_OP_ENTRY(name, forms) { #name, forms, host_##name, ref_##name },
+
+static struct {
+  const char *name;
+  unsigned forms;
+  int_func_t host;
+  int_func_t ref;
+} int_ops[] = {
+  INT_OPS(INT_OP_ENTRY)
+};
+
+#define NUM_INT_OPS (sizeof(int_ops) / sizeof(int_ops[0]))
+
+static Bit8u random_byte(void)
+{
+  static const Bit8u special[5] = { 0x00, 0xff, 0x80, 0x7f, 0x01 };
+  unsigned n = rnd(8);
+  return (n < 5) ? special[n] : (Bit8u) rnd64();
+}
+
+static void random_int_operands(BxPackedXmmRegister &a, BxPackedXmmRegister &b, bx_bool shift)
+{
+  for (unsigned i = 0; i < 16; i++) {
+    a.xmmubyte(i) = random_byte();
+    // equal lanes for the compares, min/max and the subtractions
+    b.xmmubyte(i) = rnd(4) ? random_byte() : a.xmmubyte(i);
+  }
+
+  if (shift) {
+    switch(rnd(4)) {
+      case 0:  // out of range, also in the upper bytes of the count
+        b.xmm64u(0) = rnd64() >> rnd(64);
+        break;
+      case 1:
+        b.xmm64u(0) = 60 + rnd(8);
+        break;
+      default: // all in range counts and the first ones beyond the limits
+        b.xmm64u(0) = rnd(34);
+        break;
+    }
+  }
+}
+
+static unsigned long fuzz_int(unsigned long iterations)
+{
+  unsigned long mismatches = 0;
+
+  for (unsigned long n = 0; n < iterations; n++) {
+    unsigned op = rnd(NUM_INT_OPS);
+    unsigned forms = int_ops[op].forms;
+    unsigned bytes = (forms == INT_XMM || (forms & INT_XMM && rnd(2))) ? 16 : 8;
+
+    BxPackedXmmRegister a, b, ref_r, host_r;
+    random_int_operands(a, b, !strncmp(int_ops[op].name + 1, "l_", 2) ||
+                              !strncmp(int_ops[op].name + 1, "rl_", 3) ||
+                              !strncmp(int_ops[op].name + 1, "ra_", 3));
+    // the MMX form must not touch the upper half
+    ref_r.xmm64u(0) = host_r.xmm64u(0) = rnd64();
+    ref_r.xmm64u(1) = host_r.xmm64u(1) = rnd64();
+
+    int_ops[op].ref(ref_r, a, b, bytes);
+    int_ops[op].host(host_r, a, b, bytes);
+
+    if (memcmp(&ref_r, &host_r, sizeof(BxPackedXmmRegister)) != 0) {
+      if (mismatches++ < 20) {
+        printf("%s %s:", int_ops[op].name, (bytes == 16) ? "xmm" : "mmx");
+        print_xmm("a", a);
+        print_xmm("b", b);
+        print_xmm("ref", ref_r);
+        print_xmm("host", host_r);
+        printf("\n");
+      }
+    }
+  }
+
+  return mismatches;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// floating point operations
+/////////////////////////////////////////////////////////////////////////
+
+// as in sse_pfp.cc
+BX_CPP_INLINE void mxcsr_to_softfloat_status_word(float_status_t &status, bx_mxcsr_t mxcsr)
+{
+  status.float_exception_flags = 0; // clear exceptions before execution
+  status.float_nan_handling_mode = float_first_operand_nan;
+  status.float_rounding_mode = mxcsr.get_rounding_mode();
+  // if underflow is masked and FUZ is 1, set it to 1, else to 0
+  status.flush_underflow_to_zero =
+       (mxcsr.get_flush_masked_underflow() && mxcsr.get_UM()) ? 1 : 0;
+  status.float_exception_masks = mxcsr.get_exceptions_masks();
+}
+
+typedef float32 (*soft32_func_t)(float32, float32, float_status_t &);
+typedef float64 (*soft64_func_t)(float64, float64, float_status_t &);
+typedef void (*host_fp_func_t)(BxPackedXmmRegister &op1, BxPackedXmmRegister &op2, Bit32u &mxcsr);
+
+// MINxx/MAXxx return the second operand unless the first one is less
+// (greater), the square root instructions only use the second operand
+static float32 soft_min32(float32 a, float32 b, float_status_t &status)
+  { return (float32_compare(a, b, status) == float_relation_less) ? a : b; }
+static float64 soft_min64(float64 a, float64 b, float_status_t &status)
+  { return (float64_compare(a, b, status) == float_relation_less) ? a : b; }
+static float32 soft_max32(float32 a, float32 b, float_status_t &status)
+  { return (float32_compare(a, b, status) == float_relation_greater) ? a : b; }
+static float64 soft_max64(float64 a, float64 b, float_status_t &status)
+  { return (float64_compare(a, b, status) == float_relation_greater) ? a : b; }
+static float32 soft_sqrt32(float32 a, float32 b, float_status_t &status)
+  { return float32_sqrt(b, status); }
+static float64 soft_sqrt64(float64 a, float64 b, float_status_t &status)
+  { return float64_sqrt(b, status); }
+
+#define HOST_FP_PACKED_OPS(name, func)                                   \
+static void host_##name##ps(BxPackedXmmRegister &op1, BxPackedXmmRegister &op2, Bit32u &mxcsr) \
+  { BX_HOST_SIMD_FP(ps, mxcsr, op1, op2, func##_ps); }                   \
+static void host_##name##pd(BxPackedXmmRegister &op1, BxPackedXmmRegister &op2, Bit32u &mxcsr) \
+  { BX_HOST_SIMD_FP(pd, mxcsr, op1, op2, func##_pd); }
+
+#define HOST_FP_OPS(name, func)                                          \
+HOST_FP_PACKED_OPS(name, func)                                           \
+static void host_##name##ss(BxPackedXmmRegister &op1, BxPackedXmmRegister &op2, Bit32u &mxcsr) \
+  { BX_HOST_SIMD_FP(ss, mxcsr, op1.xmm32u(0), op2.xmm32u(0), func##_ss); } \
+static void host_##name##sd(BxPackedXmmRegister &op1, BxPackedXmmRegister &op2, Bit32u &mxcsr) \
+  { BX_HOST_SIMD_FP(sd, mxcsr, op1.xmm64u(0), op2.xmm64u(0), func##_sd); }
+
+HOST_FP_OPS(add, _mm_add)
+HOST_FP_OPS(sub, _mm_sub)
+HOST_FP_OPS(mul, _mm_mul)
+HOST_FP_OPS(div, _mm_div)
+HOST_FP_OPS(min, _mm_min)
+HOST_FP_OPS(max, _mm_max)
+HOST_FP_PACKED_OPS(sqrt, bx_host_sqrt)
+
+#define FP_OP_ENTRIES(name, soft32, soft64)                              \
+  { #name "ps", 32, 4, host_##name##ps, soft32, NULL },                  \
+  { #name "pd", 64, 2, host_##name##pd, NULL, soft64 },                  \
+  { #name "ss", 32, 1, host_##name##ss, soft32, NULL },                  \
+  { #name "sd", 64, 1, host_##name##sd, NULL, soft64 },
+
+// the SQRTSS/SQRTSD instructions have no host path
+#define FP_PACKED_OP_ENTRIES(name, soft32, soft64)                       \
+  { #name "ps", 32, 4, host_##name##ps, soft32, NULL },                  \
+  { #name "pd", 64, 2, host_##name##pd, NULL, soft64 },
+
+static struct {
+  const char *name;
+  unsigned size;
+  unsigned lanes;
+  host_fp_func_t host;
+  soft32_func_t soft32;
+  soft64_func_t soft64;
+} fp_ops[] = {
+  FP_OP_ENTRIES(add, float32_add, float64_add)
+  FP_OP_ENTRIES(sub, float32_sub, float64_sub)
+  FP_OP_ENTRIES(mul, float32_mul, float64_mul)
+  FP_OP_ENTRIES(div, float32_div, float64_div)
+  FP_OP_ENTRIES(min, soft_min32, soft_min64)
+  FP_OP_ENTRIES(max, soft_max32, soft_max64)
+  FP_PACKED_OP_ENTRIES(sqrt, soft_sqrt32, soft_sqrt64)
+};
+
+#define NUM_FP_OPS (sizeof(fp_ops) / sizeof(fp_ops[0]))
+
+// the softfloat code of sse_pfp.cc
+static void soft_fp_op(unsigned op, BxPackedXmmRegister &op1, BxPackedXmmRegister &op2, Bit32u &mxcsr)
+{
+  float_status_t status_word;
+  mxcsr_to_softfloat_status_word(status_word, bx_mxcsr_t(mxcsr));
+
+  for (unsigned i = 0; i < fp_ops[op].lanes; i++) {
+    if (fp_ops[op].size == 32)
+      op1.xmm32u(i) = fp_ops[op].soft32(op1.xmm32u(i), op2.xmm32u(i), status_word);
+    else
+      op1.xmm64u(i) = fp_ops[op].soft64(op1.xmm64u(i), op2.xmm64u(i), status_word);
+  }
+
+  // all exceptions are masked when the host path is taken
+  mxcsr |= status_word.float_exception_flags & MXCSR_EXCEPTIONS;
+}
+
+// short runs of ones and zeros make carries and ties far more likely
+static Bit64u random_fraction(void)
+{
+  switch(rnd(4)) {
+    case 0:
+      return rnd64() & ~(rnd64() << rnd(64));
+    case 1:
+      return rnd64() | (rnd64() >> rnd(64));
+    case 2:
+      return rnd64() & (BX_CONST64(0xffffffffffffffff) << rnd(64));
+    default:
+      return rnd64();
+  }
+}
+
+// a float32 (size 32) or float64 (size 64) operand
+static Bit64u random_float(unsigned size, Bit64u other)
+{
+  unsigned frac_bits = (size == 32) ? 23 : 52;
+  unsigned max_exp = (size == 32) ? 0xff : 0x7ff;
+  unsigned bias = max_exp >> 1;
+  Bit64u frac_mask = (BX_CONST64(1) << frac_bits) - 1;
+  Bit64u sign = (Bit64u) rnd(2) << (size - 1);
+  Bit64u frac = random_fraction() & frac_mask;
+  unsigned other_exp = (unsigned)(other >> frac_bits) & max_exp;
+  unsigned exp;
+
+  switch(rnd(16)) {
+    case 0:  // zero
+      return sign;
+    case 1:  // denormal
+      return sign | (frac ? frac : 1);
+    case 2:  // infinity
+      return sign | ((Bit64u) max_exp << frac_bits);
+    case 3:  // quiet or signaling NaN
+      if (! (frac & (frac_mask >> 1))) frac |= 1;
+      return sign | ((Bit64u) max_exp << frac_bits) | frac;
+    case 4:  // near the underflow limit
+      exp = 1 + rnd(frac_bits + 2);
+      break;
+    case 5:  // near the overflow limit
+      exp = max_exp - 1 - rnd(frac_bits + 2);
+      break;
+    case 6:  // same magnitude as the other operand
+      return sign | ((other & ~(BX_CONST64(1) << (size - 1))) ^ (rnd64() >> (64 - frac_bits + rnd(frac_bits))));
+    case 7:
+    case 8:
+    case 9:  // close exponent
+      exp = other_exp + rnd(2 * frac_bits + 6) - (frac_bits + 3);
+      if (exp < 1 || exp >= max_exp) exp = bias;
+      break;
+    default: // any normal number, mostly of moderate magnitude
+      exp = rnd(2) ? (bias + rnd(64) - 32) : (1 + rnd(max_exp - 1));
+      break;
+  }
+
+  return sign | ((Bit64u) exp << frac_bits) | frac;
+}
+
+static void random_fp_operands(unsigned size, BxPackedXmmRegister &a, BxPackedXmmRegister &b)
+{
+  Bit64u one = (size == 32) ? 0x3f800000 : BX_CONST64(0x3ff0000000000000);
+
+  for (unsigned i = 0; i < 128 / size; i++) {
+    Bit64u x = random_float(size, one), y = random_float(size, x);
+    if (rnd(2)) { Bit64u t = x; x = y; y = t; }
+    if (size == 32) {
+      a.xmm32u(i) = (Bit32u) x;
+      b.xmm32u(i) = (Bit32u) y;
+    }
+    else {
+      a.xmm64u(i) = x;
+      b.xmm64u(i) = y;
+    }
+  }
+}
+
+static Bit32u random_mxcsr(void)
+{
+  Bit32u mxcsr = rnd(4) << 13;  // rounding control
+
+  // the host path is only taken with all exceptions masked, no DAZ and no FTZ
+  mxcsr |= rnd(8) ? MXCSR_MASKED_EXCEPTIONS : (rnd(64) << 7);
+  if (! rnd(8)) mxcsr |= MXCSR_DAZ;
+  if (! rnd(8)) mxcsr |= MXCSR_FLUSH_MASKED_UNDERFLOW;
+  // sticky flags of earlier operations
+  if (! rnd(4)) mxcsr |= rnd(64);
+  return mxcsr;
+}
+
+static unsigned long fuzz_fp(unsigned long iterations)
+{
+  unsigned long accepted[NUM_FP_OPS], total[NUM_FP_OPS], mismatches = 0;
+  memset(accepted, 0, sizeof(accepted));
+  memset(total, 0, sizeof(total));
+
+  for (unsigned long n = 0; n < iterations; n++) {
+    unsigned op = rnd(NUM_FP_OPS);
+    BxPackedXmmRegister a, b, soft_r, host_r, host_b;
+    random_fp_operands(fp_ops[op].size, a, b);
+
+    Bit32u mxcsr = random_mxcsr(), soft_mxcsr = mxcsr, host_mxcsr = mxcsr;
+    total[op]++;
+    if (! BX_HOST_SIMD_FP_MODE(mxcsr))
+      continue;
+    accepted[op]++;
+
+    soft_r = host_r = a;
+    host_b = b;
+    soft_fp_op(op, soft_r, b, soft_mxcsr);
+
+    // stale flags of earlier operations and a host rounding mode other
+    // than the guest one must neither leak into the guest MXCSR nor
+    // survive in the host mode
+    Bit32u host_mode = MXCSR_MASKED_EXCEPTIONS | (rnd(4) ? 0 : rnd(4) << 13);
+    _mm_setcsr(host_mode | (rnd(2) ? rnd(64) : 0));
+    fp_ops[op].host(host_r, host_b, host_mxcsr);
+    Bit32u host_mode_after = _mm_getcsr() & ~MXCSR_EXCEPTIONS;
+    _mm_setcsr(MXCSR_RESET);
+
+    if (memcmp(&soft_r, &host_r, sizeof(BxPackedXmmRegister)) != 0 ||
+        memcmp(&b, &host_b, sizeof(BxPackedXmmRegister)) != 0 ||
+        soft_mxcsr != host_mxcsr || host_mode_after != host_mode)
+    {
+      if (mismatches++ < 20) {
+        printf("%s rc=%d:", fp_ops[op].name, (mxcsr >> 13) & 3);
+        print_xmm("a", a);
+        print_xmm("b", b);
+        print_xmm("soft", soft_r);
+        print_xmm("host", host_r);
+        printf(" mxcsr=%04x soft=%04x host=%04x host mode=%04x after=%04x\n",
+          mxcsr, soft_mxcsr, host_mxcsr, host_mode, host_mode_after);
+      }
+    }
+  }
+
+  for (unsigned op = 0; op < NUM_FP_OPS; op++) {
+    printf("%s: %lu operations, %lu taken by the host\n",
+      fp_ops[op].name, total[op], accepted[op]);
+  }
+
+  return mismatches;
+}
+
+// a positive normal number of moderate magnitude, denormal operands and
+// results take a slow microcode path in the host
+static Bit64u random_normal(unsigned size)
+{
+  unsigned frac_bits = (size == 32) ? 23 : 52;
+  unsigned bias = (size == 32) ? 0x7f : 0x3ff;
+  Bit64u frac = random_fraction() & ((BX_CONST64(1) << frac_bits) - 1);
+
+  return ((Bit64u)(bias + rnd(64) - 32) << frac_bits) | frac;
+}
+
+// time both paths on operands and an MXCSR the host accepts
+static void benchmark(unsigned op)
+{
+  enum { N = 256, ROUNDS = 2000 };
+  static BxPackedXmmRegister a[N], b[N];
+
+  for (unsigned n = 0; n < N; n++) {
+    for (unsigned i = 0; i < 128 / fp_ops[op].size; i++) {
+      Bit64u x = random_normal(fp_ops[op].size);
+      Bit64u y = random_normal(fp_ops[op].size);
+      if (fp_ops[op].size == 32) {
+        a[n].xmm32u(i) = (Bit32u) x;
+        b[n].xmm32u(i) = (Bit32u) y;
+      }
+      else {
+        a[n].xmm64u(i) = x;
+        b[n].xmm64u(i) = y;
+      }
+    }
+  }
+
+  // round to nearest, the mode of almost all guest code
+  Bit32u mxcsr = MXCSR_RESET;
+  Bit64u sum = 0;
+  BxPackedXmmRegister r;
+
+  double start = get_time();
+  for (unsigned k = 0; k < ROUNDS; k++)
+    for (unsigned n = 0; n < N; n++) {
+      r = a[n];
+      soft_fp_op(op, r, b[n], mxcsr);
+      sum += r.xmm64u(0);
+    }
+  double soft_time = get_time() - start;
+
+  start = get_time();
+  for (unsigned k = 0; k < ROUNDS; k++)
+    for (unsigned n = 0; n < N; n++) {
+      r = a[n];
+      fp_ops[op].host(r, b[n], mxcsr);
+      sum += r.xmm64u(0);
+    }
+  double host_time = get_time() - start;
+
+  printf("%s: softfloat %.1f ns, host %.1f ns per instruction (%x)\n", fp_ops[op].name,
+    soft_time * 1e9 / (N * ROUNDS), host_time * 1e9 / (N * ROUNDS), (unsigned) sum & 0xf);
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long iterations = (argc > 1) ? strtoul(argv[1], NULL, 0) : 10000000;
+  rng_state = (argc > 2) ? strtoull(argv[2], NULL, 0) : BX_CONST64(0x9e3779b97f4a7c15);
+  if (! rng_state) rng_state = 1;
+
+  unsigned long int_mismatches = fuzz_int(iterations);
+  printf("integer: %lu operations, %lu mismatches\n", iterations, int_mismatches);
+  unsigned long fp_mismatches = fuzz_fp(iterations);
+  printf("floating point: %lu mismatches\n", fp_mismatches);
+
+  for (unsigned op = 0; op < NUM_FP_OPS; op++)
+    benchmark(op);
+
+  return (int_mismatches || fp_mismatches) ? 1 : 0;
+}
+
+#else
+
+int main(void)
+{
+  fprintf(stderr, "simd-fuzz: the host SSE2 path needs an SSE2 capable host compiler\n");
+  return 1;
+}
+
+#endif
@@ -0,0 +1,422 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// timer-bench.cc
+//
+// This program benchmarks the timer heap of bx_pc_system_c against a
+// model of the old countdownEvent(), which scanned all timer slots on
+// every expiry. The real bx_pc_system and the model are driven through
+// the same sequence of register, activate, deactivate and tickn() calls,
+// so besides the timing the program also checks that the heap fires the
+// same timers at the same ticks as the linear scan did.
+//
+// Build it with "make timer-bench" in a configured build directory, it is
+// linked with the Bochs objects except main.o. Then run
+// "timer-bench [seconds of emulated time]".
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "cpu/cpu.h"
+
+#include <sys/time.h>
+
+// The globals of main.cc, the benchmark does not start a simulation.
+static logfunctions thePluginLog;
+logfunctions *pluginlog = &thePluginLog;
+
+bx_startup_flags_t bx_startup_flags;
+bx_bool bx_user_quit;
+Bit8u bx_cpu_count;
+Bit32u apic_id_mask;
+bx_bool simulate_xapic;
+
+bx_pc_system_c bx_pc_system;
+
+bx_debug_t bx_dbg;
+
+#if BX_SUPPORT_SMP
+BOCHSAPI BX_CPU_C **bx_cpu_array = NULL;
+#else
+BOCHSAPI BX_CPU_C bx_cpu;
+#endif
+
+BOCHSAPI BX_MEM_C bx_mem;
+
+int bx_begin_simulation(int argc, char *argv[]) { return 0; }
+int bx_atexit(void) { return 0; }
+void bx_sr_after_restore_state(void) {}
+
+#if BX_SUPPORT_SMP_THREADS
+// there are no CPU threads, so the SMP lock is not needed
+__thread BX_CPU_C *bx_smp_self = NULL;
+volatile bx_bool bx_smp_reset_pending = 0;
+void bx_smp_lock(void) {}
+void bx_smp_unlock(void) {}
+void bx_smp_unlock_all(void) {}
+void bx_smp_request_reset(unsigned type) {}
+#endif
+
+#define NullTimerInterval 0xffffffff
+
+// emulated instructions per second, like the 'ips' option
+#define BENCH_IPS 50000000
+
+// the cpu loop advances time in chunks of this many ticks
+#define BENCH_TICKN 16
+
+// at most this many timers per mix
+#define BENCH_MAX_TIMERS 256
+
+class bench_sched_c;
+struct bench_timer_t;
+typedef void (*bench_handler_t)(bench_timer_t *t);
+
+// A device timer of the benchmark. The id is the registration order,
+// which is also the order of the timer slots in both schedulers.
+struct bench_timer_t {
+  bench_sched_c *sched;
+  unsigned id;
+  unsigned handle;  // timer index in the scheduler
+  Bit64u nominal;   // device period the handlers jitter around
+  bench_handler_t funct;
+};
+
+// The interface both schedulers are driven through, and the checksum
+// of the fired timers.
+class bench_sched_c {
+public:
+  bench_sched_c(): numTimers(0), fired(0), checksum(0) {}
+  virtual ~bench_sched_c() {}
+
+  bench_timer_t *register_timer_ticks(bench_handler_t funct, Bit64u ticks,
+                                      bx_bool continuous, bx_bool active)
+  {
+    if (numTimers == BENCH_MAX_TIMERS) {
+      fprintf(stderr, "too many timers\n");
+      exit(1);
+    }
+    bench_timer_t *t = &timers[numTimers];
+    t->sched = this;
+    t->id = ++numTimers;
+    t->nominal = ticks;
+    t->funct = funct;
+    t->handle = queue_register(t, ticks, continuous, active);
+    return t;
+  }
+
+  void fire(bench_timer_t *t)
+  {
+    fired++;
+    checksum = checksum * 1000003 + time_ticks() * 131 + t->id;
+    t->funct(t);
+  }
+
+  virtual unsigned queue_register(bench_timer_t *t, Bit64u ticks,
+                                  bx_bool continuous, bx_bool active) = 0;
+  virtual void activate_timer_ticks(bench_timer_t *t, Bit64u ticks, bx_bool continuous) = 0;
+  virtual void deactivate_timer(bench_timer_t *t) = 0;
+  virtual void tickn(Bit32u n) = 0;
+  virtual Bit64u time_ticks() = 0;
+
+  bench_timer_t timers[BENCH_MAX_TIMERS];
+  unsigned numTimers;
+  Bit64u fired, checksum;
+};
+
+// Model of the countdown event as it was before the timer heap: two
+// passes over all timer slots on every expiry.
+class bench_scan_c : public bench_sched_c {
+public:
+  bench_scan_c(): numSlots(1), currCountdown(NullTimerInterval),
+    currCountdownPeriod(NullTimerInterval), ticksTotal(0)
+  {
+    memset(slot, 0, sizeof(slot));
+    // the null timer
+    slot[0].active = 1;
+    slot[0].continuous = 1;
+    slot[0].period = NullTimerInterval;
+    slot[0].timeToFire = NullTimerInterval;
+  }
+
+  unsigned queue_register(bench_timer_t *t, Bit64u ticks,
+                          bx_bool continuous, bx_bool active)
+  {
+    unsigned i = numSlots++;
+    slot[i].timer = t;
+    slot[i].period = ticks;
+    slot[i].timeToFire = time_ticks() + ticks;
+    slot[i].active = active;
+    slot[i].continuous = continuous;
+    if (active) skew_countdown(ticks);
+    return i;
+  }
+
+  void activate_timer_ticks(bench_timer_t *t, Bit64u ticks, bx_bool continuous)
+  {
+    unsigned i = t->handle;
+    if (ticks < 1) ticks = 1;
+    slot[i].period = ticks;
+    slot[i].timeToFire = time_ticks() + ticks;
+    slot[i].continuous = continuous;
+    slot[i].active = 1;
+    skew_countdown(ticks);
+  }
+
+  void deactivate_timer(bench_timer_t *t) { slot[t->handle].active = 0; }
+
+  void tickn(Bit32u n)
+  {
+    while (n >= currCountdown) {
+      n -= currCountdown;
+      currCountdown = 0;
+      countdownEvent();
+    }
+    currCountdown -= n;
+  }
+
+  Bit64u time_ticks() {
+    return ticksTotal + Bit64u(currCountdownPeriod - currCountdown);
+  }
+
+private:
+  void skew_countdown(Bit64u ticks)
+  {
+    if (ticks < Bit64u(currCountdown)) {
+      currCountdownPeriod -= (currCountdown - Bit32u(ticks));
+      currCountdown = Bit32u(ticks);
+    }
+  }
+
+  void countdownEvent(void)
+  {
+    unsigned i, n, numTriggered = 0;
+    Bit64u minTimeToFire = (Bit64u) -1;
+
+    ticksTotal += Bit64u(currCountdownPeriod);
+
+    for (i=0; i < numSlots; i++) {
+      if (slot[i].active) {
+        if (ticksTotal == slot[i].timeToFire) {
+          triggered[numTriggered++] = i;
+          if (slot[i].continuous==0) {
+            slot[i].active = 0;
+          }
+          else {
+            slot[i].timeToFire += slot[i].period;
+            if (slot[i].timeToFire < minTimeToFire)
+              minTimeToFire = slot[i].timeToFire;
+          }
+        }
+        else {
+          if (slot[i].timeToFire < minTimeToFire)
+            minTimeToFire = slot[i].timeToFire;
+        }
+      }
+    }
+
+    currCountdown = currCountdownPeriod = Bit32u(minTimeToFire - ticksTotal);
+
+    for (n=0; n < numTriggered; n++) {
+      i = triggered[n];
+      if (i != 0) fire(slot[i].timer);
+    }
+  }
+
+  struct {
+    bx_bool active;
+    bx_bool continuous;
+    Bit64u  period;
+    Bit64u  timeToFire;
+    bench_timer_t *timer;
+  } slot[BENCH_MAX_TIMERS + 1];
+  unsigned triggered[BENCH_MAX_TIMERS + 1];
+  unsigned numSlots;
+  Bit32u currCountdown, currCountdownPeriod;
+  Bit64u ticksTotal;
+};
+
+// The real timers of bx_pc_system. The timers are unregistered again
+// when the mix is done, so the next mix starts from an empty system.
+class bench_pc_system_c : public bench_sched_c {
+public:
+  bench_pc_system_c() { bx_pc_system.initialize(BENCH_IPS); }
+  ~bench_pc_system_c()
+  {
+    while (numTimers > 0) {
+      bench_timer_t *t = &timers[--numTimers];
+      bx_pc_system.deactivate_timer(t->handle);
+      bx_pc_system.unregisterTimer(t->handle);
+    }
+  }
+
+  static void timer_handler(void *this_ptr)
+  {
+    bench_timer_t *t = (bench_timer_t *) this_ptr;
+    t->sched->fire(t);
+  }
+
+  unsigned queue_register(bench_timer_t *t, Bit64u ticks,
+                          bx_bool continuous, bx_bool active)
+  {
+    return bx_pc_system.register_timer_ticks(t, timer_handler, ticks,
+                                             continuous, active, "bench");
+  }
+
+  void activate_timer_ticks(bench_timer_t *t, Bit64u ticks, bx_bool continuous)
+  {
+    bx_pc_system.activate_timer_ticks(t->handle, ticks, continuous);
+  }
+
+  void deactivate_timer(bench_timer_t *t) { bx_pc_system.deactivate_timer(t->handle); }
+  void tickn(Bit32u n) { bx_pc_system_c::tickn(n); }
+  Bit64u time_ticks() { return bx_pc_system_c::time_ticks(); }
+};
+
+// ------------------------------------------------------------------
+// Timer mixes.  The periods follow what the device models register
+// with the default 'ips' setting; one-shot timers re-arm themselves
+// from their handler like the serial and network models do.
+// ------------------------------------------------------------------
+
+#define USEC(u) (Bit64u(u) * (BENCH_IPS / 1000000))
+
+struct bench_device_t {
+  const char *name;
+  Bit64u period;
+  bx_bool continuous;
+  unsigned count;
+};
+
+// simple deterministic generator, so both schedulers see the same mix
+static Bit32u bench_rand_state;
+static Bit32u bench_rand(void)
+{
+  bench_rand_state = bench_rand_state * 1103515245 + 12345;
+  return bench_rand_state >> 8;
+}
+
+// one-shot device timer: re-arm with a jittered period (serial tx/rx,
+// NIC receive, hard drive iolight)
+static void oneshot_handler(bench_timer_t *t)
+{
+  Bit64u base = t->nominal;
+  t->sched->activate_timer_ticks(t, base / 2 + bench_rand() % (base + 1), 0);
+}
+
+// continuous device timer: occasionally reprogrammed by the guest
+// (PIT, APIC timer)
+static void periodic_handler(bench_timer_t *t)
+{
+  if ((bench_rand() & 0xff) == 0) {
+    t->sched->deactivate_timer(t);
+    t->sched->activate_timer_ticks(t, t->nominal, 1);
+  }
+}
+
+static const bench_device_t idle_mix[] = {
+  { "pit",        USEC(1000),   1, 1 },
+  { "apic",       USEC(10000),  1, 1 },
+  { "cmos",       USEC(1000000),1, 1 },
+  { "vga",        USEC(40000),  1, 1 },
+  { "keyboard",   USEC(1000),   1, 1 },
+  { "hd_iolight", USEC(5000),   0, 1 },
+  { "serial",     USEC(100),    0, 0 },
+  { "ne2k",       USEC(2000),   0, 0 },
+  { NULL, 0, 0, 0 }
+};
+
+static const bench_device_t busy_mix[] = {
+  { "pit",        USEC(1000),   1, 1 },
+  { "apic",       USEC(1000),   1, 2 },
+  { "cmos",       USEC(1000000),1, 1 },
+  { "vga",        USEC(40000),  1, 1 },
+  { "keyboard",   USEC(1000),   1, 1 },
+  { "hd_iolight", USEC(5000),   0, 2 },
+  { "serial",     USEC(100),    0, 4 },
+  { "ne2k",       USEC(200),    0, 2 },
+  { "usb",        USEC(1000),   1, 2 },
+  { "sb16",       USEC(500),    1, 1 },
+  { "dma",        USEC(50),     0, 1 },
+  { NULL, 0, 0, 0 }
+};
+
+// more timers than the old fixed limit of 64 slots
+static const bench_device_t many_mix[] = {
+  { "pit",        USEC(1000),   1, 1 },
+  { "apic",       USEC(1000),   1, 8 },
+  { "vga",        USEC(40000),  1, 1 },
+  { "serial",     USEC(100),    0, 32 },
+  { "ne2k",       USEC(200),    0, 32 },
+  { "idle",       USEC(1000000),0, 64 },
+  { NULL, 0, 0, 0 }
+};
+
+static double now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void run(const char *mixname, const bench_device_t *mix,
+                bench_sched_c *sched, const char *schedname, unsigned seconds,
+                Bit64u *fired, Bit64u *checksum)
+{
+  bench_rand_state = 1;
+  for (unsigned d=0; mix[d].name != NULL; d++) {
+    for (unsigned c=0; c < mix[d].count; c++) {
+      // idle one-shot timers stay registered but inactive
+      bx_bool active = mix[d].continuous || strcmp(mix[d].name, "idle");
+      sched->register_timer_ticks(mix[d].continuous ? periodic_handler : oneshot_handler,
+                                  mix[d].period, mix[d].continuous, active);
+    }
+  }
+
+  Bit64u total = Bit64u(seconds) * BENCH_IPS;
+  double start = now();
+  for (Bit64u t = 0; t < total; t += BENCH_TICKN)
+    sched->tickn(BENCH_TICKN);
+  double elapsed = now() - start;
+
+  printf("%-6s %-5s timers=%-4u fired=%-10llu time=%.3fs (%.1f ns/event)\n",
+         mixname, schedname, sched->numTimers, (unsigned long long) sched->fired,
+         elapsed, elapsed * 1e9 / (sched->fired ? sched->fired : 1));
+  *fired = sched->fired;
+  *checksum = sched->checksum;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned seconds = (argc > 1) ? atoi(argv[1]) : 10;
+  static const struct {
+    const char *name;
+    const bench_device_t *mix;
+  } mixes[] = {
+    { "idle", idle_mix },
+    { "busy", busy_mix },
+    { "many", many_mix }
+  };
+  int mismatches = 0;
+
+  printf("%u seconds of emulated time at %u ips, tickn(%u)\n",
+         seconds, BENCH_IPS, BENCH_TICKN);
+  for (unsigned m=0; m < sizeof(mixes)/sizeof(mixes[0]); m++) {
+    Bit64u fired[2], checksum[2];
+    {
+      bench_scan_c scan;
+      run(mixes[m].name, mixes[m].mix, &scan, "scan", seconds, &fired[0], &checksum[0]);
+    }
+    {
+      bench_pc_system_c heap;
+      run(mixes[m].name, mixes[m].mix, &heap, "heap", seconds, &fired[1], &checksum[1]);
+    }
+    if (fired[0] != fired[1] || checksum[0] != checksum[1]) {
+      printf("%s: MISMATCH between scan and heap\n", mixes[m].name);
+      mismatches++;
+    }
+  }
+  printf("mismatches=%d\n", mismatches);
+  return mismatches != 0;
+}
@@ -31,6 +31,8 @@
 #define BXPN_BOCHS_BENCHMARK             "general.benchmark"
 #define BXPN_RESTORE_FLAG                "general.restore"
 #define BXPN_RESTORE_PATH                "general.restore_path"
+#define BXPN_CHECKPOINT_INTERVAL         "general.checkpoint"
+#define BXPN_CHECKPOINT_PATH             "general.checkpoint_path"
 #define BXPN_DEBUG_RUNNING               "general.debug_running"
 #define BXPN_CPU_NPROCESSORS             "cpu.n_processors"
 #define BXPN_CPU_NCORES                  "cpu.n_cores"
@@ -40,6 +42,9 @@
 #define BXPN_RESET_ON_TRIPLE_FAULT       "cpu.reset_on_triple_fault"
 #define BXPN_IGNORE_BAD_MSRS             "cpu.ignore_bad_msrs"
 #define BXPN_CONFIGURABLE_MSRS_PATH      "cpu.msrs"
+#define BXPN_CPU_TLB_SIZE                "cpu.tlb_size"
+#define BXPN_CPU_TLB_ASIDS               "cpu.tlb_asids"
+#define BXPN_CPU_STATS_FILE              "cpu.stats_file"
 #define BXPN_VENDOR_STRING               "cpuid.vendor_string"
 #define BXPN_BRAND_STRING                "cpuid.brand_string"
 #define BXPN_CPUID_STEPPING              "cpuid.stepping"
@@ -58,6 +63,8 @@
 #define BXPN_CPUID_FSGSBASE              "cpuid.fsgsbase"
 #define BXPN_MEM_SIZE                    "memory.standard.ram.size"
 #define BXPN_HOST_MEM_SIZE               "memory.standard.ram.host_size"
+#define BXPN_MEM_FILE                    "memory.standard.ram.file"
+#define BXPN_MEM_FILE_MODE               "memory.standard.ram.file_mode"
 #define BXPN_ROM_PATH                    "memory.standard.rom.path"
 #define BXPN_ROM_ADDRESS                 "memory.standard.rom.addr"
 #define BXPN_VGA_ROM_PATH                "memory.standard.vgarom.path"
@@ -160,6 +167,7 @@
 #define BXPN_PORT_E9_HACK                "misc.port_e9_hack"
 #define BXPN_TEXT_SNAPSHOT_CHECK         "misc.text_snapshot_check"
 #define BXPN_GDBSTUB                     "misc.gdbstub"
+#define BXPN_PROFILER                    "misc.profiler"
 #define BXPN_PLUGIN_CTRL                 "misc.plugin_ctrl"
 #define BXPN_LOG_FILENAME                "log.filename"
 #define BXPN_LOG_PREFIX                  "log.prefix"
@@ -173,5 +181,6 @@
 #define BXPN_WX_CPU_STATE                "wxdebug.cpu"
 #define BXPN_WX_CPU0_STATE               "wxdebug.cpu.0"
 #define BXPN_WX_CPU0_EFLAGS_IOPL         "wxdebug.cpu.0.IOPL"
+#define BXPN_STATISTICS                  "statistics"
 
 #endif
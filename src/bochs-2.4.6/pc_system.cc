@@ -55,19 +55,28 @@ bx_pc_system_c::bx_pc_system_c()
   // case here.  It should never be turned off or modified, and its
   // duration should always remain the same.
   ticksTotal = 0; // Reset ticks since emulator started.
-  timer[0].inUse      = 1;
-  timer[0].period     = NullTimerInterval;
-  timer[0].active     = 1;
-  timer[0].continuous = 1;
-  timer[0].funct      = nullTimer;
-  timer[0].this_ptr   = this;
+  timerChunk = NULL;
+  numTimerChunks = 0;
+  timerHeap = NULL;
+  timerHeapSize = 0;
+  timerTriggered = NULL;
+  allocTimerChunk();
+  timer(0).inUse      = 1;
+  timer(0).period     = NullTimerInterval;
+  timer(0).timeToFire = NullTimerInterval;
+  timer(0).active     = 1;
+  timer(0).continuous = 1;
+  timer(0).funct      = nullTimer;
+  timer(0).this_ptr   = this;
   numTimers = 1; // So far, only the nullTimer.
+  heapInsert(0);
 }
 
 void bx_pc_system_c::initialize(Bit32u ips)
 {
   ticksTotal = 0;
-  timer[0].timeToFire = NullTimerInterval;
+  timer(0).timeToFire = NullTimerInterval;
+  rebuildTimerHeap();
   currCountdown       = NullTimerInterval;
   currCountdownPeriod = NullTimerInterval;
   lastTimeUsec = 0;
@@ -75,6 +84,8 @@ void bx_pc_system_c::initialize(Bit32u ips)
   triggeredTimer = 0;
   HRQ = 0;
   kill_bochs_request = 0;
+  state_ops_pending = 0;
+  rollback_count = 0;
 
   // parameter 'ips' is the processor speed in Instructions-Per-Second
   m_ips = double(ips) / 1000000.0L;
@@ -86,7 +97,38 @@ void bx_pc_system_c::set_HRQ(bx_bool val)
 {
   HRQ = val;
   if (val)
-    BX_CPU(0)->async_event = 1;
+    BX_CPU(0)->set_async_event(1);
+}
+
+// Saving the state, taking a checkpoint or rolling back to it must see (or
+// replace) a consistent CPU state, so it cannot run from a device handler or
+// a timer callback in the middle of an instruction. All CPUs are stopped at the next instruction boundary, where
+// handleAsyncEvent() (or the simulation thread, with one host thread per
+// CPU) calls handle_state_ops() and restarts the CPU loop.
+void bx_pc_system_c::request_state_op(Bit32u op)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  state_ops_pending |= op;
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+    BX_CPU(i)->set_async_event(1);
+}
+
+void bx_pc_system_c::handle_state_ops(void)
+{
+  Bit32u ops = state_ops_pending;
+  state_ops_pending = 0;
+
+  if (ops & BX_STATE_OP_SAVE)
+    save_checkpoint();
+  if (ops & BX_STATE_OP_CHECKPOINT) {
+    if (SIM->checkpoint_state())
+      rollback_count = 0;
+  }
+  if (ops & BX_STATE_OP_ROLLBACK) {
+    if (SIM->rollback_state())
+      rollback_count++;
+  }
 }
 
 void bx_pc_system_c::set_INTR(bx_bool value)
@@ -171,18 +213,40 @@ bx_bool bx_pc_system_c::get_enable_a20(void)
 
 void bx_pc_system_c::MemoryMappingChanged(void)
 {
-  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP_THREADS
+    if (BX_SMP_REMOTE_CPU(BX_CPU(i))) {
+      BX_CPU(i)->post_remote_request(BX_REMOTE_TLB_FLUSH);
+      continue;
+    }
+#endif
     BX_CPU(i)->TLB_flush();
+  }
 }
 
 void bx_pc_system_c::invlpg(bx_address addr)
 {
-  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP_THREADS
+    if (BX_SMP_REMOTE_CPU(BX_CPU(i))) {
+      BX_CPU(i)->post_remote_request(BX_REMOTE_TLB_FLUSH);
+      continue;
+    }
+#endif
     BX_CPU(i)->TLB_invlpg(addr);
+  }
 }
 
 int bx_pc_system_c::Reset(unsigned type)
 {
+#if BX_SUPPORT_SMP_THREADS
+  if (bx_smp_self) {
+    // the other CPUs are running, reset the machine once they stopped
+    bx_smp_request_reset(type);
+    return(0);
+  }
+#endif
+
   // type is BX_RESET_HARDWARE or BX_RESET_SOFTWARE
   BX_INFO(("bx_pc_system_c::Reset(%s) called",type==BX_RESET_HARDWARE?"HARDWARE":"SOFTWARE"));
 
@@ -209,7 +273,13 @@ Bit8u bx_pc_system_c::IAC(void)
 void bx_pc_system_c::exit(void)
 {
   // delete all registered timers (exception: null timer and APIC timer)
+  for (unsigned i = 1 + BX_SUPPORT_APIC; i < numTimers; i++) {
+    // a device might still deactivate its timer later on
+    timer(i).active = 0;
+    timer(i).inUse = 0;
+  }
   numTimers = 1 + BX_SUPPORT_APIC;
+  rebuildTimerHeap();
   bx_devices.exit();
   if (bx_gui) {
     bx_gui->cleanup();
@@ -234,14 +304,20 @@ void bx_pc_system_c::register_state(void)
     char name[4];
     sprintf(name, "%d", i);
     bx_list_c *bxtimer = new bx_list_c(timers, name, 5);
-    BXRS_PARAM_BOOL(bxtimer, inUse, timer[i].inUse);
-    BXRS_DEC_PARAM_FIELD(bxtimer, period, timer[i].period);
-    BXRS_DEC_PARAM_FIELD(bxtimer, timeToFire, timer[i].timeToFire);
-    BXRS_PARAM_BOOL(bxtimer, active, timer[i].active);
-    BXRS_PARAM_BOOL(bxtimer, continuous, timer[i].continuous);
+    BXRS_PARAM_BOOL(bxtimer, inUse, timer(i).inUse);
+    BXRS_DEC_PARAM_FIELD(bxtimer, period, timer(i).period);
+    BXRS_DEC_PARAM_FIELD(bxtimer, timeToFire, timer(i).timeToFire);
+    BXRS_PARAM_BOOL(bxtimer, active, timer(i).active);
+    BXRS_PARAM_BOOL(bxtimer, continuous, timer(i).continuous);
   }
 }
 
+void bx_pc_system_c::after_restore_state(void)
+{
+  // the active flags and fire times were replaced behind our back
+  rebuildTimerHeap();
+}
+
 // ================================================
 // Bochs internal timer delivery framework features
 // ================================================
@@ -270,33 +346,35 @@ int bx_pc_system_c::register_timer_ticks(void* this_ptr, bx_timer_handler_t func
 
   // search for new timer for i=1, i=0 is reserved for NullTimer
   for (i=1; i < numTimers; i++) {
-    if (timer[i].inUse == 0)
+    if (timer(i).inUse == 0)
       break;
   }
 
 #if BX_TIMER_DEBUG
   if (i==0)
     BX_PANIC(("register_timer: cannot register NullTimer again!"));
-  if (numTimers >= BX_MAX_TIMERS)
-    BX_PANIC(("register_timer: too many registered timers"));
   if (this_ptr == NULL)
     BX_PANIC(("register_timer_ticks: this_ptr is NULL!"));
   if (funct == NULL)
     BX_PANIC(("register_timer_ticks: funct is NULL!"));
 #endif
 
-  timer[i].inUse      = 1;
-  timer[i].period     = ticks;
-  timer[i].timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) +
+  if (i == (numTimerChunks << BX_TIMER_CHUNK_SHIFT))
+    allocTimerChunk();
+
+  timer(i).inUse      = 1;
+  timer(i).period     = ticks;
+  timer(i).timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) +
                         ticks;
-  timer[i].active     = active;
-  timer[i].continuous = continuous;
-  timer[i].funct      = funct;
-  timer[i].this_ptr   = this_ptr;
-  strncpy(timer[i].id, id, BxMaxTimerIDLen);
-  timer[i].id[BxMaxTimerIDLen-1] = 0; // Null terminate if not already.
+  timer(i).active     = active;
+  timer(i).continuous = continuous;
+  timer(i).funct      = funct;
+  timer(i).this_ptr   = this_ptr;
+  strncpy(timer(i).id, id, BxMaxTimerIDLen);
+  timer(i).id[BxMaxTimerIDLen-1] = 0; // Null terminate if not already.
 
   if (active) {
+    heapInsert(i);
     if (ticks < Bit64u(currCountdown)) {
       // This new timer needs to fire before the current countdown.
       // Skew the current countdown and countdown period to be smaller
@@ -317,9 +395,7 @@ int bx_pc_system_c::register_timer_ticks(void* this_ptr, bx_timer_handler_t func
 
 void bx_pc_system_c::countdownEvent(void)
 {
-  unsigned i;
-  Bit64u   minTimeToFire;
-  bx_bool  triggered[BX_MAX_TIMERS];
+  unsigned i, n, numTriggered = 0;
 
   // The countdown decremented to 0.  We need to service all the active
   // timers, and invoke callbacks from those timers which have fired.
@@ -331,53 +407,56 @@ void bx_pc_system_c::countdownEvent(void)
   // Increment global ticks counter by number of ticks which have
   // elapsed since the last update.
   ticksTotal += Bit64u(currCountdownPeriod);
-  minTimeToFire = (Bit64u) -1;
 
-  for (i=0; i < numTimers; i++) {
-    triggered[i] = 0; // Reset triggered flag.
-    if (timer[i].active) {
-#if BX_TIMER_DEBUG
-      if (ticksTotal > timer[i].timeToFire)
-        BX_PANIC(("countdownEvent: ticksTotal > timeToFire[%u], D " FMT_LL "u", i,
-                  timer[i].timeToFire-ticksTotal));
-#endif
-      if (ticksTotal == timer[i].timeToFire) {
-        // This timer is ready to fire.
-        triggered[i] = 1;
-
-        if (timer[i].continuous==0) {
-          // If triggered timer is one-shot, deactive.
-          timer[i].active = 0;
-        }
-        else {
-          // Continuous timer, increment time-to-fire by period.
-          timer[i].timeToFire += timer[i].period;
-          if (timer[i].timeToFire < minTimeToFire)
-            minTimeToFire = timer[i].timeToFire;
-        }
-      }
-      else {
-        // This timer is not ready to fire yet.
-        if (timer[i].timeToFire < minTimeToFire)
-          minTimeToFire = timer[i].timeToFire;
-      }
+  // The null timer is always active, so the heap is never empty.
+  // Only the timers which fire now are touched.
+  while (timer(timerHeap[0]).timeToFire == ticksTotal) {
+    i = timerHeap[0];
+    // This timer is ready to fire.
+    timerTriggered[numTriggered++] = i;
+
+    if (timer(i).continuous==0) {
+      // If triggered timer is one-shot, deactive.
+      timer(i).active = 0;
+      heapRemove(i);
+    }
+    else {
+      // Continuous timer, increment time-to-fire by period.
+      timer(i).timeToFire += timer(i).period;
+      heapSiftDown(0);
     }
   }
 
+#if BX_TIMER_DEBUG
+  if (ticksTotal > timer(timerHeap[0]).timeToFire)
+    BX_PANIC(("countdownEvent: ticksTotal > timeToFire[%u], D " FMT_LL "u", timerHeap[0],
+              timer(timerHeap[0]).timeToFire-ticksTotal));
+#endif
+
   // Calculate next countdown period.  We need to do this before calling
   // any of the callbacks, as they may call timer features, which need
   // to be advanced to the next countdown cycle.
   currCountdown = currCountdownPeriod =
-      Bit32u(minTimeToFire - ticksTotal);
+      Bit32u(timer(timerHeap[0]).timeToFire - ticksTotal);
+
+  // Call the handlers in timer index order, so the order of simultaneous
+  // events does not depend on the heap layout.
+  for (n=1; n < numTriggered; n++) {
+    i = timerTriggered[n];
+    unsigned k = n;
+    for (; k > 0 && timerTriggered[k-1] > i; k--)
+      timerTriggered[k] = timerTriggered[k-1];
+    timerTriggered[k] = i;
+  }
 
-  for (i=0; i < numTimers; i++) {
+  for (n=0; n < numTriggered; n++) {
     // Call requested timer function.  It may request a different
-    // timer period or deactivate etc.
-    if (triggered[i]) {
-      triggeredTimer = i;
-      timer[i].funct(timer[i].this_ptr);
-      triggeredTimer = 0;
-    }
+    // timer period or deactivate etc.  A handler registering a new
+    // timer may move timerTriggered, so it is read again every time.
+    i = timerTriggered[n];
+    triggeredTimer = i;
+    timer(i).funct(timer(i).this_ptr);
+    triggeredTimer = 0;
   }
 }
 
@@ -398,10 +477,10 @@ void bx_pc_system_c::nullTimer(void* this_ptr)
 #if SpewPeriodicTimerInfo
   BX_INFO(("==================================="));
   for (unsigned i=0; i < bx_pc_system.numTimers; i++) {
-    if (bx_pc_system.timer[i].active) {
+    if (bx_pc_system.timer(i).active) {
       BX_INFO(("BxTimer(%s): period=" FMT_LL "u, continuous=%u",
-               bx_pc_system.timer[i].id, bx_pc_system.timer[i].period,
-               bx_pc_system.timer[i].continuous));
+               bx_pc_system.timer(i).id, bx_pc_system.timer(i).period,
+               bx_pc_system.timer(i).continuous));
     }
   }
 #endif
@@ -414,6 +493,42 @@ void bx_pc_system_c::benchmarkTimer(void* this_ptr)
   bx_user_quit = 1;
 }
 
+// Periodic saved states for the -checkpoint option. The timer fires in the
+// middle of an instruction, the state is saved at the next boundary.
+void bx_pc_system_c::checkpointTimer(void* this_ptr)
+{
+  bx_pc_system_c *class_ptr = (bx_pc_system_c *) this_ptr;
+  class_ptr->request_state_op(BX_STATE_OP_SAVE);
+}
+
+// Each periodic saved state goes to a new numbered folder below the
+// checkpoint path and only the first one holds all of the guest RAM, the
+// others refer to their predecessor.
+void bx_pc_system_c::save_checkpoint(void)
+{
+  static unsigned checkpoint_num = 0;
+  char sr_path[BX_PATHNAME_LEN];
+  int ret;
+
+  // never overwrite an existing saved state, it may be the base of a chain
+  do {
+    snprintf(sr_path, sizeof(sr_path), "%s/%06u",
+      SIM->get_param_string(BXPN_CHECKPOINT_PATH)->getptr(), checkpoint_num++);
+#ifndef WIN32
+    ret = mkdir(sr_path, 0755);
+  } while ((ret < 0) && (errno == EEXIST));
+#else
+    ret = (CreateDirectory(sr_path, NULL) != 0) ? 0 : -1;
+  } while ((ret < 0) && (GetLastError() == ERROR_ALREADY_EXISTS));
+#endif
+  if (ret < 0) {
+    BX_ERROR(("cannot create checkpoint folder '%s'", sr_path));
+    return;
+  }
+  if (!SIM->save_state_incremental(sr_path))
+    BX_ERROR(("cannot save checkpoint to '%s'", sr_path));
+}
+
 #if BX_DEBUGGER
 void bx_pc_system_c::timebp_handler(void* this_ptr)
 {
@@ -460,9 +575,9 @@ void bx_pc_system_c::activate_timer_ticks(unsigned i, Bit64u ticks, bx_bool cont
     BX_PANIC(("activate_timer_ticks: timer %u OOB", i));
   if (i == 0)
     BX_PANIC(("activate_timer_ticks: timer 0 is the NullTimer!"));
-  if (timer[i].period < MinAllowableTimerPeriod)
+  if (timer(i).period < MinAllowableTimerPeriod)
     BX_PANIC(("activate_timer_ticks: timer[%u].period of " FMT_LL "u < min of %u",
-              i, timer[i].period, MinAllowableTimerPeriod));
+              i, timer(i).period, MinAllowableTimerPeriod));
 #endif
 
   // If the timer frequency is rediculously low, make it more sane.
@@ -473,11 +588,19 @@ void bx_pc_system_c::activate_timer_ticks(unsigned i, Bit64u ticks, bx_bool cont
     ticks = MinAllowableTimerPeriod;
   }
 
-  timer[i].period = ticks;
-  timer[i].timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) +
+  timer(i).period = ticks;
+  timer(i).timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) +
                         ticks;
-  timer[i].active     = 1;
-  timer[i].continuous = continuous;
+  timer(i).continuous = continuous;
+  if (timer(i).active) {
+    // already queued, only the fire time moved
+    heapSiftUp(timer(i).heapIndex);
+    heapSiftDown(timer(i).heapIndex);
+  }
+  else {
+    timer(i).active = 1;
+    heapInsert(i);
+  }
 
   if (ticks < Bit64u(currCountdown)) {
     // This new timer needs to fire before the current countdown.
@@ -502,7 +625,7 @@ void bx_pc_system_c::activate_timer(unsigned i, Bit32u useconds, bx_bool continu
   // if useconds = 0, use default stored in period field
   // else set new period from useconds
   if (useconds==0) {
-    ticks = timer[i].period;
+    ticks = timer(i).period;
   }
   else {
     // convert useconds to number of ticks
@@ -516,7 +639,7 @@ void bx_pc_system_c::activate_timer(unsigned i, Bit32u useconds, bx_bool continu
       ticks = MinAllowableTimerPeriod;
     }
 
-    timer[i].period = ticks;
+    timer(i).period = ticks;
   }
 
   activate_timer_ticks(i, ticks, continuous);
@@ -531,7 +654,10 @@ void bx_pc_system_c::deactivate_timer(unsigned i)
     BX_PANIC(("deactivate_timer: timer 0 is the nullTimer!"));
 #endif
 
-  timer[i].active = 0;
+  if (timer(i).active) {
+    timer(i).active = 0;
+    heapRemove(i);
+  }
 }
 
 bx_bool bx_pc_system_c::unregisterTimer(unsigned timerIndex)
@@ -541,25 +667,115 @@ bx_bool bx_pc_system_c::unregisterTimer(unsigned timerIndex)
     BX_PANIC(("unregisterTimer: timer %u OOB", timerIndex));
   if (timerIndex == 0)
     BX_PANIC(("unregisterTimer: timer 0 is the nullTimer!"));
-  if (timer[timerIndex].inUse == 0)
+  if (timer(timerIndex).inUse == 0)
     BX_PANIC(("unregisterTimer: timer %u is not in-use!", timerIndex));
 #endif
 
-  if (timer[timerIndex].active) {
-    BX_PANIC(("unregisterTimer: timer '%s' is still active!", timer[timerIndex].id));
+  if (timer(timerIndex).active) {
+    BX_PANIC(("unregisterTimer: timer '%s' is still active!", timer(timerIndex).id));
     return(0); // Fail.
   }
 
   // Reset timer fields for good measure.
-  timer[timerIndex].inUse      = 0; // No longer registered.
-  timer[timerIndex].period     = BX_MAX_BIT64S; // Max value (invalid)
-  timer[timerIndex].timeToFire = BX_MAX_BIT64S; // Max value (invalid)
-  timer[timerIndex].continuous = 0;
-  timer[timerIndex].funct      = NULL;
-  timer[timerIndex].this_ptr   = NULL;
-  memset(timer[timerIndex].id, 0, BxMaxTimerIDLen);
+  timer(timerIndex).inUse      = 0; // No longer registered.
+  timer(timerIndex).period     = BX_MAX_BIT64S; // Max value (invalid)
+  timer(timerIndex).timeToFire = BX_MAX_BIT64S; // Max value (invalid)
+  timer(timerIndex).continuous = 0;
+  timer(timerIndex).funct      = NULL;
+  timer(timerIndex).this_ptr   = NULL;
+  memset(timer(timerIndex).id, 0, BxMaxTimerIDLen);
 
   if (timerIndex == (numTimers-1)) numTimers--;
 
   return(1); // OK
 }
+
+void bx_pc_system_c::allocTimerChunk(void)
+{
+  bx_pc_timer_t **chunks = new bx_pc_timer_t*[numTimerChunks+1];
+  unsigned *heap = new unsigned[(numTimerChunks+1) << BX_TIMER_CHUNK_SHIFT];
+  unsigned *triggered = new unsigned[(numTimerChunks+1) << BX_TIMER_CHUNK_SHIFT];
+
+  for (unsigned n=0; n < numTimerChunks; n++)
+    chunks[n] = timerChunk[n];
+  for (unsigned n=0; n < timerHeapSize; n++)
+    heap[n] = timerHeap[n];
+  // called from a timer handler, the list of the running countdown
+  // event is still in use
+  if (timerTriggered != NULL)
+    memcpy(triggered, timerTriggered, sizeof(unsigned) * (numTimerChunks << BX_TIMER_CHUNK_SHIFT));
+  chunks[numTimerChunks] = new bx_pc_timer_t[BX_TIMER_CHUNK_SIZE];
+  memset(chunks[numTimerChunks], 0, sizeof(bx_pc_timer_t) * BX_TIMER_CHUNK_SIZE);
+
+  delete [] timerChunk;
+  delete [] timerHeap;
+  delete [] timerTriggered;
+  timerChunk = chunks;
+  timerHeap = heap;
+  timerTriggered = triggered;
+  numTimerChunks++;
+}
+
+void bx_pc_system_c::heapSiftUp(unsigned pos)
+{
+  unsigned i = timerHeap[pos];
+  Bit64u timeToFire = timer(i).timeToFire;
+
+  while (pos > 0) {
+    unsigned parent = (pos - 1) >> 1;
+    if (timer(timerHeap[parent]).timeToFire <= timeToFire) break;
+    timerHeap[pos] = timerHeap[parent];
+    timer(timerHeap[pos]).heapIndex = pos;
+    pos = parent;
+  }
+  timerHeap[pos] = i;
+  timer(i).heapIndex = pos;
+}
+
+void bx_pc_system_c::heapSiftDown(unsigned pos)
+{
+  unsigned i = timerHeap[pos];
+  Bit64u timeToFire = timer(i).timeToFire;
+
+  for (;;) {
+    unsigned child = 2*pos + 1;
+    if (child >= timerHeapSize) break;
+    if (child+1 < timerHeapSize &&
+        timer(timerHeap[child+1]).timeToFire < timer(timerHeap[child]).timeToFire)
+      child++;
+    if (timeToFire <= timer(timerHeap[child]).timeToFire) break;
+    timerHeap[pos] = timerHeap[child];
+    timer(timerHeap[pos]).heapIndex = pos;
+    pos = child;
+  }
+  timerHeap[pos] = i;
+  timer(i).heapIndex = pos;
+}
+
+void bx_pc_system_c::heapInsert(unsigned i)
+{
+  timerHeap[timerHeapSize] = i;
+  heapSiftUp(timerHeapSize++);
+}
+
+void bx_pc_system_c::heapRemove(unsigned i)
+{
+  unsigned pos = timer(i).heapIndex;
+
+  BX_ASSERT(timerHeap[pos] == i);
+  if (pos != --timerHeapSize) {
+    unsigned last = timerHeap[timerHeapSize];
+    timerHeap[pos] = last;
+    heapSiftUp(pos);
+    heapSiftDown(timer(last).heapIndex);
+  }
+}
+
+void bx_pc_system_c::rebuildTimerHeap(void)
+{
+  timerHeapSize = 0;
+  for (unsigned i=0; i < numTimers; i++) {
+    if (timer(i).inUse && timer(i).active)
+      heapInsert(i);
+  }
+}
@@ -23,7 +23,10 @@
 #ifndef BX_PCSYS_H
 #define BX_PCSYS_H
 
-#define BX_MAX_TIMERS 64
+// Timer slots are allocated in chunks, so the slot addresses (which are
+// registered with the save/restore param tree) never move.
+#define BX_TIMER_CHUNK_SHIFT 6
+#define BX_TIMER_CHUNK_SIZE (1 << BX_TIMER_CHUNK_SHIFT)
 #define BX_NULL_TIMER_HANDLE 10000
 
 typedef void (*bx_timer_handler_t)(void *);
@@ -41,7 +44,7 @@ private:
   // Timer oriented private features
   // ===============================
 
-  struct {
+  typedef struct {
     bx_bool inUse;      // Timer slot is in-use (currently registered).
     Bit64u  period;     // Timer periodocity in cpu ticks.
     Bit64u  timeToFire; // Time to fire next (in absolute ticks).
@@ -53,7 +56,29 @@ private:
                                //   has to be stored as well.
 #define BxMaxTimerIDLen 32
     char id[BxMaxTimerIDLen]; // String ID of timer.
-  } timer[BX_MAX_TIMERS];
+    unsigned heapIndex;       // Position in timerHeap while active.
+  } bx_pc_timer_t;
+
+  bx_pc_timer_t **timerChunk; // Chunks of BX_TIMER_CHUNK_SIZE timer slots.
+  unsigned   numTimerChunks;  // Number of allocated chunks.
+
+  BX_CPP_INLINE bx_pc_timer_t& timer(unsigned i) {
+    return timerChunk[i >> BX_TIMER_CHUNK_SHIFT][i & (BX_TIMER_CHUNK_SIZE-1)];
+  }
+
+  // Binary min-heap of the active timers ordered by timeToFire, so the
+  // countdown event only has to look at the timers which actually fire.
+  unsigned  *timerHeap;
+  unsigned   timerHeapSize;
+  // The timers which fire in one countdown event, same size as the heap.
+  unsigned  *timerTriggered;
+
+  void   heapInsert(unsigned i);
+  void   heapRemove(unsigned i);
+  void   heapSiftUp(unsigned pos);
+  void   heapSiftDown(unsigned pos);
+  void   rebuildTimerHeap(void);
+  void   allocTimerChunk(void);
 
   unsigned   numTimers;  // Number of currently allocated timers.
   unsigned   triggeredTimer;  // ID of the actually triggered timer.
@@ -81,6 +106,9 @@ private:
   // ticks finds that an event has occurred.
   void   countdownEvent(void);
 
+  // saves the next periodic state for the -checkpoint option
+  void   save_checkpoint(void);
+
 public:
 
   // ==============================
@@ -132,6 +160,7 @@ public:
   static void timebp_handler(void* this_ptr);
 #endif
   static void benchmarkTimer(void* this_ptr);
+  static void checkpointTimer(void* this_ptr);
 
   // ===========================
   // Non-timer oriented features
@@ -156,6 +185,14 @@ public:
 
   volatile bx_bool kill_bochs_request;
 
+  // pending BX_STATE_OP_* operations (see siminterface.h)
+  volatile Bit32u state_ops_pending;
+  // rollbacks since the checkpoint was taken, not part of the machine state
+  Bit32u rollback_count;
+
+  void request_state_op(Bit32u op);
+  void handle_state_ops(void);
+
   void set_HRQ(bx_bool val);  // set the Hold ReQuest line
   void set_INTR(bx_bool value); // set the INTR line to value
 
@@ -173,6 +210,7 @@ public:
   void    invlpg(bx_address addr);    // flush TLB page in all CPUs
   void    exit(void);
   void    register_state(void);
+  void    after_restore_state(void);
 };
 
 #endif
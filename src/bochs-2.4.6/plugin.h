@@ -170,9 +170,17 @@ extern "C" {
     (bx_devices.pluginHardDrive->set_cd_media_status(handle, status))
 #define DEV_hd_present() (bx_devices.pluginHardDrive != &bx_devices.stubHardDrive)
 #define DEV_hd_bmdma_read_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_read_sector(a,b,c)
-#define DEV_hd_bmdma_write_sector(a,b) bx_devices.pluginHardDrive->bmdma_write_sector(a,b)
+#define DEV_hd_bmdma_write_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_write_sector(a,b,c)
+#define DEV_hd_bmdma_read_mapped(a,b) bx_devices.pluginHardDrive->bmdma_read_mapped(a,b)
 #define DEV_hd_bmdma_complete(a) bx_devices.pluginHardDrive->bmdma_complete(a)
+#define DEV_hd_checkpoint_disks() bx_devices.pluginHardDrive->checkpoint_disks()
+#define DEV_hd_rollback_disks() bx_devices.pluginHardDrive->rollback_disks()
 #define DEV_hdimage_init_image(a,b,c) bx_devices.pluginHDImageCtl->init_image(a,b,c)
+#define DEV_hdimage_init_cache(a,b,c) bx_devices.pluginHDImageCtl->init_cache(a,b,c)
+#define DEV_hdimage_init_async(a) bx_devices.pluginHDImageCtl->init_async(a)
+#define DEV_hdimage_init_overlay(a,b) bx_devices.pluginHDImageCtl->init_overlay(a,b)
+#define DEV_hdimage_rollback_overlay(a) bx_devices.pluginHDImageCtl->rollback_overlay(a)
+#define DEV_hdimage_release_overlay(a) bx_devices.pluginHDImageCtl->release_overlay(a)
 
 #define DEV_bulk_io_quantum_requested() (bx_devices.bulkIOQuantumsRequested)
 #define DEV_bulk_io_quantum_transferred() (bx_devices.bulkIOQuantumsTransferred)
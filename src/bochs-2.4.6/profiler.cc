@@ -0,0 +1,605 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// profiler.cc
+//
+// Guest sampling profiler.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "cpu/cpu.h"
+#include "param_names.h"
+#include "profiler.h"
+
+#define LOG_THIS bx_profiler.
+
+bx_profiler_c bx_profiler;
+
+#define BX_PROFILER_INITIAL_TABLE_SIZE 4096
+
+bx_profiler_c::bx_profiler_c()
+{
+  put("PROF");
+  timer_index = BX_NULL_TIMER_HANDLE;
+  max_depth = 0;
+  samples = 0;
+  table = NULL;
+  tableSize = tableUsed = 0;
+  stackPool = NULL;
+  stackPoolSize = stackPoolUsed = 0;
+  symbols = NULL;
+  numSymbols = 0;
+  symNames = NULL;
+  symFile = NULL;
+}
+
+bx_profiler_c::~bx_profiler_c()
+{
+  free(table);
+  free(stackPool);
+  free(symbols);
+  free(symNames);
+  free(symFile);
+}
+
+void bx_profiler_c::init(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PROFILER);
+  Bit32u interval = SIM->get_param_num("interval", base)->get();
+  if (interval == 0) return;
+
+  max_depth = SIM->get_param_num("stack", base)->get();
+  if (max_depth > BX_PROFILER_MAX_DEPTH) max_depth = BX_PROFILER_MAX_DEPTH;
+
+  const char *path = SIM->get_param_string("symbols", base)->getptr();
+  if (strlen(path) > 0) {
+    if (load_symbols(path))
+      BX_INFO(("loaded %u code symbols from '%s'", numSymbols, path));
+  }
+
+  tableSize = BX_PROFILER_INITIAL_TABLE_SIZE;
+  table = (bx_profile_stack_t*) calloc(tableSize, sizeof(bx_profile_stack_t));
+  stackPoolSize = BX_PROFILER_INITIAL_TABLE_SIZE;
+  stackPool = (Bit64u*) malloc(stackPoolSize * sizeof(Bit64u));
+  if (table == NULL || stackPool == NULL) {
+    BX_PANIC(("cannot allocate the profiler sample tables"));
+    return;
+  }
+
+  BX_INFO(("sampling the guest every %u ticks into '%s'", interval,
+    SIM->get_param_string("file", base)->getptr()));
+  timer_index = bx_pc_system.register_timer_ticks(this, timer_handler,
+    interval, 1, 1, "profiler");
+}
+
+void bx_profiler_c::timer_handler(void *this_ptr)
+{
+  bx_profiler_c *class_ptr = (bx_profiler_c *) this_ptr;
+
+  for (unsigned cpu=0; cpu<BX_SMP_PROCESSORS; cpu++) {
+#if BX_SUPPORT_SMP
+    if (BX_CPU(cpu) == NULL) continue;
+#endif
+    class_ptr->sample(BX_CPU(cpu));
+  }
+}
+
+// The timers fire between instructions, so RIP is the next instruction
+// of the CPU. The other CPUs of a threaded SMP simulation are sampled
+// while they run; their register values may be one instruction off.
+void bx_profiler_c::sample(BX_CPU_C *cpu)
+{
+  Bit64u pcs[BX_PROFILER_MAX_DEPTH + 1];
+
+  pcs[0] = cpu->get_laddr(BX_SEG_REG_CS, cpu->get_instruction_pointer());
+  unsigned depth = 1;
+  if (max_depth)
+    depth += unwind(cpu, pcs + 1, max_depth);
+
+  bx_bool user = (cpu->sregs[BX_SEG_REG_CS].selector.rpl == 3);
+  Bit64u cr3 = 0;
+  // the kernel is shared by all the address spaces, only user samples
+  // are kept apart by their page directory
+  if (user && cpu->cr0.get_PG())
+    cr3 = cpu->cr3;
+
+  record(cr3, user, pcs, depth);
+  samples++;
+}
+
+bx_bool bx_profiler_c::read_guest(BX_CPU_C *cpu, unsigned seg, bx_address offset, unsigned len, Bit64u *data)
+{
+  bx_address laddr = cpu->get_laddr(seg, offset);
+  bx_phy_address phy;
+
+  // the frames are naturally aligned, a word crossing pages ends the walk
+  if ((laddr & 0xfff) + len > 0x1000) return 0;
+  if (! cpu->dbg_xlate_linear2phy(laddr, &phy)) return 0;
+
+  Bit8u *hostAddr = BX_MEM(0)->getHostMemAddr(cpu, phy, BX_READ);
+  if (hostAddr == NULL) return 0;
+
+  if (len == 8) {
+    ReadHostQWordFromLittleEndian(hostAddr, *data);
+  }
+  else {
+    Bit32u data32;
+    ReadHostDWordFromLittleEndian(hostAddr, data32);
+    *data = data32;
+  }
+  return 1;
+}
+
+// Walk the saved frame pointers: [fp] holds the caller's frame pointer
+// and [fp + word] the return address. Code built without frame pointers
+// gives short or wrong stacks, as with any frame pointer unwinder.
+unsigned bx_profiler_c::unwind(BX_CPU_C *cpu, Bit64u *pcs, unsigned max)
+{
+  unsigned word, n = 0;
+  Bit64u fp;
+
+  switch(cpu->get_cpu_mode()) {
+#if BX_SUPPORT_X86_64
+    case BX_MODE_LONG_64:
+      word = 8;
+      fp = cpu->get_reg64(BX_64BIT_REG_RBP);
+      break;
+#endif
+    case BX_MODE_IA32_PROTECTED:
+#if BX_SUPPORT_X86_64
+    case BX_MODE_LONG_COMPAT:
+#endif
+      if (! cpu->sregs[BX_SEG_REG_SS].cache.u.segment.d_b) return 0;
+      word = 4;
+      fp = cpu->get_reg32(BX_32BIT_REG_EBP);
+      break;
+    default:
+      return 0; // real and v8086 mode
+  }
+
+  while (n < max && fp != 0 && (fp & (word - 1)) == 0) {
+    Bit64u next, ret;
+    if (! read_guest(cpu, BX_SEG_REG_SS, (bx_address) fp, word, &next)) break;
+    if (! read_guest(cpu, BX_SEG_REG_SS, (bx_address) (fp + word), word, &ret)) break;
+    if (ret == 0) break;
+    pcs[n++] = cpu->get_laddr(BX_SEG_REG_CS, (bx_address) ret);
+    // the stack grows down, the caller frames are above
+    if (next <= fp) break;
+    fp = next;
+  }
+
+  return n;
+}
+
+static Bit64u profiler_hash(Bit64u cr3, bx_bool user, const Bit64u *pcs, unsigned depth)
+{
+  // FNV-1a over the 64-bit words
+  Bit64u hash = BX_CONST64(0xcbf29ce484222325);
+  hash = (hash ^ cr3) * BX_CONST64(0x100000001b3);
+  hash = (hash ^ user) * BX_CONST64(0x100000001b3);
+  for (unsigned n=0; n<depth; n++)
+    hash = (hash ^ pcs[n]) * BX_CONST64(0x100000001b3);
+  return hash | 1; // zero marks a free slot
+}
+
+void bx_profiler_c::record(Bit64u cr3, bx_bool user, const Bit64u *pcs, unsigned depth)
+{
+  Bit64u hash = profiler_hash(cr3, user, pcs, depth);
+  Bit32u mask = tableSize - 1;
+
+  for (Bit32u i = (Bit32u) hash & mask;; i = (i + 1) & mask) {
+    bx_profile_stack_t *entry = &table[i];
+    if (entry->hash == 0) {
+      if (stackPoolUsed + depth > stackPoolSize) {
+        Bit64u *pool = (Bit64u*) realloc(stackPool, stackPoolSize * 2 * sizeof(Bit64u));
+        if (pool == NULL) {
+          BX_ERROR(("out of memory for profiler stacks, sample dropped"));
+          return;
+        }
+        stackPool = pool;
+        stackPoolSize *= 2;
+      }
+      entry->hash = hash;
+      entry->cr3 = cr3;
+      entry->count = 1;
+      entry->pcs = stackPoolUsed;
+      entry->depth = depth;
+      entry->user = user;
+      memcpy(&stackPool[stackPoolUsed], pcs, depth * sizeof(Bit64u));
+      stackPoolUsed += depth;
+      if (++tableUsed * 2 > tableSize)
+        grow_table();
+      return;
+    }
+    if (entry->hash == hash && entry->cr3 == cr3 && entry->user == user &&
+        entry->depth == depth &&
+        !memcmp(&stackPool[entry->pcs], pcs, depth * sizeof(Bit64u)))
+    {
+      entry->count++;
+      return;
+    }
+  }
+}
+
+void bx_profiler_c::grow_table(void)
+{
+  Bit32u newSize = tableSize * 2, mask = newSize - 1;
+  bx_profile_stack_t *newTable = (bx_profile_stack_t*) calloc(newSize, sizeof(bx_profile_stack_t));
+  if (newTable == NULL) {
+    BX_PANIC(("cannot grow the profiler sample table"));
+    return;
+  }
+
+  for (Bit32u n=0; n<tableSize; n++) {
+    if (table[n].hash == 0) continue;
+    Bit32u i = (Bit32u) table[n].hash & mask;
+    while (newTable[i].hash != 0) i = (i + 1) & mask;
+    newTable[i] = table[n];
+  }
+
+  free(table);
+  table = newTable;
+  tableSize = newSize;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// ELF symbol table
+
+static Bit64u elf_read(const Bit8u *p, unsigned len)
+{
+  Bit64u val = 0;
+  while (len--) val = (val << 8) | p[len];
+  return val;
+}
+
+static int profiler_symbol_compare(const void *a, const void *b)
+{
+  Bit64u addr_a = *(const Bit64u*) a, addr_b = *(const Bit64u*) b;
+  return (addr_a < addr_b) ? -1 : (addr_a > addr_b);
+}
+
+// Load the code symbols (functions and untyped labels in executable
+// sections) of a little endian ELF32 or ELF64 file. Symbols without a
+// size extend to the next symbol or to the end of their section.
+bx_bool bx_profiler_c::load_symbols(const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    BX_ERROR(("cannot open symbol file '%s'", path));
+    return 0;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  Bit8u *image = (size > 0) ? (Bit8u*) malloc(size) : NULL;
+  if (image == NULL || fread(image, 1, size, fp) != (size_t) size) {
+    BX_ERROR(("cannot read symbol file '%s'", path));
+    free(image);
+    fclose(fp);
+    return 0;
+  }
+  fclose(fp);
+
+  if (size < 64 || memcmp(image, "\177ELF", 4) || image[5] != 1 ||
+      (image[4] != 1 && image[4] != 2))
+  {
+    BX_ERROR(("'%s' is not a little endian ELF file", path));
+    free(image);
+    return 0;
+  }
+
+  bx_bool elf64 = (image[4] == 2);
+  Bit64u shoff = elf64 ? elf_read(image + 0x28, 8) : elf_read(image + 0x20, 4);
+  unsigned shentsize = elf_read(image + (elf64 ? 0x3a : 0x2e), 2);
+  unsigned shnum = elf_read(image + (elf64 ? 0x3c : 0x30), 2);
+  if (shoff == 0 || shoff + (Bit64u) shnum * shentsize > (Bit64u) size) {
+    BX_ERROR(("'%s' has no section headers", path));
+    free(image);
+    return 0;
+  }
+
+#define SH_FIELD(n, off32, off64, len32, len64) \
+  elf_read(image + shoff + (Bit64u)(n) * shentsize + (elf64 ? (off64) : (off32)), elf64 ? (len64) : (len32))
+#define SH_TYPE(n)   elf_read(image + shoff + (Bit64u)(n) * shentsize + 4, 4)
+#define SH_FLAGS(n)  SH_FIELD(n,  8,  8, 4, 8)
+#define SH_ADDR(n)   SH_FIELD(n, 12, 16, 4, 8)
+#define SH_OFFSET(n) SH_FIELD(n, 16, 24, 4, 8)
+#define SH_SIZE(n)   SH_FIELD(n, 20, 32, 4, 8)
+#define SH_LINK(n)   SH_FIELD(n, 24, 40, 4, 4)
+
+  unsigned symtab = shnum;
+  for (unsigned n=0; n<shnum; n++) {
+    Bit32u type = (Bit32u) SH_TYPE(n);
+    if (type == 2) { symtab = n; break; }      // SHT_SYMTAB
+    if (type == 11) symtab = n;                 // SHT_DYNSYM
+  }
+  if (symtab == shnum || SH_LINK(symtab) >= shnum) {
+    BX_ERROR(("'%s' has no symbol table", path));
+    free(image);
+    return 0;
+  }
+
+  Bit64u symoff = SH_OFFSET(symtab), symsize = SH_SIZE(symtab);
+  unsigned strtab = (unsigned) SH_LINK(symtab);
+  Bit64u stroff = SH_OFFSET(strtab), strsize = SH_SIZE(strtab);
+  unsigned entsize = elf64 ? 24 : 16;
+  if (symoff + symsize > (Bit64u) size || stroff + strsize > (Bit64u) size) {
+    BX_ERROR(("'%s' has a truncated symbol table", path));
+    free(image);
+    return 0;
+  }
+
+  unsigned maxSymbols = (unsigned)(symsize / entsize);
+  symbols = (bx_profile_symbol_t*) malloc((maxSymbols + 1) * sizeof(bx_profile_symbol_t));
+  symNames = (char*) malloc(strsize + 1);
+  if (symbols == NULL || symNames == NULL) {
+    BX_PANIC(("cannot allocate the profiler symbol table"));
+    free(image);
+    return 0;
+  }
+  memcpy(symNames, image + stroff, strsize);
+  symNames[strsize] = 0;
+
+  numSymbols = 0;
+  for (unsigned n=0; n<maxSymbols; n++) {
+    const Bit8u *sym = image + symoff + (Bit64u) n * entsize;
+    Bit32u name = (Bit32u) elf_read(sym, 4);
+    unsigned info = elf64 ? sym[4] : sym[12];
+    unsigned shndx = (unsigned) elf_read(sym + (elf64 ? 6 : 14), 2);
+    Bit64u value = elf64 ? elf_read(sym + 8, 8) : elf_read(sym + 4, 4);
+    Bit64u symSize = elf64 ? elf_read(sym + 16, 8) : elf_read(sym + 8, 4);
+
+    unsigned type = info & 0xf;
+    if (type != 0 && type != 2) continue;                // NOTYPE, FUNC
+    if (shndx == 0 || shndx >= shnum) continue;          // undefined, ABS, COMMON
+    if (!(SH_FLAGS(shndx) & 0x4)) continue;              // SHF_EXECINSTR
+    if (name == 0 || name >= strsize || symNames[name] == 0) continue;
+    if (symNames[name] == '.' || symNames[name] == '$') continue; // local labels
+
+    bx_profile_symbol_t *s = &symbols[numSymbols++];
+    s->addr = value;
+    s->end = symSize ? value + symSize : SH_ADDR(shndx) + SH_SIZE(shndx);
+    s->name = name;
+  }
+
+#undef SH_FIELD
+#undef SH_TYPE
+#undef SH_FLAGS
+#undef SH_ADDR
+#undef SH_OFFSET
+#undef SH_SIZE
+#undef SH_LINK
+
+  free(image);
+
+  qsort(symbols, numSymbols, sizeof(bx_profile_symbol_t), profiler_symbol_compare);
+  for (unsigned n=0; n+1<numSymbols; n++) {
+    // a sizeless label ends where the next symbol starts
+    if (symbols[n].end > symbols[n+1].addr && symbols[n+1].addr > symbols[n].addr)
+      symbols[n].end = symbols[n+1].addr;
+  }
+
+  const char *file = strrchr(path, '/');
+  symFile = strdup(file ? file + 1 : path);
+  return 1;
+}
+
+const bx_profiler_c::bx_profile_symbol_t *bx_profiler_c::find_symbol(Bit64u addr) const
+{
+  unsigned lo = 0, hi = numSymbols;
+
+  // last symbol starting at or below addr
+  while (lo < hi) {
+    unsigned mid = (lo + hi) / 2;
+    if (symbols[mid].addr <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0) return NULL;
+
+  const bx_profile_symbol_t *s = &symbols[lo - 1];
+  return (addr < s->end) ? s : NULL;
+}
+
+const char *bx_profiler_c::symbol_name(Bit64u addr, char *buf, unsigned len, bx_bool with_offset) const
+{
+  const bx_profile_symbol_t *s = find_symbol(addr);
+
+  if (s == NULL)
+    snprintf(buf, len, "0x" FMT_LL "x", addr);
+  else if (with_offset)
+    snprintf(buf, len, "%s+0x" FMT_LL "x", symNames + s->name, addr - s->addr);
+  else
+    return symNames + s->name;
+
+  return buf;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Reports
+
+// histogram bucket of the flat report: one function (or one address
+// without symbol) in one address space
+typedef struct {
+  Bit64u key;
+  Bit64u cr3;
+  Bit64u count;
+  bx_bool user;
+} bx_profile_bucket_t;
+
+static int profiler_bucket_key_compare(const void *a, const void *b)
+{
+  const bx_profile_bucket_t *x = (const bx_profile_bucket_t*) a;
+  const bx_profile_bucket_t *y = (const bx_profile_bucket_t*) b;
+  if (x->user != y->user) return x->user - y->user;
+  if (x->cr3 != y->cr3) return (x->cr3 < y->cr3) ? -1 : 1;
+  if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+  return 0;
+}
+
+static int profiler_bucket_count_compare(const void *a, const void *b)
+{
+  const bx_profile_bucket_t *x = (const bx_profile_bucket_t*) a;
+  const bx_profile_bucket_t *y = (const bx_profile_bucket_t*) b;
+  if (x->count != y->count) return (x->count > y->count) ? -1 : 1;
+  return profiler_bucket_key_compare(a, b);
+}
+
+void bx_profiler_c::write_flat(FILE *fp)
+{
+  bx_profile_bucket_t *buckets = (bx_profile_bucket_t*) malloc((tableUsed + 1) * sizeof(bx_profile_bucket_t));
+  unsigned n, num = 0;
+  char buf[64];
+
+  if (buckets == NULL) return;
+
+  // only the sampled instruction counts here, not its callers
+  for (Bit32u i=0; i<tableSize; i++) {
+    if (table[i].hash == 0) continue;
+    Bit64u addr = stackPool[table[i].pcs];
+    const bx_profile_symbol_t *s = find_symbol(addr);
+    buckets[num].key = s ? s->addr : addr;
+    buckets[num].cr3 = table[i].cr3;
+    buckets[num].count = table[i].count;
+    buckets[num].user = table[i].user;
+    num++;
+  }
+
+  qsort(buckets, num, sizeof(bx_profile_bucket_t), profiler_bucket_key_compare);
+  unsigned merged = 0;
+  for (n=0; n<num; n++) {
+    if (merged > 0 && !profiler_bucket_key_compare(&buckets[merged-1], &buckets[n]))
+      buckets[merged-1].count += buckets[n].count;
+    else
+      buckets[merged++] = buckets[n];
+  }
+  qsort(buckets, merged, sizeof(bx_profile_bucket_t), profiler_bucket_count_compare);
+
+  fprintf(fp, "# " FMT_LL "u samples\n", samples);
+  fprintf(fp, "# %%samples   samples  space             symbol\n");
+  for (n=0; n<merged; n++) {
+    char space[32];
+    if (buckets[n].user)
+      snprintf(space, sizeof(space), "cr3=0x" FMT_LL "x", buckets[n].cr3);
+    else
+      strcpy(space, "kernel");
+    char count[24];
+    sprintf(count, FMT_LL "u", buckets[n].count);
+    fprintf(fp, "%8.2f%% %9s  %-16s  %s\n",
+      buckets[n].count * 100.0 / samples, count, space,
+      symbol_name(buckets[n].key, buf, sizeof(buf), 0));
+  }
+
+  free(buckets);
+}
+
+typedef struct {
+  char *stack;
+  Bit64u count;
+} bx_profile_folded_t;
+
+static int profiler_folded_compare(const void *a, const void *b)
+{
+  return strcmp(((const bx_profile_folded_t*) a)->stack, ((const bx_profile_folded_t*) b)->stack);
+}
+
+void bx_profiler_c::write_folded(FILE *fp)
+{
+  bx_profile_folded_t *lines = (bx_profile_folded_t*) malloc((tableUsed + 1) * sizeof(bx_profile_folded_t));
+  unsigned n, num = 0;
+  char buf[64];
+
+  if (lines == NULL) return;
+
+  for (Bit32u i=0; i<tableSize; i++) {
+    bx_profile_stack_t *entry = &table[i];
+    if (entry->hash == 0) continue;
+
+    unsigned len = 32;
+    for (n=0; n<entry->depth; n++)
+      len += strlen(symbol_name(stackPool[entry->pcs + n], buf, sizeof(buf), 0)) + 1;
+    char *stack = (char*) malloc(len);
+    if (stack == NULL) break;
+
+    if (entry->user)
+      sprintf(stack, "user-cr3-" FMT_LL "x", entry->cr3);
+    else
+      strcpy(stack, "kernel");
+    // outermost caller first
+    for (n=entry->depth; n>0; n--) {
+      strcat(stack, ";");
+      strcat(stack, symbol_name(stackPool[entry->pcs + n - 1], buf, sizeof(buf), 0));
+    }
+    lines[num].stack = stack;
+    lines[num].count = entry->count;
+    num++;
+  }
+
+  // stacks which differ only in the call sites fold into the same line
+  qsort(lines, num, sizeof(bx_profile_folded_t), profiler_folded_compare);
+  for (n=0; n<num; n++) {
+    if (n+1 < num && !strcmp(lines[n].stack, lines[n+1].stack)) {
+      lines[n+1].count += lines[n].count;
+    }
+    else {
+      fprintf(fp, "%s " FMT_LL "u\n", lines[n].stack, lines[n].count);
+    }
+    free(lines[n].stack);
+  }
+
+  free(lines);
+}
+
+void bx_profiler_c::write_perf(FILE *fp)
+{
+  // 'perf script' layout, with the sample count in the period field so
+  // that stackcollapse-perf.pl and similar tools weight the stacks
+  const char *dso = symFile ? symFile : "[unknown]";
+  char buf[64];
+
+  for (Bit32u i=0; i<tableSize; i++) {
+    bx_profile_stack_t *entry = &table[i];
+    if (entry->hash == 0) continue;
+
+    unsigned pid = (unsigned)(entry->cr3 >> 12);
+    fprintf(fp, "%s %u/%u [000] 0.000000: " FMT_LL "u cpu-clock:\n",
+      entry->user ? "user" : "kernel", pid, pid, entry->count);
+    for (unsigned n=0; n<entry->depth; n++) {
+      Bit64u addr = stackPool[entry->pcs + n];
+      fprintf(fp, "\t%08x%08x %s (%s)\n", GET32H(addr), GET32L(addr),
+        find_symbol(addr) ? symbol_name(addr, buf, sizeof(buf), 1) : "[unknown]",
+        find_symbol(addr) ? dso : "[unknown]");
+    }
+    fprintf(fp, "\n");
+  }
+}
+
+void bx_profiler_c::exit(void)
+{
+  if (timer_index == BX_NULL_TIMER_HANDLE) return;
+  timer_index = BX_NULL_TIMER_HANDLE;
+
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PROFILER);
+  const char *path = SIM->get_param_string("file", base)->getptr();
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    BX_ERROR(("cannot write profile to '%s'", path));
+    return;
+  }
+
+  switch(SIM->get_param_enum("format", base)->get()) {
+    case BX_PROFILER_FORMAT_FOLDED:
+      write_folded(fp);
+      break;
+    case BX_PROFILER_FORMAT_PERF:
+      write_perf(fp);
+      break;
+    default:
+      write_flat(fp);
+  }
+
+  fclose(fp);
+  BX_INFO(("" FMT_LL "u samples (%u unique stacks) written to '%s'",
+    samples, tableUsed, path));
+}
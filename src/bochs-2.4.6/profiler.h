@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+// profiler.h
+//
+// Guest sampling profiler.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_PROFILER_H
+#define BX_PROFILER_H
+
+// Guest sampling profiler (bochsrc "profiler:" option). A timer samples
+// the instruction pointer of every CPU each 'interval' emulated ticks,
+// optionally followed by the return addresses found by walking the guest
+// frame pointer chain. The samples are aggregated by call stack, address
+// space (CR3) and privilege level, and written at exit as a flat symbol
+// histogram, flamegraph folded stacks or 'perf script' text. Symbols are
+// resolved from an optional ELF file (e.g. the guest kernel image).
+
+#define BX_PROFILER_MAX_DEPTH 64
+
+enum {
+  BX_PROFILER_FORMAT_FLAT = 0,
+  BX_PROFILER_FORMAT_FOLDED,
+  BX_PROFILER_FORMAT_PERF
+};
+
+BOCHSAPI extern class bx_profiler_c bx_profiler;
+
+class BOCHSAPI bx_profiler_c : private logfunctions {
+public:
+  bx_profiler_c();
+ ~bx_profiler_c();
+
+  void init(void);
+  void exit(void);
+
+private:
+  // one unique (CPU mode, address space, call stack) with its sample count
+  typedef struct {
+    Bit64u   hash;
+    Bit64u   cr3;
+    Bit64u   count;
+    Bit32u   pcs;       // index of the first address in stackPool
+    Bit8u    depth;     // number of addresses, innermost first
+    Bit8u    user;      // sampled at CPL 3
+  } bx_profile_stack_t;
+
+  typedef struct {
+    Bit64u   addr;
+    Bit64u   end;
+    Bit32u   name;      // offset in symNames
+  } bx_profile_symbol_t;
+
+  static void timer_handler(void *this_ptr);
+  void sample(BX_CPU_C *cpu);
+  unsigned unwind(BX_CPU_C *cpu, Bit64u *pcs, unsigned max_depth);
+  bx_bool read_guest(BX_CPU_C *cpu, unsigned seg, bx_address offset, unsigned len, Bit64u *data);
+  void record(Bit64u cr3, bx_bool user, const Bit64u *pcs, unsigned depth);
+  void grow_table(void);
+
+  bx_bool load_symbols(const char *path);
+  const bx_profile_symbol_t *find_symbol(Bit64u addr) const;
+  const char *symbol_name(Bit64u addr, char *buf, unsigned len, bx_bool with_offset) const;
+  void write_flat(FILE *fp);
+  void write_folded(FILE *fp);
+  void write_perf(FILE *fp);
+
+  int timer_index;
+  unsigned max_depth;
+  Bit64u samples;
+
+  bx_profile_stack_t *table;  // open addressing hash of the unique stacks
+  Bit32u tableSize;           // power of two
+  Bit32u tableUsed;
+
+  Bit64u *stackPool;          // addresses of all the recorded stacks
+  Bit32u stackPoolSize;
+  Bit32u stackPoolUsed;
+
+  bx_profile_symbol_t *symbols; // sorted by address
+  unsigned numSymbols;
+  char *symNames;
+  char *symFile;
+};
+
+#endif